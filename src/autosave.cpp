@@ -0,0 +1,259 @@
+#include <algorithm>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "autosave.h"
+#include "exceptions.h"
+
+void storage::writeFileAtomically(const std::filesystem::path& path, std::string_view data)
+{
+	std::filesystem::path temporary = path;
+	temporary += ".tmp";
+
+	// A failed write removes the temporary file again, so failures do not leave clutter next to the target
+	std::error_code error;
+	int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		throw OpenError("Unable to open <", temporary.string(), "> for writing.");
+
+	while (!data.empty())
+	{
+		const ssize_t written = ::write(fd, data.data(), data.size());
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			::close(fd);
+			std::filesystem::remove(temporary, error);
+			throw FileError("Unable to write <", temporary.string(), ">.");
+		}
+		data.remove_prefix(written);
+	}
+
+	// The descriptor is closed even if syncing failed
+	const bool synced = ::fdatasync(fd) == 0;
+	const bool closed = ::close(fd) == 0;
+	if (!synced || !closed)
+	{
+		std::filesystem::remove(temporary, error);
+		throw FileError("Unable to sync <", temporary.string(), "> to disk.");
+	}
+
+	std::filesystem::rename(temporary, path, error);
+	if (error)
+	{
+		const std::string message = error.message();
+		std::filesystem::remove(temporary, error);
+		throw FileError("Unable to replace <", path.string(), ">: ", message);
+	}
+
+	// The rename itself only survives a crash once the directory entry is on disk
+	const std::filesystem::path folder = path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+	fd = ::open(folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		throw OpenError("Unable to open <", folder.string(), "> for syncing.");
+	const bool folderSynced = ::fsync(fd) == 0;
+	::close(fd);
+	if (!folderSynced)
+		throw FileError("Unable to sync <", folder.string(), "> to disk.");
+}
+
+storage::AutosaveScheduler::AutosaveScheduler(std::chrono::milliseconds _debounce,
+		std::chrono::milliseconds _maxLatency, std::chrono::milliseconds _slowWrite) :
+		debounce(_debounce), maxLatency(_maxLatency), slowWrite(_slowWrite), writing(false)
+{
+	worker = std::jthread([this] (std::stop_token token) { run(token); });
+}
+
+storage::AutosaveScheduler::~AutosaveScheduler()
+{
+	flush();
+}
+
+void storage::AutosaveScheduler::addSource(const void* owner, Source source)
+{
+	const std::uint64_t generation = source.generation();
+	sources.insert_or_assign(owner, Entry{ std::move(source), generation, generation, {}, {} });
+}
+
+void storage::AutosaveScheduler::removeSource(const void* owner)
+{
+	auto it = sources.find(owner);
+	if (it == sources.end())
+		return;
+
+	if (it->second.source.generation() != it->second.queuedGeneration)
+		enqueue(owner, it->second);
+
+	sources.erase(it);
+}
+
+void storage::AutosaveScheduler::save(const void* owner)
+{
+	auto it = sources.find(owner);
+	if (it != sources.end())
+		enqueue(owner, it->second);
+}
+
+void storage::AutosaveScheduler::update()
+{
+	collectResults();
+
+	const Clock::time_point now = Clock::now();
+	float backoff;
+	{
+		std::scoped_lock lockGuard(mutex);
+		backoff = metrics.backoff;
+	}
+
+	for (auto& [owner, entry] : sources)
+	{
+		const std::uint64_t generation = entry.source.generation();
+
+		// Track new edits
+		if (generation != entry.seenGeneration)
+		{
+			if (entry.seenGeneration == entry.queuedGeneration)
+				entry.firstEdit = now;
+			entry.lastEdit = now;
+
+			std::scoped_lock lockGuard(mutex);
+			metrics.edits += generation - entry.seenGeneration;
+			entry.seenGeneration = generation;
+		}
+
+		if (generation == entry.queuedGeneration)
+			continue;
+
+		// Write once the edits settled down or the source was dirty for too long
+		if (now - entry.lastEdit >= debounce * backoff || now - entry.firstEdit >= maxLatency * backoff)
+			enqueue(owner, entry);
+	}
+}
+
+void storage::AutosaveScheduler::flush()
+{
+	for (auto& [owner, entry] : sources)
+		if (entry.source.generation() != entry.queuedGeneration)
+			enqueue(owner, entry);
+
+	{
+		std::unique_lock lock(mutex);
+		condition.wait(lock, [this] { return queue.empty() && !writing; });
+	}
+
+	collectResults();
+}
+
+storage::AutosaveScheduler::Metrics storage::AutosaveScheduler::getMetrics() const
+{
+	std::scoped_lock lockGuard(mutex);
+
+	// The writes age out of the last minute while nothing is written
+	Metrics current = metrics;
+	const Clock::time_point now = Clock::now();
+	current.writesLastMinute = std::count_if(recentWrites.begin(), recentWrites.end(),
+			[now] (const Clock::time_point& write) { return now - write <= std::chrono::minutes(1); });
+	return current;
+}
+
+void storage::AutosaveScheduler::enqueue(const void* owner, Entry& entry)
+{
+	Job job{ owner, entry.source.path, entry.source.snapshot(), entry.source.generation(), entry.source.prepare };
+	entry.seenGeneration = job.generation;
+	entry.queuedGeneration = job.generation;
+
+	{
+		std::scoped_lock lockGuard(mutex);
+
+		// A newer snapshot of the same source supersedes a queued one
+		std::erase_if(queue, [owner] (const Job& queued) { return queued.owner == owner; });
+		queue.push_back(std::move(job));
+	}
+	condition.notify_all();
+}
+
+void storage::AutosaveScheduler::collectResults()
+{
+	std::deque<Result> finished;
+	{
+		std::scoped_lock lockGuard(mutex);
+		finished.swap(results);
+	}
+
+	for (const Result& result : finished)
+	{
+		auto it = sources.find(result.owner);
+		if (it == sources.end())
+			continue;
+
+		if (result.success)
+		{
+			if (it->second.source.saved)
+				it->second.source.saved(result.generation);
+		}
+		else if (it->second.queuedGeneration == result.generation)
+		{
+			// Retry a failed write with the next update
+			it->second.queuedGeneration = result.generation - 1;
+			it->second.firstEdit = it->second.lastEdit = Clock::now();
+		}
+	}
+}
+
+void storage::AutosaveScheduler::run(std::stop_token token)
+{
+	std::unique_lock lock(mutex);
+
+	while (condition.wait(lock, token, [this] { return !queue.empty(); }))
+	{
+		Job job = std::move(queue.front());
+		queue.pop_front();
+		writing = true;
+		lock.unlock();
+
+		const Clock::time_point start = Clock::now();
+		bool success = true;
+		try
+		{
+			if (job.prepare)
+				job.prepare();
+			writeFileAtomically(job.path, job.data);
+		}
+		catch (const std::exception&)
+		{
+			success = false;
+		}
+		const Clock::time_point end = Clock::now();
+
+		lock.lock();
+		writing = false;
+		results.push_back({ job.owner, job.generation, job.data.size(), end - start, success });
+
+		// Update the statistics
+		metrics.lastWriteTime = end - start;
+		if (success)
+		{
+			++metrics.writes;
+			metrics.bytesWritten += job.data.size();
+		}
+		else
+			++metrics.failedWrites;
+
+		recentWrites.push_back(end);
+		while (!recentWrites.empty() && end - recentWrites.front() > std::chrono::minutes(1))
+			recentWrites.pop_front();
+		metrics.writesLastMinute = recentWrites.size();
+
+		// Back off while the disk is slow or failing, recover once it is fast again
+		if (!success || end - start > slowWrite)
+			metrics.backoff = std::min(metrics.backoff * 2.0f, 16.0f);
+		else
+			metrics.backoff = std::max(metrics.backoff * 0.5f, 1.0f);
+
+		condition.notify_all();
+	}
+}
@@ -0,0 +1,241 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+
+
+namespace storage
+{
+	/**
+	 * @brief Write a file by replacing it with a completely written temporary file
+	 *
+	 * The data is written into a temporary file next to the target which is
+	 * synced to disk and renamed over the target afterwards, then the folder
+	 * is synced so the rename survives a crash. Readers therefore only ever
+	 * see the old or the new content. Failures throw a FileError and remove
+	 * the temporary file again.
+	 *
+	 * @param path The file to write
+	 * @param data The new content of the file
+	 */
+	void writeFileAtomically(const std::filesystem::path& path, std::string_view data);
+
+	/**
+	 * @brief Coalescing background saver for the library and open documents.
+	 *
+	 * Every registered source reports an edit generation which is polled once
+	 * per frame by update(). A changed generation marks the source dirty. The
+	 * source is written once no further edit arrived for the debounce time or
+	 * once it was dirty for the maximum latency, whichever comes first.
+	 *
+	 * Snapshots are taken on the calling (UI) thread, the actual file writes
+	 * happen on a worker thread. Slow writes increase a backoff factor which
+	 * stretches both time limits until writes become fast again.
+	 */
+	class AutosaveScheduler
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		/**
+		 * @brief Description of something that can be saved
+		 */
+		struct Source
+		{
+			/// @brief The file the source is written to
+			std::filesystem::path path;
+			/// @brief Returns the current edit generation of the source
+			std::function<std::uint64_t()> generation;
+			/// @brief Serializes the current state of the source
+			std::function<std::string()> snapshot;
+			/// @brief Called with the generation of a snapshot after it was written
+			std::function<void(std::uint64_t)> saved;
+			/// @brief Optionally called on the writer thread right before a snapshot is written
+			std::function<void()> prepare;
+		};
+
+		/**
+		 * @brief Statistics about the work done by the scheduler
+		 */
+		struct Metrics
+		{
+			/// @brief The number of edits noticed on all sources
+			std::uint64_t edits = 0;
+			/// @brief The number of successful writes
+			std::uint64_t writes = 0;
+			/// @brief The number of writes which failed
+			std::uint64_t failedWrites = 0;
+			/// @brief The number of bytes written successfully
+			std::uint64_t bytesWritten = 0;
+			/// @brief The number of writes finished during the last minute
+			std::size_t writesLastMinute = 0;
+			/// @brief The time the last write took
+			std::chrono::duration<double> lastWriteTime{};
+			/// @brief The current factor applied to debounce and latency
+			float backoff = 1.0f;
+		};
+
+	public:
+		/**
+		 * @brief Construct a new autosave scheduler and start its writer thread
+		 *
+		 * @param debounce The quiet time after an edit before a source is written
+		 * @param maxLatency The longest time a source stays dirty while being edited
+		 * @param slowWrite Writes taking longer than this increase the backoff
+		 */
+		AutosaveScheduler(std::chrono::milliseconds debounce = std::chrono::seconds(2),
+				std::chrono::milliseconds maxLatency = std::chrono::seconds(30),
+				std::chrono::milliseconds slowWrite = std::chrono::milliseconds(250));
+		AutosaveScheduler(AutosaveScheduler&&) = delete;
+		AutosaveScheduler(const AutosaveScheduler&) = delete;
+		/**
+		 * @brief Write all dirty sources and stop the writer thread
+		 */
+		~AutosaveScheduler();
+
+		AutosaveScheduler& operator=(AutosaveScheduler&&) = delete;
+		AutosaveScheduler& operator=(const AutosaveScheduler&) = delete;
+
+		/**
+		 * @brief Register a new source
+		 *
+		 * The source is considered clean at its current generation.
+		 *
+		 * @param owner The object the source belongs to, used as its key
+		 * @param source The description of the source
+		 */
+		void addSource(const void* owner, Source source);
+		/**
+		 * @brief Unregister a source, saving it one last time if dirty
+		 *
+		 * @param owner The object the source belongs to
+		 */
+		void removeSource(const void* owner);
+		/**
+		 * @brief Queue a source for writing immediately, ignoring all timers
+		 *
+		 * @param owner The object the source belongs to
+		 */
+		void save(const void* owner);
+
+		/**
+		 * @brief Poll all sources and queue the ones which are due
+		 *
+		 * This has to be called regularly (usually once per frame) from the
+		 * thread which owns the sources.
+		 */
+		void update();
+		/**
+		 * @brief Write all dirty sources and wait until everything is on disk
+		 */
+		void flush();
+
+		/**
+		 * @brief Get statistics about the scheduler
+		 *
+		 * @return Metrics A copy of the current statistics
+		 */
+		Metrics getMetrics() const;
+
+	private:
+		/**
+		 * @brief The bookkeeping of a registered source
+		 */
+		struct Entry
+		{
+			/// @brief The description of the source
+			Source source;
+			/// @brief The generation seen by the last update
+			std::uint64_t seenGeneration;
+			/// @brief The generation of the last snapshot handed to the writer
+			std::uint64_t queuedGeneration;
+			/// @brief The time of the first edit since the last snapshot
+			Clock::time_point firstEdit;
+			/// @brief The time of the last edit
+			Clock::time_point lastEdit;
+		};
+
+		/**
+		 * @brief A snapshot waiting to be written
+		 */
+		struct Job
+		{
+			const void* owner;
+			std::filesystem::path path;
+			std::string data;
+			std::uint64_t generation;
+			std::function<void()> prepare;
+		};
+
+		/**
+		 * @brief The outcome of a finished write
+		 */
+		struct Result
+		{
+			const void* owner;
+			std::uint64_t generation;
+			std::size_t bytes;
+			std::chrono::duration<double> time;
+			bool success;
+		};
+
+		/**
+		 * @brief Snapshot a source and hand it to the writer thread
+		 *
+		 * @param owner The key of the source
+		 * @param entry The source to snapshot
+		 */
+		void enqueue(const void* owner, Entry& entry);
+		/**
+		 * @brief Deliver finished writes to their sources
+		 */
+		void collectResults();
+		/**
+		 * @brief The body of the writer thread
+		 *
+		 * @param token The stop token of the writer thread
+		 */
+		void run(std::stop_token token);
+
+		/// @brief The quiet time after an edit before a source is written
+		const std::chrono::milliseconds debounce;
+		/// @brief The longest time a source stays dirty while being edited
+		const std::chrono::milliseconds maxLatency;
+		/// @brief Writes taking longer than this increase the backoff
+		const std::chrono::milliseconds slowWrite;
+
+		/// @brief All registered sources
+		std::map<const void*, Entry> sources;
+
+		/// @brief Guards the queue, the results and the metrics
+		mutable std::mutex mutex;
+		/// @brief Signals new jobs to the writer and finished jobs to flush
+		std::condition_variable_any condition;
+		/// @brief Snapshots waiting to be written
+		std::deque<Job> queue;
+		/// @brief Finished writes waiting to be collected
+		std::deque<Result> results;
+		/// @brief Set while the writer thread is writing a snapshot
+		bool writing;
+		/// @brief The end times of recent writes
+		std::deque<Clock::time_point> recentWrites;
+		/// @brief The current statistics
+		Metrics metrics;
+
+		/// @brief The writer thread, declared last so it is joined first
+		std::jthread worker;
+	};
+} // namespace storage
+
+#endif // AUTOSAVE_H
@@ -0,0 +1,179 @@
+#include "binary.h"
+#include "exceptions.h"
+
+std::uint64_t storage::fnv1a(std::string_view data, std::uint64_t hash)
+{
+	for (const char c : data)
+	{
+		hash ^= static_cast<std::uint8_t>(c);
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+std::string storage::encodeBase64(std::string_view data)
+{
+	constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	std::string text;
+	text.reserve((data.size() + 2) / 3 * 4);
+
+	std::size_t i = 0;
+	for (; i + 2 < data.size(); i += 3)
+	{
+		const std::uint32_t triple = static_cast<std::uint8_t>(data[i]) << 16
+				| static_cast<std::uint8_t>(data[i + 1]) << 8 | static_cast<std::uint8_t>(data[i + 2]);
+		text.push_back(alphabet[triple >> 18]);
+		text.push_back(alphabet[(triple >> 12) & 0x3f]);
+		text.push_back(alphabet[(triple >> 6) & 0x3f]);
+		text.push_back(alphabet[triple & 0x3f]);
+	}
+
+	if (i < data.size())
+	{
+		std::uint32_t triple = static_cast<std::uint8_t>(data[i]) << 16;
+		if (i + 1 < data.size())
+			triple |= static_cast<std::uint8_t>(data[i + 1]) << 8;
+
+		text.push_back(alphabet[triple >> 18]);
+		text.push_back(alphabet[(triple >> 12) & 0x3f]);
+		text.push_back(i + 1 < data.size() ? alphabet[(triple >> 6) & 0x3f] : '=');
+		text.push_back('=');
+	}
+
+	return text;
+}
+
+std::string storage::decodeBase64(std::string_view text)
+{
+	std::string data;
+	data.reserve(text.size() / 4 * 3);
+
+	std::uint32_t accumulator = 0;
+	int bits = 0;
+	for (const char c : text)
+	{
+		int value;
+		if (c >= 'A' && c <= 'Z')
+			value = c - 'A';
+		else if (c >= 'a' && c <= 'z')
+			value = c - 'a' + 26;
+		else if (c >= '0' && c <= '9')
+			value = c - '0' + 52;
+		else if (c == '+')
+			value = 62;
+		else if (c == '/')
+			value = 63;
+		else if (c == '=' || c == ' ' || c == '\t' || c == '\r' || c == '\n')
+			continue;
+		else
+			throw ParsingError("Invalid character in base64 text.");
+
+		accumulator = accumulator << 6 | value;
+		bits += 6;
+		if (bits >= 8)
+		{
+			bits -= 8;
+			data.push_back(static_cast<char>(accumulator >> bits));
+		}
+	}
+
+	return data;
+}
+
+void storage::BinaryWriter::writeU32(std::uint32_t value)
+{
+	for (int i = 0; i < 4; ++i)
+		writeU8(static_cast<std::uint8_t>(value >> (8 * i)));
+}
+
+void storage::BinaryWriter::writeU64(std::uint64_t value)
+{
+	for (int i = 0; i < 8; ++i)
+		writeU8(static_cast<std::uint8_t>(value >> (8 * i)));
+}
+
+void storage::BinaryWriter::writeVarint(std::uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		writeU8(static_cast<std::uint8_t>(value) | 0x80);
+		value >>= 7;
+	}
+	writeU8(static_cast<std::uint8_t>(value));
+}
+
+void storage::BinaryWriter::writeSignedVarint(std::int64_t value)
+{
+	writeVarint((static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63));
+}
+
+void storage::BinaryWriter::writeString(std::string_view value)
+{
+	writeVarint(value.size());
+	writeBytes(value);
+}
+
+std::uint8_t storage::BinaryReader::readU8()
+{
+	if (data.empty())
+		throw ParsingError("Unexpected end of binary data.");
+
+	const std::uint8_t value = static_cast<std::uint8_t>(data.front());
+	data.remove_prefix(1);
+	return value;
+}
+
+std::uint32_t storage::BinaryReader::readU32()
+{
+	const std::string_view bytes = readBytes(4);
+
+	std::uint32_t value = 0;
+	for (int i = 0; i < 4; ++i)
+		value |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(bytes[i])) << (8 * i);
+	return value;
+}
+
+std::uint64_t storage::BinaryReader::readU64()
+{
+	const std::string_view bytes = readBytes(8);
+
+	std::uint64_t value = 0;
+	for (int i = 0; i < 8; ++i)
+		value |= static_cast<std::uint64_t>(static_cast<std::uint8_t>(bytes[i])) << (8 * i);
+	return value;
+}
+
+std::uint64_t storage::BinaryReader::readVarint()
+{
+	std::uint64_t value = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		const std::uint8_t byte = readU8();
+		value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+			return value;
+	}
+	throw ParsingError("Variable length integer is too long.");
+}
+
+std::int64_t storage::BinaryReader::readSignedVarint()
+{
+	const std::uint64_t value = readVarint();
+	return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+std::string_view storage::BinaryReader::readString()
+{
+	return readBytes(readVarint());
+}
+
+std::string_view storage::BinaryReader::readBytes(std::size_t size)
+{
+	if (size > data.size())
+		throw ParsingError("Unexpected end of binary data.");
+
+	const std::string_view bytes = data.substr(0, size);
+	data.remove_prefix(size);
+	return bytes;
+}
@@ -0,0 +1,151 @@
+#ifndef BINARY_H
+#define BINARY_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+
+
+namespace storage
+{
+	/**
+	 * @brief Calculate the 64 bit FNV-1a hash of some data
+	 *
+	 * @param data The data to hash
+	 * @param hash The hash to continue from, used to hash data in pieces
+	 * @return std::uint64_t The hash of the data
+	 */
+	std::uint64_t fnv1a(std::string_view data, std::uint64_t hash = 0xcbf29ce484222325ull);
+
+	/**
+	 * @brief Encode binary data as base64 text, for example to embed it into xml
+	 *
+	 * @param data The data to encode
+	 * @return std::string The padded base64 text
+	 */
+	std::string encodeBase64(std::string_view data);
+	/**
+	 * @brief Decode base64 text, ignoring any white space
+	 *
+	 * @param text The base64 text
+	 * @return std::string The decoded data
+	 */
+	std::string decodeBase64(std::string_view text);
+
+	/**
+	 * @brief Appends little endian binary values to a string
+	 */
+	class BinaryWriter
+	{
+	public:
+		/**
+		 * @brief Construct a new binary writer
+		 *
+		 * @param _buffer The string all values are appended to
+		 */
+		BinaryWriter(std::string& _buffer) : buffer(_buffer) { }
+
+		/**
+		 * @brief Append a single byte
+		 *
+		 * @param value The byte to append
+		 */
+		void writeU8(std::uint8_t value) { buffer.push_back(static_cast<char>(value)); }
+		/**
+		 * @brief Append a 32 bit value with fixed width
+		 *
+		 * @param value The value to append
+		 */
+		void writeU32(std::uint32_t value);
+		/**
+		 * @brief Append a 64 bit value with fixed width
+		 *
+		 * @param value The value to append
+		 */
+		void writeU64(std::uint64_t value);
+		/**
+		 * @brief Append an unsigned value as LEB128 variable length integer
+		 *
+		 * @param value The value to append
+		 */
+		void writeVarint(std::uint64_t value);
+		/**
+		 * @brief Append a signed value as zigzag encoded variable length integer, small magnitudes stay short
+		 *
+		 * @param value The value to append
+		 */
+		void writeSignedVarint(std::int64_t value);
+		/**
+		 * @brief Append a string prefixed by its length
+		 *
+		 * @param value The string to append
+		 */
+		void writeString(std::string_view value);
+		/**
+		 * @brief Append raw bytes without any length information
+		 *
+		 * @param value The bytes to append
+		 */
+		void writeBytes(std::string_view value) { buffer.append(value); }
+
+	private:
+		/// @brief The string all values are appended to
+		std::string& buffer;
+	};
+
+	/**
+	 * @brief Reads little endian binary values written by a BinaryWriter
+	 *
+	 * Reading past the end of the data throws a ParsingError.
+	 */
+	class BinaryReader
+	{
+	public:
+		/**
+		 * @brief Construct a new binary reader
+		 *
+		 * @param _data The data to read from, it has to outlive the reader
+		 */
+		BinaryReader(std::string_view _data) : data(_data) { }
+
+		std::uint8_t readU8();
+		std::uint32_t readU32();
+		std::uint64_t readU64();
+		std::uint64_t readVarint();
+		std::int64_t readSignedVarint();
+		/**
+		 * @brief Read a string prefixed by its length
+		 *
+		 * @return std::string_view A view into the underlying data
+		 */
+		std::string_view readString();
+		/**
+		 * @brief Read a fixed number of raw bytes
+		 *
+		 * @param size The number of bytes to read
+		 * @return std::string_view A view into the underlying data
+		 */
+		std::string_view readBytes(std::size_t size);
+
+		/**
+		 * @brief Get the data which was not read yet
+		 *
+		 * @return std::string_view The remaining data
+		 */
+		std::string_view remaining() const { return data; }
+		/**
+		 * @brief Check if all data was read
+		 *
+		 * @return true If nothing is left to read
+		 * @return false If there is more data
+		 */
+		bool empty() const { return data.empty(); }
+
+	private:
+		/// @brief The data which was not read yet
+		std::string_view data;
+	};
+} // namespace storage
+
+#endif // BINARY_H
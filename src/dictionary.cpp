@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+
+#include "dictionary.h"
+#include "autosave.h"
+#include "exceptions.h"
+
+namespace
+{
+	/// @brief Identifies a compiled dictionary
+	constexpr std::uint32_t magic = 0x47574144;
+	/// @brief The version of the compiled form
+	constexpr std::uint32_t formatVersion = 1;
+	/// @brief The number of 32 bit values in front of the edges
+	constexpr std::size_t headerSize = 4;
+
+	/// @brief Set on edges behind which a word ends
+	constexpr std::uint32_t finalBit = 1u << 8;
+	/// @brief Set on the last edge of a node
+	constexpr std::uint32_t lastBit = 1u << 9;
+	/// @brief The position of the first edge of the target node inside an edge
+	constexpr std::uint32_t targetShift = 10;
+	/// @brief The number of edges the packed targets can address
+	constexpr std::uint32_t maximumEdges = 1u << (32 - targetShift);
+
+	/// @brief The longest word whose case is adjusted for a lookup
+	constexpr std::size_t maximumFolded = 64;
+
+	/**
+	 * @brief Check a word as given and with adjusted case
+	 *
+	 * @param dictionary The dictionary to search
+	 * @param word The word to check
+	 * @return true If the word or one of its case variants is known
+	 * @return false Otherwise
+	 */
+	bool checkCase(const storage::Dictionary& dictionary, std::string_view word)
+	{
+		if (dictionary.contains(word))
+			return true;
+		if (word.empty() || word.size() > maximumFolded || word[0] < 'A' || word[0] > 'Z')
+			return false;
+
+		// A capitalized word may start a sentence, a word in capitals may be shouted
+		char folded[maximumFolded];
+		std::copy(word.begin(), word.end(), folded);
+		folded[0] += 'a' - 'A';
+		if (dictionary.contains(std::string_view(folded, word.size())))
+			return true;
+
+		if (!std::all_of(word.begin(), word.end(), [] (char c) { return c < 'a' || c > 'z'; }))
+			return false;
+		for (std::size_t i = 1; i < word.size(); ++i)
+			if (folded[i] >= 'A' && folded[i] <= 'Z')
+				folded[i] += 'a' - 'A';
+		if (dictionary.contains(std::string_view(folded, word.size())))
+			return true;
+		folded[0] = word[0];
+		return dictionary.contains(std::string_view(folded, word.size()));
+	}
+} // namespace
+
+std::vector<std::uint32_t> storage::Dictionary::compile(std::vector<std::string> words)
+{
+	std::sort(words.begin(), words.end());
+	words.erase(std::unique(words.begin(), words.end()), words.end());
+	std::erase(words, std::string());
+
+	/**
+	 * @brief A node of the graph under construction
+	 */
+	struct Node
+	{
+		/// @brief The bytes and targets of the edges ordered by byte
+		std::vector<std::pair<std::uint8_t, std::uint32_t>> edges;
+		/// @brief Set if a word ends at the node
+		bool final;
+	};
+
+	// Add the sorted words one after the other, once a word shares less of its prefix with the next
+	// one, the nodes behind the shared prefix are final and get merged with an equal node if there is one
+	std::vector<Node> nodes(1);
+	std::vector<std::uint32_t> unused;
+	std::unordered_map<std::string, std::uint32_t> registry;
+	std::vector<std::uint32_t> path{ 0 };
+	std::string signature;
+	const auto minimize = [&] (std::size_t depth)
+		{
+			while (path.size() > depth + 1)
+			{
+				const std::uint32_t child = path.back();
+				path.pop_back();
+
+				signature.assign(1, nodes[child].final);
+				for (const auto& [byte, target] : nodes[child].edges)
+				{
+					signature += static_cast<char>(byte);
+					signature.append(reinterpret_cast<const char*>(&target), sizeof(target));
+				}
+
+				const auto [existing, inserted] = registry.try_emplace(signature, child);
+				if (!inserted)
+				{
+					nodes[path.back()].edges.back().second = existing->second;
+					nodes[child] = Node();
+					unused.push_back(child);
+				}
+			}
+		};
+
+	std::string_view previous;
+	for (const std::string& word : words)
+	{
+		const std::size_t shared = std::mismatch(word.begin(), word.begin() + std::min(word.size(), previous.size()),
+				previous.begin()).first - word.begin();
+		minimize(shared);
+
+		for (std::size_t i = shared; i < word.size(); ++i)
+		{
+			std::uint32_t node;
+			if (!unused.empty())
+			{
+				node = unused.back();
+				unused.pop_back();
+			}
+			else
+			{
+				node = nodes.size();
+				nodes.emplace_back();
+			}
+			nodes[path.back()].edges.emplace_back(word[i], node);
+			path.push_back(node);
+		}
+		nodes[path.back()].final = true;
+		previous = word;
+	}
+	minimize(0);
+
+	// Give every node with edges a block of consecutive edges, nodes close to the root come first
+	constexpr std::uint32_t noOffset = std::numeric_limits<std::uint32_t>::max();
+	std::vector<std::uint32_t> offsets(nodes.size(), noOffset);
+	std::vector<std::uint32_t> order{ 0 };
+	std::size_t edgeCount = nodes[0].edges.size();
+	offsets[0] = 0;
+	for (std::size_t i = 0; i < order.size(); ++i)
+		for (const auto& [byte, target] : nodes[order[i]].edges)
+			if (offsets[target] == noOffset && !nodes[target].edges.empty())
+			{
+				offsets[target] = edgeCount;
+				edgeCount += nodes[target].edges.size();
+				order.push_back(target);
+			}
+	if (edgeCount >= maximumEdges)
+		throw ParsingError("The word list is too large for a dictionary.");
+
+	std::vector<std::uint32_t> image{ magic, formatVersion, static_cast<std::uint32_t>(words.size()),
+			static_cast<std::uint32_t>(edgeCount) };
+	image.reserve(headerSize + edgeCount);
+	for (const std::uint32_t node : order)
+	{
+		const auto& edges = nodes[node].edges;
+		for (std::size_t i = 0; i < edges.size(); ++i)
+		{
+			const Node& target = nodes[edges[i].second];
+			image.push_back(edges[i].first | (target.final ? finalBit : 0) | (i + 1 == edges.size() ? lastBit : 0)
+					| (target.edges.empty() ? 0 : offsets[edges[i].second] << targetShift));
+		}
+	}
+	return image;
+}
+
+storage::Dictionary storage::Dictionary::load(const std::filesystem::path& wordList,
+		const std::filesystem::path& cache)
+{
+	std::error_code error;
+	const bool listExists = std::filesystem::exists(wordList, error);
+	if (std::filesystem::exists(cache, error) && (!listExists
+			|| std::filesystem::last_write_time(cache, error) >= std::filesystem::last_write_time(wordList, error)))
+	{
+		try
+		{
+			return Dictionary(cache);
+		}
+		catch (const FileError&)
+		{
+			// Compile the word list again
+		}
+	}
+
+	std::ifstream input(wordList);
+	if (!input)
+		throw OpenError("Unable to open the word list <", wordList.string(), ">.");
+
+	std::vector<std::string> words;
+	for (std::string line; std::getline(input, line); )
+	{
+		const std::size_t first = line.find_first_not_of(" \t\r");
+		if (first != std::string::npos)
+			words.push_back(line.substr(first, line.find_last_not_of(" \t\r") - first + 1));
+	}
+	if (input.bad())
+		throw ReadError("Unable to read the word list <", wordList.string(), ">.");
+
+	Dictionary dictionary(compile(std::move(words)));
+	try
+	{
+		dictionary.save(cache);
+	}
+	catch (const FileError&)
+	{
+		// Without a cache the word list is compiled on every start
+	}
+	return dictionary;
+}
+
+storage::Dictionary::Dictionary() : image(compile({})), edges(nullptr), edgeCount(0), wordCount(0)
+{
+	attach(image.data(), image.size() * sizeof(std::uint32_t));
+}
+
+storage::Dictionary::Dictionary(std::vector<std::uint32_t> _image) :
+		image(std::move(_image)), edges(nullptr), edgeCount(0), wordCount(0)
+{
+	attach(image.data(), image.size() * sizeof(std::uint32_t));
+}
+
+storage::Dictionary::Dictionary(const std::filesystem::path& path) :
+		mapping(std::make_unique<MappedFile>(path)), edges(nullptr), edgeCount(0), wordCount(0)
+{
+	attach(mapping->data(), mapping->size());
+}
+
+bool storage::Dictionary::contains(std::string_view word) const
+{
+	if (word.empty() || edgeCount == 0)
+		return false;
+
+	// Edges are ordered by byte, so the search of a node stops at the first larger byte
+	std::uint32_t index = 0;
+	bool final = false;
+	for (std::size_t i = 0; i < word.size(); ++i)
+	{
+		if (i != 0 && index == 0)
+			return false;
+
+		const std::uint32_t byte = static_cast<std::uint8_t>(word[i]);
+		std::uint32_t edge = edges[index];
+		while ((edge & 0xff) != byte)
+		{
+			if ((edge & 0xff) > byte || (edge & lastBit) != 0)
+				return false;
+			edge = edges[++index];
+		}
+		final = (edge & finalBit) != 0;
+		index = edge >> targetShift;
+	}
+	return final;
+}
+
+bool storage::Dictionary::check(std::string_view word) const
+{
+	if (checkCase(*this, word))
+		return true;
+
+	// Possessives are rarely part of word lists
+	for (const std::string_view suffix : { std::string_view("'s"), std::string_view("’s") })
+		if (word.size() > suffix.size() && word.ends_with(suffix))
+			return checkCase(*this, word.substr(0, word.size() - suffix.size()));
+	return false;
+}
+
+void storage::Dictionary::save(const std::filesystem::path& path) const
+{
+	writeFileAtomically(path, std::string_view(reinterpret_cast<const char*>(edges - headerSize),
+			(headerSize + edgeCount) * sizeof(std::uint32_t)));
+}
+
+void storage::Dictionary::attach(const void* data, std::size_t size)
+{
+	const std::uint32_t* const header = static_cast<const std::uint32_t*>(data);
+	if (size < headerSize * sizeof(std::uint32_t) || header[0] != magic || header[1] != formatVersion
+			|| size != (headerSize + header[3]) * sizeof(std::uint32_t))
+		throw ParsingError("The dictionary is damaged or was compiled by another version.");
+
+	// Lookups follow the targets and scan a node up to its last edge without any bounds checks, so every
+	// target has to lie inside the image and the final edge has to end a node
+	const std::uint32_t* const packed = header + headerSize;
+	const std::uint32_t count = header[3];
+	if (count != 0 && (packed[count - 1] & lastBit) == 0)
+		throw ParsingError("The dictionary is damaged or was compiled by another version.");
+	for (std::uint32_t i = 0; i < count; ++i)
+		if ((packed[i] >> targetShift) >= count)
+			throw ParsingError("The dictionary is damaged or was compiled by another version.");
+
+	wordCount = header[2];
+	edgeCount = count;
+	edges = packed;
+}
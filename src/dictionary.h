@@ -0,0 +1,134 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.h"
+
+
+
+namespace storage
+{
+	/**
+	 * @brief A word list compiled into a minimized directed acyclic word graph
+	 *
+	 * Words sharing a prefix share the path of the prefix and, after the
+	 * minimization, words sharing a suffix share the path of the suffix too.
+	 * This shrinks large word lists to a few megabytes. Every edge is packed
+	 * into 32 bits: the byte it consumes, whether a word ends behind it,
+	 * whether it is the last edge of its node and the first edge of the node
+	 * it leads to. The compiled form is written to disk as is and mapped into
+	 * memory when loaded again, so no parsing is needed at startup.
+	 *
+	 * The compiled form uses the byte order of the machine, it is a cache
+	 * which is rebuilt from the word list whenever it does not fit.
+	 */
+	class Dictionary
+	{
+	public:
+		/**
+		 * @brief Compile a list of words
+		 *
+		 * @param words The words, in any order and possibly with duplicates
+		 * @return std::vector<std::uint32_t> The compiled dictionary
+		 */
+		static std::vector<std::uint32_t> compile(std::vector<std::string> words);
+		/**
+		 * @brief Load a dictionary, compiling the word list only if the cache is missing or outdated
+		 *
+		 * The word list holds one word per line. A cache which can not be
+		 * written is no error, the dictionary is compiled again on the next
+		 * start.
+		 *
+		 * @param wordList The path of the word list
+		 * @param cache The path of the compiled dictionary
+		 * @return Dictionary The loaded dictionary
+		 */
+		static Dictionary load(const std::filesystem::path& wordList, const std::filesystem::path& cache);
+
+	public:
+		/**
+		 * @brief Construct a new empty dictionary
+		 */
+		Dictionary();
+		/**
+		 * @brief Take over a compiled dictionary
+		 *
+		 * @param _image The compiled dictionary
+		 */
+		Dictionary(std::vector<std::uint32_t> _image);
+		/**
+		 * @brief Map a compiled dictionary file into memory
+		 *
+		 * @param path The path of the compiled dictionary
+		 */
+		Dictionary(const std::filesystem::path& path);
+
+		/**
+		 * @brief Check if a word is part of the dictionary exactly as given
+		 *
+		 * @param word The word to check
+		 * @return true If the dictionary contains the word
+		 * @return false Otherwise
+		 */
+		bool contains(std::string_view word) const;
+		/**
+		 * @brief Check if a word is spelled correctly
+		 *
+		 * Capitalized words and words in capitals are also accepted if the
+		 * dictionary contains them in lower case, and possessives are accepted
+		 * for all words of the dictionary.
+		 *
+		 * @param word The word to check
+		 * @return true If the word is spelled correctly
+		 * @return false Otherwise
+		 */
+		bool check(std::string_view word) const;
+
+		/**
+		 * @brief Get the number of words
+		 *
+		 * @return std::size_t The number of words
+		 */
+		std::size_t size() const { return wordCount; }
+		/**
+		 * @brief Get the number of edges of the graph
+		 *
+		 * @return std::size_t The number of edges
+		 */
+		std::size_t getEdgeCount() const { return edgeCount; }
+		/**
+		 * @brief Save the compiled dictionary
+		 *
+		 * @param path The path of the file
+		 */
+		void save(const std::filesystem::path& path) const;
+
+	private:
+		/**
+		 * @brief Point the lookups at a compiled dictionary after checking its header and edges
+		 *
+		 * @param data The start of the compiled dictionary
+		 * @param size The size in bytes
+		 */
+		void attach(const void* data, std::size_t size);
+
+		/// @brief The compiled dictionary if it was built in memory
+		std::vector<std::uint32_t> image;
+		/// @brief The mapping of the compiled dictionary if it was loaded from a file
+		std::unique_ptr<MappedFile> mapping;
+		/// @brief The packed edges, the edges of the root come first
+		const std::uint32_t* edges;
+		/// @brief The number of edges
+		std::uint32_t edgeCount;
+		/// @brief The number of words
+		std::uint32_t wordCount;
+	};
+} // namespace storage
+
+#endif // DICTIONARY_H
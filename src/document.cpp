@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#include "document.h"
+#include "binary.h"
+#include "exceptions.h"
+
+std::string storage::Document::Edit::serialize() const
+{
+	std::string data;
+	BinaryWriter writer(data);
+	writer.writeVarint(offset);
+	writer.writeVarint(erase);
+	writer.writeBytes(insert);
+	return data;
+}
+
+storage::Document::Edit storage::Document::Edit::parse(std::string_view data)
+{
+	BinaryReader reader(data);
+	Edit edit;
+	edit.offset = reader.readVarint();
+	edit.erase = reader.readVarint();
+	edit.insert = reader.remaining();
+	return edit;
+}
+
+storage::Document::Document(std::filesystem::path _path) :
+		path(std::move(_path)), generation(0), savedGeneration(0)
+{
+	if (!std::filesystem::exists(path))
+		return;
+
+	std::ifstream input(path, std::ifstream::binary);
+	if (!input)
+		throw OpenError("Unable to open document <", path.string(), ">.");
+
+	text.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+	if (input.bad())
+		throw ReadError("Unable to read document <", path.string(), ">.");
+}
+
+void storage::Document::setText(std::string _text)
+{
+	if (_text == text)
+		return;
+
+	if (!editHandler)
+	{
+		text = std::move(_text);
+		++generation;
+		return;
+	}
+
+	// Reduce the change to the range between the common prefix and suffix
+	const std::size_t shorter = std::min(text.size(), _text.size());
+	const std::size_t prefix = std::mismatch(text.begin(), text.begin() + shorter, _text.begin()).first
+			- text.begin();
+	const std::size_t suffix = std::mismatch(text.rbegin(), text.rbegin() + (shorter - prefix),
+			_text.rbegin()).first - text.rbegin();
+	const Edit edit{ prefix, text.size() - prefix - suffix, _text.substr(prefix, _text.size() - prefix - suffix) };
+
+	text = std::move(_text);
+	++generation;
+	editHandler(edit);
+}
+
+void storage::Document::apply(const Edit& edit)
+{
+	if (edit.offset > text.size() || edit.erase > text.size() - edit.offset)
+		throw ParsingError("Edit exceeds the text of document <", path.string(), ">.");
+
+	text.replace(edit.offset, edit.erase, edit.insert);
+	++generation;
+}
+
+void storage::Document::markSaved(std::uint64_t _generation)
+{
+	savedGeneration = std::max(savedGeneration, _generation);
+}
@@ -0,0 +1,133 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+
+
+
+namespace storage
+{
+	/**
+	 * @brief The text content of a library book opened for editing
+	 *
+	 * A document is backed by the file at the location of its library book.
+	 * Every change bumps the edit generation so that it can be tracked by the
+	 * autosave in the same way as the library itself.
+	 */
+	class Document
+	{
+	public:
+		/**
+		 * @brief A single change of the document text
+		 *
+		 * The bytes in the range [offset, offset + erase) are replaced by the
+		 * inserted bytes.
+		 */
+		struct Edit
+		{
+			/// @brief The byte offset of the change
+			std::uint64_t offset;
+			/// @brief The number of bytes removed at the offset
+			std::uint64_t erase;
+			/// @brief The bytes inserted at the offset
+			std::string insert;
+
+			/**
+			 * @brief Encode the edit into a compact binary form
+			 *
+			 * @return std::string The encoded edit
+			 */
+			std::string serialize() const;
+			/**
+			 * @brief Decode an edit from its binary form
+			 *
+			 * @param data The encoded edit
+			 * @return Edit The decoded edit
+			 */
+			static Edit parse(std::string_view data);
+		};
+
+	public:
+		/**
+		 * @brief Open a document from a file
+		 *
+		 * A file which does not exist yet results in an empty document.
+		 *
+		 * @param path The path to the document file
+		 */
+		Document(std::filesystem::path path);
+
+		/**
+		 * @brief Get the path of the document file
+		 *
+		 * @return const std::filesystem::path& The document file path
+		 */
+		const std::filesystem::path& getPath() const { return path; }
+		/**
+		 * @brief Get the current text of the document
+		 *
+		 * @return const std::string& The document text
+		 */
+		const std::string& getText() const { return text; }
+		/**
+		 * @brief Replace the text of the document
+		 *
+		 * @param _text The new document text
+		 */
+		void setText(std::string _text);
+		/**
+		 * @brief Apply a single edit to the document text
+		 *
+		 * This is used to replay logged edits and does not notify the edit
+		 * handler.
+		 *
+		 * @param edit The edit to apply
+		 */
+		void apply(const Edit& edit);
+		/**
+		 * @brief Set a function which is called with every change of the text
+		 *
+		 * The function is called once the text was changed.
+		 * @param handler The function receiving the edits
+		 */
+		void setEditHandler(std::function<void(const Edit&)> handler) { editHandler = std::move(handler); }
+
+		/**
+		 * @brief Get the edit generation of the document
+		 *
+		 * @return std::uint64_t The number of modifications since opening
+		 */
+		std::uint64_t getGeneration() const { return generation; }
+		/**
+		 * @brief Mark the document content up to a generation as saved
+		 *
+		 * @param _generation The generation which has been written to disk
+		 */
+		void markSaved(std::uint64_t _generation);
+		/**
+		 * @brief Check if the document contains unsaved modifications
+		 *
+		 * @return true If the document was modified since the last save
+		 * @return false If the document is saved
+		 */
+		bool isDirty() const { return generation != savedGeneration; }
+
+	private:
+		/// @brief The path of the document file
+		std::filesystem::path path;
+		/// @brief The current text of the document
+		std::string text;
+		/// @brief The number of modifications since opening
+		std::uint64_t generation;
+		/// @brief The generation which was last written to disk
+		std::uint64_t savedGeneration;
+		/// @brief The function which is notified about every change
+		std::function<void(const Edit&)> editHandler;
+	};
+} // namespace storage
+
+#endif // DOCUMENT_H
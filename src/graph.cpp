@@ -0,0 +1,414 @@
+#include <iterator>
+
+#include "graph.h"
+#include "binary.h"
+#include "exceptions.h"
+
+namespace
+{
+	/// @brief The version of the binary form written by serialize
+	constexpr std::uint8_t formatVersion = 1;
+	/// @brief The pending changes which always fit into the delta buffer
+	constexpr std::size_t minimumDelta = 4096;
+	/// @brief The pending changes per edge of the arrays which trigger a merge
+	constexpr std::size_t deltaRatio = 8;
+} // namespace
+
+std::string_view storage::RelationshipGraph::getTypeName(EntityType type)
+{
+	switch (type)
+	{
+	case EntityType::Character:
+		return "Character";
+	case EntityType::Place:
+		return "Place";
+	case EntityType::Faction:
+		return "Faction";
+	case EntityType::Term:
+		return "Term";
+	}
+	return "Unknown";
+}
+
+std::uint32_t storage::RelationshipGraph::addEntity(std::string name, EntityType type)
+{
+	entities.push_back({ std::move(name), type, false });
+	added.emplace_back();
+	removed.emplace_back();
+	return static_cast<std::uint32_t>(entities.size() - 1);
+}
+
+bool storage::RelationshipGraph::removeEntity(std::uint32_t entity)
+{
+	if (!isEntity(entity))
+		return false;
+
+	for (const Edge& edge : getNeighbors(entity))
+	{
+		if (edge.incoming)
+			removeRelation(edge.target, entity, relationTypes[edge.type]);
+		else
+			removeRelation(entity, edge.target, relationTypes[edge.type]);
+	}
+
+	entities[entity].removed = true;
+	return true;
+}
+
+bool storage::RelationshipGraph::addRelation(std::uint32_t source, std::uint32_t target, std::string_view type)
+{
+	if (!isEntity(source) || !isEntity(target) || source == target || hasRelation(source, target, type))
+		return false;
+
+	std::uint32_t code = findType(type);
+	if (code == noEntity)
+	{
+		if (relationTypes.size() > std::numeric_limits<std::uint16_t>::max())
+			return false;
+
+		code = static_cast<std::uint32_t>(relationTypes.size());
+		relationTypes.emplace_back(type);
+		relationCodes.emplace(type, static_cast<std::uint16_t>(code));
+	}
+
+	insert({ source, { target, static_cast<std::uint16_t>(code), false } });
+	insert({ target, { source, static_cast<std::uint16_t>(code), true } });
+	++relationCount;
+
+	if (pending > std::max(minimumDelta, edges.size() / deltaRatio))
+		compact();
+	return true;
+}
+
+bool storage::RelationshipGraph::removeRelation(std::uint32_t source, std::uint32_t target, std::string_view type)
+{
+	if (!hasRelation(source, target, type))
+		return false;
+
+	const std::uint16_t code = static_cast<std::uint16_t>(findType(type));
+	erase({ source, { target, code, false } });
+	erase({ target, { source, code, true } });
+	--relationCount;
+
+	if (pending > std::max(minimumDelta, edges.size() / deltaRatio))
+		compact();
+	return true;
+}
+
+bool storage::RelationshipGraph::hasRelation(std::uint32_t source, std::uint32_t target, std::string_view type) const
+{
+	const std::uint32_t code = findType(type);
+	if (code == noEntity)
+		return false;
+
+	if (!isEntity(source))
+		return false;
+
+	const Edge edge{ target, static_cast<std::uint16_t>(code), false };
+	if (std::binary_search(added[source].begin(), added[source].end(), edge))
+		return true;
+	return isStored(source, edge) && !isRemoved(source, edge);
+}
+
+std::vector<storage::RelationshipGraph::Edge> storage::RelationshipGraph::getNeighbors(std::uint32_t entity) const
+{
+	std::vector<Edge> neighbors;
+	forEachNeighbor(entity, [&neighbors] (const Edge& edge) { neighbors.push_back(edge); });
+	return neighbors;
+}
+
+std::vector<std::uint32_t> storage::RelationshipGraph::findShortestPath(std::uint32_t from, std::uint32_t to,
+		bool directed) const
+{
+	if (!isEntity(from) || !isEntity(to))
+		return { };
+
+	// Search from both ends and always grow the smaller frontier by one level,
+	// which touches far fewer edges than a search from one end in dense graphs
+	std::vector<std::uint32_t> forwardParents(entities.size(), noEntity);
+	std::vector<std::uint32_t> backwardParents(entities.size(), noEntity);
+	forwardParents[from] = from;
+	backwardParents[to] = to;
+
+	std::vector<std::uint32_t> forwardFrontier{ from };
+	std::vector<std::uint32_t> backwardFrontier{ to };
+	std::vector<std::uint32_t> next;
+	std::uint32_t meeting = from == to ? from : noEntity;
+
+	while (meeting == noEntity && !forwardFrontier.empty() && !backwardFrontier.empty())
+	{
+		const bool forward = forwardFrontier.size() <= backwardFrontier.size();
+		std::vector<std::uint32_t>& frontier = forward ? forwardFrontier : backwardFrontier;
+		std::vector<std::uint32_t>& parents = forward ? forwardParents : backwardParents;
+		const std::vector<std::uint32_t>& others = forward ? backwardParents : forwardParents;
+
+		next.clear();
+		for (const std::uint32_t entity : frontier)
+		{
+			// The backward search walks the relationships against their direction
+			forEachNeighbor(entity, [&] (const Edge& edge) {
+				if (meeting != noEntity || (directed && edge.incoming == forward) || parents[edge.target] != noEntity)
+					return;
+				parents[edge.target] = entity;
+				if (others[edge.target] != noEntity)
+					meeting = edge.target;
+				next.push_back(edge.target);
+			});
+			if (meeting != noEntity)
+				break;
+		}
+		frontier.swap(next);
+	}
+
+	if (meeting == noEntity)
+		return { };
+
+	std::vector<std::uint32_t> path{ meeting };
+	while (path.back() != from)
+		path.push_back(forwardParents[path.back()]);
+	std::reverse(path.begin(), path.end());
+	while (path.back() != to)
+		path.push_back(backwardParents[path.back()]);
+	return path;
+}
+
+std::vector<std::pair<std::uint32_t, std::uint32_t>> storage::RelationshipGraph::findWithinHops(std::uint32_t from,
+		std::uint32_t hops, bool directed) const
+{
+	if (!isEntity(from))
+		return { };
+
+	std::vector<std::uint32_t> parents;
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> reached = search(from, noEntity, hops, directed, parents);
+	reached.erase(reached.begin());
+	return reached;
+}
+
+void storage::RelationshipGraph::compact()
+{
+	if (pending == 0 && offsets.size() == entities.size() + 1)
+		return;
+
+	// The arrays and the delta buffer are both sorted, so a linear merge per entity replaces a full sort
+	std::vector<DeltaEdge> halves;
+	halves.reserve(edges.size() + pending);
+	for (std::uint32_t entity = 0; entity < entities.size(); ++entity)
+	{
+		const std::size_t begin = halves.size();
+		if (entity + 1 < offsets.size())
+			for (std::uint32_t i = offsets[entity]; i < offsets[entity + 1]; ++i)
+				if (!isRemoved(entity, edges[i]))
+					halves.push_back({ entity, edges[i] });
+
+		const std::size_t middle = halves.size();
+		for (const Edge& edge : added[entity])
+			halves.push_back({ entity, edge });
+		std::inplace_merge(halves.begin() + begin, halves.begin() + middle, halves.end());
+	}
+
+	build(halves);
+}
+
+std::size_t storage::RelationshipGraph::getMemoryUsage() const
+{
+	std::size_t usage = sizeof(RelationshipGraph)
+			+ entities.capacity() * sizeof(Entity)
+			+ offsets.capacity() * sizeof(std::uint32_t)
+			+ edges.capacity() * sizeof(Edge)
+			+ (added.capacity() + removed.capacity()) * sizeof(std::vector<Edge>);
+
+	for (const Entity& entity : entities)
+		usage += entity.name.capacity();
+	for (std::size_t i = 0; i < entities.size(); ++i)
+		usage += (added[i].capacity() + removed[i].capacity()) * sizeof(Edge);
+	for (const std::string& type : relationTypes)
+		usage += 2 * (sizeof(std::string) + type.capacity()) + 32;
+
+	return usage;
+}
+
+std::string storage::RelationshipGraph::serialize() const
+{
+	std::string data;
+	BinaryWriter writer(data);
+	writer.writeU8(formatVersion);
+
+	writer.writeVarint(entities.size());
+	for (const Entity& entity : entities)
+	{
+		writer.writeString(entity.name);
+		writer.writeU8(static_cast<std::uint8_t>(entity.type));
+		writer.writeU8(entity.removed);
+	}
+
+	writer.writeVarint(relationTypes.size());
+	for (const std::string& type : relationTypes)
+		writer.writeString(type);
+
+	// Only the outgoing direction is stored, the incoming one is derived when parsing
+	writer.writeVarint(relationCount);
+	for (std::uint32_t entity = 0; entity < entities.size(); ++entity)
+	{
+		forEachNeighbor(entity, [&writer, entity] (const Edge& edge) {
+			if (edge.incoming)
+				return;
+			writer.writeVarint(entity);
+			writer.writeVarint(edge.target);
+			writer.writeVarint(edge.type);
+		});
+	}
+
+	return data;
+}
+
+void storage::RelationshipGraph::parse(std::string_view data)
+{
+	BinaryReader reader(data);
+	if (reader.readU8() != formatVersion)
+		throw ParsingError("Unsupported relationship graph version.");
+
+	RelationshipGraph graph;
+
+	const std::uint64_t entityCount = reader.readVarint();
+	if (entityCount > reader.remaining().size())
+		throw ParsingError("Relationship graph entity count is implausible.");
+	graph.entities.reserve(entityCount);
+	for (std::uint64_t i = 0; i < entityCount; ++i)
+	{
+		Entity entity{ std::string(reader.readString()), static_cast<EntityType>(reader.readU8()), false };
+		entity.removed = reader.readU8() != 0;
+		graph.entities.push_back(std::move(entity));
+	}
+	graph.added.resize(entityCount);
+	graph.removed.resize(entityCount);
+
+	const std::uint64_t typeCount = reader.readVarint();
+	if (typeCount > std::numeric_limits<std::uint16_t>::max() + 1ull)
+		throw ParsingError("Relationship graph has too many relationship types.");
+	for (std::uint64_t i = 0; i < typeCount; ++i)
+	{
+		graph.relationTypes.emplace_back(reader.readString());
+		graph.relationCodes.emplace(graph.relationTypes.back(), static_cast<std::uint16_t>(i));
+	}
+
+	const std::uint64_t relationCount = reader.readVarint();
+	if (relationCount > reader.remaining().size())
+		throw ParsingError("Relationship graph relation count is implausible.");
+
+	std::vector<DeltaEdge> halves;
+	halves.reserve(2 * relationCount);
+	for (std::uint64_t i = 0; i < relationCount; ++i)
+	{
+		const std::uint64_t source = reader.readVarint();
+		const std::uint64_t target = reader.readVarint();
+		const std::uint64_t type = reader.readVarint();
+		if (source >= entityCount || target >= entityCount || type >= typeCount)
+			throw ParsingError("Relationship graph edge is out of range.");
+
+		halves.push_back({ static_cast<std::uint32_t>(source),
+				{ static_cast<std::uint32_t>(target), static_cast<std::uint16_t>(type), false } });
+		halves.push_back({ static_cast<std::uint32_t>(target),
+				{ static_cast<std::uint32_t>(source), static_cast<std::uint16_t>(type), true } });
+	}
+
+	std::sort(halves.begin(), halves.end());
+	graph.build(halves);
+	graph.relationCount = relationCount;
+	*this = std::move(graph);
+}
+
+std::uint32_t storage::RelationshipGraph::findType(std::string_view type) const
+{
+	const auto code = relationCodes.find(type);
+	return code == relationCodes.end() ? noEntity : code->second;
+}
+
+bool storage::RelationshipGraph::isStored(std::uint32_t source, const Edge& edge) const
+{
+	if (source + 1 >= offsets.size())
+		return false;
+	return std::binary_search(edges.begin() + offsets[source], edges.begin() + offsets[source + 1], edge);
+}
+
+void storage::RelationshipGraph::insert(const DeltaEdge& half)
+{
+	// Adding back a removed edge only drops its tombstone
+	std::vector<Edge>& tombstones = removed[half.source];
+	const auto tombstone = std::lower_bound(tombstones.begin(), tombstones.end(), half.edge);
+	if (tombstone != tombstones.end() && *tombstone == half.edge)
+	{
+		tombstones.erase(tombstone);
+		--pending;
+	}
+	else
+	{
+		std::vector<Edge>& list = added[half.source];
+		list.insert(std::lower_bound(list.begin(), list.end(), half.edge), half.edge);
+		++pending;
+	}
+}
+
+void storage::RelationshipGraph::erase(const DeltaEdge& half)
+{
+	std::vector<Edge>& list = added[half.source];
+	const auto edge = std::lower_bound(list.begin(), list.end(), half.edge);
+	if (edge != list.end() && *edge == half.edge)
+	{
+		list.erase(edge);
+		--pending;
+	}
+	else
+	{
+		std::vector<Edge>& tombstones = removed[half.source];
+		tombstones.insert(std::lower_bound(tombstones.begin(), tombstones.end(), half.edge), half.edge);
+		++pending;
+	}
+}
+
+void storage::RelationshipGraph::build(const std::vector<DeltaEdge>& halves)
+{
+	offsets.assign(entities.size() + 1, 0);
+	for (const DeltaEdge& half : halves)
+		++offsets[half.source + 1];
+	for (std::size_t i = 1; i < offsets.size(); ++i)
+		offsets[i] += offsets[i - 1];
+
+	edges.resize(halves.size());
+	for (std::size_t i = 0; i < halves.size(); ++i)
+		edges[i] = halves[i].edge;
+	edges.shrink_to_fit();
+
+	for (std::size_t i = 0; i < entities.size(); ++i)
+	{
+		std::vector<Edge>().swap(added[i]);
+		std::vector<Edge>().swap(removed[i]);
+	}
+	pending = 0;
+}
+
+std::vector<std::pair<std::uint32_t, std::uint32_t>> storage::RelationshipGraph::search(std::uint32_t from,
+		std::uint32_t to, std::uint32_t hops, bool directed, std::vector<std::uint32_t>& parents) const
+{
+	parents.assign(entities.size(), noEntity);
+	parents[from] = from;
+
+	// The reached entities double as the queue of the search
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> reached{ { from, 0 } };
+	for (std::size_t next = 0; next < reached.size(); ++next)
+	{
+		const auto [entity, distance] = reached[next];
+		if (entity == to)
+			break;
+		if (distance == hops)
+			continue;
+
+		forEachNeighbor(entity, [&] (const Edge& edge) {
+			if ((directed && edge.incoming) || parents[edge.target] != noEntity)
+				return;
+			parents[edge.target] = entity;
+			reached.emplace_back(edge.target, distance + 1);
+		});
+	}
+
+	return reached;
+}
@@ -0,0 +1,332 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+
+namespace storage
+{
+	/**
+	 * @brief Characters, places, factions and glossary terms linked by typed relationships
+	 *
+	 * The adjacency is kept in compressed sparse row form: one offset per
+	 * entity into a single array of edges sorted by their source. Every
+	 * relationship is stored twice, once as outgoing edge of its source and
+	 * once as incoming edge of its target, so both directions can be walked
+	 * without a search.
+	 *
+	 * Rebuilding the arrays for every change would be too slow for large
+	 * graphs. Added edges are therefore collected in a small sorted delta
+	 * buffer per entity and removed edges are remembered as tombstones. Both
+	 * are merged into the arrays once they grow past a fraction of the graph.
+	 *
+	 * Entity ids are indices which stay stable, removed entities are only
+	 * marked as such.
+	 */
+	class RelationshipGraph
+	{
+	public:
+		/**
+		 * @brief The kinds of entities
+		 */
+		enum class EntityType : std::uint8_t
+		{
+			Character,
+			Place,
+			Faction,
+			Term
+		};
+
+		/**
+		 * @brief A node of the graph
+		 */
+		struct Entity
+		{
+			/// @brief The name of the entity
+			std::string name;
+			/// @brief The kind of the entity
+			EntityType type;
+			/// @brief Set once the entity was removed, its id is never reused
+			bool removed;
+		};
+
+		/**
+		 * @brief One direction of a relationship as seen from one of its entities
+		 */
+		struct Edge
+		{
+			/// @brief The entity on the other side of the relationship
+			std::uint32_t target;
+			/// @brief The code of the relationship type
+			std::uint16_t type;
+			/// @brief Set if the relationship points from the target to the entity
+			bool incoming;
+
+			auto operator<=>(const Edge&) const = default;
+		};
+
+		/// @brief The id used for missing entities
+		static constexpr std::uint32_t noEntity = std::numeric_limits<std::uint32_t>::max();
+
+		/**
+		 * @brief Get the display name of an entity type
+		 *
+		 * @param type The entity type
+		 * @return std::string_view The name of the type
+		 */
+		static std::string_view getTypeName(EntityType type);
+
+	public:
+		/**
+		 * @brief Construct a new empty graph
+		 */
+		RelationshipGraph() : relationCount(0), pending(0) { }
+
+		/**
+		 * @brief Add a new entity
+		 *
+		 * @param name The name of the entity
+		 * @param type The kind of the entity
+		 * @return std::uint32_t The id of the new entity
+		 */
+		std::uint32_t addEntity(std::string name, EntityType type);
+		/**
+		 * @brief Remove an entity together with all its relationships
+		 *
+		 * @param entity The id of the entity
+		 * @return true If the entity was removed
+		 * @return false If there is no such entity
+		 */
+		bool removeEntity(std::uint32_t entity);
+		/**
+		 * @brief Check if an entity exists
+		 *
+		 * @param entity The id of the entity
+		 * @return true If the entity exists and was not removed
+		 * @return false Otherwise
+		 */
+		bool isEntity(std::uint32_t entity) const { return entity < entities.size() && !entities[entity].removed; }
+		/**
+		 * @brief Get all entities including removed ones, indexed by their ids
+		 *
+		 * @return const std::vector<Entity>& The entities
+		 */
+		const std::vector<Entity>& getEntities() const { return entities; }
+
+		/**
+		 * @brief Add a relationship between two entities
+		 *
+		 * @param source The entity the relationship starts at
+		 * @param target The entity the relationship points to
+		 * @param type The type of the relationship, for example "ally of"
+		 * @return true If the relationship was added
+		 * @return false If an entity is missing or the relationship already exists
+		 */
+		bool addRelation(std::uint32_t source, std::uint32_t target, std::string_view type);
+		/**
+		 * @brief Remove a relationship between two entities
+		 *
+		 * @param source The entity the relationship starts at
+		 * @param target The entity the relationship points to
+		 * @param type The type of the relationship
+		 * @return true If the relationship was removed
+		 * @return false If there is no such relationship
+		 */
+		bool removeRelation(std::uint32_t source, std::uint32_t target, std::string_view type);
+		/**
+		 * @brief Check if a relationship exists
+		 *
+		 * @param source The entity the relationship starts at
+		 * @param target The entity the relationship points to
+		 * @param type The type of the relationship
+		 * @return true If the relationship exists
+		 * @return false Otherwise
+		 */
+		bool hasRelation(std::uint32_t source, std::uint32_t target, std::string_view type) const;
+		/**
+		 * @brief Get the number of relationships
+		 *
+		 * @return std::size_t The number of relationships
+		 */
+		std::size_t getRelationCount() const { return relationCount; }
+		/**
+		 * @brief Get the names of all relationship types
+		 *
+		 * @return const std::vector<std::string>& The names indexed by the type codes
+		 */
+		const std::vector<std::string>& getRelationTypes() const { return relationTypes; }
+
+		/**
+		 * @brief Call a function for every relationship of an entity
+		 *
+		 * @tparam Function The type of the function
+		 * @param entity The id of the entity
+		 * @param function The function receiving every edge of the entity
+		 */
+		template<typename Function>
+		void forEachNeighbor(std::uint32_t entity, Function function) const
+		{
+			if (entity + 1 < offsets.size())
+				for (std::uint32_t i = offsets[entity]; i < offsets[entity + 1]; ++i)
+					if (removed[entity].empty() || !isRemoved(entity, edges[i]))
+						function(edges[i]);
+
+			if (entity < added.size())
+				for (const Edge& edge : added[entity])
+					function(edge);
+		}
+		/**
+		 * @brief Get all relationships of an entity
+		 *
+		 * @param entity The id of the entity
+		 * @return std::vector<Edge> The edges of the entity
+		 */
+		std::vector<Edge> getNeighbors(std::uint32_t entity) const;
+		/**
+		 * @brief Find a shortest chain of relationships between two entities
+		 *
+		 * @param from The entity to start at
+		 * @param to The entity to reach
+		 * @param directed Only follow relationships in their direction
+		 * @return std::vector<std::uint32_t> The entities along the path including both ends, empty if unreachable
+		 */
+		std::vector<std::uint32_t> findShortestPath(std::uint32_t from, std::uint32_t to, bool directed = false) const;
+		/**
+		 * @brief Find all entities within a number of relationships of an entity
+		 *
+		 * @param from The entity to start at
+		 * @param hops The maximum number of relationships to follow
+		 * @param directed Only follow relationships in their direction
+		 * @return std::vector<std::pair<std::uint32_t, std::uint32_t>> The entities and their distance, nearest first
+		 */
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> findWithinHops(std::uint32_t from,
+				std::uint32_t hops, bool directed = false) const;
+
+		/**
+		 * @brief Merge the delta buffer and the tombstones into the adjacency arrays
+		 */
+		void compact();
+		/**
+		 * @brief Estimate the memory used by the graph
+		 *
+		 * @return std::size_t The estimated memory in bytes
+		 */
+		std::size_t getMemoryUsage() const;
+
+		/**
+		 * @brief Encode the graph into a compact binary form
+		 *
+		 * @return std::string The encoded graph
+		 */
+		std::string serialize() const;
+		/**
+		 * @brief Replace the graph by decoding its binary form
+		 *
+		 * @param data The encoded graph
+		 */
+		void parse(std::string_view data);
+
+	private:
+		/**
+		 * @brief An edge together with the entity it belongs to
+		 */
+		struct DeltaEdge
+		{
+			/// @brief The entity the edge belongs to
+			std::uint32_t source;
+			/// @brief The edge
+			Edge edge;
+
+			auto operator<=>(const DeltaEdge&) const = default;
+		};
+
+		/**
+		 * @brief Find the code of a relationship type
+		 *
+		 * @param type The name of the type
+		 * @return std::uint32_t The code or noEntity if the type is unknown
+		 */
+		std::uint32_t findType(std::string_view type) const;
+		/**
+		 * @brief Check if an edge is part of the adjacency arrays
+		 *
+		 * @param source The entity the edge belongs to
+		 * @param edge The edge
+		 * @return true If the arrays contain the edge, regardless of tombstones
+		 * @return false Otherwise
+		 */
+		bool isStored(std::uint32_t source, const Edge& edge) const;
+		/**
+		 * @brief Check if an edge of the adjacency arrays was removed
+		 *
+		 * @param source The entity the edge belongs to
+		 * @param edge The edge
+		 * @return true If there is a tombstone for the edge
+		 * @return false Otherwise
+		 */
+		bool isRemoved(std::uint32_t source, const Edge& edge) const
+		{
+			return std::binary_search(removed[source].begin(), removed[source].end(), edge);
+		}
+		/**
+		 * @brief Insert one direction of a relationship
+		 *
+		 * @param half The edge and the entity it belongs to
+		 */
+		void insert(const DeltaEdge& half);
+		/**
+		 * @brief Remove one direction of a relationship
+		 *
+		 * @param half The edge and the entity it belongs to
+		 */
+		void erase(const DeltaEdge& half);
+		/**
+		 * @brief Replace the adjacency arrays
+		 *
+		 * @param halves Both directions of all relationships, sorted
+		 */
+		void build(const std::vector<DeltaEdge>& halves);
+		/**
+		 * @brief Run a breadth first search
+		 *
+		 * @param from The entity to start at
+		 * @param to The entity to stop at, noEntity to search everything
+		 * @param hops The maximum distance to search
+		 * @param directed Only follow relationships in their direction
+		 * @param parents Receives the entity every reached entity was reached from
+		 * @return std::vector<std::pair<std::uint32_t, std::uint32_t>> The reached entities and their distance
+		 */
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> search(std::uint32_t from, std::uint32_t to,
+				std::uint32_t hops, bool directed, std::vector<std::uint32_t>& parents) const;
+
+		/// @brief All entities indexed by their ids
+		std::vector<Entity> entities;
+		/// @brief The names of all relationship types indexed by their codes
+		std::vector<std::string> relationTypes;
+		/// @brief The code of every relationship type
+		std::map<std::string, std::uint16_t, std::less<>> relationCodes;
+		/// @brief The number of relationships
+		std::size_t relationCount;
+
+		/// @brief The start of the edges of every entity, one more than the number of entities at the last merge
+		std::vector<std::uint32_t> offsets;
+		/// @brief The edges of all entities, sorted by entity and edge
+		std::vector<Edge> edges;
+		/// @brief Edges added since the last merge, sorted per entity
+		std::vector<std::vector<Edge>> added;
+		/// @brief Edges of the arrays removed since the last merge, sorted per entity
+		std::vector<std::vector<Edge>> removed;
+		/// @brief The number of edges inside the delta buffer and the tombstones
+		std::size_t pending;
+	};
+} // namespace storage
+
+#endif // GRAPH_H
@@ -0,0 +1,517 @@
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <numeric>
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+	#define GRAPHLAYOUT_X86
+#endif
+
+#include "graph_layout.h"
+
+namespace
+{
+	/// @brief The ratio of cell size to distance below which a cell acts as a single mass
+	constexpr float theta = 0.8f;
+	/// @brief Added to every squared distance, so close nodes do not blow the forces up
+	constexpr float softening = 1.0f;
+	/// @brief The strength of the pull towards the origin, keeps unconnected parts together
+	constexpr float gravity = 0.1f;
+	/// @brief The factor the temperature is reduced by after every iteration
+	constexpr float cooling = 0.95f;
+	/// @brief The number of nodes up to which a cell is not split further
+	constexpr std::uint32_t leafSize = 8;
+	/// @brief The size of cells which are not split further, nodes on the same spot share them
+	constexpr float minimumHalf = 1e-3f;
+
+	using RepulsionFunction = void (*)(float, float, const float*, const float*, const float*, std::size_t,
+			float&, float&);
+
+	/// @brief Set of kernel implementations for a specific instruction set
+	struct Kernels
+	{
+		RepulsionFunction repulsion;
+		const char* name;
+	};
+
+	// ---------------------------------------------------------------------------
+	// Scalar kernels
+
+	void repulsionScalar(float x, float y, const float* massX, const float* massY, const float* mass,
+			std::size_t count, float& forceX, float& forceY)
+	{
+		float sumX = 0.0f;
+		float sumY = 0.0f;
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			const float dx = x - massX[i];
+			const float dy = y - massY[i];
+			const float f = mass[i] / (dx * dx + dy * dy + softening);
+			sumX += dx * f;
+			sumY += dy * f;
+		}
+		forceX += sumX;
+		forceY += sumY;
+	}
+
+#ifdef GRAPHLAYOUT_X86
+	// ---------------------------------------------------------------------------
+	// Vectorized kernels
+	//
+	// Every lane accumulates the forces of its own subset of masses, the lanes
+	// are only summed up at the end. The remaining masses are handled by the
+	// scalar kernel.
+
+	void repulsionSSE(float x, float y, const float* massX, const float* massY, const float* mass,
+			std::size_t count, float& forceX, float& forceY)
+	{
+		const __m128 px = _mm_set1_ps(x);
+		const __m128 py = _mm_set1_ps(y);
+		const __m128 soft = _mm_set1_ps(softening);
+		__m128 sumX = _mm_setzero_ps();
+		__m128 sumY = _mm_setzero_ps();
+
+		std::size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 dx = _mm_sub_ps(px, _mm_loadu_ps(massX + i));
+			const __m128 dy = _mm_sub_ps(py, _mm_loadu_ps(massY + i));
+			const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), soft);
+			const __m128 f = _mm_div_ps(_mm_loadu_ps(mass + i), distance);
+			sumX = _mm_add_ps(sumX, _mm_mul_ps(dx, f));
+			sumY = _mm_add_ps(sumY, _mm_mul_ps(dy, f));
+		}
+
+		alignas(16) float lanesX[4];
+		alignas(16) float lanesY[4];
+		_mm_store_ps(lanesX, sumX);
+		_mm_store_ps(lanesY, sumY);
+		forceX += (lanesX[0] + lanesX[1]) + (lanesX[2] + lanesX[3]);
+		forceY += (lanesY[0] + lanesY[1]) + (lanesY[2] + lanesY[3]);
+
+		repulsionScalar(x, y, massX + i, massY + i, mass + i, count - i, forceX, forceY);
+	}
+
+	__attribute__((target("avx2,fma")))
+	void repulsionAVX2(float x, float y, const float* massX, const float* massY, const float* mass,
+			std::size_t count, float& forceX, float& forceY)
+	{
+		const __m256 px = _mm256_set1_ps(x);
+		const __m256 py = _mm256_set1_ps(y);
+		const __m256 soft = _mm256_set1_ps(softening);
+		__m256 sumX = _mm256_setzero_ps();
+		__m256 sumY = _mm256_setzero_ps();
+
+		std::size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256 dx = _mm256_sub_ps(px, _mm256_loadu_ps(massX + i));
+			const __m256 dy = _mm256_sub_ps(py, _mm256_loadu_ps(massY + i));
+			const __m256 distance = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, soft));
+			const __m256 f = _mm256_div_ps(_mm256_loadu_ps(mass + i), distance);
+			sumX = _mm256_fmadd_ps(dx, f, sumX);
+			sumY = _mm256_fmadd_ps(dy, f, sumY);
+		}
+
+		alignas(32) float lanesX[8];
+		alignas(32) float lanesY[8];
+		_mm256_store_ps(lanesX, sumX);
+		_mm256_store_ps(lanesY, sumY);
+		for (int lane = 0; lane < 8; ++lane)
+		{
+			forceX += lanesX[lane];
+			forceY += lanesY[lane];
+		}
+
+		// Avoid the penalty of mixing dirty upper halves with the legacy encoded scalar kernel
+		_mm256_zeroupper();
+		repulsionScalar(x, y, massX + i, massY + i, mass + i, count - i, forceX, forceY);
+	}
+#endif
+
+	const Kernels& getKernels()
+	{
+		static const Kernels kernels = [] () -> Kernels
+		{
+#ifdef GRAPHLAYOUT_X86
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+				return { repulsionAVX2, "avx2" };
+			if (__builtin_cpu_supports("sse2"))
+				return { repulsionSSE, "sse2" };
+#endif
+			return { repulsionScalar, "scalar" };
+		}();
+
+		return kernels;
+	}
+
+	/**
+	 * @brief The masses acting on a node, collected before their forces are accumulated
+	 */
+	struct Interactions
+	{
+		/// @brief The horizontal centers of the masses
+		std::vector<float> x;
+		/// @brief The vertical centers of the masses
+		std::vector<float> y;
+		/// @brief The masses
+		std::vector<float> mass;
+		/// @brief The cells still to visit
+		std::vector<std::uint32_t> stack;
+
+		void add(float massX, float massY, float weight)
+		{
+			x.push_back(massX);
+			y.push_back(massY);
+			mass.push_back(weight);
+		}
+	};
+} // namespace
+
+storage::GraphLayout::GraphLayout(ThreadPool* _pool) :
+		pool(_pool), generation(std::numeric_limits<std::uint64_t>::max()), temperature(0.0f), pinned(noNode),
+		statistics{0, 0.0, 0, getKernels().name}, iterationTime(0) { }
+
+bool storage::GraphLayout::update(const RelationshipGraph& graph, std::uint64_t generation)
+{
+	if (this->generation == generation)
+		return false;
+	this->generation = generation;
+
+	const std::vector<RelationshipGraph::Entity>& all = graph.getEntities();
+	const std::uint32_t pinnedEntity = pinned != noNode ? entities[pinned] : noNode;
+	const std::vector<std::uint32_t> oldNodes = std::move(nodes);
+	const std::vector<float> oldX = std::move(positionX);
+	const std::vector<float> oldY = std::move(positionY);
+	const std::vector<std::uint32_t> oldEntities = std::move(entities);
+	const std::vector<std::pair<std::uint32_t, std::uint32_t>> oldLinks = std::move(links);
+
+	// Number the remaining entities
+	entities.clear();
+	nodes.assign(all.size(), noNode);
+	for (std::uint32_t entity = 0; entity < all.size(); ++entity)
+		if (!all[entity].removed)
+		{
+			nodes[entity] = entities.size();
+			entities.push_back(entity);
+		}
+	pinned = getNode(pinnedEntity);
+
+	// Collect every connected pair once
+	links.clear();
+	for (std::uint32_t node = 0; node < entities.size(); ++node)
+		graph.forEachNeighbor(entities[node],
+			[this, &graph, node] (const RelationshipGraph::Edge& edge)
+			{
+				if (!edge.incoming && graph.isEntity(edge.target) && nodes[edge.target] != node)
+					links.push_back(std::minmax(node, nodes[edge.target]));
+			}
+		);
+	std::sort(links.begin(), links.end());
+	links.erase(std::unique(links.begin(), links.end()), links.end());
+
+	neighborOffsets.assign(entities.size() + 1, 0);
+	for (const auto& [a, b] : links)
+	{
+		++neighborOffsets[a + 1];
+		++neighborOffsets[b + 1];
+	}
+	for (std::size_t i = 1; i < neighborOffsets.size(); ++i)
+		neighborOffsets[i] += neighborOffsets[i - 1];
+	neighbors.resize(links.size() * 2);
+	{
+		std::vector<std::uint32_t> fill(neighborOffsets.begin(), neighborOffsets.end() - 1);
+		for (const auto& [a, b] : links)
+		{
+			neighbors[fill[a]++] = b;
+			neighbors[fill[b]++] = a;
+		}
+	}
+
+	// Keep the positions of known entities
+	positionX.assign(entities.size(), 0.0f);
+	positionY.assign(entities.size(), 0.0f);
+	forceX.assign(entities.size(), 0.0f);
+	forceY.assign(entities.size(), 0.0f);
+	std::vector<bool> placed(entities.size(), false);
+	std::deque<std::uint32_t> queue;
+	for (std::uint32_t node = 0; node < entities.size(); ++node)
+	{
+		const std::uint32_t entity = entities[node];
+		if (entity < oldNodes.size() && oldNodes[entity] != noNode)
+		{
+			positionX[node] = oldX[oldNodes[entity]];
+			positionY[node] = oldY[oldNodes[entity]];
+			placed[node] = true;
+			queue.push_back(node);
+		}
+	}
+	const bool fresh = queue.empty();
+
+	// Place new entities next to a placed neighbor, whole new components at random
+	std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+	std::uniform_real_distribution<float> spread(-1.0f, 1.0f);
+	const float radius = edgeLength * std::sqrt(static_cast<float>(entities.size()));
+	for (std::uint32_t start = 0; start <= entities.size(); ++start)
+	{
+		while (!queue.empty())
+		{
+			const std::uint32_t node = queue.front();
+			queue.pop_front();
+			for (std::uint32_t i = neighborOffsets[node]; i < neighborOffsets[node + 1]; ++i)
+				if (const std::uint32_t neighbor = neighbors[i]; !placed[neighbor])
+				{
+					const float direction = angle(random);
+					positionX[neighbor] = positionX[node] + std::cos(direction) * edgeLength;
+					positionY[neighbor] = positionY[node] + std::sin(direction) * edgeLength;
+					placed[neighbor] = true;
+					queue.push_back(neighbor);
+				}
+		}
+
+		if (start < entities.size() && !placed[start])
+		{
+			positionX[start] = spread(random) * radius;
+			positionY[start] = spread(random) * radius;
+			placed[start] = true;
+			queue.push_back(start);
+		}
+	}
+
+	// Other changes of the library do not disturb a settled layout
+	if (entities == oldEntities && links == oldLinks)
+		return false;
+
+	temperature = std::max(temperature, fresh ? edgeLength * 4.0f : edgeLength);
+	return true;
+}
+
+void storage::GraphLayout::clear()
+{
+	generation = std::numeric_limits<std::uint64_t>::max();
+	entities.clear();
+	nodes.clear();
+	links.clear();
+	positionX.clear();
+	positionY.clear();
+	temperature = 0.0f;
+	pinned = noNode;
+}
+
+void storage::GraphLayout::step(std::chrono::microseconds budget)
+{
+	using Clock = std::chrono::steady_clock;
+
+	statistics.iterations = 0;
+	statistics.stepTime = 0.0;
+	if (entities.empty() || isSettled())
+		return;
+
+	// Stop before an iteration would likely overrun the budget
+	const Clock::time_point start = Clock::now();
+	Clock::time_point now = start;
+	do
+	{
+		iterate();
+		const Clock::time_point end = Clock::now();
+		iterationTime = (iterationTime * 3 + (end - now)) / 4;
+		now = end;
+		++statistics.iterations;
+	}
+	while (!isSettled() && now - start + iterationTime <= budget);
+
+	statistics.totalIterations += statistics.iterations;
+	statistics.stepTime = std::chrono::duration<double, std::milli>(now - start).count();
+}
+
+void storage::GraphLayout::reheat()
+{
+	temperature = std::max(temperature, edgeLength);
+}
+
+void storage::GraphLayout::pin(std::uint32_t node, float x, float y)
+{
+	pinned = node;
+	positionX[node] = x;
+	positionY[node] = y;
+	temperature = std::max(temperature, edgeLength * 0.5f);
+}
+
+void storage::GraphLayout::iterate()
+{
+	buildTree();
+	pool->parallelFor(entities.size(), 64,
+		[this] (std::size_t begin, std::size_t end) { computeForces(begin, end); });
+
+	// Move every node along its force, at most by the temperature
+	for (std::size_t node = 0; node < entities.size(); ++node)
+	{
+		if (node == pinned)
+			continue;
+
+		const float length = std::sqrt(forceX[node] * forceX[node] + forceY[node] * forceY[node]);
+		if (length > 0.0f)
+		{
+			const float scale = std::min(length, temperature) / length;
+			positionX[node] += forceX[node] * scale;
+			positionY[node] += forceY[node] * scale;
+		}
+	}
+	temperature *= cooling;
+}
+
+void storage::GraphLayout::buildTree()
+{
+	const auto [minimumX, maximumX] = std::minmax_element(positionX.begin(), positionX.end());
+	const auto [minimumY, maximumY] = std::minmax_element(positionY.begin(), positionY.end());
+	const float half = std::max(*maximumX - *minimumX, *maximumY - *minimumY) / 2.0f + 1.0f;
+
+	order.resize(entities.size());
+	std::iota(order.begin(), order.end(), 0);
+	sortedX.resize(entities.size());
+	sortedY.resize(entities.size());
+
+	cells.clear();
+	cells.push_back({(*minimumX + *maximumX) / 2.0f, (*minimumY + *maximumY) / 2.0f, half,
+			0.0f, 0.0f, 0.0f, 0, 0});
+	split(0, 0, order.size());
+}
+
+void storage::GraphLayout::split(std::uint32_t index, std::uint32_t begin, std::uint32_t end)
+{
+	// The cell vector grows while the children are split
+	const Cell cell = cells[index];
+
+	if (end - begin <= leafSize || cell.half < minimumHalf)
+	{
+		float x = 0.0f;
+		float y = 0.0f;
+		for (std::uint32_t i = begin; i < end; ++i)
+		{
+			sortedX[i] = positionX[order[i]];
+			sortedY[i] = positionY[order[i]];
+			x += sortedX[i];
+			y += sortedY[i];
+		}
+
+		Cell& leaf = cells[index];
+		leaf.first = begin;
+		leaf.mass = end - begin;
+		if (end > begin)
+		{
+			leaf.massX = x / leaf.mass;
+			leaf.massY = y / leaf.mass;
+		}
+		return;
+	}
+
+	// Sort the nodes by quadrant, the upper half first and the left before the right
+	const auto first = order.begin() + begin;
+	const auto last = order.begin() + end;
+	const auto lower = std::partition(first, last,
+			[this, &cell] (std::uint32_t node) { return positionY[node] < cell.centerY; });
+	const auto upperRight = std::partition(first, lower,
+			[this, &cell] (std::uint32_t node) { return positionX[node] < cell.centerX; });
+	const auto lowerRight = std::partition(lower, last,
+			[this, &cell] (std::uint32_t node) { return positionX[node] < cell.centerX; });
+	const std::uint32_t bounds[5] = {begin, static_cast<std::uint32_t>(upperRight - order.begin()),
+			static_cast<std::uint32_t>(lower - order.begin()), static_cast<std::uint32_t>(lowerRight - order.begin()),
+			end};
+
+	const std::uint32_t children = cells.size();
+	const float quarter = cell.half / 2.0f;
+	for (std::uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+		cells.push_back({cell.centerX + (quadrant & 1 ? quarter : -quarter),
+				cell.centerY + (quadrant & 2 ? quarter : -quarter), quarter,
+				0.0f, 0.0f, 0.0f, 0, 0});
+	cells[index].children = children;
+
+	float mass = 0.0f;
+	float x = 0.0f;
+	float y = 0.0f;
+	for (std::uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+	{
+		split(children + quadrant, bounds[quadrant], bounds[quadrant + 1]);
+
+		const Cell& child = cells[children + quadrant];
+		mass += child.mass;
+		x += child.massX * child.mass;
+		y += child.massY * child.mass;
+	}
+
+	Cell& parent = cells[index];
+	parent.mass = mass;
+	parent.massX = x / mass;
+	parent.massY = y / mass;
+}
+
+void storage::GraphLayout::computeForces(std::size_t begin, std::size_t end)
+{
+	// Reused by every node of the thread, bound once since every access to a thread local is a call
+	thread_local Interactions buffers;
+	Interactions& interactions = buffers;
+	std::vector<std::uint32_t>& stack = interactions.stack;
+
+	const RepulsionFunction repulsion = getKernels().repulsion;
+	for (std::size_t i = begin; i < end; ++i)
+	{
+		const std::uint32_t node = order[i];
+		const float x = positionX[node];
+		const float y = positionY[node];
+
+		// Collect single nodes close by and whole cells far away
+		interactions.x.clear();
+		interactions.y.clear();
+		interactions.mass.clear();
+		stack.assign(1, 0);
+		while (!stack.empty())
+		{
+			const Cell& cell = cells[stack.back()];
+			stack.pop_back();
+			if (cell.mass == 0.0f)
+				continue;
+
+			if (cell.children == 0)
+			{
+				const std::uint32_t last = cell.first + static_cast<std::uint32_t>(cell.mass);
+				for (std::uint32_t j = cell.first; j < last; ++j)
+					if (order[j] != node)
+						interactions.add(sortedX[j], sortedY[j], 1.0f);
+				continue;
+			}
+
+			const float dx = cell.massX - x;
+			const float dy = cell.massY - y;
+			const float size = cell.half * 2.0f;
+			if (size * size < theta * theta * (dx * dx + dy * dy))
+				interactions.add(cell.massX, cell.massY, cell.mass);
+			else
+			{
+				for (std::uint32_t child = cell.children; child < cell.children + 4; ++child)
+					stack.push_back(child);
+			}
+		}
+
+		float fx = 0.0f;
+		float fy = 0.0f;
+		repulsion(x, y, interactions.x.data(), interactions.y.data(), interactions.mass.data(),
+				interactions.mass.size(), fx, fy);
+		fx *= edgeLength * edgeLength;
+		fy *= edgeLength * edgeLength;
+
+		// Relationships pull with the square of their length
+		for (std::uint32_t j = neighborOffsets[node]; j < neighborOffsets[node + 1]; ++j)
+		{
+			const float dx = positionX[neighbors[j]] - x;
+			const float dy = positionY[neighbors[j]] - y;
+			const float f = std::sqrt(dx * dx + dy * dy) / edgeLength;
+			fx += dx * f;
+			fy += dy * f;
+		}
+
+		forceX[node] = fx - x * gravity;
+		forceY[node] = fy - y * gravity;
+	}
+}
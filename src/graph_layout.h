@@ -0,0 +1,257 @@
+#ifndef GRAPH_LAYOUT_H
+#define GRAPH_LAYOUT_H
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+#include "thread_pool.h"
+
+
+
+namespace storage
+{
+	/**
+	 * @brief A force directed layout of a relationship graph
+	 *
+	 * Every entity repels every other entity while relationships pull their
+	 * entities together like springs. The repulsion is approximated by the
+	 * Barnes-Hut method: the entities are sorted into a quadtree and distant
+	 * cells act as a single mass at their center, which brings an iteration
+	 * down from quadratic to about n log n. Leafs hold a few nodes each, which
+	 * keeps the tree shallow and hands the near nodes to the kernels in bulk. The forces of the entities are
+	 * computed in parallel on a thread pool, the repulsion of the collected
+	 * masses is accumulated by vectorized kernels.
+	 *
+	 * The layout cools down over time and stops moving once it settled,
+	 * changes of the graph heat it up again. Positions are stored per entity,
+	 * so a changed graph keeps the arrangement of its unchanged parts.
+	 */
+	class GraphLayout
+	{
+	public:
+		/**
+		 * @brief Measurements of the last step
+		 */
+		struct Statistics
+		{
+			/// @brief The number of iterations run by the last step
+			std::size_t iterations;
+			/// @brief The time taken by the last step in milliseconds
+			double stepTime;
+			/// @brief The number of iterations run since the layout was created
+			std::size_t totalIterations;
+			/// @brief The name of the force accumulation kernels in use
+			const char* kernel;
+		};
+
+		/// @brief The index used for missing nodes
+		static constexpr std::uint32_t noNode = std::numeric_limits<std::uint32_t>::max();
+		/// @brief The preferred length of a relationship
+		static constexpr float edgeLength = 80.0f;
+
+	public:
+		/**
+		 * @brief Construct a new empty layout
+		 *
+		 * @param _pool The threads computing the forces
+		 */
+		GraphLayout(ThreadPool* _pool);
+
+		/**
+		 * @brief Take over the entities and relationships of a graph
+		 *
+		 * Nothing is done if the generation did not change since the last
+		 * update. New entities are placed next to one of their neighbors.
+		 *
+		 * @param graph The graph to lay out
+		 * @param generation A number which changes whenever the graph changed
+		 * @return true If entities or relationships changed
+		 * @return false If the layout was up to date
+		 */
+		bool update(const RelationshipGraph& graph, std::uint64_t generation);
+		/**
+		 * @brief Forget all nodes, the next update places every entity anew
+		 */
+		void clear();
+
+		/**
+		 * @brief Run iterations of the simulation until a time budget is used up
+		 *
+		 * At least one iteration is run unless the layout settled.
+		 *
+		 * @param budget The time the iterations may take
+		 */
+		void step(std::chrono::microseconds budget);
+		/**
+		 * @brief Heat the layout up again, so it moves towards a new equilibrium
+		 */
+		void reheat();
+		/**
+		 * @brief Check if the layout came to rest
+		 *
+		 * @return true If the simulation stopped
+		 * @return false If the nodes are still moving
+		 */
+		bool isSettled() const { return temperature <= minimumTemperature; }
+
+		/**
+		 * @brief Move a node and keep it there until it is released
+		 *
+		 * @param node The index of the node
+		 * @param x The new horizontal position
+		 * @param y The new vertical position
+		 */
+		void pin(std::uint32_t node, float x, float y);
+		/**
+		 * @brief Let a pinned node move freely again
+		 */
+		void release() { pinned = noNode; }
+
+		/**
+		 * @brief Get the number of nodes
+		 *
+		 * @return std::size_t The number of nodes
+		 */
+		std::size_t size() const { return entities.size(); }
+		/**
+		 * @brief Get the entity shown by a node
+		 *
+		 * @param node The index of the node
+		 * @return std::uint32_t The id of the entity
+		 */
+		std::uint32_t getEntity(std::uint32_t node) const { return entities[node]; }
+		/**
+		 * @brief Get the node showing an entity
+		 *
+		 * @param entity The id of the entity
+		 * @return std::uint32_t The index of the node or noNode
+		 */
+		std::uint32_t getNode(std::uint32_t entity) const { return entity < nodes.size() ? nodes[entity] : noNode; }
+		/**
+		 * @brief Get the horizontal positions of all nodes
+		 *
+		 * @return const std::vector<float>& The positions indexed by node
+		 */
+		const std::vector<float>& getX() const { return positionX; }
+		/**
+		 * @brief Get the vertical positions of all nodes
+		 *
+		 * @return const std::vector<float>& The positions indexed by node
+		 */
+		const std::vector<float>& getY() const { return positionY; }
+		/**
+		 * @brief Get the connected pairs of nodes, one pair for all relationships between two entities
+		 *
+		 * @return const std::vector<std::pair<std::uint32_t, std::uint32_t>>& The pairs of node indices
+		 */
+		const std::vector<std::pair<std::uint32_t, std::uint32_t>>& getLinks() const { return links; }
+		/**
+		 * @brief Get the measurements of the last step
+		 *
+		 * @return const Statistics& The statistics
+		 */
+		const Statistics& getStatistics() const { return statistics; }
+
+	private:
+		/**
+		 * @brief A square of the quadtree
+		 */
+		struct Cell
+		{
+			/// @brief The horizontal center of the square
+			float centerX;
+			/// @brief The vertical center of the square
+			float centerY;
+			/// @brief Half the side length of the square
+			float half;
+			/// @brief The horizontal center of mass
+			float massX;
+			/// @brief The vertical center of mass
+			float massY;
+			/// @brief The number of nodes inside the square
+			float mass;
+			/// @brief The first of the four consecutive children, zero for leafs
+			std::uint32_t children;
+			/// @brief The position of the first node of a leaf inside the leaf order
+			std::uint32_t first;
+		};
+
+		/// @brief The temperature below which the layout stops moving
+		static constexpr float minimumTemperature = edgeLength * 0.01f;
+
+		/**
+		 * @brief Run a single iteration of the simulation
+		 */
+		void iterate();
+		/**
+		 * @brief Sort all nodes into the quadtree and compute the centers of mass
+		 */
+		void buildTree();
+		/**
+		 * @brief Split a cell into its quadrants until only few nodes remain per leaf
+		 *
+		 * @param index The index of the cell
+		 * @param begin The position of the first node of the cell inside the leaf order
+		 * @param end The position past the last node
+		 */
+		void split(std::uint32_t index, std::uint32_t begin, std::uint32_t end);
+		/**
+		 * @brief Compute the force acting on a range of nodes
+		 *
+		 * @param begin The first position inside the leaf order
+		 * @param end The position past the last one
+		 */
+		void computeForces(std::size_t begin, std::size_t end);
+
+		/// @brief The threads computing the forces
+		ThreadPool* const pool;
+		/// @brief The generation of the graph at the last update
+		std::uint64_t generation;
+		/// @brief The source of the positions of isolated new nodes
+		std::minstd_rand random;
+
+		/// @brief The entity of every node
+		std::vector<std::uint32_t> entities;
+		/// @brief The node of every entity id
+		std::vector<std::uint32_t> nodes;
+		/// @brief The connected pairs of nodes
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> links;
+		/// @brief The start of the neighbors of every node inside neighbors
+		std::vector<std::uint32_t> neighborOffsets;
+		/// @brief The neighbors of all nodes
+		std::vector<std::uint32_t> neighbors;
+
+		/// @brief The horizontal position of every node
+		std::vector<float> positionX;
+		/// @brief The vertical position of every node
+		std::vector<float> positionY;
+		/// @brief The horizontal force on every node during an iteration
+		std::vector<float> forceX;
+		/// @brief The vertical force on every node during an iteration
+		std::vector<float> forceY;
+		/// @brief The quadtree, the root is the first cell
+		std::vector<Cell> cells;
+		/// @brief The nodes in the order of the quadtree leafs
+		std::vector<std::uint32_t> order;
+		/// @brief The horizontal positions in leaf order
+		std::vector<float> sortedX;
+		/// @brief The vertical positions in leaf order
+		std::vector<float> sortedY;
+
+		/// @brief The maximal distance a node may move per iteration
+		float temperature;
+		/// @brief The node held in place or noNode
+		std::uint32_t pinned;
+		/// @brief The measurements of the last step
+		Statistics statistics;
+		/// @brief The average duration of an iteration
+		std::chrono::nanoseconds iterationTime;
+	};
+} // namespace storage
+
+#endif // GRAPH_LAYOUT_H
@@ -1,7 +1,11 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
 #include <iostream>
 #include <numeric>
 #include "implementation_glfw.h"
 #include "backend.h"
+#include "exceptions.h"
 
 namespace graphics
 {
@@ -50,18 +54,43 @@ namespace graphics
 		}
 	}
 
-	auto SystemWindow::isActive() -> bool
+	auto SystemWindow::isActive(double timeout) -> bool
 	{
 		bool value = !glfwWindowShouldClose(glfwWindow);
 
 		[[likely]] if (value)
 		{
-			glfwPollEvents();
+			if (timeout > 0.0)
+			{
+				glfwWaitEventsTimeout(timeout);
+			}
+			else
+			{
+				glfwPollEvents();
+			}
 		}
 
 		return value;
 	}
 
+	auto SystemWindow::wakeUp() -> void
+	{
+		// glfw must not be called before the first window initialized it or after the last one terminated it
+		std::scoped_lock lockGuard (SystemWindow::globalOperationMutex);
+		if (globalWindowCount > 0)
+		{
+			glfwPostEmptyEvent();
+		}
+	}
+
+	auto SystemWindow::getContentScale() -> float
+	{
+		float xscale;
+		float yscale;
+		glfwGetWindowContentScale(glfwWindow, &xscale, &yscale);
+		return std::max(xscale, yscale);
+	}
+
 #ifdef IMGUI_VULKAN_DEBUG_REPORT
 	static VKAPI_ATTR VkBool32 VKAPI_CALL debug_report(VkDebugReportFlagsEXT flags,
 			VkDebugReportObjectTypeEXT objectType, uint64_t object, size_t location,
@@ -75,9 +104,59 @@ namespace graphics
 	}
 #endif // IMGUI_VULKAN_DEBUG_REPORT
 
+	// Mix data into a hash eight bytes at a time, which is only meant to detect changes and not collision resistant
+	static uint64_t hashBytes(const void* data, size_t size, uint64_t hash)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (; size >= sizeof(uint64_t); bytes += sizeof(uint64_t), size -= sizeof(uint64_t))
+		{
+			uint64_t word;
+			std::memcpy(&word, bytes, sizeof(word));
+			hash = std::rotl(hash ^ (word * 0x9e3779b97f4a7c15ull), 29) * 0xbf58476d1ce4e5b9ull;
+		}
+		uint64_t rest = size;
+		std::memcpy(&rest, bytes, size);
+		return std::rotl(hash ^ (rest * 0x9e3779b97f4a7c15ull), 29) * 0xbf58476d1ce4e5b9ull;
+	}
+
+	template <typename T>
+	static uint64_t hashValue(const T& value, uint64_t hash)
+	{
+		return hashBytes(&value, sizeof(value), hash);
+	}
+
+	// Hash everything the draw data puts on screen, none if a callback draws something unknown
+	static std::optional<uint64_t> hashDrawData(const ImDrawData* drawData)
+	{
+		uint64_t hash = 0x84222325cbf29ce4ull;
+		hash = hashValue(drawData->DisplayPos, hash);
+		hash = hashValue(drawData->DisplaySize, hash);
+		hash = hashValue(drawData->FramebufferScale, hash);
+		hash = hashValue(drawData->CmdListsCount, hash);
+		for (int list = 0; list < drawData->CmdListsCount; ++list)
+		{
+			const ImDrawList* drawList = drawData->CmdLists[list];
+			hash = hashBytes(drawList->VtxBuffer.Data, drawList->VtxBuffer.size_in_bytes(), hash);
+			hash = hashBytes(drawList->IdxBuffer.Data, drawList->IdxBuffer.size_in_bytes(), hash);
+			for (const ImDrawCmd& command : drawList->CmdBuffer)
+			{
+				if (command.UserCallback != nullptr && command.UserCallback != ImDrawCallback_ResetRenderState)
+				{
+					return std::nullopt;
+				}
+				hash = hashValue(command.ClipRect, hash);
+				hash = hashValue(command.TextureId, hash);
+				hash = hashValue(command.VtxOffset, hash);
+				hash = hashValue(command.IdxOffset, hash);
+				hash = hashValue(command.ElemCount, hash);
+			}
+		}
+		return hash;
+	}
+
 	VulkanInstance::ErrorFunction VulkanInstance::error_handler = nullptr;
 
-	VulkanInstance::VulkanInstance(SystemWindow& window) :
+	VulkanInstance::VulkanInstance(SystemWindow& window, const std::filesystem::path& pipelineCachePath) :
 			g_Allocator(VK_NULL_HANDLE),
 			g_Instance(VK_NULL_HANDLE),
 			g_PhysicalDevice(VK_NULL_HANDLE),
@@ -88,7 +167,13 @@ namespace graphics
 			g_MinImageCount(2),
 			g_SwapChainRebuild(false),
 			skipPresentFrame(false),
-			g_PipelineCache(VK_NULL_HANDLE)
+			g_PipelineCache(VK_NULL_HANDLE),
+			pipelineCacheFile(pipelineCachePath),
+			cachedPipelines(false),
+			frameStatistics{0, 0},
+			timestampBits(0),
+			timestampPool(VK_NULL_HANDLE),
+			geometryTimings{}
 	{
 		// Get Required extensions
 		uint32_t extensions_count = 0;
@@ -160,17 +245,21 @@ namespace graphics
 			// (multi-gpu/integrated+dedicated graphics). Handling more complicated
 			// setups (multiple dedicated GPUs) is out of scope of this sample.
 			// TODO Graphics Card Selector in Settings
-			g_PhysicalDevice = gpus.front();
+			g_PhysicalDevice = VK_NULL_HANDLE;
 			for (auto& gpu : gpus)
 			{
-				VkPhysicalDeviceProperties properties;
-				vkGetPhysicalDeviceProperties(gpu, &properties);
-				if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+				vkGetPhysicalDeviceProperties(gpu, &deviceProperties);
+				if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
 				{
 					g_PhysicalDevice = gpu;
 					break;
 				}
 			}
+			if (g_PhysicalDevice == VK_NULL_HANDLE)
+			{
+				g_PhysicalDevice = gpus.front();
+				vkGetPhysicalDeviceProperties(g_PhysicalDevice, &deviceProperties);
+			}
 		}
 
 		{ // Select graphics queue family
@@ -184,6 +273,7 @@ namespace graphics
 				if (queues[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
 				{
 					g_QueueFamily = i;
+					timestampBits = queues[i].timestampValidBits;
 					break;
 				}
 			}
@@ -222,6 +312,20 @@ namespace graphics
 
 			callErrorHandler(vkCreateDevice(g_PhysicalDevice, &create_info, g_Allocator, &g_Device));
 			vkGetDeviceQueue(g_Device, g_QueueFamily, 0, &g_Queue);
+			memoryAllocator = std::make_unique<GpuMemoryAllocator>(g_PhysicalDevice, g_Device, g_Allocator);
+		}
+
+		{ // Create Pipeline Cache
+			// The data of the last run is only used if it came from the same device and driver
+			const std::string data = pipelineCacheFile.load(deviceProperties);
+			cachedPipelines = !data.empty();
+
+			const VkPipelineCacheCreateInfo cache_info{
+				.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+				.initialDataSize = data.size(),
+				.pInitialData = data.data()
+			};
+			callErrorHandler(vkCreatePipelineCache(g_Device, &cache_info, g_Allocator, &g_PipelineCache));
 		}
 
 		{ // Create Descriptor Pool
@@ -267,6 +371,65 @@ namespace graphics
 			{
 				throw std::runtime_error("Error no WSI support on physical device 0");
 			}
+		}
+	}
+
+	VulkanInstance::~VulkanInstance()
+	{
+		callErrorHandler(vkDeviceWaitIdle(g_Device));
+		ImGui_ImplVulkan_Shutdown();
+		ImGui_ImplGlfw_Shutdown();
+		ImGui::DestroyContext();
+
+		ImGui_ImplVulkanH_DestroyWindow(g_Instance, g_Device, &mainData, g_Allocator);
+		destroyTimestampPool();
+		for (auto& upload : fontUploads)
+		{
+			destroyFontUpload(upload);
+		}
+		memoryAllocator.reset();
+		vkDestroyDescriptorPool(g_Device, g_DescriptorPool, g_Allocator);
+
+		// Keep the pipelines compiled during this run for the next one
+		{
+			size_t size = 0;
+			std::string data;
+			if (vkGetPipelineCacheData(g_Device, g_PipelineCache, &size, nullptr) == VK_SUCCESS)
+			{
+				data.resize(size);
+				if (vkGetPipelineCacheData(g_Device, g_PipelineCache, &size, data.data()) == VK_SUCCESS)
+				{
+					data.resize(size);
+					try
+					{
+						pipelineCacheFile.store(deviceProperties, data);
+					}
+					catch (const storage::FileError& error)
+					{
+						std::cerr << "[vulkan] Pipeline cache not saved: " << error.what() << std::endl;
+					}
+				}
+			}
+		}
+		vkDestroyPipelineCache(g_Device, g_PipelineCache, g_Allocator);
+
+#ifdef IMGUI_VULKAN_DEBUG_REPORT
+		// Remove the debug report callback
+		const auto vkDestroyDebugReportCallbackEXT = (PFN_vkDestroyDebugReportCallbackEXT)
+				vkGetInstanceProcAddr(g_Instance, "vkDestroyDebugReportCallbackEXT");
+		vkDestroyDebugReportCallbackEXT(g_Instance, g_DebugReport, g_Allocator);
+#endif // IMGUI_VULKAN_DEBUG_REPORT
+
+		vkDestroyDevice(g_Device, g_Allocator);
+		vkDestroyInstance(g_Instance, g_Allocator);
+	}
+
+	auto VulkanInstance::init(SystemWindow& window) -> void
+	{
+		{ // Setup the swapchain of the Vulkan Window
+			// This is not done by the constructor, which may run on a worker thread
+			// while ImGui is set up. The ImGui helpers allocate through the ImGui
+			// context and glfw only reports the framebuffer size on the main thread.
 
 			// Select Surface Format
 			const std::array requestSurfaceImageFormat{
@@ -316,32 +479,9 @@ namespace graphics
 			ImGui_ImplVulkanH_CreateOrResizeWindow(g_Instance, g_PhysicalDevice,
 					g_Device, &mainData, g_QueueFamily, g_Allocator, width,
 					height, g_MinImageCount);
+			createTimestampPool();
 		}
-	}
-
-	VulkanInstance::~VulkanInstance()
-	{
-		callErrorHandler(vkDeviceWaitIdle(g_Device));
-		ImGui_ImplVulkan_Shutdown();
-		ImGui_ImplGlfw_Shutdown();
-		ImGui::DestroyContext();
-
-		ImGui_ImplVulkanH_DestroyWindow(g_Instance, g_Device, &mainData, g_Allocator);
-		vkDestroyDescriptorPool(g_Device, g_DescriptorPool, g_Allocator);
-
-#ifdef IMGUI_VULKAN_DEBUG_REPORT
-		// Remove the debug report callback
-		const auto vkDestroyDebugReportCallbackEXT = (PFN_vkDestroyDebugReportCallbackEXT)
-				vkGetInstanceProcAddr(g_Instance, "vkDestroyDebugReportCallbackEXT");
-		vkDestroyDebugReportCallbackEXT(g_Instance, g_DebugReport, g_Allocator);
-#endif // IMGUI_VULKAN_DEBUG_REPORT
-
-		vkDestroyDevice(g_Device, g_Allocator);
-		vkDestroyInstance(g_Instance, g_Allocator);
-	}
 
-	auto VulkanInstance::init(SystemWindow& window) -> void
-	{
 		{ // Setup Platform/Renderer backends
 			ImGui_ImplGlfw_InitForVulkan(window.glfwWindow, true);
 			ImGui_ImplVulkan_InitInfo init_info = {
@@ -357,39 +497,13 @@ namespace graphics
 				.ImageCount = mainData.ImageCount,
 				.MSAASamples = VK_SAMPLE_COUNT_1_BIT,
 				.Allocator = g_Allocator,
-				.CheckVkResultFn = callErrorHandler
+				.CheckVkResultFn = callErrorHandler,
+				.MemoryAllocator = memoryAllocator.get()
 			};
 			ImGui_ImplVulkan_Init(&init_info, mainData.RenderPass);
 		}
 
-		{ // FIXME Load Fonts
-			// - If no fonts are loaded, dear imgui will use the default font.
-			//     You can also load multiple fonts and use
-			//     ImGui::PushFont()/PopFont() to select them.
-			// - AddFontFromFileTTF() will return the ImFont* so you can store
-			//     it if you need to select the font among multiple.
-			// - If the file cannot be loaded, the function will return NULL.
-			//     Please handle those errors in your application (e.g. use an
-			//     assertion, or display an error and quit).
-			// - The fonts will be rasterized at a given size (w/ oversampling)
-			//     and stored into a texture when calling
-			//     ImFontAtlas::Build()/GetTexDataAsXXXX(), which
-			//     ImGui_ImplXXXX_NewFrame below will call.
-			// - Read 'docs/FONTS.md' for more instructions and details.
-			// - Remember that in C/C++ if you want to include a backslash \ in
-			//     a string literal you need to write a double backslash \\ !
-			//io.Fonts->AddFontDefault();
-			//io.Fonts->AddFontFromFileTTF("../../misc/fonts/Roboto-Medium.ttf", 16.0f);
-			//io.Fonts->AddFontFromFileTTF("../../misc/fonts/Cousine-Regular.ttf", 15.0f);
-			//io.Fonts->AddFontFromFileTTF("../../misc/fonts/DroidSans.ttf", 16.0f);
-			//io.Fonts->AddFontFromFileTTF("../../misc/fonts/ProggyTiny.ttf", 10.0f);
-			//ImFont* font = io.Fonts->AddFontFromFileTTF(
-			//		"c:\\Windows\\Fonts\\ArialUni.ttf", 18.0f, NULL,
-			//		io.Fonts->GetGlyphRangesJapanese());
-			//IM_ASSERT(font != NULL);
-		}
-
-		{ // Upload Fonts
+		{ // Upload Fonts, which the caller added to the atlas before
 			// Use any command queue
 			VkCommandPool command_pool =
 					mainData.Frames[mainData.FrameIndex].CommandPool;
@@ -432,8 +546,11 @@ namespace graphics
 			ImGui_ImplVulkanH_CreateOrResizeWindow(g_Instance, g_PhysicalDevice,
 					g_Device, &mainData, g_QueueFamily, g_Allocator,
 					width, height, g_MinImageCount);
+			destroyTimestampPool();
+			createTimestampPool();
 			mainData.FrameIndex = 0;
 			g_SwapChainRebuild = false;
+			presentedHash.reset();
 		}
 	}
 
@@ -446,6 +563,14 @@ namespace graphics
 			skipPresentFrame = true;
 			return;
 		}
+		// The image presented last stays on screen, so an unchanged frame needs no new one
+		renderedHash = hashDrawData(drawData);
+		if (renderedHash && renderedHash == presentedHash && fontRegions.empty())
+		{
+			skipPresentFrame = true;
+			++frameStatistics.skipped;
+			return;
+		}
 		skipPresentFrame = false;
 
 		VkSemaphore image_acquired_semaphore =
@@ -477,6 +602,24 @@ namespace graphics
 			callErrorHandler(vkBeginCommandBuffer(frameData->CommandBuffer, &info));
 		}
 
+		// The fence was waited for, so the timestamps of the last use of this frame are written
+		const ImGui_ImplVulkan_GeometryMemory geometry = ImGui_ImplVulkan_GetGeometryMemory();
+		if (timestampPool != VK_NULL_HANDLE)
+		{
+			readTimestamps(mainData.FrameIndex);
+			vkCmdResetQueryPool(frameData->CommandBuffer, timestampPool, mainData.FrameIndex * 2, 2);
+			vkCmdWriteTimestamp(frameData->CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+					timestampPool, mainData.FrameIndex * 2);
+		}
+
+		// Copy the glyphs rasterized since the last frame into the font texture
+		if (!fontRegions.empty())
+		{
+			uploadFontRegions(frameData->CommandBuffer);
+		}
+		// Copies into device-local memory are not allowed inside the render pass
+		ImGui_ImplVulkan_UploadDrawData(drawData, frameData->CommandBuffer);
+
 		{
 			const VkRenderPassBeginInfo info{
 				.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
@@ -499,6 +642,12 @@ namespace graphics
 
 		// Submit command buffer
 		vkCmdEndRenderPass(frameData->CommandBuffer);
+		if (timestampPool != VK_NULL_HANDLE)
+		{
+			vkCmdWriteTimestamp(frameData->CommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+					timestampPool, mainData.FrameIndex * 2 + 1);
+			timestampGeometry[mainData.FrameIndex] = geometry;
+		}
 
 		{
 			const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
@@ -515,6 +664,7 @@ namespace graphics
 			callErrorHandler(vkEndCommandBuffer(frameData->CommandBuffer));
 			callErrorHandler(vkQueueSubmit(g_Queue, 1, &info, frameData->Fence));
 		}
+		++frameStatistics.rendered;
 	}
 
 	auto VulkanInstance::presentFrame() -> void
@@ -540,10 +690,140 @@ namespace graphics
 		}
 
 		callErrorHandler(err);
+		presentedHash = renderedHash;
 		// Now we can use the next set of semaphores
 		mainData.SemaphoreIndex = (mainData.SemaphoreIndex + 1) % mainData.ImageCount;
 	}
 
+	auto VulkanInstance::updateFontTexture(int x, int y, int width, int height) -> void
+	{
+		fontRegions.push_back({
+			.offset = { x, y },
+			.extent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) }
+		});
+	}
+
+	auto VulkanInstance::uploadFontRegions(VkCommandBuffer commandBuffer) -> void
+	{
+		const ImFontAtlas* atlas = ImGui::GetIO().Fonts;
+		VkDeviceSize size = 0;
+		for (const auto& region : fontRegions)
+		{
+			size += VkDeviceSize(region.extent.width) * region.extent.height * 4;
+		}
+
+		// The fence of the frame was waited for, so the staging memory of its arena is free again
+		while (fontUploads.size() <= mainData.FrameIndex)
+		{
+			fontUploads.push_back(FontUpload{ VK_NULL_HANDLE, memoryAllocator->createArena() });
+		}
+		FontUpload& upload = fontUploads[mainData.FrameIndex];
+		destroyFontUpload(upload);
+		memoryAllocator->resetArena(upload.arena);
+
+		const VkBufferCreateInfo buffer_info{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size = size,
+			.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE
+		};
+		callErrorHandler(vkCreateBuffer(g_Device, &buffer_info, g_Allocator, &upload.buffer));
+
+		VkMemoryRequirements requirements;
+		vkGetBufferMemoryRequirements(g_Device, upload.buffer, &requirements);
+		const GpuMemoryAllocator::Allocation memory = memoryAllocator->allocateLinear(requirements,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, upload.arena);
+		callErrorHandler(vkBindBufferMemory(g_Device, upload.buffer, memory.memory, memory.offset));
+
+		// Expand the alpha of the atlas to white RGBA texels like ImFontAtlas::GetTexDataAsRGBA32()
+		std::vector<VkBufferImageCopy> copies;
+		copies.reserve(fontRegions.size());
+		unsigned char* target = static_cast<unsigned char*>(memory.mapped);
+		VkDeviceSize offset = 0;
+		for (const auto& region : fontRegions)
+		{
+			copies.push_back({
+				.bufferOffset = offset,
+				.imageSubresource = {
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.layerCount = 1
+				},
+				.imageOffset = { region.offset.x, region.offset.y, 0 },
+				.imageExtent = { region.extent.width, region.extent.height, 1 }
+			});
+			for (uint32_t row = 0; row < region.extent.height; ++row)
+			{
+				const unsigned char* source = atlas->TexPixelsAlpha8
+						+ size_t(region.offset.y + row) * atlas->TexWidth + region.offset.x;
+				for (uint32_t column = 0; column < region.extent.width; ++column)
+				{
+					target[offset++] = 0xff;
+					target[offset++] = 0xff;
+					target[offset++] = 0xff;
+					target[offset++] = source[column];
+				}
+			}
+		}
+
+		ImGui_ImplVulkan_UpdateFontsTexture(commandBuffer, upload.buffer, copies.data(),
+				static_cast<uint32_t>(copies.size()));
+		fontRegions.clear();
+	}
+
+	auto VulkanInstance::destroyFontUpload(FontUpload& upload) -> void
+	{
+		if (upload.buffer != VK_NULL_HANDLE)
+		{
+			vkDestroyBuffer(g_Device, upload.buffer, g_Allocator);
+		}
+		upload.buffer = VK_NULL_HANDLE;
+	}
+
+	auto VulkanInstance::createTimestampPool() -> void
+	{
+		timestampGeometry.assign(mainData.ImageCount, -1);
+		if (timestampBits == 0 || deviceProperties.limits.timestampPeriod <= 0.0f)
+		{
+			return;
+		}
+
+		const VkQueryPoolCreateInfo info{
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_TIMESTAMP,
+			.queryCount = mainData.ImageCount * 2
+		};
+		callErrorHandler(vkCreateQueryPool(g_Device, &info, g_Allocator, &timestampPool));
+	}
+
+	auto VulkanInstance::destroyTimestampPool() -> void
+	{
+		if (timestampPool != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(g_Device, timestampPool, g_Allocator);
+		}
+		timestampPool = VK_NULL_HANDLE;
+		timestampGeometry.clear();
+	}
+
+	auto VulkanInstance::readTimestamps(uint32_t frame) -> void
+	{
+		const int geometry = timestampGeometry[frame];
+		timestampGeometry[frame] = -1;
+		std::array<uint64_t, 2> timestamps;
+		if (geometry < 0 || vkGetQueryPoolResults(g_Device, timestampPool, frame * 2, 2, sizeof(timestamps),
+				timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+		{
+			return;
+		}
+
+		const uint64_t mask = timestampBits >= 64 ? ~uint64_t(0) : (uint64_t(1) << timestampBits) - 1;
+		const double milliseconds = double((timestamps[1] - timestamps[0]) & mask)
+				* deviceProperties.limits.timestampPeriod / 1e6;
+		GeometryTiming& timing = geometryTimings[geometry];
+		timing.milliseconds = timing.frames == 0 ? milliseconds : timing.milliseconds * 0.95 + milliseconds * 0.05;
+		++timing.frames;
+	}
+
 	auto NewFrame() -> void
 	{
 		ImGui_ImplVulkan_NewFrame();
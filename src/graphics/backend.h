@@ -1,16 +1,23 @@
 #ifndef GRAPHICS_BACKEND_H
 #define GRAPHICS_BACKEND_H
 
+#include <array>
+#include <filesystem>
 #include <mutex>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <string_view>
+#include <vector>
 
 #define GLFW_INCLUDE_NONE
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan.h>
 
+#include "gpu_memory.h"
 #include "implementation_vulkan.h"
+#include "pipeline_cache.h"
 
 //#define IMGUI_UNLIMITED_FRAME_RATE
 #ifdef DEBUG
@@ -51,7 +58,11 @@ namespace graphics
 		SystemWindow& operator=(SystemWindow&&) = delete;
 		SystemWindow& operator=(const SystemWindow&) = delete;
 
-		auto isActive() -> bool;
+		// Handle the events of all windows, waiting up to timeout seconds for the first one
+		auto isActive(double timeout = 0.0) -> bool;
+		auto getContentScale() -> float;
+		// Interrupt the wait of isActive(), callable from any thread
+		static auto wakeUp() -> void;
 	private:
 		::GLFWwindow* glfwWindow;
 	};
@@ -69,6 +80,22 @@ namespace graphics
 	public:
 		using ErrorFunction = std::function<void(VkResult)>;
 
+		// Counts the frames of the main window, frames equal to the presented one are skipped
+		struct FrameStatistics
+		{
+			uint64_t rendered;
+			uint64_t skipped;
+		};
+
+		// The GPU time of the main window's frames with one placement of the geometry
+		struct GeometryTiming
+		{
+			// Moving average over the last few dozen frames
+			double milliseconds;
+			uint64_t frames;
+		};
+		using GeometryTimings = std::array<GeometryTiming, ImGui_ImplVulkan_GeometryMemory_COUNT>;
+
 		static auto setErrorHandler(ErrorFunction function) -> void
 		{
 			error_handler = function;
@@ -88,7 +115,11 @@ namespace graphics
 		static ErrorFunction error_handler;
 
 	public:
-		VulkanInstance(SystemWindow& window);
+		// The constructor only uses thread safe glfw functions and no ImGui
+		// state, so it may run on a worker thread. init() and everything after
+		// it belongs to the main thread. The compiled pipelines are kept in
+		// the pipeline cache file between runs.
+		VulkanInstance(SystemWindow& window, const std::filesystem::path& pipelineCachePath);
 		VulkanInstance(VulkanInstance&&) = delete;
 		VulkanInstance(const VulkanInstance&) = delete;
 		~VulkanInstance();
@@ -102,8 +133,57 @@ namespace graphics
 		auto rebuildSwapchain(SystemWindow& window) -> void;
 		auto render() -> void;
 		auto presentFrame() -> void;
+		// Queue a changed rectangle of the font atlas to be uploaded by the next render()
+		auto updateFontTexture(int x, int y, int width, int height) -> void;
+		// Whether the pipeline cache file matched the device, so init() skips compiling the pipelines
+		inline auto hasCachedPipelines() const -> bool
+		{
+			return cachedPipelines;
+		}
+		// Whether the last render() left the presented image as it was
+		inline auto isFrameSkipped() const -> bool
+		{
+			return skipPresentFrame;
+		}
+		inline auto getFrameStatistics() const -> const FrameStatistics&
+		{
+			return frameStatistics;
+		}
+		inline auto getDeviceProperties() const -> const VkPhysicalDeviceProperties&
+		{
+			return deviceProperties;
+		}
+		// Whether the queue writes timestamps, otherwise there are no geometry timings
+		inline auto hasGpuTimings() const -> bool
+		{
+			return timestampPool != VK_NULL_HANDLE;
+		}
+		// Compares the geometry memory paths on this device, see ImGui_ImplVulkan_SetGeometryMemory()
+		inline auto getGeometryTimings() const -> const GeometryTimings&
+		{
+			return geometryTimings;
+		}
+		// The usage of the device memory shared by the buffers and images of the renderer
+		inline auto getMemoryStatistics() const -> GpuMemoryAllocator::Statistics
+		{
+			return memoryAllocator->getStatistics();
+		}
 
 	private:
+		// A staging buffer for font atlas uploads in a linear arena, one per frame in flight
+		struct FontUpload
+		{
+			VkBuffer buffer;
+			uint32_t arena;
+		};
+
+		auto uploadFontRegions(VkCommandBuffer commandBuffer) -> void;
+		auto destroyFontUpload(FontUpload& upload) -> void;
+		// Two timestamps per frame in flight enclose the upload and drawing of the main window
+		auto createTimestampPool() -> void;
+		auto destroyTimestampPool() -> void;
+		auto readTimestamps(uint32_t frame) -> void;
+
 		ImGui_ImplVulkanH_Window mainData;
 
 		VkAllocationCallbacks* g_Allocator;
@@ -115,11 +195,26 @@ namespace graphics
 		uint32_t g_QueueFamily;
 		VkQueue g_Queue;
 		VkDevice g_Device;
+		VkPhysicalDeviceProperties deviceProperties;
+		std::unique_ptr<GpuMemoryAllocator> memoryAllocator;
 		VkDescriptorPool g_DescriptorPool;
 		unsigned int g_MinImageCount;
 		bool g_SwapChainRebuild;
 		bool skipPresentFrame;
 		VkPipelineCache g_PipelineCache;
+		PipelineCacheFile pipelineCacheFile;
+		bool cachedPipelines;
+		// The hash of the draw data submitted last and of the one on screen, none if unknown
+		std::optional<uint64_t> renderedHash;
+		std::optional<uint64_t> presentedHash;
+		FrameStatistics frameStatistics;
+		std::vector<VkRect2D> fontRegions;
+		std::vector<FontUpload> fontUploads;
+		uint32_t timestampBits;
+		VkQueryPool timestampPool;
+		// The geometry memory the timestamps of each frame were written with, -1 if none are pending
+		std::vector<int> timestampGeometry;
+		GeometryTimings geometryTimings;
 	};
 
 
@@ -0,0 +1,301 @@
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#include "imgui_internal.h"
+
+#include "font_cache.h"
+#include "autosave.h"
+#include "binary.h"
+#include "exceptions.h"
+#include "mapped_file.h"
+
+namespace
+{
+	/// @brief The header of the cache format
+	constexpr std::string_view cacheHeader = "honmonofonts 2";
+
+	static_assert(std::is_trivially_copyable_v<ImFontGlyph>, "The glyphs are cached as they are laid out in memory");
+
+	/**
+	 * @brief Count the glyphs of a font which ImGui adds for custom rectangles when it finishes the atlas
+	 *
+	 * They come after the rasterized glyphs and are left out of the cache, since finishing the restored atlas adds
+	 * them again.
+	 *
+	 * @param atlas The atlas
+	 * @param font The font
+	 * @return int The number of glyphs
+	 */
+	int countCustomGlyphs(const ImFontAtlas* atlas, const ImFont* font)
+	{
+		int count = 0;
+		for (const ImFontAtlasCustomRect& rect : atlas->CustomRects)
+			if (rect.Font == font && rect.GlyphID != 0)
+				++count;
+		return count;
+	}
+
+	/**
+	 * @brief Write a float by its bits
+	 *
+	 * @param writer The writer
+	 * @param value The value to write
+	 */
+	void writeFloat(storage::BinaryWriter& writer, float value)
+	{
+		writer.writeU32(std::bit_cast<std::uint32_t>(value));
+	}
+
+	/**
+	 * @brief Read a float written by writeFloat()
+	 *
+	 * @param reader The reader
+	 * @return float The value
+	 */
+	float readFloat(storage::BinaryReader& reader)
+	{
+		return std::bit_cast<float>(reader.readU32());
+	}
+
+	/**
+	 * @brief Describe a font file the way ImGui expects it
+	 *
+	 * @param font The font file
+	 * @param scale The content scale of the monitor
+	 * @return ImFontConfig The configuration without any font data
+	 */
+	ImFontConfig getConfig(const graphics::FontSource& font, float scale)
+	{
+		ImFontConfig config;
+		config.SizePixels = font.size * scale;
+		config.GlyphRanges = font.ranges;
+		config.MergeMode = font.merge;
+		std::snprintf(config.Name, sizeof(config.Name), "%s, %.0fpx", font.path.filename().c_str(), config.SizePixels);
+		return config;
+	}
+} // namespace
+
+graphics::FontAtlasCache::FontAtlasCache(std::filesystem::path _path) : path(std::move(_path))
+{
+}
+
+bool graphics::FontAtlasCache::build(ImFontAtlas* atlas, const std::vector<FontSource>& fonts, float scale)
+{
+	// Everything the rasterized glyphs depend on goes into the key
+	std::vector<storage::MappedFile> files;
+	files.reserve(fonts.size());
+	std::string description;
+	storage::BinaryWriter writer(description);
+	writer.writeU32(IMGUI_VERSION_NUM);
+	writer.writeU32(sizeof(ImFontGlyph));
+	writeFloat(writer, scale);
+	writer.writeU32(static_cast<std::uint32_t>(atlas->Flags));
+	writer.writeU32(static_cast<std::uint32_t>(atlas->TexDesiredWidth));
+	writer.writeU32(static_cast<std::uint32_t>(atlas->TexGlyphPadding));
+	for (const FontSource& font : fonts)
+	{
+		const storage::MappedFile& file = files.emplace_back(font.path, true);
+		if (file.size() == 0)
+			throw storage::ParsingError("Font file <", font.path.string(), "> is empty.");
+
+		writer.writeU64(storage::fnv1a(file.view()));
+		writeFloat(writer, font.size);
+		writer.writeU8(font.merge);
+		for (const ImWchar* range = font.ranges; range != nullptr && *range != 0; ++range)
+			writer.writeVarint(*range);
+		writer.writeVarint(0);
+	}
+	const std::uint64_t key = storage::fnv1a(description);
+
+	if (restore(atlas, fonts, scale, key))
+		return true;
+
+	// The atlas keeps its own copy of the font data until it is cleared
+	for (std::size_t i = 0; i < fonts.size(); ++i)
+	{
+		ImFontConfig config = getConfig(fonts[i], scale);
+		void* data = IM_ALLOC(files[i].size());
+		std::memcpy(data, files[i].data(), files[i].size());
+		atlas->AddFontFromMemoryTTF(data, static_cast<int>(files[i].size()), config.SizePixels, &config,
+				fonts[i].ranges);
+	}
+	if (!atlas->Build())
+	{
+		atlas->Clear();
+		throw storage::ParsingError("The fonts could not be rasterized.");
+	}
+
+	try
+	{
+		store(atlas, key);
+	}
+	catch (const storage::FileError&)
+	{
+		// Without a cache the atlas is rasterized on every start
+	}
+	return false;
+}
+
+bool graphics::FontAtlasCache::restore(ImFontAtlas* atlas, const std::vector<FontSource>& fonts, float scale,
+		std::uint64_t key)
+{
+	std::error_code error;
+	if (!std::filesystem::exists(path, error))
+		return false;
+
+	try
+	{
+		const storage::MappedFile file(path);
+		storage::BinaryReader reader(file.view());
+		if (reader.readBytes(cacheHeader.size()) != cacheHeader)
+			throw storage::ParsingError("Wrong header.");
+		const std::uint32_t size = reader.readU32();
+		const std::uint32_t checksum = reader.readU32();
+		if (reader.remaining().size() != size || static_cast<std::uint32_t>(storage::fnv1a(reader.remaining())) != checksum)
+			throw storage::ParsingError("Wrong checksum.");
+		if (reader.readU64() != key)
+			return false;
+
+		// The fonts are recreated without their data, which is only needed by the rasterizer
+		for (const FontSource& font : fonts)
+		{
+			ImFontConfig config = getConfig(font, scale);
+			config.FontDataOwnedByAtlas = false;
+			if (!font.merge)
+				atlas->Fonts.push_back(IM_NEW(ImFont));
+			config.DstFont = atlas->Fonts.back();
+			atlas->ConfigData.push_back(config);
+		}
+		if (reader.readVarint() != static_cast<std::uint64_t>(atlas->Fonts.Size))
+			throw storage::ParsingError("Wrong number of fonts.");
+
+		for (ImFont* font : atlas->Fonts)
+		{
+			// Set up like ImGui does before rasterizing, the ellipsis is taken from the config like in AddFont()
+			const float fontSize = readFloat(reader);
+			const float ascent = readFloat(reader);
+			const float descent = readFloat(reader);
+			for (ImFontConfig& config : atlas->ConfigData)
+				if (config.DstFont == font)
+				{
+					if (!config.MergeMode)
+						font->EllipsisChar = config.EllipsisChar;
+					ImFontAtlasBuildSetupFont(atlas, font, &config, ascent, descent);
+				}
+			font->FontSize = fontSize;
+
+			const std::size_t glyphs = reader.readVarint();
+			const std::string_view data = reader.readBytes(glyphs * sizeof(ImFontGlyph));
+			font->Glyphs.resize(static_cast<int>(glyphs));
+			std::memcpy(font->Glyphs.Data, data.data(), data.size());
+		}
+
+		// The mouse cursors and the line textures live in custom rectangles
+		for (std::uint64_t rects = reader.readVarint(); rects > 0; --rects)
+		{
+			ImFontAtlasCustomRect rect;
+			rect.Width = static_cast<unsigned short>(reader.readVarint());
+			rect.Height = static_cast<unsigned short>(reader.readVarint());
+			rect.X = static_cast<unsigned short>(reader.readVarint());
+			rect.Y = static_cast<unsigned short>(reader.readVarint());
+			rect.GlyphID = static_cast<unsigned int>(reader.readVarint());
+			rect.GlyphAdvanceX = readFloat(reader);
+			rect.GlyphOffset.x = readFloat(reader);
+			rect.GlyphOffset.y = readFloat(reader);
+			const std::uint64_t font = reader.readVarint();
+			if (font > static_cast<std::uint64_t>(atlas->Fonts.Size))
+				throw storage::ParsingError("Wrong font of a custom rectangle.");
+			rect.Font = font == 0 ? nullptr : atlas->Fonts[static_cast<int>(font - 1)];
+			atlas->CustomRects.push_back(rect);
+		}
+		atlas->PackIdMouseCursors = static_cast<int>(reader.readSignedVarint());
+		atlas->PackIdLines = static_cast<int>(reader.readSignedVarint());
+
+		atlas->TexWidth = static_cast<int>(reader.readU32());
+		atlas->TexHeight = static_cast<int>(reader.readU32());
+		atlas->TexUvScale.x = readFloat(reader);
+		atlas->TexUvScale.y = readFloat(reader);
+		atlas->TexUvWhitePixel.x = readFloat(reader);
+		atlas->TexUvWhitePixel.y = readFloat(reader);
+		const std::string_view lines = reader.readBytes(sizeof(atlas->TexUvLines));
+		std::memcpy(atlas->TexUvLines, lines.data(), lines.size());
+		const std::string_view pixels = reader.readBytes(static_cast<std::size_t>(atlas->TexWidth) * atlas->TexHeight);
+		if (!reader.empty())
+			throw storage::ParsingError("Trailing data.");
+		atlas->TexPixelsAlpha8 = static_cast<unsigned char*>(IM_ALLOC(pixels.size()));
+		std::memcpy(atlas->TexPixelsAlpha8, pixels.data(), pixels.size());
+	}
+	catch (const storage::FileError&)
+	{
+		// A damaged cache is rasterized again and replaced
+		atlas->Clear();
+		return false;
+	}
+
+	// Renders the cursors and lines again, adds the glyphs of the custom rectangles and builds the lookup tables
+	// with the fallback and ellipsis characters
+	atlas->TexPixelsUseColors = false;
+	ImFontAtlasBuildFinish(atlas);
+	return true;
+}
+
+void graphics::FontAtlasCache::store(const ImFontAtlas* atlas, std::uint64_t key)
+{
+	// Colored glyphs only end up in the RGBA texture, which is four times larger and not worth caching
+	if (atlas->TexPixelsAlpha8 == nullptr)
+		return;
+
+	std::string payload;
+	storage::BinaryWriter writer(payload);
+	writer.writeU64(key);
+
+	writer.writeVarint(static_cast<std::uint64_t>(atlas->Fonts.Size));
+	for (const ImFont* font : atlas->Fonts)
+	{
+		writeFloat(writer, font->FontSize);
+		writeFloat(writer, font->Ascent);
+		writeFloat(writer, font->Descent);
+		const int glyphs = font->Glyphs.Size - countCustomGlyphs(atlas, font);
+		writer.writeVarint(static_cast<std::uint64_t>(glyphs));
+		writer.writeBytes(std::string_view(reinterpret_cast<const char*>(font->Glyphs.Data),
+				glyphs * sizeof(ImFontGlyph)));
+	}
+
+	writer.writeVarint(static_cast<std::uint64_t>(atlas->CustomRects.Size));
+	for (const ImFontAtlasCustomRect& rect : atlas->CustomRects)
+	{
+		writer.writeVarint(rect.Width);
+		writer.writeVarint(rect.Height);
+		writer.writeVarint(rect.X);
+		writer.writeVarint(rect.Y);
+		writer.writeVarint(rect.GlyphID);
+		writeFloat(writer, rect.GlyphAdvanceX);
+		writeFloat(writer, rect.GlyphOffset.x);
+		writeFloat(writer, rect.GlyphOffset.y);
+		std::uint64_t font = 0;
+		for (int i = 0; i < atlas->Fonts.Size; ++i)
+			if (atlas->Fonts[i] == rect.Font)
+				font = i + 1;
+		writer.writeVarint(font);
+	}
+	writer.writeSignedVarint(atlas->PackIdMouseCursors);
+	writer.writeSignedVarint(atlas->PackIdLines);
+
+	writer.writeU32(static_cast<std::uint32_t>(atlas->TexWidth));
+	writer.writeU32(static_cast<std::uint32_t>(atlas->TexHeight));
+	writeFloat(writer, atlas->TexUvScale.x);
+	writeFloat(writer, atlas->TexUvScale.y);
+	writeFloat(writer, atlas->TexUvWhitePixel.x);
+	writeFloat(writer, atlas->TexUvWhitePixel.y);
+	writer.writeBytes(std::string_view(reinterpret_cast<const char*>(atlas->TexUvLines), sizeof(atlas->TexUvLines)));
+	writer.writeBytes(std::string_view(reinterpret_cast<const char*>(atlas->TexPixelsAlpha8),
+			static_cast<std::size_t>(atlas->TexWidth) * atlas->TexHeight));
+
+	std::string content(cacheHeader);
+	storage::BinaryWriter header(content);
+	header.writeU32(static_cast<std::uint32_t>(payload.size()));
+	header.writeU32(static_cast<std::uint32_t>(storage::fnv1a(payload)));
+	storage::writeFileAtomically(path, content += payload);
+}
@@ -0,0 +1,91 @@
+#ifndef FONT_CACHE_H
+#define FONT_CACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+#include "imgui_tools.h"
+
+
+
+namespace graphics
+{
+	/**
+	 * @brief A font file added to the font atlas
+	 */
+	struct FontSource
+	{
+		/// @brief The font file
+		std::filesystem::path path;
+		/// @brief The size in pixels before the content scale is applied
+		float size;
+		/// @brief The ranges of glyphs to rasterize, owned by the caller
+		const ImWchar* ranges;
+		/// @brief Whether the glyphs are merged into the previous font instead of creating a font of their own
+		bool merge;
+	};
+
+	/**
+	 * @brief Stores the rasterized font atlas on disk so it is only built once
+	 *
+	 * Rasterizing the Japanese glyph ranges takes far longer than the rest of
+	 * the startup. The cache holds the texture of the atlas together with the
+	 * glyph tables of every font and is keyed by the content of the font
+	 * files, their sizes and ranges, the content scale and the ImGui version.
+	 * On a hit the fonts are recreated from the tables without touching the
+	 * rasterizer and the texture is handed to the renderer as it is. Any
+	 * change of the key or a damaged cache rebuilds the atlas and replaces
+	 * the cache.
+	 */
+	class FontAtlasCache
+	{
+	public:
+		/**
+		 * @brief Construct a new cache
+		 *
+		 * @param _path The file the atlas is cached in
+		 */
+		FontAtlasCache(std::filesystem::path _path);
+
+		/**
+		 * @brief Fill an empty atlas with fonts, from the cache if possible
+		 *
+		 * A font file which can not be read throws a FileError and leaves
+		 * the atlas empty. Failing to write the cache is not an error.
+		 *
+		 * @param atlas The atlas to fill
+		 * @param fonts The font files, the first one must not be merged
+		 * @param scale The content scale of the monitor
+		 * @return true If the atlas came from the cache
+		 * @return false If it was rasterized
+		 */
+		bool build(ImFontAtlas* atlas, const std::vector<FontSource>& fonts, float scale);
+
+	private:
+		/**
+		 * @brief Recreate the atlas from the cache
+		 *
+		 * @param atlas The empty atlas
+		 * @param fonts The font files
+		 * @param scale The content scale of the monitor
+		 * @param key The key the cache has to match
+		 * @return true If the cache matched
+		 * @return false If the cache is missing, outdated or damaged, the atlas is left empty
+		 */
+		bool restore(ImFontAtlas* atlas, const std::vector<FontSource>& fonts, float scale, std::uint64_t key);
+		/**
+		 * @brief Write a freshly built atlas to the cache
+		 *
+		 * @param atlas The built atlas
+		 * @param key The key of the atlas
+		 */
+		void store(const ImFontAtlas* atlas, std::uint64_t key);
+
+		/// @brief The file the atlas is cached in
+		const std::filesystem::path path;
+	};
+} // namespace graphics
+
+#endif // FONT_CACHE_H
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <limits>
+
+#include "frame_pacer.h"
+
+namespace
+{
+	/**
+	 * @brief Check if the last frame handled input which changes the next one
+	 *
+	 * ImGui repeats held keys by itself and drag operations move with every
+	 * frame, so both keep rendering without any new event.
+	 *
+	 * @return true If the input is still going on
+	 */
+	bool hasOngoingInput()
+	{
+		const ImGuiIO& io = ImGui::GetIO();
+		if (io.MouseDelta.x != 0.0f || io.MouseDelta.y != 0.0f || io.MouseWheel != 0.0f || io.MouseWheelH != 0.0f)
+			return true;
+		if (ImGui::IsAnyMouseDown() || ImGui::IsAnyItemActive())
+			return true;
+
+		for (int key = ImGuiKey_NamedKey_BEGIN; key < ImGuiKey_NamedKey_END; ++key)
+			if (ImGui::IsKeyDown(static_cast<ImGuiKey>(key)))
+				return true;
+		return false;
+	}
+} // namespace
+
+std::atomic<graphics::FramePacer::Clock::rep> graphics::FramePacer::requested(
+		std::numeric_limits<graphics::FramePacer::Clock::rep>::max());
+
+graphics::FramePacer::FramePacer() : pendingFrames(settleFrames), lastFrame(Clock::now()), frameSkipped(false)
+{
+}
+
+void graphics::FramePacer::requestFrame(double delay)
+{
+	const Clock::rep due = (Clock::now() + std::chrono::duration_cast<Clock::duration>(
+			std::chrono::duration<double>(delay))).time_since_epoch().count();
+	Clock::rep current = requested.load(std::memory_order_relaxed);
+	while (due < current && !requested.compare_exchange_weak(current, due, std::memory_order_relaxed))
+	{
+	}
+
+	if (delay <= 0.0)
+		SystemWindow::wakeUp();
+}
+
+bool graphics::FramePacer::waitForFrame(SystemWindow& window)
+{
+	const double timeout = getTimeout();
+	const Clock::time_point start = Clock::now();
+	if (!window.isActive(timeout))
+		return false;
+
+	// Returning before the timeout means an event arrived, which includes the wake up of requestFrame()
+	lastFrame = Clock::now();
+	if (timeout > 0.0 && lastFrame - start < std::chrono::duration<double>(timeout))
+		pendingFrames = settleFrames;
+	return true;
+}
+
+double graphics::FramePacer::getTimeout()
+{
+	// Every request up to now is served by the next frame
+	const Clock::rep due = requested.exchange(std::numeric_limits<Clock::rep>::max(), std::memory_order_relaxed);
+
+	bool focused = false;
+	bool minimized = true;
+	const ImGuiPlatformIO& platform = ImGui::GetPlatformIO();
+	for (ImGuiViewport* viewport : platform.Viewports)
+	{
+		if (platform.Platform_GetWindowFocus != nullptr && platform.Platform_GetWindowFocus(viewport))
+			focused = true;
+		if (platform.Platform_GetWindowMinimized == nullptr || !platform.Platform_GetWindowMinimized(viewport))
+			minimized = false;
+	}
+	if (minimized)
+		return idleTimeout;
+
+	if (hasOngoingInput())
+		pendingFrames = settleFrames;
+
+	double timeout = idleTimeout;
+	if (pendingFrames > 0)
+	{
+		--pendingFrames;
+		timeout = 0.0;
+	}
+	else if (ImGui::GetIO().WantTextInput)
+		timeout = blinkInterval;
+
+	if (due != std::numeric_limits<Clock::rep>::max())
+	{
+		const Clock::time_point dueTime{ Clock::duration(due) };
+		timeout = std::min(timeout, std::max(std::chrono::duration<double>(dueTime - Clock::now()).count(), 0.0));
+	}
+
+	// Without focus or a presented frame the frames are spaced out, glfw only waits for a positive timeout
+	const double elapsed = std::chrono::duration<double>(Clock::now() - lastFrame).count();
+	if (!focused)
+		timeout = std::max(timeout, unfocusedInterval - elapsed);
+	if (frameSkipped)
+		timeout = std::max(timeout, skippedInterval - elapsed);
+	return timeout;
+}
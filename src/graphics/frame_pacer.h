@@ -0,0 +1,100 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <atomic>
+#include <chrono>
+
+#include "backend.h"
+
+
+
+namespace graphics
+{
+	/**
+	 * @brief Renders frames only when something changed
+	 *
+	 * Rendering continuously keeps a core and the GPU busy while the user is
+	 * just reading. Between frames the main loop waits for events instead, as
+	 * long as the last frame showed nothing moving:
+	 *
+	 * - After an event a few frames are rendered, so hovered items and
+	 *   layouts depending on the previous frame settle.
+	 * - Held keys and mouse buttons and an active item keep rendering.
+	 * - A text cursor is kept blinking at a low rate.
+	 * - Windows and background threads ask for frames with requestFrame().
+	 *
+	 * Without input focus the frame rate is limited, minimized windows only
+	 * wake up for the periodic work of the main loop. Frames the renderer
+	 * skipped are not paced by the display, so they are limited as well.
+	 */
+	class FramePacer
+	{
+	public:
+		/// @brief The number of frames rendered after an event
+		static constexpr int settleFrames = 3;
+		/// @brief The longest wait in seconds, so the periodic work of the main loop keeps running
+		static constexpr double idleTimeout = 0.5;
+		/// @brief The time in seconds between frames while a text cursor blinks
+		static constexpr double blinkInterval = 0.2;
+		/// @brief The shortest time in seconds between frames while no window has the input focus
+		static constexpr double unfocusedInterval = 0.1;
+		/// @brief The time in seconds between frames showing the progress of a background thread
+		static constexpr double progressInterval = 0.1;
+		/// @brief The shortest time in seconds between frames which were not presented
+		static constexpr double skippedInterval = 1.0 / 60.0;
+
+	public:
+		/**
+		 * @brief Construct a new pacer, which renders the first frames right away
+		 */
+		FramePacer();
+
+		/**
+		 * @brief Ask for a frame to be rendered
+		 *
+		 * Callable from any thread, a delay is only meant for the main thread
+		 * while it builds a frame, like a progress bar asking to be updated.
+		 *
+		 * @param delay The time in seconds the frame may be rendered after
+		 */
+		static void requestFrame(double delay = 0.0);
+
+		/**
+		 * @brief Wait until the next frame is due and handle the events
+		 *
+		 * @param window The main window
+		 * @return true If the next frame should be rendered
+		 * @return false If the main window was closed
+		 */
+		bool waitForFrame(SystemWindow& window);
+
+		/**
+		 * @brief Tell whether the last frame was presented or skipped by the renderer
+		 *
+		 * @param skipped Whether the frame was skipped
+		 */
+		void setFrameSkipped(bool skipped) { frameSkipped = skipped; }
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		/**
+		 * @brief Decide how long to wait for events after the last frame
+		 *
+		 * @return double The timeout in seconds, zero to render right away
+		 */
+		double getTimeout();
+
+		/// @brief The time the earliest requested frame is due, Clock::duration::max() if none is requested
+		static std::atomic<Clock::rep> requested;
+
+		/// @brief The number of frames still to render right away
+		int pendingFrames;
+		/// @brief The time the last wait ended
+		Clock::time_point lastFrame;
+		/// @brief Whether the last frame was skipped by the renderer
+		bool frameSkipped;
+	};
+} // namespace graphics
+
+#endif // FRAME_PACER_H
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "imstb_truetype.h"
+
+#include "glyph_cache.h"
+
+struct graphics::GlyphCache::Face
+{
+	/// @brief The parsed font file
+	stbtt_fontinfo info;
+	/// @brief The scale from font units to pixels
+	float scale;
+};
+
+graphics::GlyphCache* graphics::GlyphCache::attached = nullptr;
+
+graphics::GlyphCache::GlyphCache() :
+		atlas(nullptr), font(nullptr), head(-1), tail(-1), resident(0), pendingRow(0), poolTop(0), cellSize(0),
+		cellsPerRow(0), frame(1)
+{
+}
+
+graphics::GlyphCache::~GlyphCache()
+{
+	if (attached == this)
+		attached = nullptr;
+}
+
+void graphics::GlyphCache::attach(ImFontAtlas* _atlas, const std::vector<std::filesystem::path>& paths, float size)
+{
+	IM_ASSERT(atlas == nullptr && _atlas->TexPixelsAlpha8 != nullptr && !_atlas->Fonts.empty());
+	for (const std::filesystem::path& path : paths)
+	{
+		const storage::MappedFile& file = files.emplace_back(path);
+		const unsigned char* data = reinterpret_cast<const unsigned char*>(file.data());
+		Face face;
+		if (file.size() != 0 && stbtt_InitFont(&face.info, data, stbtt_GetFontOffsetForIndex(data, 0)))
+		{
+			face.scale = stbtt_ScaleForPixelHeight(&face.info, size);
+			faces.push_back(face);
+		}
+	}
+
+	atlas = _atlas;
+	font = atlas->Fonts[0];
+	cellSize = static_cast<int>(std::ceil(font->FontSize)) + 2;
+	cellsPerRow = std::max(atlas->TexWidth / cellSize, 1);
+	const int cellRows = static_cast<int>((glyphCapacity + cellsPerRow - 1) / cellsPerRow);
+
+	std::size_t slots = 0;
+	for (const ImWchar* range = dynamicRanges; range[0] != 0; range += 2)
+		slots += range[1] - range[0] + 1;
+	lookup.assign(slots, unknownGlyph);
+
+	// Append the transparent row and the pool to the texture, which moves the existing texture coordinates
+	const int width = atlas->TexWidth;
+	const int oldHeight = atlas->TexHeight;
+	pendingRow = oldHeight;
+	poolTop = pendingRow + 1;
+	const int height = poolTop + cellRows * cellSize;
+
+	unsigned char* pixels = static_cast<unsigned char*>(IM_ALLOC(static_cast<std::size_t>(width) * height));
+	std::memcpy(pixels, atlas->TexPixelsAlpha8, static_cast<std::size_t>(width) * oldHeight);
+	std::memset(pixels + static_cast<std::size_t>(width) * oldHeight, 0,
+			static_cast<std::size_t>(width) * (height - oldHeight));
+	IM_FREE(atlas->TexPixelsAlpha8);
+	atlas->TexPixelsAlpha8 = pixels;
+	if (atlas->TexPixelsRGBA32 != nullptr)
+	{
+		IM_FREE(atlas->TexPixelsRGBA32);
+		atlas->TexPixelsRGBA32 = nullptr;
+	}
+
+	const float ratio = static_cast<float>(oldHeight) / height;
+	for (ImFont* other : atlas->Fonts)
+		for (ImFontGlyph& glyph : other->Glyphs)
+		{
+			glyph.V0 *= ratio;
+			glyph.V1 *= ratio;
+		}
+	atlas->TexUvWhitePixel.y *= ratio;
+	for (ImVec4& line : atlas->TexUvLines)
+	{
+		line.y *= ratio;
+		line.w *= ratio;
+	}
+	atlas->TexHeight = height;
+	atlas->TexUvScale.y = 1.0f / height;
+
+	// All cells start out free
+	cells.resize(static_cast<std::size_t>(cellRows) * cellsPerRow);
+	for (std::size_t i = 0; i < cells.size(); ++i)
+		cells[i] = { -1, static_cast<int>(i) - 1, i + 1 < cells.size() ? static_cast<int>(i) + 1 : -1, 0 };
+	head = 0;
+	tail = static_cast<int>(cells.size()) - 1;
+	attached = this;
+}
+
+void graphics::GlyphCache::request(std::string_view text)
+{
+	if (attached != nullptr)
+		attached->collect(text);
+}
+
+std::span<const graphics::GlyphCache::Region> graphics::GlyphCache::update()
+{
+	regions.clear();
+	if (atlas == nullptr)
+		return regions;
+
+	for (const int glyph : queued)
+		if (!rasterize(glyph))
+			break;
+	queued.clear();
+	++frame;
+	return regions;
+}
+
+void graphics::GlyphCache::collect(std::string_view text)
+{
+	// The ideographs are encoded in three bytes with lead bytes 0xe4 to 0xe9, everything else is skipped quickly
+	bool added = false;
+	for (std::size_t i = 0; i < text.size(); ++i)
+	{
+		const unsigned char lead = static_cast<unsigned char>(text[i]);
+		if (lead < 0xe4 || lead > 0xe9 || i + 2 >= text.size())
+			continue;
+		const unsigned char second = static_cast<unsigned char>(text[i + 1]);
+		const unsigned char third = static_cast<unsigned char>(text[i + 2]);
+		if ((second & 0xc0) != 0x80 || (third & 0xc0) != 0x80)
+			continue;
+		const unsigned int codepoint = (lead & 0x0fu) << 12 | (second & 0x3fu) << 6 | (third & 0x3fu);
+		i += 2;
+
+		std::size_t slot = 0;
+		const ImWchar* range = dynamicRanges;
+		for (; range[0] != 0; range += 2)
+		{
+			if (codepoint >= range[0] && codepoint <= range[1])
+				break;
+			slot += range[1] - range[0] + 1;
+		}
+		if (range[0] == 0)
+			continue;
+		slot += codepoint - range[0];
+
+		if (lookup[slot] == unknownGlyph)
+		{
+			lookup[slot] = addGlyph(codepoint);
+			added = added || lookup[slot] != missingGlyph;
+		}
+		const int glyph = lookup[slot];
+		if (glyph == missingGlyph)
+			continue;
+
+		Glyph& entry = glyphs[glyph];
+		if (entry.cell != -1)
+			touch(entry.cell);
+		else if (entry.requested != frame)
+		{
+			entry.requested = frame;
+			queued.push_back(glyph);
+		}
+	}
+
+	// The text is laid out after the request, so the new glyphs have to be found right away
+	if (added)
+		font->BuildLookupTable();
+}
+
+int graphics::GlyphCache::addGlyph(unsigned int codepoint)
+{
+	if (font->FindGlyphNoFallback(static_cast<ImWchar>(codepoint)) != nullptr)
+		return missingGlyph;
+
+	// The ideograph takes its metrics from the first face containing it, the texture coordinates follow on demand
+	const float ascent = std::round(font->Ascent);
+	for (std::size_t i = 0; i < faces.size(); ++i)
+	{
+		const int index = stbtt_FindGlyphIndex(&faces[i].info, static_cast<int>(codepoint));
+		if (index == 0)
+			continue;
+
+		int advance;
+		int bearing;
+		int x0;
+		int y0;
+		int x1;
+		int y1;
+		stbtt_GetGlyphHMetrics(&faces[i].info, index, &advance, &bearing);
+		stbtt_GetGlyphBitmapBox(&faces[i].info, index, faces[i].scale, faces[i].scale, &x0, &y0, &x1, &y1);
+		x1 = std::min(x1, x0 + cellSize - 2);
+		y1 = std::min(y1, y0 + cellSize - 2);
+
+		font->AddGlyph(nullptr, static_cast<ImWchar>(codepoint), static_cast<float>(x0), y0 + ascent,
+				static_cast<float>(x1), y1 + ascent, 0.0f, 0.0f, 0.0f, 0.0f, advance * faces[i].scale);
+		glyphs.push_back({ static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(index),
+				font->Glyphs.Size - 1, -1, 0 });
+		const int glyph = static_cast<int>(glyphs.size()) - 1;
+		setPending(glyph);
+		return glyph;
+	}
+	return missingGlyph;
+}
+
+void graphics::GlyphCache::touch(int cell)
+{
+	cells[cell].used = frame;
+	if (cell == head)
+		return;
+
+	// Unlink the cell and put it in front
+	Cell& entry = cells[cell];
+	cells[entry.previous].next = entry.next;
+	if (entry.next != -1)
+		cells[entry.next].previous = entry.previous;
+	else
+		tail = entry.previous;
+	entry.previous = -1;
+	entry.next = head;
+	cells[head].previous = cell;
+	head = cell;
+}
+
+bool graphics::GlyphCache::rasterize(int glyph)
+{
+	// Free cells are never requested and sink to the end of the order, so the tail is free or the oldest
+	const int cell = tail;
+	if (cells[cell].used == frame)
+		return false;
+	if (cells[cell].glyph != -1)
+	{
+		glyphs[cells[cell].glyph].cell = -1;
+		setPending(cells[cell].glyph);
+	}
+	else
+		++resident;
+
+	// The cell keeps a transparent border, so filtering never reaches into the neighbours
+	const int cellX = cell % cellsPerRow * cellSize;
+	const int cellY = poolTop + cell / cellsPerRow * cellSize;
+	const int width = atlas->TexWidth;
+	for (int row = 0; row < cellSize; ++row)
+		std::memset(atlas->TexPixelsAlpha8 + static_cast<std::size_t>(cellY + row) * width + cellX, 0, cellSize);
+
+	Glyph& entry = glyphs[glyph];
+	ImFontGlyph& fontGlyph = font->Glyphs[entry.fontGlyph];
+	const Face& face = faces[entry.face];
+	const int glyphWidth = static_cast<int>(fontGlyph.X1 - fontGlyph.X0);
+	const int glyphHeight = static_cast<int>(fontGlyph.Y1 - fontGlyph.Y0);
+	stbtt_MakeGlyphBitmap(&face.info, atlas->TexPixelsAlpha8 + static_cast<std::size_t>(cellY + 1) * width + cellX + 1,
+			glyphWidth, glyphHeight, width, face.scale, face.scale, static_cast<int>(entry.index));
+
+	fontGlyph.U0 = (cellX + 1) * atlas->TexUvScale.x;
+	fontGlyph.V0 = (cellY + 1) * atlas->TexUvScale.y;
+	fontGlyph.U1 = (cellX + 1 + glyphWidth) * atlas->TexUvScale.x;
+	fontGlyph.V1 = (cellY + 1 + glyphHeight) * atlas->TexUvScale.y;
+	entry.cell = cell;
+	cells[cell].glyph = glyph;
+	touch(cell);
+
+	regions.push_back({ cellX, cellY, cellSize, cellSize });
+	return true;
+}
+
+void graphics::GlyphCache::setPending(int glyph)
+{
+	// A degenerated quad samples the center of a texel in the transparent row
+	ImFontGlyph& fontGlyph = font->Glyphs[glyphs[glyph].fontGlyph];
+	fontGlyph.U0 = fontGlyph.U1 = 0.5f * atlas->TexUvScale.x;
+	fontGlyph.V0 = fontGlyph.V1 = (pendingRow + 0.5f) * atlas->TexUvScale.y;
+}
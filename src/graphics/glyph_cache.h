@@ -0,0 +1,238 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "imgui_tools.h"
+#include "mapped_file.h"
+
+
+
+namespace graphics
+{
+	/**
+	 * @brief Rasterizes the CJK ideographs of a font when they are first drawn
+	 *
+	 * Baking all ideographs into the font atlas up front takes long and
+	 * creates a huge texture, while a document only uses a few thousand of
+	 * them. The atlas is therefore built with the static ranges only and the
+	 * cache appends a pool of cells to its texture, each holding one
+	 * rasterized glyph, reused in least recently used order once all are
+	 * taken.
+	 *
+	 * Windows pass the text they submit to request(). An ideograph seen for
+	 * the first time is looked up in the font files and added to the font
+	 * with its real metrics, so text is laid out correctly, but with texture
+	 * coordinates pointing at a transparent texel. After ImGui::Render() the
+	 * requested ideographs are rasterized into cells and show up from the
+	 * next frame on. Requesting a rasterized ideograph marks its cell as
+	 * used. Only the changed cells have to be uploaded to the texture.
+	 */
+	class GlyphCache
+	{
+	public:
+		/// @brief The ranges rasterized with the atlas, Latin, Japanese punctuation and kana
+		static constexpr ImWchar staticRanges[] = {
+			0x0020, 0x00ff, // Basic Latin and Latin-1 Supplement
+			0x2000, 0x206f, // General Punctuation
+			0x3000, 0x30ff, // CJK Symbols and Punctuation, Hiragana, Katakana
+			0x31f0, 0x31ff, // Katakana Phonetic Extensions
+			0xff00, 0xffef, // Half-width characters
+			0xfffd, 0xfffd, // Invalid
+			0
+		};
+		/// @brief The ranges rasterized on demand, the CJK Unified Ideographs
+		static constexpr ImWchar dynamicRanges[] = {
+			0x4e00, 0x9faf,
+			0
+		};
+		/// @brief The number of glyphs which stay rasterized at the same time
+		static constexpr std::size_t glyphCapacity = 4096;
+
+		/**
+		 * @brief A changed rectangle of the atlas texture in pixels
+		 */
+		struct Region
+		{
+			/// @brief The left edge
+			int x;
+			/// @brief The top edge
+			int y;
+			/// @brief The width
+			int width;
+			/// @brief The height
+			int height;
+		};
+
+	public:
+		/**
+		 * @brief Construct a new cache which is not attached to any atlas
+		 */
+		GlyphCache();
+		GlyphCache(const GlyphCache&) = delete;
+		~GlyphCache();
+
+		GlyphCache& operator=(const GlyphCache&) = delete;
+
+		/**
+		 * @brief Prepare the first font of a built atlas for the ideographs
+		 *
+		 * Has to be called before the texture of the atlas is uploaded. The
+		 * font files are searched for every requested ideograph in order,
+		 * like merged fonts in ImGui.
+		 *
+		 * @param _atlas The atlas built with the static ranges
+		 * @param paths The font files the font was built from
+		 * @param size The size of the font in pixels
+		 */
+		void attach(ImFontAtlas* _atlas, const std::vector<std::filesystem::path>& paths, float size);
+
+		/**
+		 * @brief Request the ideographs of a text submitted to ImGui in the current frame
+		 *
+		 * Does nothing while no cache is attached. Ideographs not rasterized
+		 * yet are drawn transparent until the next frame.
+		 *
+		 * @param text The UTF-8 text
+		 */
+		static void request(std::string_view text);
+
+		/**
+		 * @brief Rasterize the ideographs requested in the current frame, has to be called after ImGui::Render()
+		 *
+		 * @return std::span<const Region> The regions of the texture which changed, valid until the next update
+		 */
+		std::span<const Region> update();
+
+		/**
+		 * @brief Get the number of ideographs currently rasterized
+		 *
+		 * @return std::size_t The number of used cells
+		 */
+		std::size_t getResidentCount() const { return resident; }
+
+	private:
+		/**
+		 * @brief A font file searched for ideographs
+		 */
+		struct Face;
+
+		/**
+		 * @brief An ideograph added to the font
+		 */
+		struct Glyph
+		{
+			/// @brief The face containing the ideograph
+			std::uint32_t face;
+			/// @brief The index of the glyph inside the face
+			std::uint32_t index;
+			/// @brief The index of the glyph inside the ImGui font
+			int fontGlyph;
+			/// @brief The cell holding the rasterized glyph, -1 if it is not rasterized
+			int cell;
+			/// @brief The last frame the glyph was requested in
+			std::uint64_t requested;
+		};
+
+		/**
+		 * @brief A place for one rasterized glyph, linked in the order of its last use
+		 */
+		struct Cell
+		{
+			/// @brief The glyph in the cell, -1 if it is free
+			int glyph;
+			/// @brief The previous cell, which was used more recently
+			int previous;
+			/// @brief The next cell, which was used less recently
+			int next;
+			/// @brief The last frame the glyph in the cell was requested in
+			std::uint64_t used;
+		};
+
+		/// @brief Marks ideographs which were never requested
+		static constexpr int unknownGlyph = -1;
+		/// @brief Marks ideographs none of the font files contains
+		static constexpr int missingGlyph = -2;
+
+		/**
+		 * @brief Request the ideographs of a text from this cache
+		 *
+		 * @param text The UTF-8 text
+		 */
+		void collect(std::string_view text);
+		/**
+		 * @brief Find an ideograph in the font files and add it to the font
+		 *
+		 * @param codepoint The ideograph
+		 * @return int The new glyph, missingGlyph if no font file contains it
+		 */
+		int addGlyph(unsigned int codepoint);
+		/**
+		 * @brief Move a cell to the front of the use order
+		 *
+		 * @param cell The cell
+		 */
+		void touch(int cell);
+		/**
+		 * @brief Rasterize a glyph into the least recently used cell
+		 *
+		 * @param glyph The glyph
+		 * @return true If the glyph got a cell
+		 * @return false If all cells are requested in the current frame
+		 */
+		bool rasterize(int glyph);
+		/**
+		 * @brief Point the texture coordinates of a glyph at the transparent texel
+		 *
+		 * @param glyph The glyph
+		 */
+		void setPending(int glyph);
+
+		/// @brief The atlas the glyphs are added to, nullptr if not attached
+		ImFontAtlas* atlas;
+		/// @brief The font the glyphs are added to
+		ImFont* font;
+		/// @brief The mapped font files
+		std::vector<storage::MappedFile> files;
+		/// @brief The font files searched for ideographs
+		std::vector<Face> faces;
+
+		/// @brief The cache request() is routed to, nullptr if none is attached
+		static GlyphCache* attached;
+
+		/// @brief The ideographs added to the font in the order they were first requested
+		std::vector<Glyph> glyphs;
+		/// @brief The glyph of every ideograph of the dynamic ranges, or unknownGlyph or missingGlyph
+		std::vector<int> lookup;
+		/// @brief The glyphs requested in the current frame which are not rasterized
+		std::vector<int> queued;
+		/// @brief The cells of the pool
+		std::vector<Cell> cells;
+		/// @brief The most recently used cell
+		int head;
+		/// @brief The least recently used cell
+		int tail;
+		/// @brief The number of cells holding a glyph
+		std::size_t resident;
+
+		/// @brief The row of the transparent texel not rasterized glyphs point at
+		int pendingRow;
+		/// @brief The first row of the pool
+		int poolTop;
+		/// @brief The width and height of a cell in pixels
+		int cellSize;
+		/// @brief The number of cells per row of the pool
+		int cellsPerRow;
+
+		/// @brief Counts the updates
+		std::uint64_t frame;
+		/// @brief The regions changed by the last update
+		std::vector<Region> regions;
+	};
+} // namespace graphics
+
+#endif // GLYPH_CACHE_H
@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "gpu_memory.h"
+
+namespace
+{
+	/// @brief The share of a heap a single block may take
+	constexpr VkDeviceSize heapBlockDivisor = 8;
+
+	/**
+	 * @brief Round an offset up to an alignment
+	 *
+	 * @param offset The offset
+	 * @param alignment The alignment, a power of two or zero
+	 * @return VkDeviceSize The aligned offset
+	 */
+	VkDeviceSize alignUp(VkDeviceSize offset, VkDeviceSize alignment)
+	{
+		if (alignment <= 1)
+			return offset;
+		return (offset + alignment - 1) & ~(alignment - 1);
+	}
+} // namespace
+
+graphics::GpuMemoryAllocator::GpuMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice _device,
+		const VkAllocationCallbacks* _callbacks, VkDeviceSize _blockSize) :
+	device(_device), callbacks(_callbacks), memoryProperties{}, blockSize(_blockSize), arenaCount(0),
+	dedicatedAllocations(0), dedicatedBytes(0), allocateCalls(0), requests(0)
+{
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+}
+
+graphics::GpuMemoryAllocator::~GpuMemoryAllocator()
+{
+	for (const Pool& pool : pools)
+		for (const Block& block : pool.blocks)
+			if (block.memory != VK_NULL_HANDLE)
+				vkFreeMemory(device, block.memory, callbacks);
+}
+
+graphics::GpuMemoryAllocator::Allocation graphics::GpuMemoryAllocator::allocate(
+		const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, Resource resource)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	const std::uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+	const VkDeviceSize size = std::max<VkDeviceSize>(requirements.size, 1);
+	++requests;
+
+	// Large resources would waste most of a block
+	if (size > getBlockSize(memoryType) / 2)
+	{
+		unsigned char* mapped;
+		const VkDeviceMemory memory = allocateMemory(memoryType, size, &mapped);
+		++dedicatedAllocations;
+		dedicatedBytes += size;
+		return Allocation{ memory, 0, size, mapped, noPool, 0 };
+	}
+
+	const std::uint32_t poolIndex = getPool(memoryType, resource, noArena);
+	Pool& pool = pools[poolIndex];
+	for (;;)
+	{
+		for (std::size_t blockIndex = 0; blockIndex < pool.blocks.size(); ++blockIndex)
+		{
+			Block& block = pool.blocks[blockIndex];
+			if (block.memory == VK_NULL_HANDLE)
+				continue;
+			for (auto range = block.free.begin(); range != block.free.end(); ++range)
+			{
+				const VkDeviceSize offset = alignUp(range->offset, requirements.alignment);
+				const VkDeviceSize end = range->offset + range->size;
+				if (offset + size > end)
+					continue;
+
+				// The padding in front stays free, so freeing only has to know the piece itself
+				const Range tail{ offset + size, end - offset - size };
+				if (offset > range->offset)
+				{
+					range->size = offset - range->offset;
+					if (tail.size > 0)
+						block.free.insert(range + 1, tail);
+				}
+				else if (tail.size > 0)
+					*range = tail;
+				else
+					block.free.erase(range);
+
+				block.used += size;
+				++block.allocations;
+				return Allocation{ block.memory, offset, size, block.mapped != nullptr ? block.mapped + offset : nullptr,
+						poolIndex, static_cast<std::uint32_t>(blockIndex) };
+			}
+		}
+
+		// No block has room left, reuse the slot of a released block or add one
+		// The block is only stored once its memory exists, so a failure leaves the pool as it was
+		const std::size_t slot = std::find_if(pool.blocks.begin(), pool.blocks.end(),
+				[](const Block& block) { return block.memory == VK_NULL_HANDLE; }) - pool.blocks.begin();
+		if (slot == pool.blocks.size())
+			pool.blocks.reserve(slot + 1);
+		const VkDeviceSize newSize = getBlockSize(memoryType);
+		Block block{ VK_NULL_HANDLE, newSize, nullptr, { Range{ 0, newSize } }, 0, 0, 0 };
+		block.memory = allocateMemory(memoryType, newSize, &block.mapped);
+		if (slot == pool.blocks.size())
+			pool.blocks.push_back(std::move(block));
+		else
+			pool.blocks[slot] = std::move(block);
+	}
+}
+
+void graphics::GpuMemoryAllocator::free(Allocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE)
+		return;
+
+	const std::lock_guard<std::mutex> lock(mutex);
+	if (allocation.pool == noPool)
+	{
+		vkFreeMemory(device, allocation.memory, callbacks);
+		--dedicatedAllocations;
+		dedicatedBytes -= allocation.size;
+		allocation = {};
+		return;
+	}
+
+	Pool& pool = pools[allocation.pool];
+	if (pool.arena != noArena)
+	{
+		allocation = {};
+		return;
+	}
+
+	Block& block = pool.blocks[allocation.block];
+	block.used -= allocation.size;
+	--block.allocations;
+
+	// Insert the range sorted and merge it with its neighbours
+	auto next = std::lower_bound(block.free.begin(), block.free.end(), allocation.offset,
+			[](const Range& range, VkDeviceSize offset) { return range.offset < offset; });
+	Range range{ allocation.offset, allocation.size };
+	if (next != block.free.end() && range.offset + range.size == next->offset)
+	{
+		range.size += next->size;
+		next = block.free.erase(next);
+	}
+	if (next != block.free.begin() && std::prev(next)->offset + std::prev(next)->size == range.offset)
+		std::prev(next)->size += range.size;
+	else
+		block.free.insert(next, range);
+	allocation = {};
+
+	// Keep one empty block per pool around, so a resized buffer does not allocate again
+	if (block.allocations == 0)
+	{
+		const bool otherEmpty = std::any_of(pool.blocks.begin(), pool.blocks.end(), [&block](const Block& other)
+				{ return &other != &block && other.memory != VK_NULL_HANDLE && other.allocations == 0; });
+		if (otherEmpty)
+		{
+			vkFreeMemory(device, block.memory, callbacks);
+			block = Block{ VK_NULL_HANDLE, 0, nullptr, {}, 0, 0, 0 };
+		}
+	}
+}
+
+std::uint32_t graphics::GpuMemoryAllocator::createArena()
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	return arenaCount++;
+}
+
+graphics::GpuMemoryAllocator::Allocation graphics::GpuMemoryAllocator::allocateLinear(
+		const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, std::uint32_t arena)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	const std::uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+	const VkDeviceSize size = std::max<VkDeviceSize>(requirements.size, 1);
+	++requests;
+
+	const std::uint32_t poolIndex = getPool(memoryType, Resource::Buffer, arena);
+	Pool& pool = pools[poolIndex];
+	for (std::size_t blockIndex = 0; blockIndex < pool.blocks.size(); ++blockIndex)
+	{
+		Block& block = pool.blocks[blockIndex];
+		if (block.memory == VK_NULL_HANDLE)
+			continue;
+		const VkDeviceSize offset = alignUp(block.top, requirements.alignment);
+		if (offset + size > block.size)
+			continue;
+
+		block.top = offset + size;
+		block.used += size;
+		++block.allocations;
+		return Allocation{ block.memory, offset, size, block.mapped != nullptr ? block.mapped + offset : nullptr,
+				poolIndex, static_cast<std::uint32_t>(blockIndex) };
+	}
+
+	// Arenas are reset as a whole, so a large request simply gets a block of its own size
+	const VkDeviceSize newSize = std::max(getBlockSize(memoryType), size);
+	pool.blocks.reserve(pool.blocks.size() + 1);
+	Block block{ VK_NULL_HANDLE, newSize, nullptr, {}, size, size, 1 };
+	block.memory = allocateMemory(memoryType, newSize, &block.mapped);
+	const Allocation allocation{ block.memory, 0, size, block.mapped, poolIndex,
+			static_cast<std::uint32_t>(pool.blocks.size()) };
+	pool.blocks.push_back(std::move(block));
+	return allocation;
+}
+
+void graphics::GpuMemoryAllocator::resetArena(std::uint32_t arena)
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	for (Pool& pool : pools)
+	{
+		if (pool.arena != arena)
+			continue;
+		for (Block& block : pool.blocks)
+		{
+			block.top = 0;
+			block.used = 0;
+			block.allocations = 0;
+		}
+	}
+}
+
+graphics::GpuMemoryAllocator::Statistics graphics::GpuMemoryAllocator::getStatistics() const
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+	Statistics statistics{ {}, dedicatedAllocations, dedicatedBytes, dedicatedAllocations, allocateCalls, requests };
+	for (const Pool& pool : pools)
+	{
+		PoolStatistics entry{ pool.memoryType, memoryProperties.memoryTypes[pool.memoryType].propertyFlags,
+				pool.resource, pool.arena != noArena, 0, 0, 0, 0, 0 };
+		for (const Block& block : pool.blocks)
+		{
+			if (block.memory == VK_NULL_HANDLE)
+				continue;
+			++entry.blocks;
+			entry.reserved += block.size;
+			entry.used += block.used;
+			entry.allocations += block.allocations;
+			if (pool.arena != noArena)
+				entry.largestFree = std::max(entry.largestFree, block.size - block.top);
+			for (const Range& range : block.free)
+				entry.largestFree = std::max(entry.largestFree, range.size);
+		}
+		if (entry.blocks == 0)
+			continue;
+
+		statistics.deviceAllocations += entry.blocks;
+		statistics.pools.push_back(entry);
+	}
+	return statistics;
+}
+
+std::uint32_t graphics::GpuMemoryAllocator::findMemoryType(std::uint32_t typeBits,
+		VkMemoryPropertyFlags properties) const
+{
+	for (std::uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+		if ((typeBits & (1u << i)) != 0 && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			return i;
+	throw std::runtime_error("No GPU memory type with the requested properties.");
+}
+
+std::uint32_t graphics::GpuMemoryAllocator::getPool(std::uint32_t memoryType, Resource resource, std::uint32_t arena)
+{
+	const auto pool = std::find_if(pools.begin(), pools.end(), [=](const Pool& candidate)
+			{ return candidate.memoryType == memoryType && candidate.resource == resource && candidate.arena == arena; });
+	if (pool != pools.end())
+		return static_cast<std::uint32_t>(pool - pools.begin());
+
+	pools.push_back(Pool{ memoryType, resource, arena, {} });
+	return static_cast<std::uint32_t>(pools.size() - 1);
+}
+
+VkDeviceMemory graphics::GpuMemoryAllocator::allocateMemory(std::uint32_t memoryType, VkDeviceSize size,
+		unsigned char** mapped)
+{
+	const VkMemoryAllocateInfo allocateInfo{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = size,
+		.memoryTypeIndex = memoryType,
+	};
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(device, &allocateInfo, callbacks, &memory) != VK_SUCCESS)
+		throw std::runtime_error("Can't allocate GPU memory.");
+	++allocateCalls;
+
+	*mapped = nullptr;
+	if ((memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0)
+	{
+		void* data;
+		if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS)
+		{
+			vkFreeMemory(device, memory, callbacks);
+			throw std::runtime_error("Can't map GPU memory.");
+		}
+		*mapped = static_cast<unsigned char*>(data);
+	}
+	return memory;
+}
+
+VkDeviceSize graphics::GpuMemoryAllocator::getBlockSize(std::uint32_t memoryType) const
+{
+	const VkMemoryHeap& heap = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex];
+	return std::max<VkDeviceSize>(std::min(blockSize, heap.size / heapBlockDivisor), 1 << 16);
+}
@@ -0,0 +1,293 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+
+
+namespace graphics
+{
+	/**
+	 * @brief Places buffers and images inside a few large blocks of device memory
+	 *
+	 * Every vkAllocateMemory() is slow and drivers only allow a few thousand
+	 * allocations at the same time, so memory is reserved in blocks and
+	 * handed out in pieces. There are two kinds of pools for every memory
+	 * type:
+	 *
+	 * - Free list pools keep the free ranges of each block sorted by offset
+	 *   and merge neighbours when a piece is freed. Buffers and images use
+	 *   pools of their own, so the buffer image granularity never has to be
+	 *   considered.
+	 * - Linear arenas hand out buffer memory by bumping an offset and free
+	 *   everything at once, which fits memory used by a single frame.
+	 *
+	 * Requests larger than half a block get a dedicated allocation. Blocks of
+	 * host visible memory stay mapped for their whole life.
+	 */
+	class GpuMemoryAllocator
+	{
+	public:
+		/// @brief The default size of a block
+		static constexpr VkDeviceSize defaultBlockSize = VkDeviceSize(16) << 20;
+		/// @brief The pool of an empty or dedicated allocation
+		static constexpr std::uint32_t noPool = std::numeric_limits<std::uint32_t>::max();
+
+		/**
+		 * @brief The kinds of resources bound to the memory
+		 */
+		enum class Resource
+		{
+			/// @brief A buffer, or an image with linear tiling
+			Buffer,
+			/// @brief An image with optimal tiling
+			Image
+		};
+
+		/**
+		 * @brief A piece of device memory, zero initialized it is empty
+		 */
+		struct Allocation
+		{
+			/// @brief The memory to bind the resource to
+			VkDeviceMemory memory;
+			/// @brief The offset to bind the resource at
+			VkDeviceSize offset;
+			/// @brief The size of the piece
+			VkDeviceSize size;
+			/// @brief The piece in host memory, nullptr if the memory is not host visible
+			void* mapped;
+			/// @brief The pool of the piece, noPool for dedicated allocations
+			std::uint32_t pool;
+			/// @brief The block of the piece inside its pool
+			std::uint32_t block;
+		};
+
+		/**
+		 * @brief The usage of one pool
+		 */
+		struct PoolStatistics
+		{
+			/// @brief The memory type of the pool
+			std::uint32_t memoryType;
+			/// @brief The properties of the memory type
+			VkMemoryPropertyFlags properties;
+			/// @brief The resources placed in the pool
+			Resource resource;
+			/// @brief Whether the pool is a linear arena
+			bool linear;
+			/// @brief The number of blocks
+			std::size_t blocks;
+			/// @brief The size of all blocks
+			VkDeviceSize reserved;
+			/// @brief The size of all pieces handed out
+			VkDeviceSize used;
+			/// @brief The number of pieces handed out
+			std::size_t allocations;
+			/// @brief The largest free range of all blocks
+			VkDeviceSize largestFree;
+		};
+
+		/**
+		 * @brief The usage of the whole allocator
+		 */
+		struct Statistics
+		{
+			/// @brief The pools which have at least one block
+			std::vector<PoolStatistics> pools;
+			/// @brief The number of dedicated allocations
+			std::size_t dedicatedAllocations;
+			/// @brief The size of the dedicated allocations
+			VkDeviceSize dedicatedBytes;
+			/// @brief The number of device memory objects currently allocated
+			std::size_t deviceAllocations;
+			/// @brief The number of calls to vkAllocateMemory() since the allocator was created
+			std::uint64_t allocateCalls;
+			/// @brief The number of pieces handed out since the allocator was created
+			std::uint64_t requests;
+		};
+
+	public:
+		/**
+		 * @brief Construct a new allocator which has not reserved any memory yet
+		 *
+		 * @param physicalDevice The device providing the memory types
+		 * @param _device The logical device to allocate from
+		 * @param _callbacks The host allocation callbacks, may be nullptr
+		 * @param _blockSize The size of a block, smaller for heaps below eight blocks
+		 */
+		GpuMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice _device, const VkAllocationCallbacks* _callbacks,
+				VkDeviceSize _blockSize = defaultBlockSize);
+		GpuMemoryAllocator(const GpuMemoryAllocator&) = delete;
+		/**
+		 * @brief Release all blocks, every resource bound to them has to be destroyed before
+		 */
+		~GpuMemoryAllocator();
+
+		GpuMemoryAllocator& operator=(const GpuMemoryAllocator&) = delete;
+
+		/**
+		 * @brief Allocate memory from a free list pool, throws a std::runtime_error on failure
+		 *
+		 * @param requirements The requirements of the resource
+		 * @param properties The properties the memory type needs to have
+		 * @param resource The kind of the resource
+		 * @return Allocation The piece of memory
+		 */
+		Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+				Resource resource);
+		/**
+		 * @brief Give back memory of allocate(), pieces of linear arenas are only freed by resetArena()
+		 *
+		 * @param allocation The piece, which is emptied
+		 */
+		void free(Allocation& allocation);
+
+		/**
+		 * @brief Create a new linear arena
+		 *
+		 * @return std::uint32_t The identifier of the arena
+		 */
+		std::uint32_t createArena();
+		/**
+		 * @brief Allocate buffer memory from a linear arena, throws a std::runtime_error on failure
+		 *
+		 * @param requirements The requirements of the buffer
+		 * @param properties The properties the memory type needs to have
+		 * @param arena The arena
+		 * @return Allocation The piece of memory, valid until the arena is reset
+		 */
+		Allocation allocateLinear(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+				std::uint32_t arena);
+		/**
+		 * @brief Free all pieces of a linear arena, the blocks are kept for the next use
+		 *
+		 * @param arena The arena
+		 */
+		void resetArena(std::uint32_t arena);
+
+		/**
+		 * @brief Get the current usage
+		 *
+		 * @return Statistics The usage of all pools
+		 */
+		Statistics getStatistics() const;
+
+	private:
+		/// @brief The arena of free list pools
+		static constexpr std::uint32_t noArena = std::numeric_limits<std::uint32_t>::max();
+
+		/**
+		 * @brief A free range of a block
+		 */
+		struct Range
+		{
+			/// @brief The first byte
+			VkDeviceSize offset;
+			/// @brief The number of bytes
+			VkDeviceSize size;
+		};
+
+		/**
+		 * @brief One device memory object split into pieces
+		 */
+		struct Block
+		{
+			/// @brief The memory, VK_NULL_HANDLE if the block was released
+			VkDeviceMemory memory;
+			/// @brief The size of the memory
+			VkDeviceSize size;
+			/// @brief The mapped memory, nullptr if it is not host visible
+			unsigned char* mapped;
+			/// @brief The free ranges sorted by their offset, unused by linear arenas
+			std::vector<Range> free;
+			/// @brief The first free byte of a linear arena
+			VkDeviceSize top;
+			/// @brief The size of all pieces handed out
+			VkDeviceSize used;
+			/// @brief The number of pieces handed out
+			std::size_t allocations;
+		};
+
+		/**
+		 * @brief The blocks of one memory type and kind of resource
+		 */
+		struct Pool
+		{
+			/// @brief The memory type
+			std::uint32_t memoryType;
+			/// @brief The kind of resources placed in the blocks
+			Resource resource;
+			/// @brief The linear arena, noArena for free list pools
+			std::uint32_t arena;
+			/// @brief The blocks, released blocks keep their slot so the indices stay valid
+			std::vector<Block> blocks;
+		};
+
+		/**
+		 * @brief Find the first memory type with the requested properties
+		 *
+		 * @param typeBits The memory types the resource can use
+		 * @param properties The requested properties
+		 * @return std::uint32_t The memory type
+		 */
+		std::uint32_t findMemoryType(std::uint32_t typeBits, VkMemoryPropertyFlags properties) const;
+		/**
+		 * @brief Find or create a pool
+		 *
+		 * @param memoryType The memory type
+		 * @param resource The kind of resources
+		 * @param arena The linear arena, noArena for a free list pool
+		 * @return std::uint32_t The index of the pool
+		 */
+		std::uint32_t getPool(std::uint32_t memoryType, Resource resource, std::uint32_t arena);
+		/**
+		 * @brief Allocate and map a device memory object
+		 *
+		 * @param memoryType The memory type
+		 * @param size The size
+		 * @param mapped Receives the mapped memory, nullptr if it is not host visible
+		 * @return VkDeviceMemory The memory
+		 */
+		VkDeviceMemory allocateMemory(std::uint32_t memoryType, VkDeviceSize size, unsigned char** mapped);
+		/**
+		 * @brief Get the size of new blocks of a memory type
+		 *
+		 * @param memoryType The memory type
+		 * @return VkDeviceSize The block size
+		 */
+		VkDeviceSize getBlockSize(std::uint32_t memoryType) const;
+
+		/// @brief Guards everything below
+		mutable std::mutex mutex;
+		/// @brief The device to allocate from
+		const VkDevice device;
+		/// @brief The host allocation callbacks
+		const VkAllocationCallbacks* const callbacks;
+		/// @brief The memory types and heaps of the physical device
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		/// @brief The size of a block
+		const VkDeviceSize blockSize;
+
+		/// @brief All pools
+		std::vector<Pool> pools;
+		/// @brief The number of linear arenas created
+		std::uint32_t arenaCount;
+		/// @brief The number of dedicated allocations
+		std::size_t dedicatedAllocations;
+		/// @brief The size of the dedicated allocations
+		VkDeviceSize dedicatedBytes;
+		/// @brief The number of calls to vkAllocateMemory()
+		std::uint64_t allocateCalls;
+		/// @brief The number of pieces handed out
+		std::uint64_t requests;
+	};
+} // namespace graphics
+
+#endif // GPU_MEMORY_H
@@ -64,6 +64,7 @@
 //  2016-08-27: Vulkan: Fix Vulkan example for use when a depth buffer is active.
 
 #include "implementation_vulkan.h"
+#include "gpu_memory.h"
 #include <stdio.h>
 
 // Visual Studio warnings
@@ -71,24 +72,37 @@
 #pragma warning (disable: 4127) // condition expression is constant
 #endif
 
-// Reusable buffers used for rendering 1 current in-flight frame, for ImGui_ImplVulkan_RenderDrawData()
+// Reusable ring buffer used for rendering 1 current in-flight frame, for ImGui_ImplVulkan_RenderDrawData()
+// Vertex and index data of the frame are streamed into it at aligned offsets, the memory stays mapped.
 // [Please zero-clear before use!]
 struct ImGui_ImplVulkanH_FrameRenderBuffers
 {
-    VkDeviceMemory      VertexBufferMemory;
-    VkDeviceMemory      IndexBufferMemory;
-    VkDeviceSize        VertexBufferSize;
-    VkDeviceSize        IndexBufferSize;
-    VkBuffer            VertexBuffer;
-    VkBuffer            IndexBuffer;
+    graphics::GpuMemoryAllocator::Allocation RingBufferMemory;
+    VkDeviceSize        RingBufferSize;
+    VkDeviceSize        RingBufferHead;         // First free byte, reset when the frame is reused
+    VkBuffer            RingBuffer;
+    graphics::GpuMemoryAllocator::Allocation DeviceBufferMemory;
+    VkDeviceSize        DeviceBufferSize;
+    VkBuffer            DeviceBuffer;           // Device-local copy of the ring buffer, for ImGui_ImplVulkan_GeometryMemory_Staged
+    VkBuffer            DrawBuffer;             // The buffer drawn from, RingBuffer or DeviceBuffer
+    VkDeviceSize        VertexOffset;
+    VkDeviceSize        IndexOffset;
 };
 
+// Sizing of the ring buffers: they start at RING_BUFFER_MIN_SIZE and at least double when a frame outgrows them
+static const VkDeviceSize RING_BUFFER_MIN_SIZE = 64 * 1024;
+static const VkDeviceSize RING_BUFFER_ALIGNMENT = 16;     // Covers sizeof(ImDrawIdx) required for index buffer offsets
+
+// Without resizable BAR discrete GPUs only map a 256 MiB window of their memory, larger host-visible device-local heaps mean it is enabled
+static const VkDeviceSize BAR_WINDOW_SIZE = 256 * 1024 * 1024;
+
 // Each viewport will hold 1 ImGui_ImplVulkanH_WindowRenderBuffers
 // [Please zero-clear before use!]
 struct ImGui_ImplVulkanH_WindowRenderBuffers
 {
     uint32_t            Index;
     uint32_t            Count;
+    bool                Uploaded;               // ImGui_ImplVulkan_UploadDrawData() already filled the frame at Index
     ImGui_ImplVulkanH_FrameRenderBuffers*   FrameRenderBuffers;
 };
 
@@ -110,6 +124,7 @@ struct ImGui_ImplVulkan_Data
     ImGui_ImplVulkan_InitInfo   VulkanInitInfo;
     VkRenderPass                RenderPass;
     VkDeviceSize                BufferMemoryAlignment;
+    ImGui_ImplVulkan_GeometryMemory GeometryMemory;
     VkPipelineCreateFlags       PipelineCreateFlags;
     VkDescriptorSetLayout       DescriptorSetLayout;
     VkPipelineLayout            PipelineLayout;
@@ -120,11 +135,11 @@ struct ImGui_ImplVulkan_Data
 
     // Font data
     VkSampler                   FontSampler;
-    VkDeviceMemory              FontMemory;
+    graphics::GpuMemoryAllocator::Allocation FontMemory;
     VkImage                     FontImage;
     VkImageView                 FontView;
     VkDescriptorSet             FontDescriptorSet;
-    VkDeviceMemory              UploadBufferMemory;
+    graphics::GpuMemoryAllocator::Allocation UploadBufferMemory;
     VkBuffer                    UploadBuffer;
 
     // Render buffers for main window
@@ -166,6 +181,7 @@ static bool g_FunctionsLoaded = true;
     IMGUI_VULKAN_FUNC_MAP_MACRO(vkCmdBindIndexBuffer) \
     IMGUI_VULKAN_FUNC_MAP_MACRO(vkCmdBindPipeline) \
     IMGUI_VULKAN_FUNC_MAP_MACRO(vkCmdBindVertexBuffers) \
+    IMGUI_VULKAN_FUNC_MAP_MACRO(vkCmdCopyBuffer) \
     IMGUI_VULKAN_FUNC_MAP_MACRO(vkCmdCopyBufferToImage) \
     IMGUI_VULKAN_FUNC_MAP_MACRO(vkCmdDrawIndexed) \
     IMGUI_VULKAN_FUNC_MAP_MACRO(vkCmdPipelineBarrier) \
@@ -358,18 +374,6 @@ static ImGui_ImplVulkan_Data* ImGui_ImplVulkan_GetBackendData()
     return ImGui::GetCurrentContext() ? (ImGui_ImplVulkan_Data*)ImGui::GetIO().BackendRendererUserData : NULL;
 }
 
-static uint32_t ImGui_ImplVulkan_MemoryType(VkMemoryPropertyFlags properties, uint32_t type_bits)
-{
-    ImGui_ImplVulkan_Data* bd = ImGui_ImplVulkan_GetBackendData();
-    ImGui_ImplVulkan_InitInfo* v = &bd->VulkanInitInfo;
-    VkPhysicalDeviceMemoryProperties prop;
-    vkGetPhysicalDeviceMemoryProperties(v->PhysicalDevice, &prop);
-    for (uint32_t i = 0; i < prop.memoryTypeCount; i++)
-        if ((prop.memoryTypes[i].propertyFlags & properties) == properties && type_bits & (1 << i))
-            return i;
-    return 0xFFFFFFFF; // Unable to find memoryType
-}
-
 static void check_vk_result(VkResult err)
 {
     ImGui_ImplVulkan_Data* bd = ImGui_ImplVulkan_GetBackendData();
@@ -380,15 +384,28 @@ static void check_vk_result(VkResult err)
         v->CheckVkResultFn(err);
 }
 
-static void CreateOrResizeBuffer(VkBuffer& buffer, VkDeviceMemory& buffer_memory, VkDeviceSize& p_buffer_size, size_t new_size, VkBufferUsageFlagBits usage)
+static VkDeviceSize AlignRingOffset(VkDeviceSize offset)
+{
+    return (offset + RING_BUFFER_ALIGNMENT - 1) & ~(RING_BUFFER_ALIGNMENT - 1);
+}
+
+// Take an aligned piece of the ring buffer of a frame, which was sized for the whole frame before
+static VkDeviceSize AllocateFromRingBuffer(ImGui_ImplVulkanH_FrameRenderBuffers* rb, VkDeviceSize size)
+{
+    VkDeviceSize offset = AlignRingOffset(rb->RingBufferHead);
+    IM_ASSERT(offset + size <= rb->RingBufferSize);
+    rb->RingBufferHead = offset + size;
+    return offset;
+}
+
+static void CreateOrResizeBuffer(VkBuffer& buffer, graphics::GpuMemoryAllocator::Allocation& buffer_memory, VkDeviceSize& p_buffer_size, size_t new_size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties)
 {
     ImGui_ImplVulkan_Data* bd = ImGui_ImplVulkan_GetBackendData();
     ImGui_ImplVulkan_InitInfo* v = &bd->VulkanInitInfo;
     VkResult err;
     if (buffer != VK_NULL_HANDLE)
         vkDestroyBuffer(v->Device, buffer, v->Allocator);
-    if (buffer_memory != VK_NULL_HANDLE)
-        vkFreeMemory(v->Device, buffer_memory, v->Allocator);
+    v->MemoryAllocator->free(buffer_memory);
 
     VkDeviceSize vertex_buffer_size_aligned = ((new_size - 1) / bd->BufferMemoryAlignment + 1) * bd->BufferMemoryAlignment;
     VkBufferCreateInfo buffer_info = {};
@@ -402,14 +419,9 @@ static void CreateOrResizeBuffer(VkBuffer& buffer, VkDeviceMemory& buffer_memory
     VkMemoryRequirements req;
     vkGetBufferMemoryRequirements(v->Device, buffer, &req);
     bd->BufferMemoryAlignment = (bd->BufferMemoryAlignment > req.alignment) ? bd->BufferMemoryAlignment : req.alignment;
-    VkMemoryAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = req.size;
-    alloc_info.memoryTypeIndex = ImGui_ImplVulkan_MemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, req.memoryTypeBits);
-    err = vkAllocateMemory(v->Device, &alloc_info, v->Allocator, &buffer_memory);
-    check_vk_result(err);
+    buffer_memory = v->MemoryAllocator->allocate(req, properties, graphics::GpuMemoryAllocator::Resource::Buffer);
 
-    err = vkBindBufferMemory(v->Device, buffer, buffer_memory, 0);
+    err = vkBindBufferMemory(v->Device, buffer, buffer_memory.memory, buffer_memory.offset);
     check_vk_result(err);
     p_buffer_size = req.size;
 }
@@ -426,10 +438,10 @@ static void ImGui_ImplVulkan_SetupRenderState(ImDrawData* draw_data, VkPipeline
     // Bind Vertex And Index Buffer:
     if (draw_data->TotalVtxCount > 0)
     {
-        VkBuffer vertex_buffers[1] = { rb->VertexBuffer };
-        VkDeviceSize vertex_offset[1] = { 0 };
+        VkBuffer vertex_buffers[1] = { rb->DrawBuffer };
+        VkDeviceSize vertex_offset[1] = { rb->VertexOffset };
         vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, vertex_offset);
-        vkCmdBindIndexBuffer(command_buffer, rb->IndexBuffer, 0, sizeof(ImDrawIdx) == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+        vkCmdBindIndexBuffer(command_buffer, rb->DrawBuffer, rb->IndexOffset, sizeof(ImDrawIdx) == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
     }
 
     // Setup viewport:
@@ -458,24 +470,15 @@ static void ImGui_ImplVulkan_SetupRenderState(ImDrawData* draw_data, VkPipeline
     }
 }
 
-// Render function
-void ImGui_ImplVulkan_RenderDrawData(ImDrawData* draw_data, VkCommandBuffer command_buffer, VkPipeline pipeline)
+// Stream the geometry of a viewport into the ring buffer of its next frame.
+// Given a command buffer outside of a render pass, ImGui_ImplVulkan_GeometryMemory_Staged copies it into device-local memory,
+// otherwise the ring buffer is drawn from directly.
+static ImGui_ImplVulkanH_FrameRenderBuffers* ImGui_ImplVulkan_UploadGeometry(ImDrawData* draw_data, ImGui_ImplVulkanH_WindowRenderBuffers* wrb, VkCommandBuffer command_buffer)
 {
-    // Avoid rendering when minimized, scale coordinates for retina displays (screen coordinates != framebuffer coordinates)
-    int fb_width = (int)(draw_data->DisplaySize.x * draw_data->FramebufferScale.x);
-    int fb_height = (int)(draw_data->DisplaySize.y * draw_data->FramebufferScale.y);
-    if (fb_width <= 0 || fb_height <= 0)
-        return;
-
     ImGui_ImplVulkan_Data* bd = ImGui_ImplVulkan_GetBackendData();
     ImGui_ImplVulkan_InitInfo* v = &bd->VulkanInitInfo;
-    if (pipeline == VK_NULL_HANDLE)
-        pipeline = bd->Pipeline;
 
     // Allocate array to store enough vertex/index buffers. Each unique viewport gets its own storage.
-    ImGui_ImplVulkan_ViewportData* viewport_renderer_data = (ImGui_ImplVulkan_ViewportData*)draw_data->OwnerViewport->RendererUserData;
-    IM_ASSERT(viewport_renderer_data != NULL);
-    ImGui_ImplVulkanH_WindowRenderBuffers* wrb = &viewport_renderer_data->RenderBuffers;
     if (wrb->FrameRenderBuffers == NULL)
     {
         wrb->Index = 0;
@@ -489,21 +492,31 @@ void ImGui_ImplVulkan_RenderDrawData(ImDrawData* draw_data, VkCommandBuffer comm
 
     if (draw_data->TotalVtxCount > 0)
     {
-        // Create or resize the vertex/index buffers
+        // The frame was waited for before it is reused, so its ring buffer starts over
         size_t vertex_size = draw_data->TotalVtxCount * sizeof(ImDrawVert);
         size_t index_size = draw_data->TotalIdxCount * sizeof(ImDrawIdx);
-        if (rb->VertexBuffer == VK_NULL_HANDLE || rb->VertexBufferSize < vertex_size)
-            CreateOrResizeBuffer(rb->VertexBuffer, rb->VertexBufferMemory, rb->VertexBufferSize, vertex_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-        if (rb->IndexBuffer == VK_NULL_HANDLE || rb->IndexBufferSize < index_size)
-            CreateOrResizeBuffer(rb->IndexBuffer, rb->IndexBufferMemory, rb->IndexBufferSize, index_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-
-        // Upload vertex/index data into a single contiguous GPU buffer
-        ImDrawVert* vtx_dst = NULL;
-        ImDrawIdx* idx_dst = NULL;
-        VkResult err = vkMapMemory(v->Device, rb->VertexBufferMemory, 0, rb->VertexBufferSize, 0, (void**)(&vtx_dst));
-        check_vk_result(err);
-        err = vkMapMemory(v->Device, rb->IndexBufferMemory, 0, rb->IndexBufferSize, 0, (void**)(&idx_dst));
-        check_vk_result(err);
+        VkDeviceSize required_size = AlignRingOffset(vertex_size) + index_size;
+        if (rb->RingBuffer == VK_NULL_HANDLE || rb->RingBufferSize < required_size)
+        {
+            // Grow geometrically, so a slowly growing UI does not reallocate every few frames
+            VkDeviceSize new_size = rb->RingBufferSize * 2;
+            if (new_size < RING_BUFFER_MIN_SIZE)
+                new_size = RING_BUFFER_MIN_SIZE;
+            if (new_size < required_size)
+                new_size = required_size;
+            // Coherent memory stays mapped inside its block and needs neither map calls nor flushes per frame
+            VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            if (bd->GeometryMemory == ImGui_ImplVulkan_GeometryMemory_Mapped)
+                properties |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            CreateOrResizeBuffer(rb->RingBuffer, rb->RingBufferMemory, rb->RingBufferSize, new_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, properties);
+        }
+        rb->RingBufferHead = 0;
+        rb->VertexOffset = AllocateFromRingBuffer(rb, vertex_size);
+        rb->IndexOffset = AllocateFromRingBuffer(rb, index_size);
+
+        // Stream vertex/index data into the mapped ring buffer
+        ImDrawVert* vtx_dst = (ImDrawVert*)((char*)rb->RingBufferMemory.mapped + rb->VertexOffset);
+        ImDrawIdx* idx_dst = (ImDrawIdx*)((char*)rb->RingBufferMemory.mapped + rb->IndexOffset);
         for (int n = 0; n < draw_data->CmdListsCount; n++)
         {
             const ImDrawList* cmd_list = draw_data->CmdLists[n];
@@ -512,18 +525,66 @@ void ImGui_ImplVulkan_RenderDrawData(ImDrawData* draw_data, VkCommandBuffer comm
             vtx_dst += cmd_list->VtxBuffer.Size;
             idx_dst += cmd_list->IdxBuffer.Size;
         }
-        VkMappedMemoryRange range[2] = {};
-        range[0].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        range[0].memory = rb->VertexBufferMemory;
-        range[0].size = VK_WHOLE_SIZE;
-        range[1].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        range[1].memory = rb->IndexBufferMemory;
-        range[1].size = VK_WHOLE_SIZE;
-        err = vkFlushMappedMemoryRanges(v->Device, 2, range);
-        check_vk_result(err);
-        vkUnmapMemory(v->Device, rb->VertexBufferMemory);
-        vkUnmapMemory(v->Device, rb->IndexBufferMemory);
+
+        rb->DrawBuffer = rb->RingBuffer;
+        if (bd->GeometryMemory == ImGui_ImplVulkan_GeometryMemory_Staged && command_buffer != VK_NULL_HANDLE)
+        {
+            if (rb->DeviceBuffer == VK_NULL_HANDLE || rb->DeviceBufferSize < rb->RingBufferSize)
+                CreateOrResizeBuffer(rb->DeviceBuffer, rb->DeviceBufferMemory, rb->DeviceBufferSize, rb->RingBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+            VkBufferCopy region = {};
+            region.size = rb->RingBufferHead;
+            vkCmdCopyBuffer(command_buffer, rb->RingBuffer, rb->DeviceBuffer, 1, &region);
+
+            VkBufferMemoryBarrier barrier[1] = {};
+            barrier[0].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier[0].dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+            barrier[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier[0].buffer = rb->DeviceBuffer;
+            barrier[0].size = rb->RingBufferHead;
+            vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, NULL, 1, barrier, 0, NULL);
+            rb->DrawBuffer = rb->DeviceBuffer;
+        }
     }
+    return rb;
+}
+
+void ImGui_ImplVulkan_UploadDrawData(ImDrawData* draw_data, VkCommandBuffer command_buffer)
+{
+    int fb_width = (int)(draw_data->DisplaySize.x * draw_data->FramebufferScale.x);
+    int fb_height = (int)(draw_data->DisplaySize.y * draw_data->FramebufferScale.y);
+    if (fb_width <= 0 || fb_height <= 0)
+        return;
+
+    ImGui_ImplVulkan_ViewportData* viewport_renderer_data = (ImGui_ImplVulkan_ViewportData*)draw_data->OwnerViewport->RendererUserData;
+    IM_ASSERT(viewport_renderer_data != NULL);
+    ImGui_ImplVulkanH_WindowRenderBuffers* wrb = &viewport_renderer_data->RenderBuffers;
+    IM_ASSERT(!wrb->Uploaded && "ImGui_ImplVulkan_RenderDrawData() was not called after the last upload!");
+    ImGui_ImplVulkan_UploadGeometry(draw_data, wrb, command_buffer);
+    wrb->Uploaded = true;
+}
+
+// Render function
+void ImGui_ImplVulkan_RenderDrawData(ImDrawData* draw_data, VkCommandBuffer command_buffer, VkPipeline pipeline)
+{
+    // Avoid rendering when minimized, scale coordinates for retina displays (screen coordinates != framebuffer coordinates)
+    int fb_width = (int)(draw_data->DisplaySize.x * draw_data->FramebufferScale.x);
+    int fb_height = (int)(draw_data->DisplaySize.y * draw_data->FramebufferScale.y);
+    if (fb_width <= 0 || fb_height <= 0)
+        return;
+
+    ImGui_ImplVulkan_Data* bd = ImGui_ImplVulkan_GetBackendData();
+    if (pipeline == VK_NULL_HANDLE)
+        pipeline = bd->Pipeline;
+
+    // The geometry is only uploaded here if ImGui_ImplVulkan_UploadDrawData() was not called before the render pass
+    ImGui_ImplVulkan_ViewportData* viewport_renderer_data = (ImGui_ImplVulkan_ViewportData*)draw_data->OwnerViewport->RendererUserData;
+    IM_ASSERT(viewport_renderer_data != NULL);
+    ImGui_ImplVulkanH_WindowRenderBuffers* wrb = &viewport_renderer_data->RenderBuffers;
+    ImGui_ImplVulkanH_FrameRenderBuffers* rb = wrb->Uploaded ? &wrb->FrameRenderBuffers[wrb->Index] : ImGui_ImplVulkan_UploadGeometry(draw_data, wrb, VK_NULL_HANDLE);
+    wrb->Uploaded = false;
 
     // Setup desired Vulkan state
     ImGui_ImplVulkan_SetupRenderState(draw_data, pipeline, command_buffer, rb, fb_width, fb_height);
@@ -635,13 +696,8 @@ bool ImGui_ImplVulkan_CreateFontsTexture(VkCommandBuffer command_buffer)
         check_vk_result(err);
         VkMemoryRequirements req;
         vkGetImageMemoryRequirements(v->Device, bd->FontImage, &req);
-        VkMemoryAllocateInfo alloc_info = {};
-        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        alloc_info.allocationSize = req.size;
-        alloc_info.memoryTypeIndex = ImGui_ImplVulkan_MemoryType(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, req.memoryTypeBits);
-        err = vkAllocateMemory(v->Device, &alloc_info, v->Allocator, &bd->FontMemory);
-        check_vk_result(err);
-        err = vkBindImageMemory(v->Device, bd->FontImage, bd->FontMemory, 0);
+        bd->FontMemory = v->MemoryAllocator->allocate(req, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, graphics::GpuMemoryAllocator::Resource::Image);
+        err = vkBindImageMemory(v->Device, bd->FontImage, bd->FontMemory.memory, bd->FontMemory.offset);
         check_vk_result(err);
     }
 
@@ -674,29 +730,14 @@ bool ImGui_ImplVulkan_CreateFontsTexture(VkCommandBuffer command_buffer)
         VkMemoryRequirements req;
         vkGetBufferMemoryRequirements(v->Device, bd->UploadBuffer, &req);
         bd->BufferMemoryAlignment = (bd->BufferMemoryAlignment > req.alignment) ? bd->BufferMemoryAlignment : req.alignment;
-        VkMemoryAllocateInfo alloc_info = {};
-        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        alloc_info.allocationSize = req.size;
-        alloc_info.memoryTypeIndex = ImGui_ImplVulkan_MemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, req.memoryTypeBits);
-        err = vkAllocateMemory(v->Device, &alloc_info, v->Allocator, &bd->UploadBufferMemory);
-        check_vk_result(err);
-        err = vkBindBufferMemory(v->Device, bd->UploadBuffer, bd->UploadBufferMemory, 0);
+        bd->UploadBufferMemory = v->MemoryAllocator->allocate(req, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, graphics::GpuMemoryAllocator::Resource::Buffer);
+        err = vkBindBufferMemory(v->Device, bd->UploadBuffer, bd->UploadBufferMemory.memory, bd->UploadBufferMemory.offset);
         check_vk_result(err);
     }
 
     // Upload to Buffer:
     {
-        char* map = NULL;
-        err = vkMapMemory(v->Device, bd->UploadBufferMemory, 0, upload_size, 0, (void**)(&map));
-        check_vk_result(err);
-        memcpy(map, pixels, upload_size);
-        VkMappedMemoryRange range[1] = {};
-        range[0].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        range[0].memory = bd->UploadBufferMemory;
-        range[0].size = upload_size;
-        err = vkFlushMappedMemoryRanges(v->Device, 1, range);
-        check_vk_result(err);
-        vkUnmapMemory(v->Device, bd->UploadBufferMemory);
+        memcpy(bd->UploadBufferMemory.mapped, pixels, upload_size);
     }
 
     // Copy to Image:
@@ -743,6 +784,43 @@ bool ImGui_ImplVulkan_CreateFontsTexture(VkCommandBuffer command_buffer)
     return true;
 }
 
+void ImGui_ImplVulkan_UpdateFontsTexture(VkCommandBuffer command_buffer, VkBuffer buffer, const VkBufferImageCopy* regions, uint32_t region_count)
+{
+    ImGui_ImplVulkan_Data* bd = ImGui_ImplVulkan_GetBackendData();
+    IM_ASSERT(bd->FontImage != VK_NULL_HANDLE);
+
+    // Frames submitted before may still sample the texture, the barrier waits for their fragment shaders
+    VkImageMemoryBarrier copy_barrier[1] = {};
+    copy_barrier[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    copy_barrier[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    copy_barrier[0].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    copy_barrier[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    copy_barrier[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    copy_barrier[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    copy_barrier[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    copy_barrier[0].image = bd->FontImage;
+    copy_barrier[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    copy_barrier[0].subresourceRange.levelCount = 1;
+    copy_barrier[0].subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, copy_barrier);
+
+    vkCmdCopyBufferToImage(command_buffer, buffer, bd->FontImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, region_count, regions);
+
+    VkImageMemoryBarrier use_barrier[1] = {};
+    use_barrier[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    use_barrier[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    use_barrier[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    use_barrier[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    use_barrier[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    use_barrier[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    use_barrier[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    use_barrier[0].image = bd->FontImage;
+    use_barrier[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    use_barrier[0].subresourceRange.levelCount = 1;
+    use_barrier[0].subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, use_barrier);
+}
+
 static void ImGui_ImplVulkan_CreateShaderModules(VkDevice device, const VkAllocationCallbacks* allocator)
 {
     // Create the shader modules
@@ -1009,11 +1087,7 @@ void    ImGui_ImplVulkan_DestroyFontUploadObjects()
         vkDestroyBuffer(v->Device, bd->UploadBuffer, v->Allocator);
         bd->UploadBuffer = VK_NULL_HANDLE;
     }
-    if (bd->UploadBufferMemory)
-    {
-        vkFreeMemory(v->Device, bd->UploadBufferMemory, v->Allocator);
-        bd->UploadBufferMemory = VK_NULL_HANDLE;
-    }
+    v->MemoryAllocator->free(bd->UploadBufferMemory);
 }
 
 void    ImGui_ImplVulkan_DestroyDeviceObjects()
@@ -1027,7 +1101,7 @@ void    ImGui_ImplVulkan_DestroyDeviceObjects()
     if (bd->ShaderModuleFrag)     { vkDestroyShaderModule(v->Device, bd->ShaderModuleFrag, v->Allocator); bd->ShaderModuleFrag = VK_NULL_HANDLE; }
     if (bd->FontView)             { vkDestroyImageView(v->Device, bd->FontView, v->Allocator); bd->FontView = VK_NULL_HANDLE; }
     if (bd->FontImage)            { vkDestroyImage(v->Device, bd->FontImage, v->Allocator); bd->FontImage = VK_NULL_HANDLE; }
-    if (bd->FontMemory)           { vkFreeMemory(v->Device, bd->FontMemory, v->Allocator); bd->FontMemory = VK_NULL_HANDLE; }
+    v->MemoryAllocator->free(bd->FontMemory);
     if (bd->FontSampler)          { vkDestroySampler(v->Device, bd->FontSampler, v->Allocator); bd->FontSampler = VK_NULL_HANDLE; }
     if (bd->DescriptorSetLayout)  { vkDestroyDescriptorSetLayout(v->Device, bd->DescriptorSetLayout, v->Allocator); bd->DescriptorSetLayout = VK_NULL_HANDLE; }
     if (bd->PipelineLayout)       { vkDestroyPipelineLayout(v->Device, bd->PipelineLayout, v->Allocator); bd->PipelineLayout = VK_NULL_HANDLE; }
@@ -1076,11 +1150,13 @@ bool    ImGui_ImplVulkan_Init(ImGui_ImplVulkan_InitInfo* info, VkRenderPass rend
     IM_ASSERT(info->DescriptorPool != VK_NULL_HANDLE);
     IM_ASSERT(info->MinImageCount >= 2);
     IM_ASSERT(info->ImageCount >= info->MinImageCount);
+    IM_ASSERT(info->MemoryAllocator != NULL);
     IM_ASSERT(render_pass != VK_NULL_HANDLE);
 
     bd->VulkanInitInfo = *info;
     bd->RenderPass = render_pass;
     bd->Subpass = info->Subpass;
+    bd->GeometryMemory = ImGui_ImplVulkan_IsGeometryMemorySupported(ImGui_ImplVulkan_GeometryMemory_Mapped) ? ImGui_ImplVulkan_GeometryMemory_Mapped : ImGui_ImplVulkan_GeometryMemory_Host;
 
     ImGui_ImplVulkan_CreateDeviceObjects();
 
@@ -1140,6 +1216,43 @@ void ImGui_ImplVulkan_SetMinImageCount(uint32_t min_image_count)
     bd->VulkanInitInfo.MinImageCount = min_image_count;
 }
 
+bool ImGui_ImplVulkan_IsGeometryMemorySupported(ImGui_ImplVulkan_GeometryMemory memory)
+{
+    if (memory != ImGui_ImplVulkan_GeometryMemory_Mapped)
+        return true;
+
+    // Integrated GPUs report all memory as device-local, discrete GPUs need a resizable BAR larger than the legacy window
+    ImGui_ImplVulkan_Data* bd = ImGui_ImplVulkan_GetBackendData();
+    VkPhysicalDeviceMemoryProperties prop;
+    vkGetPhysicalDeviceMemoryProperties(bd->VulkanInitInfo.PhysicalDevice, &prop);
+    const VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (uint32_t i = 0; i < prop.memoryTypeCount; i++)
+        if ((prop.memoryTypes[i].propertyFlags & flags) == flags && prop.memoryHeaps[prop.memoryTypes[i].heapIndex].size > BAR_WINDOW_SIZE)
+            return true;
+    return false;
+}
+
+ImGui_ImplVulkan_GeometryMemory ImGui_ImplVulkan_GetGeometryMemory()
+{
+    ImGui_ImplVulkan_Data* bd = ImGui_ImplVulkan_GetBackendData();
+    return bd->GeometryMemory;
+}
+
+void ImGui_ImplVulkan_SetGeometryMemory(ImGui_ImplVulkan_GeometryMemory memory)
+{
+    ImGui_ImplVulkan_Data* bd = ImGui_ImplVulkan_GetBackendData();
+    IM_ASSERT(memory >= 0 && memory < ImGui_ImplVulkan_GeometryMemory_COUNT);
+    if (bd->GeometryMemory == memory || !ImGui_ImplVulkan_IsGeometryMemorySupported(memory))
+        return;
+
+    // The buffers of all frames in flight are recreated in the new memory on their next use
+    ImGui_ImplVulkan_InitInfo* v = &bd->VulkanInitInfo;
+    VkResult err = vkDeviceWaitIdle(v->Device);
+    check_vk_result(err);
+    ImGui_ImplVulkanH_DestroyAllViewportsRenderBuffers(v->Device, v->Allocator);
+    bd->GeometryMemory = memory;
+}
+
 // Register a texture
 // FIXME: This is experimental in the sense that we are unsure how to best design/tackle this problem, please post to https://github.com/ocornut/imgui/pull/914 if you have suggestions.
 VkDescriptorSet ImGui_ImplVulkan_AddTexture(VkSampler sampler, VkImageView image_view, VkImageLayout image_layout)
@@ -1541,12 +1654,17 @@ void ImGui_ImplVulkanH_DestroyFrameSemaphores(VkDevice device, ImGui_ImplVulkanH
 
 void ImGui_ImplVulkanH_DestroyFrameRenderBuffers(VkDevice device, ImGui_ImplVulkanH_FrameRenderBuffers* buffers, const VkAllocationCallbacks* allocator)
 {
-    if (buffers->VertexBuffer) { vkDestroyBuffer(device, buffers->VertexBuffer, allocator); buffers->VertexBuffer = VK_NULL_HANDLE; }
-    if (buffers->VertexBufferMemory) { vkFreeMemory(device, buffers->VertexBufferMemory, allocator); buffers->VertexBufferMemory = VK_NULL_HANDLE; }
-    if (buffers->IndexBuffer) { vkDestroyBuffer(device, buffers->IndexBuffer, allocator); buffers->IndexBuffer = VK_NULL_HANDLE; }
-    if (buffers->IndexBufferMemory) { vkFreeMemory(device, buffers->IndexBufferMemory, allocator); buffers->IndexBufferMemory = VK_NULL_HANDLE; }
-    buffers->VertexBufferSize = 0;
-    buffers->IndexBufferSize = 0;
+    graphics::GpuMemoryAllocator* memory_allocator = ImGui_ImplVulkan_GetBackendData()->VulkanInitInfo.MemoryAllocator;
+    if (buffers->RingBuffer) { vkDestroyBuffer(device, buffers->RingBuffer, allocator); buffers->RingBuffer = VK_NULL_HANDLE; }
+    memory_allocator->free(buffers->RingBufferMemory);
+    if (buffers->DeviceBuffer) { vkDestroyBuffer(device, buffers->DeviceBuffer, allocator); buffers->DeviceBuffer = VK_NULL_HANDLE; }
+    memory_allocator->free(buffers->DeviceBufferMemory);
+    buffers->DrawBuffer = VK_NULL_HANDLE;
+    buffers->RingBufferSize = 0;
+    buffers->DeviceBufferSize = 0;
+    buffers->RingBufferHead = 0;
+    buffers->VertexOffset = 0;
+    buffers->IndexOffset = 0;
 }
 
 void ImGui_ImplVulkanH_DestroyWindowRenderBuffers(VkDevice device, ImGui_ImplVulkanH_WindowRenderBuffers* buffers, const VkAllocationCallbacks* allocator)
@@ -1557,6 +1675,7 @@ void ImGui_ImplVulkanH_DestroyWindowRenderBuffers(VkDevice device, ImGui_ImplVul
     buffers->FrameRenderBuffers = NULL;
     buffers->Index = 0;
     buffers->Count = 0;
+    buffers->Uploaded = false;
 }
 
 void ImGui_ImplVulkanH_DestroyAllViewportsRenderBuffers(VkDevice device, const VkAllocationCallbacks* allocator)
@@ -1670,6 +1789,7 @@ static void ImGui_ImplVulkan_RenderWindow(ImGuiViewport* viewport, void*)
             err = vkBeginCommandBuffer(fd->CommandBuffer, &info);
             check_vk_result(err);
         }
+        ImGui_ImplVulkan_UploadDrawData(viewport->DrawData, fd->CommandBuffer);
         {
             ImVec4 clear_color = ImVec4(0.0f, 0.0f, 0.0f, 1.0f);
             memcpy(&wd->ClearValue.color.float32[0], &clear_color, 4 * sizeof(float));
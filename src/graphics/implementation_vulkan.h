@@ -47,6 +47,17 @@
 #endif
 #include <vulkan/vulkan.h>
 
+namespace graphics { class GpuMemoryAllocator; }
+
+// Memory the vertex/index data of a frame is placed in, see ImGui_ImplVulkan_SetGeometryMemory()
+enum ImGui_ImplVulkan_GeometryMemory
+{
+    ImGui_ImplVulkan_GeometryMemory_Host,       // Host-visible memory, which discrete GPUs read over the bus
+    ImGui_ImplVulkan_GeometryMemory_Mapped,     // Device-local memory mapped to the host, needs resizable BAR on discrete GPUs
+    ImGui_ImplVulkan_GeometryMemory_Staged,     // Device-local memory filled by a copy from host-visible memory
+    ImGui_ImplVulkan_GeometryMemory_COUNT
+};
+
 // Initialization data, for ImGui_ImplVulkan_Init()
 // [Please zero-clear before use!]
 struct ImGui_ImplVulkan_InitInfo
@@ -64,16 +75,22 @@ struct ImGui_ImplVulkan_InitInfo
     VkSampleCountFlagBits           MSAASamples;            // >= VK_SAMPLE_COUNT_1_BIT (0 -> default to VK_SAMPLE_COUNT_1_BIT)
     const VkAllocationCallbacks*    Allocator;
     void                            (*CheckVkResultFn)(VkResult err);
+    graphics::GpuMemoryAllocator*   MemoryAllocator;        // Places the buffers and images in shared blocks of device memory
 };
 
 // Called by user code
 bool ImGui_ImplVulkan_Init(ImGui_ImplVulkan_InitInfo* info, VkRenderPass render_pass);
 void ImGui_ImplVulkan_Shutdown();
 void ImGui_ImplVulkan_NewFrame();
+void ImGui_ImplVulkan_UploadDrawData(ImDrawData* draw_data, VkCommandBuffer command_buffer); // Optional, outside of a render pass before ImGui_ImplVulkan_RenderDrawData(), needed by ImGui_ImplVulkan_GeometryMemory_Staged
 void ImGui_ImplVulkan_RenderDrawData(ImDrawData* draw_data, VkCommandBuffer command_buffer, VkPipeline pipeline = VK_NULL_HANDLE);
 bool ImGui_ImplVulkan_CreateFontsTexture(VkCommandBuffer command_buffer);
 void ImGui_ImplVulkan_DestroyFontUploadObjects();
+void ImGui_ImplVulkan_UpdateFontsTexture(VkCommandBuffer command_buffer, VkBuffer buffer, const VkBufferImageCopy* regions, uint32_t region_count); // Copy changed RGBA32 regions of the font atlas from a staging buffer
 void ImGui_ImplVulkan_SetMinImageCount(uint32_t min_image_count); // To override MinImageCount after initialization (e.g. if swap chain is recreated)
+bool ImGui_ImplVulkan_IsGeometryMemorySupported(ImGui_ImplVulkan_GeometryMemory memory);
+ImGui_ImplVulkan_GeometryMemory ImGui_ImplVulkan_GetGeometryMemory();
+void ImGui_ImplVulkan_SetGeometryMemory(ImGui_ImplVulkan_GeometryMemory memory); // Waits for the device and recreates the vertex/index buffers
 
 // Register a texture (VkDescriptorSet == ImTextureID)
 // FIXME: This is experimental in the sense that we are unsure how to best design/tackle this problem, please post to https://github.com/ocornut/imgui/pull/914 if you have suggestions.
@@ -0,0 +1,99 @@
+#include <cstring>
+
+#include "pipeline_cache.h"
+#include "autosave.h"
+#include "binary.h"
+#include "exceptions.h"
+#include "mapped_file.h"
+
+namespace
+{
+	/// @brief The header of the file format
+	constexpr std::string_view fileHeader = "honmonopipelines 1";
+
+	/**
+	 * @brief Write the identity of a device and its driver
+	 *
+	 * @param writer The writer
+	 * @param properties The properties of the device
+	 */
+	void writeIdentity(storage::BinaryWriter& writer, const VkPhysicalDeviceProperties& properties)
+	{
+		writer.writeU32(properties.vendorID);
+		writer.writeU32(properties.deviceID);
+		writer.writeU32(properties.driverVersion);
+		writer.writeBytes(std::string_view(reinterpret_cast<const char*>(properties.pipelineCacheUUID), VK_UUID_SIZE));
+	}
+
+	/**
+	 * @brief Check the header Vulkan puts in front of the cache data
+	 *
+	 * Drivers are required to reject foreign data themselves, but a few of
+	 * them crash on it instead.
+	 *
+	 * @param data The cache data
+	 * @param properties The properties of the device
+	 * @return true If the data was created by the device
+	 */
+	bool matchesDevice(std::string_view data, const VkPhysicalDeviceProperties& properties)
+	{
+		VkPipelineCacheHeaderVersionOne header;
+		if (data.size() < sizeof(header))
+			return false;
+		std::memcpy(&header, data.data(), sizeof(header));
+		return header.headerSize >= sizeof(header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+				&& header.vendorID == properties.vendorID && header.deviceID == properties.deviceID
+				&& std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+} // namespace
+
+graphics::PipelineCacheFile::PipelineCacheFile(std::filesystem::path _path) : path(std::move(_path))
+{
+}
+
+std::string graphics::PipelineCacheFile::load(const VkPhysicalDeviceProperties& properties) const
+{
+	std::error_code error;
+	if (!std::filesystem::exists(path, error))
+		return {};
+
+	std::string identity;
+	storage::BinaryWriter writer(identity);
+	writeIdentity(writer, properties);
+
+	try
+	{
+		const storage::MappedFile file(path);
+		storage::BinaryReader reader(file.view());
+		if (reader.readBytes(fileHeader.size()) != fileHeader)
+			throw storage::ParsingError("Wrong header.");
+		const std::uint32_t size = reader.readU32();
+		const std::uint32_t checksum = reader.readU32();
+		if (reader.remaining().size() != size || static_cast<std::uint32_t>(storage::fnv1a(reader.remaining())) != checksum)
+			throw storage::ParsingError("Wrong checksum.");
+
+		// Another device or driver version, the cache is replaced on exit
+		if (reader.readBytes(identity.size()) != identity || !matchesDevice(reader.remaining(), properties))
+			return {};
+		return std::string(reader.remaining());
+	}
+	catch (const storage::FileError&)
+	{
+		// A damaged cache only costs the compilation of the pipelines
+		return {};
+	}
+}
+
+void graphics::PipelineCacheFile::store(const VkPhysicalDeviceProperties& properties, std::string_view data) const
+{
+	std::string payload;
+	storage::BinaryWriter writer(payload);
+	writeIdentity(writer, properties);
+	writer.writeBytes(data);
+
+	std::string content(fileHeader);
+	storage::BinaryWriter header(content);
+	header.writeU32(static_cast<std::uint32_t>(payload.size()));
+	header.writeU32(static_cast<std::uint32_t>(storage::fnv1a(payload)));
+	storage::writeFileAtomically(path, content += payload);
+}
@@ -0,0 +1,54 @@
+#ifndef PIPELINE_CACHE_H
+#define PIPELINE_CACHE_H
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include <vulkan/vulkan.h>
+
+
+
+namespace graphics
+{
+	/**
+	 * @brief Stores the content of a VkPipelineCache on disk between runs
+	 *
+	 * Without it the pipelines are compiled from their shaders on every
+	 * start. The data of the cache only fits the device and driver it was
+	 * created with, so the file carries the identity of both and data of any
+	 * other device, driver version or a damaged file is thrown away instead
+	 * of being handed to the driver.
+	 */
+	class PipelineCacheFile
+	{
+	public:
+		/**
+		 * @brief Construct a new pipeline cache file
+		 *
+		 * @param _path The file the cache data is stored in
+		 */
+		PipelineCacheFile(std::filesystem::path _path);
+
+		/**
+		 * @brief Read the cache data stored for a device
+		 *
+		 * @param properties The properties of the device
+		 * @return std::string The cache data, empty if there is none for the device
+		 */
+		std::string load(const VkPhysicalDeviceProperties& properties) const;
+		/**
+		 * @brief Replace the stored cache data, throws a FileError on failure
+		 *
+		 * @param properties The properties of the device the data was created with
+		 * @param data The data returned by vkGetPipelineCacheData()
+		 */
+		void store(const VkPhysicalDeviceProperties& properties, std::string_view data) const;
+
+	private:
+		/// @brief The file the cache data is stored in
+		const std::filesystem::path path;
+	};
+} // namespace graphics
+
+#endif // PIPELINE_CACHE_H
@@ -0,0 +1,126 @@
+#include <vector>
+
+#include "session_state.h"
+#include "binary.h"
+#include "exceptions.h"
+#include "mapped_file.h"
+
+namespace
+{
+	/// @brief The header of the session format
+	constexpr std::string_view sessionHeader = "honmonosession 1";
+} // namespace
+
+graphics::SessionState::SessionState(std::filesystem::path _path, ViewportRenderer* _renderer,
+		storage::AutosaveScheduler* _autosave) :
+		path(std::move(_path)), renderer(_renderer), autosave(_autosave), generation(0), windowState(0)
+{
+	autosave->addSource(this, {
+		.path = path,
+		.generation = [this] () { return generation; },
+		.snapshot = [this] () { return snapshot = serialize(); },
+		.saved = std::function<void(std::uint64_t)>(),
+		.prepare = std::function<void()>()
+	});
+}
+
+graphics::SessionState::~SessionState()
+{
+	// ImGui only reports changed settings after a delay, so the last changes are looked for here
+	if (ImGui::GetCurrentContext() != nullptr && serialize() != snapshot)
+		++generation;
+	autosave->removeSource(this);
+}
+
+void graphics::SessionState::load()
+{
+	std::error_code error;
+	if (!std::filesystem::exists(path, error))
+		return;
+
+	const storage::MappedFile file(path);
+	storage::BinaryReader reader(file.view());
+	std::string_view ini;
+	std::vector<std::pair<std::string_view, bool>> windows;
+	try
+	{
+		if (reader.readBytes(sessionHeader.size()) != sessionHeader)
+			throw storage::ParsingError("Wrong header.");
+		const std::uint32_t size = reader.readU32();
+		const std::uint32_t checksum = reader.readU32();
+		if (reader.remaining().size() != size || static_cast<std::uint32_t>(storage::fnv1a(reader.remaining())) != checksum)
+			throw storage::ParsingError("Wrong checksum.");
+
+		ini = reader.readString();
+		while (!reader.empty())
+		{
+			const std::string_view name = reader.readString();
+			windows.emplace_back(name, reader.readU8() != 0);
+		}
+	}
+	catch (const storage::ParsingError&)
+	{
+		throw storage::ParsingError("Session file <", path.string(), "> is damaged.");
+	}
+
+	// Windows unknown to this version are ignored, new windows keep their default state
+	if (!ini.empty())
+		ImGui::LoadIniSettingsFromMemory(ini.data(), ini.size());
+	renderer->forEachWindowState(
+		[&windows] (std::string_view name, bool& open)
+		{
+			for (const auto& [storedName, storedOpen] : windows)
+				if (storedName == name)
+					open = storedOpen;
+		}
+	);
+	windowState = getWindowState();
+	snapshot = file.view();
+}
+
+void graphics::SessionState::update()
+{
+	ImGuiIO& io = ImGui::GetIO();
+	const std::uint64_t state = getWindowState();
+	if (io.WantSaveIniSettings || state != windowState)
+	{
+		io.WantSaveIniSettings = false;
+		windowState = state;
+		++generation;
+	}
+}
+
+std::string graphics::SessionState::serialize()
+{
+	std::string payload;
+	storage::BinaryWriter writer(payload);
+	std::size_t iniSize = 0;
+	const char* const ini = ImGui::SaveIniSettingsToMemory(&iniSize);
+	writer.writeString(std::string_view(ini, iniSize));
+	renderer->forEachWindowState(
+		[&writer] (std::string_view name, bool& open)
+		{
+			writer.writeString(name);
+			writer.writeU8(open);
+		}
+	);
+
+	std::string content(sessionHeader);
+	storage::BinaryWriter header(content);
+	header.writeU32(static_cast<std::uint32_t>(payload.size()));
+	header.writeU32(static_cast<std::uint32_t>(storage::fnv1a(payload)));
+	return content += payload;
+}
+
+std::uint64_t graphics::SessionState::getWindowState()
+{
+	std::uint64_t state = 0;
+	std::size_t index = 0;
+	renderer->forEachWindowState(
+		[&state, &index] (std::string_view, bool& open)
+		{
+			state ^= static_cast<std::uint64_t>(open) << (index++ % 64);
+		}
+	);
+	return state;
+}
@@ -0,0 +1,83 @@
+#ifndef SESSION_STATE_H
+#define SESSION_STATE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "autosave.h"
+#include "windows.h"
+
+
+
+namespace graphics
+{
+	/**
+	 * @brief Persists the dock layout, the window positions and the open windows between runs
+	 *
+	 * The ImGui settings, which contain the dock tree and all window
+	 * positions, are stored together with the open state of every window of
+	 * the viewport renderer in one small binary file. Changes are noticed once
+	 * per frame and written through the autosave scheduler, which waits until
+	 * the layout stopped changing, so dragging a window does not cause writes.
+	 */
+	class SessionState
+	{
+	public:
+		/**
+		 * @brief Construct a new session state
+		 *
+		 * @param _path The file the session is stored in
+		 * @param _renderer The renderer whose windows are persisted
+		 * @param _autosave The scheduler writing the session
+		 */
+		SessionState(std::filesystem::path _path, ViewportRenderer* _renderer, storage::AutosaveScheduler* _autosave);
+		SessionState(const SessionState&) = delete;
+		/**
+		 * @brief Write the session one last time if it changed
+		 */
+		~SessionState();
+
+		SessionState& operator=(const SessionState&) = delete;
+
+		/**
+		 * @brief Restore the stored session, has to be called before the first frame
+		 *
+		 * Nothing happens if no session was stored so far.
+		 */
+		void load();
+		/**
+		 * @brief Notice changes of the session, has to be called once per frame
+		 */
+		void update();
+
+	private:
+		/**
+		 * @brief Encode the current session
+		 *
+		 * @return std::string The content of the session file
+		 */
+		std::string serialize();
+		/**
+		 * @brief Combine the open state of all windows into a single value
+		 *
+		 * @return std::uint64_t The combined state
+		 */
+		std::uint64_t getWindowState();
+
+		/// @brief The file the session is stored in
+		const std::filesystem::path path;
+		/// @brief The renderer whose windows are persisted
+		ViewportRenderer* const renderer;
+		/// @brief The scheduler writing the session
+		storage::AutosaveScheduler* const autosave;
+		/// @brief Bumped whenever the session changed
+		std::uint64_t generation;
+		/// @brief The combined open state of all windows at the last update
+		std::uint64_t windowState;
+		/// @brief The content of the last snapshot, so an unchanged session is not written on exit
+		std::string snapshot;
+	};
+} // namespace graphics
+
+#endif // SESSION_STATE_H
@@ -1,7 +1,17 @@
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <chrono>
+#include <climits>
 #include <cmath>
+#include <cstdio>
 #include "windows.h"
+#include "exceptions.h"
+#include "frame_pacer.h"
+#include "glyph_cache.h"
 #include "imgui_tools.h"
 #include "imgui_markdown.h"
+#include "text_scan.h"
 
 #ifdef DEBUG
 	#ifndef SHOW_FPS_COUNTER
@@ -23,7 +33,8 @@ void graphics::ViewportRenderer::renderMainMenuBar()
 
 			if (ImGui::BeginMenu("Import"))
 			{
-				ImGui::MenuItem("Text");
+				if (ImGui::MenuItem("Text", NULL, false, textImportWindow != nullptr))
+					textImportWindow->_active = true;
 				ImGui::MenuItem("Image");
 				ImGui::EndMenu();
 			}
@@ -59,6 +70,7 @@ void graphics::ViewportRenderer::renderMainMenuBar()
 			ImGui::MenuItem("Stack Tool", NULL, &active_stack_tool_window);
 #endif
 			ImGui::MenuItem("UI Performance Metrics", NULL, &active_metrics_window);
+			ImGui::MenuItem("GPU Memory", NULL, &active_memory_window, renderer != nullptr);
 			ImGui::MenuItem("About Dear ImGui", NULL, &active_about_window);
 			ImGui::EndMenu();
 		}
@@ -68,6 +80,14 @@ void graphics::ViewportRenderer::renderMainMenuBar()
 #ifdef SHOW_FPS_COUNTER
 		ImGui::TextDisabled("%2.1f FPS [%2.0f ms/f]", ImGui::GetIO().Framerate, 1000.0f / ImGui::GetIO().Framerate);
 		ImGui::Separator();
+		if (renderer != nullptr)
+		{
+			const VulkanInstance::FrameStatistics& statistics = renderer->getFrameStatistics();
+			ImGui::TextDisabled("%llu rendered, %llu unchanged frames skipped",
+					static_cast<unsigned long long>(statistics.rendered),
+					static_cast<unsigned long long>(statistics.skipped));
+			ImGui::Separator();
+		}
 #endif
 
 #ifdef DEBUG
@@ -91,6 +111,10 @@ void graphics::ViewportRenderer::renderWindows()
 		if (window->_active)
 			window->render(&window->_active);
 
+	// Render the import windows
+	if (textImportWindow != nullptr && textImportWindow->_active)
+		textImportWindow->render(&textImportWindow->_active);
+
 #ifdef DEBUG
 	if (active_demo_window)
 		ImGui::ShowDemoWindow(&active_demo_window);
@@ -100,40 +124,215 @@ void graphics::ViewportRenderer::renderWindows()
 
 	if (active_metrics_window)
 		ImGui::ShowMetricsWindow(&active_metrics_window);
+	if (active_memory_window && renderer != nullptr)
+		renderMemoryWindow(&active_memory_window);
 	if (active_about_window)
 		ImGui::ShowAboutWindow(&active_about_window);
 }
 
+void graphics::ViewportRenderer::forEachWindowState(const std::function<void(std::string_view, bool&)>& function)
+{
+	for (StaticWindow* window : staticWindows)
+		function(window->getName(), window->_active);
+	for (StaticWindow* window : settingsWindows)
+		function(window->getName(), window->_active);
+	if (textImportWindow != nullptr)
+		function(textImportWindow->getName(), textImportWindow->_active);
+
+#ifdef DEBUG
+	function("Dear ImGui Demo", active_demo_window);
+	function("Dear ImGui Stack Tool", active_stack_tool_window);
+#endif
+	function("Dear ImGui Metrics/Debugger", active_metrics_window);
+	function("GPU Memory", active_memory_window);
+	function("About Dear ImGui", active_about_window);
+}
+
+void graphics::ViewportRenderer::renderMemoryWindow(bool* open)
+{
+	ImGui::SetNextWindowSize(ImVec2(560, 360), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("GPU Memory", open))
+	{
+		ImGui::End();
+		return;
+	}
+
+	const VkPhysicalDeviceProperties& device = renderer->getDeviceProperties();
+	const char* deviceType = device.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU ? "discrete"
+			: device.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ? "integrated" : "other";
+	ImGui::Text("%s, %s GPU", device.deviceName, deviceType);
+
+	// Switching the geometry memory shows which path the GPU draws fastest, measured with the same UI on screen
+	static constexpr const char* geometryNames[ImGui_ImplVulkan_GeometryMemory_COUNT] = {
+		"Host memory", "Device memory, mapped", "Device memory, staged"
+	};
+	const ImGui_ImplVulkan_GeometryMemory current = ImGui_ImplVulkan_GetGeometryMemory();
+	const VulkanInstance::GeometryTimings& timings = renderer->getGeometryTimings();
+	for (int i = 0; i < ImGui_ImplVulkan_GeometryMemory_COUNT; ++i)
+	{
+		const ImGui_ImplVulkan_GeometryMemory memory = static_cast<ImGui_ImplVulkan_GeometryMemory>(i);
+		ImGui::BeginDisabled(!ImGui_ImplVulkan_IsGeometryMemorySupported(memory));
+		if (ImGui::RadioButton(geometryNames[i], current == memory))
+			ImGui_ImplVulkan_SetGeometryMemory(memory);
+		ImGui::EndDisabled();
+		ImGui::SameLine(200.0f);
+		if (!renderer->hasGpuTimings())
+			ImGui::TextDisabled("no GPU timestamps");
+		else if (timings[i].frames == 0)
+			ImGui::TextDisabled("not measured");
+		else
+			ImGui::TextDisabled("%.3f ms GPU time per frame, %llu frames", timings[i].milliseconds,
+					static_cast<unsigned long long>(timings[i].frames));
+	}
+	ImGui::Separator();
+
+	const GpuMemoryAllocator::Statistics statistics = renderer->getMemoryStatistics();
+	ImGui::Text("%zu device memory objects, %llu allocated in total for %llu requests", statistics.deviceAllocations,
+			static_cast<unsigned long long>(statistics.allocateCalls),
+			static_cast<unsigned long long>(statistics.requests));
+	ImGui::Text("%zu dedicated allocations, %.1f KiB", statistics.dedicatedAllocations,
+			statistics.dedicatedBytes / 1024.0);
+
+	if (ImGui::BeginTable("##pools", 7, ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY))
+	{
+		ImGui::TableSetupColumn("Memory Type");
+		ImGui::TableSetupColumn("Pool");
+		ImGui::TableSetupColumn("Blocks", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Reserved KiB", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Used KiB", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Pieces", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Largest Free KiB", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableHeadersRow();
+		for (const GpuMemoryAllocator::PoolStatistics& pool : statistics.pools)
+		{
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("%u %s%s%s", pool.memoryType,
+					(pool.properties & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0 ? "[device]" : "",
+					(pool.properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0 ? "[host]" : "",
+					(pool.properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0 ? "[coherent]" : "");
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(pool.linear ? "linear"
+					: pool.resource == GpuMemoryAllocator::Resource::Image ? "images" : "buffers");
+			ImGui::TableNextColumn();
+			ImGui::Text("%zu", pool.blocks);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f", pool.reserved / 1024.0);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f", pool.used / 1024.0);
+			ImGui::TableNextColumn();
+			ImGui::Text("%zu", pool.allocations);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f", pool.largestFree / 1024.0);
+		}
+		ImGui::EndTable();
+	}
+	ImGui::End();
+}
+
 void graphics::LibraryWindow::render(bool* open)
 {
 	ImGui::SetNextWindowSize(ImVec2(200, 300), ImGuiCond_FirstUseEver);
 	if (ImGui::Begin("Library Viewer", open, ImGuiWindowFlags_MenuBar))
 	{
+		// Forget the selection when another library became active
+		if (library != libraries->getActiveLibrary())
+		{
+			library = libraries->getActiveLibrary();
+			currentShelf = nullptr;
+			currentBookId = 0;
+			index.invalidate();
+		}
+		loader = libraries->getActiveLoader();
+
+		// Other windows and the menu add and delete books, which moves them
+		findCurrentBook();
 		renderMenuBar();
-		renderLibrary(library);
+		findCurrentBook();
+		renderLoader();
+		if (isEditable())
+			renderFilter();
+
+		if (library == nullptr)
+			ImGui::TextDisabled("No library selected.");
+		else if (isEditable() && !query.empty())
+			renderResults();
+		else
+			renderLibrary(library);
+
+		if (currentBook != nullptr && isEditable())
+			renderBookProperties();
 	}
 	ImGui::End();
 }
 
+void graphics::LibraryWindow::findCurrentBook()
+{
+	currentBook = nullptr;
+	if (!isEditable())
+		return;
+
+	if (index.update(*library))
+		filterChanged = true;
+	if (currentBookId != 0)
+		currentBook = index.findBook(currentBookId);
+}
+
+bool graphics::LibraryWindow::isEditable() const
+{
+	// An incomplete library must neither be changed nor saved
+	return library != nullptr && libraries->isActiveComplete();
+}
+
+void graphics::LibraryWindow::renderLoader()
+{
+	if (loader == nullptr)
+		return;
+
+	switch (loader->getState())
+	{
+	case storage::LibraryLoader::State::Running:
+		ImGui::ProgressBar(loader->getProgress(), ImVec2(-ImGui::GetFrameHeightWithSpacing() * 3, 0));
+		FramePacer::requestFrame(FramePacer::progressInterval);
+		ImGui::SameLine();
+		if (ImGui::SmallButton("Cancel"))
+			loader->cancel();
+		break;
+
+	case storage::LibraryLoader::State::Failed:
+		ImGui::TextWrapped("Unable to load the library: %s", loader->getError().c_str());
+		break;
+
+	case storage::LibraryLoader::State::Cancelled:
+		ImGui::TextDisabled("Loading cancelled, the library is incomplete and read-only.");
+		break;
+
+	case storage::LibraryLoader::State::Finished:
+		break;
+	}
+}
+
 void graphics::LibraryWindow::renderMenuBar()
 {
 	if (ImGui::BeginMenuBar())
 	{
+		renderLibraryMenu();
+
+		const bool editable = isEditable();
+		if (!editable)
+			ImGui::BeginDisabled();
+
 		if (ImGui::BeginMenu("Edit"))
 		{
 			if (ImGui::BeginMenu("Add"))
 			{
 				if (ImGui::MenuItem("Shelf"))
-				{
-					if (currentShelf != nullptr)
-						currentShelf->subshelfs.emplace_back();
-					else
-						library->shelfs.emplace_back();
-				}
+					library->addShelf(currentShelf);
 
 				if (ImGui::MenuItem("Book"))
 					if (currentShelf != nullptr)
-						currentShelf->books.emplace_back();
+						library->addBook(currentShelf, storage::LibraryBook());
 
 				ImGui::EndMenu();
 			}
@@ -146,7 +345,7 @@ void graphics::LibraryWindow::renderMenuBar()
 
 				if (ImGui::MenuItem("Book"))
 					if (library->deleteBook(currentBook))
-						currentBook = nullptr;
+						currentBookId = 0;
 
 				ImGui::EndMenu();
 			}
@@ -154,13 +353,59 @@ void graphics::LibraryWindow::renderMenuBar()
 			ImGui::EndMenu();
 		}
 
-		if (ImGui::MenuItem("Save"))
-			library->save();
+		if (ImGui::MenuItem(library != nullptr && library->isDirty() ? "Save*" : "Save"))
+		{
+			// Route manual saves through the autosave so writes stay ordered
+			if (autosave != nullptr)
+				autosave->save(library);
+			else
+				library->save();
+		}
+		if (autosave != nullptr && ImGui::IsItemHovered())
+		{
+			const auto metrics = autosave->getMetrics();
+			ImGui::BeginTooltip();
+			ImGui::Text("Autosave: %llu writes (%zu last minute)",
+					static_cast<unsigned long long>(metrics.writes), metrics.writesLastMinute);
+			ImGui::Text("%llu edits, %.1f KiB written, %llu failed",
+					static_cast<unsigned long long>(metrics.edits), metrics.bytesWritten / 1024.0,
+					static_cast<unsigned long long>(metrics.failedWrites));
+			ImGui::Text("Last write %.1f ms, backoff x%.0f",
+					metrics.lastWriteTime.count() * 1000.0, metrics.backoff);
+			ImGui::EndTooltip();
+		}
+
+		if (!editable)
+			ImGui::EndDisabled();
 
 		ImGui::EndMenuBar();
 	}
 }
 
+void graphics::LibraryWindow::renderLibraryMenu()
+{
+	if (ImGui::BeginMenu("Library"))
+	{
+		for (const auto& info : libraries->getLibraries())
+		{
+			GlyphCache::request(info.name);
+			if (ImGui::MenuItem(info.name.c_str(), libraries->isResident(info.path) ? "resident" : nullptr,
+					library != nullptr && library->getPath() == info.path))
+				libraries->select(info.path);
+			if (ImGui::IsItemHovered())
+				ImGui::SetTooltip("Owner: %s\n%.1f KiB on disk", info.owner.c_str(), info.fileSize / 1024.0);
+		}
+
+		ImGui::Separator();
+
+		if (ImGui::MenuItem("Rescan"))
+			libraries->scan();
+		ImGui::TextDisabled("%.1f MiB resident", libraries->getResidentMemory() / (1024.0 * 1024.0));
+
+		ImGui::EndMenu();
+	}
+}
+
 void graphics::LibraryWindow::renderLibrary(storage::Library* library)
 {
 	for (auto& shelf : *library)
@@ -169,6 +414,7 @@ void graphics::LibraryWindow::renderLibrary(storage::Library* library)
 
 void graphics::LibraryWindow::renderShelf(storage::LibraryShelf& shelf)
 {
+	GlyphCache::request(shelf.getName());
 	ImGui::SetNextItemOpen(true, ImGuiCond_Once);
 	bool node_open = ImGui::TreeNodeEx((void*) nullptr,
 			ImGuiTreeNodeFlags_OpenOnArrow
@@ -177,7 +423,7 @@ void graphics::LibraryWindow::renderShelf(storage::LibraryShelf& shelf)
 			| ImGuiTreeNodeFlags_SpanFullWidth
 			| (currentShelf == &shelf ? ImGuiTreeNodeFlags_Selected : 0),
 			shelf.getName().c_str());
-	if (ImGui::IsItemClicked() && !ImGui::IsItemToggledOpen())
+	if (ImGui::IsItemClicked() && !ImGui::IsItemToggledOpen() && isEditable())
 	{
 		if (currentShelf != &shelf)
 			currentShelf = &shelf;
@@ -194,6 +440,7 @@ void graphics::LibraryWindow::renderShelf(storage::LibraryShelf& shelf)
 
 void graphics::LibraryWindow::renderBook(storage::LibraryBook& book)
 {
+	GlyphCache::request(book.getName());
 	ImGui::TreeNodeEx((void*) nullptr,
 			ImGuiTreeNodeFlags_OpenOnArrow
 			| ImGuiTreeNodeFlags_OpenOnDoubleClick
@@ -203,8 +450,1238 @@ void graphics::LibraryWindow::renderBook(storage::LibraryBook& book)
 			| ImGuiTreeNodeFlags_NoTreePushOnOpen
 			| (currentBook == &book ? ImGuiTreeNodeFlags_Bullet : 0),
 			book.getName().c_str());
-	if (ImGui::IsItemClicked())
+	if (ImGui::IsItemClicked() && isEditable())
+	{
 		currentBook = &book;
+		currentBookId = book.getId();
+	}
+	if (bookOpenHandler && ImGui::IsItemHovered() && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+		bookOpenHandler(book);
+}
+
+void graphics::LibraryWindow::renderFilter()
+{
+	ImGui::SetNextItemWidth(-FLT_MIN);
+	if (ImGui::InputTextWithHint("##filter", "Filter, e.g. tag:villain words>2000", filter, sizeof(filter)))
+	{
+		// Keep showing the results of the last valid query while typing
+		try
+		{
+			query = storage::Query(filter);
+			filterError.clear();
+			filterChanged = true;
+		}
+		catch (const storage::ParsingError& error)
+		{
+			filterError = error.what();
+		}
+	}
+
+	// The index only changes with the library, the query is evaluated again on either change
+	if (index.update(*library) || filterChanged)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		storage::Bitmap matches;
+		query.evaluate(*library, index, matches);
+		results.clear();
+		matches.forEach([this] (std::size_t position) { results.push_back(position); });
+
+		filterTime = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		filterChanged = false;
+	}
+
+	if (!filterError.empty())
+		ImGui::TextDisabled("%s", filterError.c_str());
+}
+
+void graphics::LibraryWindow::renderResults()
+{
+	ImGui::TextDisabled("%zu of %zu books (%.0f us)", results.size(), index.size(), filterTime);
+
+	ImGuiListClipper clipper;
+	clipper.Begin(results.size());
+	while (clipper.Step())
+	{
+		for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i)
+		{
+			storage::LibraryBook* const book = index.getBook(results[i]);
+
+			ImGui::PushID(i);
+			GlyphCache::request(book->getName());
+			if (ImGui::Selectable(book->getName().c_str(), currentBook == book))
+			{
+				currentBook = book;
+				currentBookId = book->getId();
+			}
+			if (ImGui::IsItemHovered())
+			{
+				const std::string path = index.getShelfPath(results[i]);
+				GlyphCache::request(path);
+				ImGui::SetTooltip("%s", path.c_str());
+				if (bookOpenHandler && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+					bookOpenHandler(*book);
+			}
+			ImGui::PopID();
+		}
+	}
+	clipper.End();
+}
+
+void graphics::LibraryWindow::renderBookProperties()
+{
+	const auto& attributes = storage::MetadataStore::attributes;
+
+	// Refill the buffers whenever another book was selected or the library changed
+	if (propertiesBookId != currentBookId || propertiesGeneration != library->getGeneration())
+	{
+		for (std::size_t i = 0; i < attributes.size(); ++i)
+		{
+			const std::string value = library->getMetadata().get(currentBook->getId(), attributes[i].name);
+			value.copy(properties[i], sizeof(properties[i]) - 1);
+			properties[i][std::min(value.size(), sizeof(properties[i]) - 1)] = '\0';
+		}
+		propertiesBookId = currentBookId;
+		propertiesGeneration = library->getGeneration();
+	}
+
+	ImGui::Separator();
+	GlyphCache::request(currentBook->getName());
+	ImGui::TextDisabled("%s", currentBook->getName().c_str());
+
+	for (std::size_t i = 0; i < attributes.size(); ++i)
+	{
+		GlyphCache::request(properties[i]);
+		ImGui::InputText(attributes[i].name.data(), properties[i], sizeof(properties[i]));
+		if (ImGui::IsItemHovered())
+		{
+			switch (attributes[i].type)
+			{
+			case storage::MetadataStore::Type::Date:
+				ImGui::SetTooltip("A date like 2024-12-31");
+				break;
+			case storage::MetadataStore::Type::Tags:
+				ImGui::SetTooltip("A comma separated list of tags");
+				break;
+			default:
+				break;
+			}
+		}
+
+		// Invalid values are dropped by refilling the buffers with the stored values
+		if (ImGui::IsItemDeactivatedAfterEdit()
+				&& !library->setMetadata(currentBook, attributes[i].name, properties[i]))
+			propertiesBookId = 0;
+	}
+}
+
+void graphics::RelationshipWindow::render(bool* open)
+{
+	ImGui::SetNextWindowSize(ImVec2(500, 400), ImGuiCond_FirstUseEver);
+	if (ImGui::Begin("Relationships", open))
+	{
+		// Lay the graph out anew when another library became active or finished loading
+		if (library != libraries->getActiveLibrary() || complete != libraries->isActiveComplete())
+		{
+			library = libraries->getActiveLibrary();
+			complete = libraries->isActiveComplete();
+			layout.clear();
+			selected = storage::RelationshipGraph::noEntity;
+			target = storage::RelationshipGraph::noEntity;
+			dragged = storage::GraphLayout::noNode;
+		}
+
+		if (library == nullptr)
+			ImGui::TextDisabled("No library selected.");
+		else if (!complete)
+			ImGui::TextDisabled("The relationships are shown once the library is loaded.");
+		else
+		{
+			const storage::RelationshipGraph& graph = library->getGraph();
+			if (!graph.isEntity(selected))
+				selected = storage::RelationshipGraph::noEntity;
+			if (!graph.isEntity(target))
+				target = storage::RelationshipGraph::noEntity;
+
+			// Node indices change with the graph, so a drag in progress ends
+			if (layout.update(graph, library->getGeneration()))
+			{
+				layout.release();
+				dragged = storage::GraphLayout::noNode;
+			}
+			layout.step(layoutBudget);
+			if (!layout.isSettled())
+				FramePacer::requestFrame();
+
+			renderToolbar();
+			const float selectionHeight = selected != storage::RelationshipGraph::noEntity
+					? ImGui::GetFrameHeightWithSpacing() * 7.0f : 0.0f;
+			renderCanvas(ImGui::GetContentRegionAvail().y - selectionHeight);
+			if (selected != storage::RelationshipGraph::noEntity)
+				renderSelection();
+		}
+	}
+	ImGui::End();
+}
+
+bool graphics::RelationshipWindow::isEditable() const
+{
+	return library != nullptr && libraries->isActiveComplete();
+}
+
+void graphics::RelationshipWindow::renderToolbar()
+{
+	const bool editable = isEditable();
+	if (!editable)
+		ImGui::BeginDisabled();
+
+	ImGui::SetNextItemWidth(ImGui::GetFontSize() * 12.0f);
+	const bool submit = ImGui::InputTextWithHint("##entity", "New entity", entityName, sizeof(entityName),
+			ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(ImGui::GetFontSize() * 7.0f);
+	const auto type = static_cast<storage::RelationshipGraph::EntityType>(entityType);
+	if (ImGui::BeginCombo("##type", storage::RelationshipGraph::getTypeName(type).data()))
+	{
+		for (int i = 0; i <= static_cast<int>(storage::RelationshipGraph::EntityType::Term); ++i)
+			if (ImGui::Selectable(storage::RelationshipGraph::getTypeName(
+					static_cast<storage::RelationshipGraph::EntityType>(i)).data(), i == entityType))
+				entityType = i;
+		ImGui::EndCombo();
+	}
+	ImGui::SameLine();
+	if ((ImGui::Button("Add") || submit) && entityName[0] != '\0')
+	{
+		selected = library->addEntity(entityName, type);
+		entityName[0] = '\0';
+	}
+
+	if (!editable)
+		ImGui::EndDisabled();
+
+	const storage::GraphLayout::Statistics& statistics = layout.getStatistics();
+	ImGui::SameLine();
+	ImGui::TextDisabled("%zu/%zu entities, %zu/%zu links drawn, %zu iterations in %.2f ms (%s)%s",
+			drawnNodes, layout.size(), drawnLinks, layout.getLinks().size(), statistics.iterations,
+			statistics.stepTime, statistics.kernel, layout.isSettled() ? ", settled" : "");
+}
+
+void graphics::RelationshipWindow::renderCanvas(float height)
+{
+	const storage::RelationshipGraph& graph = library->getGraph();
+	const std::vector<float>& positionX = layout.getX();
+	const std::vector<float>& positionY = layout.getY();
+	const ImGuiIO& io = ImGui::GetIO();
+
+	const ImVec2 origin = ImGui::GetCursorScreenPos();
+	const ImVec2 size(std::max(ImGui::GetContentRegionAvail().x, 50.0f), std::max(height, 50.0f));
+	ImGui::InvisibleButton("##canvas", size, ImGuiButtonFlags_MouseButtonLeft | ImGuiButtonFlags_MouseButtonRight);
+	const bool hovered = ImGui::IsItemHovered();
+
+	// Zoom around the mouse cursor and pan with the right mouse button
+	const float centerX = origin.x + size.x / 2.0f;
+	const float centerY = origin.y + size.y / 2.0f;
+	if (hovered && io.MouseWheel != 0.0f)
+	{
+		const float worldX = (io.MousePos.x - centerX - offsetX) / zoom;
+		const float worldY = (io.MousePos.y - centerY - offsetY) / zoom;
+		zoom = std::clamp(zoom * std::pow(1.2f, io.MouseWheel), 0.02f, 8.0f);
+		offsetX = io.MousePos.x - centerX - worldX * zoom;
+		offsetY = io.MousePos.y - centerY - worldY * zoom;
+	}
+	if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Right))
+	{
+		offsetX += io.MouseDelta.x;
+		offsetY += io.MouseDelta.y;
+	}
+
+	// The screen position of the origin of the layout
+	const float screenX = centerX + offsetX;
+	const float screenY = centerY + offsetY;
+	const float mouseX = (io.MousePos.x - screenX) / zoom;
+	const float mouseY = (io.MousePos.y - screenY) / zoom;
+	const float radius = std::clamp(6.0f * zoom, 2.0f, 12.0f);
+	const std::uint32_t hoveredNode = hovered ? findNode(mouseX, mouseY, (radius + 2.0f) / zoom)
+			: storage::GraphLayout::noNode;
+
+	// Select with the left mouse button and drag the selection, holding shift picks the link target instead
+	if (hovered && ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+	{
+		const std::uint32_t entity = hoveredNode != storage::GraphLayout::noNode
+				? layout.getEntity(hoveredNode) : storage::RelationshipGraph::noEntity;
+		if (io.KeyShift)
+			target = entity;
+		else
+		{
+			selected = entity;
+			target = storage::RelationshipGraph::noEntity;
+			dragged = hoveredNode;
+		}
+	}
+	if (dragged != storage::GraphLayout::noNode)
+	{
+		if (!ImGui::IsMouseDown(ImGuiMouseButton_Left))
+		{
+			layout.release();
+			dragged = storage::GraphLayout::noNode;
+		}
+		else if (io.MouseDelta.x != 0.0f || io.MouseDelta.y != 0.0f)
+			layout.pin(dragged, mouseX, mouseY);
+	}
+
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+	drawList->PushClipRect(origin, ImVec2(origin.x + size.x, origin.y + size.y), true);
+	drawList->AddRectFilled(origin, ImVec2(origin.x + size.x, origin.y + size.y), ImGui::GetColorU32(ImGuiCol_FrameBg));
+
+	// Only the nodes and links overlapping the visible part of the layout are sent to the draw list
+	const float margin = radius / zoom;
+	const float minimumX = (origin.x - screenX) / zoom - margin;
+	const float maximumX = (origin.x + size.x - screenX) / zoom + margin;
+	const float minimumY = (origin.y - screenY) / zoom - margin;
+	const float maximumY = (origin.y + size.y - screenY) / zoom + margin;
+	const std::uint32_t selectedNode = layout.getNode(selected);
+
+	const ImU32 linkColor = ImGui::GetColorU32(ImGuiCol_Border);
+	const ImU32 highlightColor = ImGui::GetColorU32(ImGuiCol_PlotLinesHovered);
+	drawnLinks = 0;
+	for (const auto& [a, b] : layout.getLinks())
+	{
+		if (std::max(positionX[a], positionX[b]) < minimumX || std::min(positionX[a], positionX[b]) > maximumX
+				|| std::max(positionY[a], positionY[b]) < minimumY || std::min(positionY[a], positionY[b]) > maximumY)
+			continue;
+
+		const bool highlight = a == selectedNode || b == selectedNode;
+		drawList->AddLine(ImVec2(screenX + positionX[a] * zoom, screenY + positionY[a] * zoom),
+				ImVec2(screenX + positionX[b] * zoom, screenY + positionY[b] * zoom),
+				highlight ? highlightColor : linkColor, highlight ? 2.0f : 1.0f);
+		++drawnLinks;
+	}
+
+	const ImU32 typeColors[] = {IM_COL32(90, 150, 230, 255), IM_COL32(110, 190, 110, 255), IM_COL32(230, 150, 70, 255),
+			IM_COL32(170, 120, 210, 255)};
+	const ImU32 textColor = ImGui::GetColorU32(ImGuiCol_Text);
+	const bool labels = zoom >= 0.5f;
+	drawnNodes = 0;
+	for (std::uint32_t node = 0; node < layout.size(); ++node)
+	{
+		if (positionX[node] < minimumX || positionX[node] > maximumX
+				|| positionY[node] < minimumY || positionY[node] > maximumY)
+			continue;
+
+		const std::uint32_t entity = layout.getEntity(node);
+		const storage::RelationshipGraph::Entity& data = graph.getEntities()[entity];
+		const ImVec2 center(screenX + positionX[node] * zoom, screenY + positionY[node] * zoom);
+		drawList->AddCircleFilled(center, radius, typeColors[static_cast<int>(data.type)]);
+		if (entity == selected || entity == target)
+			drawList->AddCircle(center, radius + 3.0f, textColor, 0, 2.0f);
+		if (labels)
+		{
+			GlyphCache::request(data.name);
+			drawList->AddText(ImVec2(center.x + radius + 3.0f, center.y - ImGui::GetFontSize() / 2.0f), textColor,
+					data.name.c_str());
+		}
+		++drawnNodes;
+	}
+
+	drawList->PopClipRect();
+
+	if (hoveredNode != storage::GraphLayout::noNode && dragged == storage::GraphLayout::noNode)
+	{
+		const storage::RelationshipGraph::Entity& data = graph.getEntities()[layout.getEntity(hoveredNode)];
+		GlyphCache::request(data.name);
+		ImGui::SetTooltip("%s (%s)", data.name.c_str(), storage::RelationshipGraph::getTypeName(data.type).data());
+	}
+}
+
+void graphics::RelationshipWindow::renderSelection()
+{
+	const storage::RelationshipGraph& graph = library->getGraph();
+	const storage::RelationshipGraph::Entity& entity = graph.getEntities()[selected];
+	const bool editable = isEditable();
+
+	ImGui::Separator();
+	GlyphCache::request(entity.name);
+	ImGui::TextUnformatted(entity.name.c_str());
+	ImGui::SameLine();
+	ImGui::TextDisabled("(%s)", storage::RelationshipGraph::getTypeName(entity.type).data());
+	if (editable)
+	{
+		ImGui::SameLine();
+		if (ImGui::SmallButton("Remove"))
+		{
+			library->removeEntity(selected);
+			selected = storage::RelationshipGraph::noEntity;
+			return;
+		}
+	}
+
+	if (ImGui::BeginChild("##relations", ImVec2(0, ImGui::GetFrameHeightWithSpacing() * 4.0f)))
+	{
+		int id = 0;
+		for (const storage::RelationshipGraph::Edge& edge : graph.getNeighbors(selected))
+		{
+			const std::string& type = graph.getRelationTypes()[edge.type];
+			ImGui::PushID(id++);
+			GlyphCache::request(type);
+			GlyphCache::request(graph.getEntities()[edge.target].name);
+			ImGui::Text("%s %s %s", edge.incoming ? "<-" : "->", type.c_str(),
+					graph.getEntities()[edge.target].name.c_str());
+			if (editable)
+			{
+				ImGui::SameLine();
+				if (ImGui::SmallButton("Remove"))
+				{
+					if (edge.incoming)
+						library->removeRelation(edge.target, selected, type);
+					else
+						library->removeRelation(selected, edge.target, type);
+					ImGui::PopID();
+					break;
+				}
+			}
+			ImGui::PopID();
+		}
+	}
+	ImGui::EndChild();
+
+	if (!editable)
+		return;
+
+	if (target == storage::RelationshipGraph::noEntity || target == selected)
+	{
+		ImGui::TextDisabled("Shift-click another entity to link it.");
+		return;
+	}
+
+	const std::string& targetName = graph.getEntities()[target].name;
+	ImGui::SetNextItemWidth(ImGui::GetFontSize() * 12.0f);
+	const bool submit = ImGui::InputTextWithHint("##relation", "Relationship", relationType, sizeof(relationType),
+			ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::SameLine();
+	if ((ImGui::Button(("Link to " + targetName).c_str()) || submit) && relationType[0] != '\0')
+	{
+		library->addRelation(selected, target, relationType);
+		relationType[0] = '\0';
+	}
+
+	ImGui::SameLine();
+	const std::size_t path = graph.findShortestPath(selected, target).size();
+	if (path == 0)
+		ImGui::TextDisabled("Not connected");
+	else
+		ImGui::TextDisabled("%zu relationships apart", path - 1);
+}
+
+std::uint32_t graphics::RelationshipWindow::findNode(float x, float y, float radius) const
+{
+	std::uint32_t nearest = storage::GraphLayout::noNode;
+	float nearestDistance = radius * radius;
+	for (std::uint32_t node = 0; node < layout.size(); ++node)
+	{
+		const float dx = layout.getX()[node] - x;
+		const float dy = layout.getY()[node] - y;
+		if (dx * dx + dy * dy <= nearestDistance)
+		{
+			nearest = node;
+			nearestDistance = dx * dx + dy * dy;
+		}
+	}
+	return nearest;
+}
+
+void graphics::TimelineWindow::render(bool* open)
+{
+	ImGui::SetNextWindowSize(ImVec2(700, 300), ImGuiCond_FirstUseEver);
+	if (ImGui::Begin("Timeline", open))
+	{
+		// Start over when another library became active or finished loading
+		if (library != libraries->getActiveLibrary() || complete != libraries->isActiveComplete())
+		{
+			library = libraries->getActiveLibrary();
+			complete = libraries->isActiveComplete();
+			fitted = false;
+			selected = storage::Timeline::noEvent;
+			edited = storage::Timeline::noEvent;
+			dragged = storage::Timeline::noEvent;
+		}
+
+		if (library == nullptr)
+			ImGui::TextDisabled("No library selected.");
+		else if (!complete)
+			ImGui::TextDisabled("The timeline is shown once the library is loaded.");
+		else
+		{
+			const storage::Timeline& timeline = library->getTimeline();
+			if (!timeline.isEvent(selected))
+				selected = storage::Timeline::noEvent;
+			if (!timeline.isEvent(dragged))
+				dragged = storage::Timeline::noEvent;
+			if (!fitted)
+				fit();
+
+			renderToolbar();
+			const float selectionHeight = selected != storage::Timeline::noEvent
+					? ImGui::GetFrameHeightWithSpacing() * 7.0f : 0.0f;
+			renderCanvas(ImGui::GetContentRegionAvail().y - selectionHeight);
+			if (selected != storage::Timeline::noEvent)
+				renderSelection();
+		}
+	}
+	ImGui::End();
+}
+
+bool graphics::TimelineWindow::isEditable() const
+{
+	return library != nullptr && libraries->isActiveComplete();
+}
+
+void graphics::TimelineWindow::fit()
+{
+	const storage::Timeline& timeline = library->getTimeline();
+	const float width = std::max(ImGui::GetContentRegionAvail().x, 50.0f);
+
+	// Show the first week of an empty timeline
+	const double start = timeline.size() != 0 ? static_cast<double>(timeline.getStart()) : 0.0;
+	const double end = timeline.size() != 0 ? static_cast<double>(timeline.getEnd()) : 7.0 * 24.0 * 60.0;
+	const double span = std::max(end - start, 60.0);
+	scale = width / (span * 1.1);
+	offset = start - span * 0.05;
+	fitted = true;
+}
+
+void graphics::TimelineWindow::renderToolbar()
+{
+	const bool editable = isEditable();
+	if (!editable)
+		ImGui::BeginDisabled();
+
+	ImGui::SetNextItemWidth(ImGui::GetFontSize() * 10.0f);
+	bool submit = ImGui::InputTextWithHint("##event", "New event", eventName, sizeof(eventName),
+			ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(ImGui::GetFontSize() * 6.0f);
+	submit |= ImGui::InputTextWithHint("##start", "Day hh:mm", eventStart, sizeof(eventStart),
+			ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(ImGui::GetFontSize() * 6.0f);
+	submit |= ImGui::InputTextWithHint("##end", "Until", eventEnd, sizeof(eventEnd),
+			ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::SameLine();
+
+	// Events without an end take no time
+	std::int64_t start, end;
+	const bool valid = eventName[0] != '\0' && storage::Timeline::parseTime(eventStart, start)
+			&& (eventEnd[0] == '\0' ? (end = start, true) : storage::Timeline::parseTime(eventEnd, end)) && end >= start;
+	if ((ImGui::Button("Add") || submit) && valid)
+	{
+		selected = library->addEvent(eventName, start, end);
+		eventName[0] = '\0';
+	}
+
+	if (!editable)
+		ImGui::EndDisabled();
+
+	ImGui::SameLine();
+	if (ImGui::Button("Fit"))
+		fit();
+
+	ImGui::SameLine();
+	if (histogram)
+		ImGui::TextDisabled("%zu events, density of %zu shown", library->getTimeline().size(), aggregatedEvents);
+	else
+		ImGui::TextDisabled("%zu events, %zu drawn, %zu aggregated", library->getTimeline().size(), drawnEvents,
+				aggregatedEvents);
+}
+
+void graphics::TimelineWindow::renderCanvas(float height)
+{
+	const storage::Timeline& timeline = library->getTimeline();
+	const ImGuiIO& io = ImGui::GetIO();
+
+	const ImVec2 origin = ImGui::GetCursorScreenPos();
+	const ImVec2 size(std::max(ImGui::GetContentRegionAvail().x, 50.0f), std::max(height, 50.0f));
+	ImGui::InvisibleButton("##canvas", size, ImGuiButtonFlags_MouseButtonLeft | ImGuiButtonFlags_MouseButtonRight);
+	const bool hovered = ImGui::IsItemHovered();
+
+	// Zoom around the mouse cursor and pan with the right mouse button
+	if (hovered && io.MouseWheel != 0.0f)
+	{
+		const double time = offset + (io.MousePos.x - origin.x) / scale;
+		scale = std::clamp(scale * std::pow(1.2, io.MouseWheel), 1e-7, 8.0);
+		offset = time - (io.MousePos.x - origin.x) / scale;
+	}
+	if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Right))
+		offset -= io.MouseDelta.x / scale;
+
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+	drawList->PushClipRect(origin, ImVec2(origin.x + size.x, origin.y + size.y), true);
+	drawList->AddRectFilled(origin, ImVec2(origin.x + size.x, origin.y + size.y), ImGui::GetColorU32(ImGuiCol_FrameBg));
+	renderAxis(drawList, origin, size);
+
+	// Zoomed far out only the density of the events is drawn, it is counted without visiting them
+	const std::int64_t from = static_cast<std::int64_t>(std::floor(offset));
+	const std::int64_t to = static_cast<std::int64_t>(std::ceil(offset + size.x / scale));
+	const std::size_t count = timeline.countOverlapping(from, to);
+	histogram = count > histogramLimit;
+	if (histogram)
+	{
+		renderHistogram(drawList, origin, size);
+		aggregatedEvents = count;
+		drawnEvents = 0;
+		drawList->PopClipRect();
+		return;
+	}
+
+	const float axisHeight = ImGui::GetTextLineHeightWithSpacing();
+	const float densityHeight = ImGui::GetFontSize();
+	const float laneHeight = ImGui::GetFrameHeight();
+	const float spacing = 2.0f;
+	const std::size_t laneCount = std::max(1.0f, (size.y - axisHeight - densityHeight) / (laneHeight + spacing));
+	const std::size_t bucketCount = static_cast<std::size_t>(size.x / bucketWidth) + 1;
+	laneEnds.clear();
+	density.assign(bucketCount + 1, 0);
+
+	visible.clear();
+	timeline.forEachOverlapping(from, to, [this] (std::uint32_t event) { visible.push_back(event); });
+
+	// Pack the events ordered by start into the first lane free at their start, the rest only adds to the density
+	const ImU32 eventColor = ImGui::GetColorU32(ImGuiCol_Button);
+	const ImU32 hoveredColor = ImGui::GetColorU32(ImGuiCol_ButtonHovered);
+	const ImU32 selectedColor = ImGui::GetColorU32(ImGuiCol_PlotLinesHovered);
+	const ImU32 textColor = ImGui::GetColorU32(ImGuiCol_Text);
+	std::uint32_t hoveredEvent = storage::Timeline::noEvent;
+	drawnEvents = 0;
+	aggregatedEvents = 0;
+	for (const std::uint32_t event : visible)
+	{
+		const storage::Timeline::Event& data = timeline.getEvents()[event];
+		const std::int64_t delta = event == dragged ? dragDelta : 0;
+		const float left = std::max(origin.x + static_cast<float>((data.start + delta - offset) * scale), origin.x - 1.0f);
+		const float right = std::min(origin.x + static_cast<float>((data.end + delta - offset) * scale),
+				origin.x + size.x + 1.0f);
+		const float width = std::max(right - left, 4.0f);
+
+		std::size_t lane = 0;
+		while (lane < laneEnds.size() && laneEnds[lane] + spacing > left)
+			++lane;
+		if (lane == laneCount)
+		{
+			const std::size_t first = std::clamp((left - origin.x) / bucketWidth, 0.0f, float(bucketCount - 1));
+			const std::size_t last = std::clamp((left + width - origin.x) / bucketWidth, 0.0f, float(bucketCount - 1));
+			++density[first];
+			--density[last + 1];
+			++aggregatedEvents;
+			continue;
+		}
+		if (lane == laneEnds.size())
+			laneEnds.push_back(0.0f);
+		laneEnds[lane] = left + width;
+
+		const ImVec2 minimum(left, origin.y + axisHeight + lane * (laneHeight + spacing));
+		const ImVec2 maximum(left + width, minimum.y + laneHeight);
+		const bool isHovered = hovered && io.MousePos.x >= minimum.x && io.MousePos.x < maximum.x
+				&& io.MousePos.y >= minimum.y && io.MousePos.y < maximum.y;
+		if (isHovered)
+			hoveredEvent = event;
+
+		drawList->AddRectFilled(minimum, maximum, isHovered ? hoveredColor : eventColor, 3.0f);
+		if (event == selected)
+			drawList->AddRect(minimum, maximum, selectedColor, 3.0f, 0, 2.0f);
+		if (width > ImGui::GetFontSize())
+		{
+			drawList->PushClipRect(minimum, maximum, true);
+			GlyphCache::request(data.name);
+			drawList->AddText(ImVec2(minimum.x + 4.0f, minimum.y + ImGui::GetStyle().FramePadding.y), textColor,
+					data.name.c_str());
+			drawList->PopClipRect();
+		}
+		++drawnEvents;
+	}
+
+	// The events not fitting into a lane are drawn as a strip whose brightness follows their number
+	if (aggregatedEvents != 0)
+	{
+		const ImVec4 color = ImGui::GetStyleColorVec4(ImGuiCol_PlotHistogram);
+		const float top = origin.y + size.y - densityHeight;
+		int overlapping = 0;
+		int maximum = 1;
+		for (std::size_t bucket = 0; bucket < bucketCount; ++bucket)
+			maximum = std::max(maximum, overlapping += density[bucket]);
+		overlapping = 0;
+		for (std::size_t bucket = 0; bucket < bucketCount; ++bucket)
+		{
+			overlapping += density[bucket];
+			if (overlapping == 0)
+				continue;
+			const float alpha = 0.25f + 0.75f * overlapping / maximum;
+			const float x = origin.x + bucket * bucketWidth;
+			drawList->AddRectFilled(ImVec2(x, top), ImVec2(x + bucketWidth, origin.y + size.y),
+					ImGui::GetColorU32(ImVec4(color.x, color.y, color.z, color.w * alpha)));
+		}
+	}
+
+	drawList->PopClipRect();
+
+	// Select with the left mouse button and drag the selection along the time axis
+	if (hovered && ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+	{
+		selected = hoveredEvent;
+		dragged = isEditable() ? hoveredEvent : storage::Timeline::noEvent;
+		dragDelta = 0;
+	}
+	if (dragged != storage::Timeline::noEvent)
+	{
+		if (ImGui::IsMouseDown(ImGuiMouseButton_Left))
+			dragDelta = static_cast<std::int64_t>(std::round(ImGui::GetMouseDragDelta(ImGuiMouseButton_Left).x / scale));
+		else
+		{
+			// Only the final position becomes a library edit
+			const storage::Timeline::Event& data = timeline.getEvents()[dragged];
+			if (dragDelta != 0)
+				library->moveEvent(dragged, data.start + dragDelta, data.end + dragDelta);
+			edited = storage::Timeline::noEvent;
+			dragged = storage::Timeline::noEvent;
+			dragDelta = 0;
+		}
+	}
+
+	if (hoveredEvent != storage::Timeline::noEvent && dragged == storage::Timeline::noEvent)
+	{
+		const storage::Timeline::Event& data = timeline.getEvents()[hoveredEvent];
+		GlyphCache::request(data.name);
+		ImGui::SetTooltip("%s\n%s - %s", data.name.c_str(), storage::Timeline::formatTime(data.start).c_str(),
+				storage::Timeline::formatTime(data.end).c_str());
+	}
+}
+
+void graphics::TimelineWindow::renderAxis(ImDrawList* drawList, ImVec2 origin, ImVec2 size)
+{
+	// Use the smallest calendar step keeping the labels apart, beyond years count in powers of ten
+	constexpr std::int64_t day = 24 * 60;
+	constexpr std::int64_t steps[] = {1, 5, 15, 30, 60, 3 * 60, 6 * 60, 12 * 60, day, 2 * day, 7 * day, 30 * day,
+			91 * day, 365 * day};
+	const double spacing = ImGui::GetFontSize() * 7.0;
+	std::int64_t step = steps[std::size(steps) - 1];
+	for (const std::int64_t candidate : steps)
+		if (candidate * scale >= spacing)
+		{
+			step = candidate;
+			break;
+		}
+	while (step * scale < spacing)
+		step *= 10;
+
+	const ImU32 lineColor = ImGui::GetColorU32(ImGuiCol_Border);
+	const ImU32 textColor = ImGui::GetColorU32(ImGuiCol_TextDisabled);
+	const std::int64_t first = static_cast<std::int64_t>(std::floor(offset / step)) * step;
+	for (std::int64_t tick = first; (tick - offset) * scale < size.x; tick += step)
+	{
+		const float x = origin.x + static_cast<float>((tick - offset) * scale);
+		drawList->AddLine(ImVec2(x, origin.y), ImVec2(x, origin.y + size.y), lineColor);
+
+		// Whole days are labeled by the day alone
+		std::string label = storage::Timeline::formatTime(tick);
+		if (step % day == 0)
+			label = "Day " + label.substr(0, label.find(' '));
+		drawList->AddText(ImVec2(x + 3.0f, origin.y), textColor, label.c_str());
+	}
+}
+
+void graphics::TimelineWindow::renderHistogram(ImDrawList* drawList, ImVec2 origin, ImVec2 size)
+{
+	const storage::Timeline& timeline = library->getTimeline();
+	const std::size_t bucketCount = static_cast<std::size_t>(size.x / bucketWidth) + 1;
+	const float top = origin.y + ImGui::GetTextLineHeightWithSpacing();
+
+	// Every bucket costs two binary searches, independent of the number of events inside
+	density.resize(bucketCount);
+	int maximum = 1;
+	for (std::size_t bucket = 0; bucket < bucketCount; ++bucket)
+	{
+		const std::int64_t from = static_cast<std::int64_t>(std::floor(offset + bucket * bucketWidth / scale));
+		const std::int64_t to = static_cast<std::int64_t>(std::floor(offset + (bucket + 1) * bucketWidth / scale));
+		density[bucket] = static_cast<int>(std::min<std::size_t>(timeline.countOverlapping(from, to), INT_MAX));
+		maximum = std::max(maximum, density[bucket]);
+	}
+
+	const ImU32 color = ImGui::GetColorU32(ImGuiCol_PlotHistogram);
+	const float height = origin.y + size.y - top;
+	for (std::size_t bucket = 0; bucket < bucketCount; ++bucket)
+	{
+		if (density[bucket] == 0)
+			continue;
+		const float x = origin.x + bucket * bucketWidth;
+		drawList->AddRectFilled(ImVec2(x, origin.y + size.y - height * density[bucket] / maximum),
+				ImVec2(x + bucketWidth - 1.0f, origin.y + size.y), color);
+	}
+
+	if (ImGui::IsItemHovered())
+	{
+		const std::size_t bucket = std::clamp<float>((ImGui::GetIO().MousePos.x - origin.x) / bucketWidth, 0.0f,
+				bucketCount - 1);
+		ImGui::SetTooltip("%d events, zoom in to see them", density[bucket]);
+	}
+}
+
+void graphics::TimelineWindow::renderSelection()
+{
+	const storage::Timeline& timeline = library->getTimeline();
+	const storage::Timeline::Event& event = timeline.getEvents()[selected];
+	const bool editable = isEditable();
+
+	// Refill the fields whenever another event was selected or the selected one changed
+	if (edited != selected)
+	{
+		edited = selected;
+		std::snprintf(editName, sizeof(editName), "%s", event.name.c_str());
+		std::snprintf(editStart, sizeof(editStart), "%s", storage::Timeline::formatTime(event.start).c_str());
+		std::snprintf(editEnd, sizeof(editEnd), "%s", storage::Timeline::formatTime(event.end).c_str());
+	}
+
+	ImGui::Separator();
+	if (!editable)
+		ImGui::BeginDisabled();
+
+	ImGui::SetNextItemWidth(ImGui::GetFontSize() * 12.0f);
+	GlyphCache::request(editName);
+	ImGui::InputText("##name", editName, sizeof(editName));
+	if (ImGui::IsItemDeactivatedAfterEdit() && event.name != editName)
+		library->renameEvent(selected, editName);
+
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(ImGui::GetFontSize() * 6.0f);
+	ImGui::InputText("##from", editStart, sizeof(editStart));
+	const bool startEdited = ImGui::IsItemDeactivatedAfterEdit();
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(ImGui::GetFontSize() * 6.0f);
+	ImGui::InputText("##until", editEnd, sizeof(editEnd));
+	if (startEdited || ImGui::IsItemDeactivatedAfterEdit())
+	{
+		// Invalid times are dropped by refilling the fields
+		std::int64_t start, end;
+		if (!storage::Timeline::parseTime(editStart, start) || !storage::Timeline::parseTime(editEnd, end)
+				|| !library->moveEvent(selected, start, end))
+			edited = storage::Timeline::noEvent;
+	}
+
+	ImGui::SameLine();
+	const bool remove = ImGui::SmallButton("Remove");
+
+	if (!editable)
+		ImGui::EndDisabled();
+
+	if (remove)
+	{
+		library->removeEvent(selected);
+		selected = storage::Timeline::noEvent;
+		return;
+	}
+
+	ImGui::TextDisabled("Overlapping events:");
+	if (ImGui::BeginChild("##overlapping", ImVec2(0, ImGui::GetFrameHeightWithSpacing() * 4.0f)))
+	{
+		std::uint32_t clicked = storage::Timeline::noEvent;
+		timeline.forEachOverlapping(event.start, event.end,
+			[this, &timeline, &clicked] (std::uint32_t other)
+			{
+				if (other == selected)
+					return;
+				const storage::Timeline::Event& data = timeline.getEvents()[other];
+				ImGui::PushID(static_cast<int>(other));
+				GlyphCache::request(data.name);
+				if (ImGui::Selectable(data.name.c_str()))
+					clicked = other;
+				ImGui::SameLine();
+				ImGui::TextDisabled("%s - %s", storage::Timeline::formatTime(data.start).c_str(),
+						storage::Timeline::formatTime(data.end).c_str());
+				ImGui::PopID();
+			}
+		);
+		if (clicked != storage::Timeline::noEvent)
+			selected = clicked;
+	}
+	ImGui::EndChild();
+}
+
+void graphics::MentionWindow::render(bool* open)
+{
+	ImGui::SetNextWindowSize(ImVec2(500, 400), ImGuiCond_FirstUseEver);
+	if (ImGui::Begin("Mentions", open))
+	{
+		// Search anew when another library became active or finished loading
+		if (library != libraries->getActiveLibrary() || complete != libraries->isActiveComplete())
+		{
+			library = libraries->getActiveLibrary();
+			complete = libraries->isActiveComplete();
+			books.invalidate();
+			mentions.clear();
+			selected = storage::RelationshipGraph::noEntity;
+			resultsEntity = storage::RelationshipGraph::noEntity;
+		}
+
+		if (library == nullptr)
+			ImGui::TextDisabled("No library selected.");
+		else if (!complete)
+			ImGui::TextDisabled("The mentions are searched once the library is loaded.");
+		else
+		{
+			if (!library->getGraph().isEntity(selected))
+				selected = storage::RelationshipGraph::noEntity;
+
+			books.update(*library);
+			mentions.update(library->getGraph(), books, library->getGeneration());
+			mentions.step(scanBudget);
+
+			const storage::MentionIndex::Statistics statistics = mentions.getStatistics();
+			if (statistics.pendingBooks != 0)
+			{
+				ImGui::TextDisabled("Searching, %zu of %zu books left", statistics.pendingBooks, books.size());
+				FramePacer::requestFrame();
+			}
+			else
+				ImGui::TextDisabled("%zu books searched, %.1f MB in %.1f ms, %zu states", books.size(),
+						statistics.scannedBytes / 1e6, statistics.scanTime, mentions.getScanner().getStateCount());
+			if (statistics.failedBooks != 0)
+			{
+				ImGui::SameLine();
+				ImGui::TextDisabled("(%zu unreadable)", statistics.failedBooks);
+			}
+
+			ImGui::SetNextItemWidth(-FLT_MIN);
+			ImGui::InputTextWithHint("##filter", "Filter entities", filter, sizeof(filter));
+
+			const float width = ImGui::GetContentRegionAvail().x;
+			if (ImGui::BeginChild("##entities", ImVec2(width * 0.45f, 0), true))
+				renderEntities();
+			ImGui::EndChild();
+			ImGui::SameLine();
+			if (ImGui::BeginChild("##books", ImVec2(0, 0), true))
+				renderBooks();
+			ImGui::EndChild();
+		}
+	}
+	ImGui::End();
+}
+
+void graphics::MentionWindow::applyEdit(const storage::Document& document, const storage::Document::Edit& edit)
+{
+	if (library != nullptr && complete)
+		mentions.applyEdit(document.getPath(), edit, document.getText());
+}
+
+void graphics::MentionWindow::renderEntities()
+{
+	const std::vector<storage::RelationshipGraph::Entity>& entities = library->getGraph().getEntities();
+	const std::vector<std::uint32_t>& totals = mentions.getTotals();
+	const std::string_view search(filter);
+	const auto matches = [search] (std::string_view name)
+		{
+			return std::search(name.begin(), name.end(), search.begin(), search.end(),
+					[] (char a, char b) { return std::tolower(static_cast<unsigned char>(a))
+							== std::tolower(static_cast<unsigned char>(b)); }) != name.end();
+		};
+
+	if (!ImGui::BeginTable("##table", 2, ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY))
+		return;
+
+	ImGui::TableSetupColumn("Entity");
+	ImGui::TableSetupColumn("Mentions", ImGuiTableColumnFlags_WidthFixed);
+	ImGui::TableSetupScrollFreeze(0, 1);
+	ImGui::TableHeadersRow();
+	for (std::uint32_t entity = 0; entity < entities.size() && entity < totals.size(); ++entity)
+	{
+		const storage::RelationshipGraph::Entity& data = entities[entity];
+		if (data.removed || !matches(data.name))
+			continue;
+
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::PushID(static_cast<int>(entity));
+		GlyphCache::request(data.name);
+		if (ImGui::Selectable(data.name.c_str(), entity == selected, ImGuiSelectableFlags_SpanAllColumns))
+			selected = entity;
+		ImGui::PopID();
+		ImGui::TableNextColumn();
+		ImGui::Text("%u", totals[entity]);
+	}
+	ImGui::EndTable();
+}
+
+void graphics::MentionWindow::renderBooks()
+{
+	if (selected == storage::RelationshipGraph::noEntity)
+	{
+		ImGui::TextDisabled("Select an entity to see the books mentioning it.");
+		return;
+	}
+
+	// Counting the mentions of an entity walks all mentions, so the result is kept until they change
+	if (resultsEntity != selected || resultsVersion != mentions.getVersion())
+	{
+		mentions.findBooks(selected, results);
+		resultsEntity = selected;
+		resultsVersion = mentions.getVersion();
+	}
+
+	if (results.empty())
+	{
+		ImGui::TextDisabled(mentions.isComplete() ? "Not mentioned in any book." : "Not mentioned so far.");
+		return;
+	}
+
+	for (const storage::MentionIndex::BookCount& result : results)
+	{
+		storage::LibraryBook* const book = books.getBook(result.position);
+		ImGui::PushID(static_cast<int>(result.position));
+		GlyphCache::request(book->getName());
+		if (ImGui::Selectable(book->getName().c_str(), false, ImGuiSelectableFlags_AllowDoubleClick)
+				&& ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left) && bookOpenHandler)
+			bookOpenHandler(*book);
+		if (ImGui::IsItemHovered())
+		{
+			const std::string path = books.getShelfPath(result.position);
+			GlyphCache::request(path);
+			ImGui::SetTooltip("%s", path.c_str());
+		}
+		ImGui::SameLine();
+		ImGui::TextDisabled("%u", result.count);
+		ImGui::PopID();
+	}
+}
+
+void graphics::RepetitionWindow::render(bool* open)
+{
+	ImGui::SetNextWindowSize(ImVec2(500, 400), ImGuiCond_FirstUseEver);
+	if (ImGui::Begin("Repetitions", open))
+	{
+		if (document == nullptr)
+			ImGui::TextDisabled("Open a book to find its repeated words and phrases.");
+		else
+		{
+			const storage::RepetitionAnalyzer::Statistics statistics = analyzer.getStatistics();
+			ImGui::TextDisabled("%zu words in %zu paragraphs, %zu distinct phrases, analyzed in %.1f ms",
+					statistics.words, statistics.paragraphs, statistics.phrases, statistics.analysisTime);
+
+			ImGui::SetNextItemWidth(-FLT_MIN);
+			ImGui::SliderInt("##words", &words, 1, storage::RepetitionAnalyzer::maximumWords,
+					words == 1 ? "Single words" : "Phrases of %d words");
+
+			const float width = ImGui::GetContentRegionAvail().x;
+			if (ImGui::BeginChild("##phrases", ImVec2(width * 0.55f, 0), true))
+				renderPhrases();
+			ImGui::EndChild();
+			ImGui::SameLine();
+			if (ImGui::BeginChild("##occurrences", ImVec2(0, 0), true))
+				renderOccurrences();
+			ImGui::EndChild();
+		}
+	}
+	ImGui::End();
+}
+
+void graphics::RepetitionWindow::setDocument(const storage::Document* _document)
+{
+	document = _document;
+	selected = 0;
+	if (document != nullptr)
+		analyzer.analyze(document->getText());
+	else
+		analyzer.clear();
+}
+
+void graphics::RepetitionWindow::applyEdit(const storage::Document& _document, const storage::Document::Edit& edit)
+{
+	if (&_document == document)
+		analyzer.applyEdit(edit, document->getText());
+}
+
+void graphics::RepetitionWindow::renderPhrases()
+{
+	// Ranking the phrases walks all of them, so the result is kept until they change
+	if (phrasesVersion != analyzer.getVersion() || phrasesWords != words)
+	{
+		analyzer.findHotPhrases(words, phraseLimit, phrases);
+		phrasesVersion = analyzer.getVersion();
+		phrasesWords = words;
+	}
+
+	if (phrases.empty())
+	{
+		ImGui::TextDisabled(words == 1 ? "No word is repeated." : "No phrase is repeated.");
+		return;
+	}
+
+	if (!ImGui::BeginTable("##table", 2, ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY))
+		return;
+
+	ImGui::TableSetupColumn(words == 1 ? "Word" : "Phrase");
+	ImGui::TableSetupColumn("Count", ImGuiTableColumnFlags_WidthFixed);
+	ImGui::TableSetupScrollFreeze(0, 1);
+	ImGui::TableHeadersRow();
+	const std::string& text = document->getText();
+	for (const storage::RepetitionAnalyzer::Phrase& phrase : phrases)
+	{
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::PushID(static_cast<int>(phrase.hash));
+		if (ImGui::Selectable("##phrase", phrase.hash == selected, ImGuiSelectableFlags_SpanAllColumns))
+			selected = phrase.hash;
+		ImGui::PopID();
+		ImGui::SameLine();
+		GlyphCache::request(std::string_view(text).substr(phrase.offset, phrase.length));
+		ImGui::TextUnformatted(text.data() + phrase.offset, text.data() + phrase.offset + phrase.length);
+		ImGui::TableNextColumn();
+		ImGui::Text("%u", phrase.count);
+	}
+	ImGui::EndTable();
+}
+
+void graphics::RepetitionWindow::renderOccurrences()
+{
+	if (selected == 0)
+	{
+		ImGui::TextDisabled("Select a phrase to see where it occurs.");
+		return;
+	}
+
+	// The line numbers are counted once per change, walking the text from one occurrence to the next
+	if (occurrencesVersion != analyzer.getVersion() || occurrencesPhrase != selected)
+	{
+		analyzer.findOccurrences(selected, occurrences);
+		occurrencesVersion = analyzer.getVersion();
+		occurrencesPhrase = selected;
+
+		const std::string& text = document->getText();
+		occurrenceLines.clear();
+		std::size_t line = 1;
+		std::uint64_t counted = 0;
+		for (const storage::RepetitionAnalyzer::Occurrence& occurrence : occurrences)
+		{
+			line += std::count(text.begin() + counted, text.begin() + occurrence.offset, '\n');
+			counted = occurrence.offset;
+			occurrenceLines.push_back(line);
+		}
+	}
+
+	if (occurrences.empty())
+	{
+		ImGui::TextDisabled("The phrase is no longer repeated.");
+		return;
+	}
+
+	for (std::size_t i = 0; i < occurrences.size(); ++i)
+	{
+		ImGui::PushID(static_cast<int>(i));
+		char label[32];
+		std::snprintf(label, sizeof(label), "Line %zu", occurrenceLines[i]);
+		if (ImGui::Selectable(label) && locateHandler)
+			locateHandler(occurrences[i].offset, occurrences[i].length);
+		ImGui::PopID();
+	}
+}
+
+void graphics::TextImportWindow::render(bool* open)
+{
+	ImGui::SetNextWindowSize(ImVec2(400, 0), ImGuiCond_FirstUseEver);
+	if (ImGui::Begin("Text Import", open))
+	{
+		// Only a completely loaded library can receive the imported books
+		storage::Library* const active = libraries->isActiveComplete() ? libraries->getActiveLibrary() : nullptr;
+		if (active != library)
+		{
+			library = active;
+			shelfIndex = -1;
+		}
+
+		// Gather all shelfs of the library as possible import targets
+		shelfs.clear();
+		if (library != nullptr)
+			for (auto& shelf : *library)
+				collectShelfs(shelf, 0);
+		if (shelfIndex >= static_cast<int>(shelfs.size()))
+			shelfIndex = -1;
+
+		if (import != nullptr)
+			ImGui::BeginDisabled();
+		ImGui::InputText("Source File", sourcePath, sizeof(sourcePath));
+		if (import != nullptr)
+			ImGui::EndDisabled();
+
+		if (shelfIndex >= 0)
+			GlyphCache::request(shelfs[shelfIndex].first);
+		if (ImGui::BeginCombo("Target Shelf", shelfIndex < 0 ? "<none>" : shelfs[shelfIndex].first.c_str()))
+		{
+			for (int i = 0; i < static_cast<int>(shelfs.size()); ++i)
+			{
+				GlyphCache::request(shelfs[i].first);
+				if (ImGui::Selectable(shelfs[i].first.c_str(), i == shelfIndex))
+					shelfIndex = i;
+			}
+			ImGui::EndCombo();
+		}
+
+		ImGui::Separator();
+
+		if (import == nullptr)
+		{
+			if (sourcePath[0] == '\0')
+				ImGui::BeginDisabled();
+			if (ImGui::Button("Import"))
+			{
+				const std::filesystem::path source(sourcePath);
+				import = std::make_unique<storage::TextImport>(source, destination / source.stem());
+			}
+			if (sourcePath[0] == '\0')
+				ImGui::EndDisabled();
+		}
+		else switch (import->getState())
+		{
+		case storage::TextImport::State::Running:
+			ImGui::ProgressBar(import->getProgress());
+			FramePacer::requestFrame(FramePacer::progressInterval);
+			if (ImGui::Button("Cancel"))
+				import->cancel();
+			break;
+
+		case storage::TextImport::State::Finished:
+			ImGui::Text("Scanned %.1f MiB at %.2f GB/s (%s)",
+					import->getSourceSize() / (1024.0 * 1024.0), import->getThroughput(),
+					storage::textscan::getKernelName());
+
+			if (shelfIndex == -1)
+				ImGui::BeginDisabled();
+			if (ImGui::Button("Add To Shelf"))
+			{
+				for (auto& book : import->takeBooks())
+					library->addBook(shelfs[shelfIndex].second, std::move(book));
+				import.reset();
+			}
+			if (shelfIndex == -1)
+				ImGui::EndDisabled();
+			ImGui::SameLine();
+			if (ImGui::Button("Discard"))
+				import.reset();
+			break;
+
+		case storage::TextImport::State::Failed:
+			ImGui::TextWrapped("Import failed: %s", import->getError().c_str());
+			if (ImGui::Button("Dismiss"))
+				import.reset();
+			break;
+
+		case storage::TextImport::State::Cancelled:
+			import.reset();
+			break;
+		}
+	}
+	ImGui::End();
+}
+
+void graphics::TextImportWindow::collectShelfs(storage::LibraryShelf& shelf, int depth)
+{
+	shelfs.emplace_back(std::string(2 * depth, ' ') + shelf.getName(), &shelf);
+	for (auto& sub : shelf.subshelfs)
+		collectShelfs(sub, depth + 1);
 }
 
 void graphics::StyleEditorWindow::render(bool* open)
@@ -217,6 +1694,9 @@ void graphics::StyleEditorWindow::render(bool* open)
 			ImGui::EndPopup();
 		}
 
+		// The styles are cached by the context, only a change of the style folder lists them again
+		if (style_index >= static_cast<int>(_context->getStyleFiles().size()))
+			style_index = -1;
 		if (ImGui::Combo("Load Style:", &style_index, _context->getStyleFilesImGui()))
 			_context->loadStyleFile(_context->getStyleFiles()[style_index]);
 
@@ -390,23 +1870,40 @@ void graphics::EditorWindowTest::render(bool* open)
 	ImGui::SetNextWindowSize(ImVecN<2>(0.0f, 500.0f), ImGuiCond_FirstUseEver);
 	if (ImGui::Begin("Editor Test", open, ImGuiWindowFlags_MenuBar))
 	{
+		// Rendering the editor resets its changed flag, so edits of the menu are remembered separately
+		bool menuEdited = false;
 		if (ImGui::BeginMenuBar())
 		{
 			if (ImGui::MenuItem("Undo", "Ctrl-Z", nullptr, editor.CanUndo()))
+			{
 				editor.Undo();
+				menuEdited = true;
+			}
 			if (ImGui::MenuItem("Redo", "Ctrl-Y", nullptr, editor.CanRedo()))
+			{
 				editor.Redo();
+				menuEdited = true;
+			}
 
 			ImGui::Separator();
 
 			if (ImGui::MenuItem("Copy", "Ctrl-C", nullptr, editor.HasSelection()))
 				editor.Copy();
 			if (ImGui::MenuItem("Cut", "Ctrl-X", nullptr, editor.HasSelection()))
+			{
 				editor.Cut();
+				menuEdited = true;
+			}
 			if (ImGui::MenuItem("Delete", "Del", nullptr, editor.HasSelection()))
+			{
 				editor.Delete();
+				menuEdited = true;
+			}
 			if (ImGui::MenuItem("Paste", "Ctrl-V", nullptr, ImGui::GetClipboardText() != nullptr))
+			{
 				editor.Paste();
+				menuEdited = true;
+			}
 
 			ImGui::Separator();
 
@@ -415,19 +1912,226 @@ void graphics::EditorWindowTest::render(bool* open)
 			ImGui::EndMenuBar();
 		}
 
-		editor.Render("TextEditor", ImVec2(0, ImGui::GetWindowHeight() - (ImGui::GetTextLineHeightWithSpacing() * 4)));
+		if (!openError.empty())
+			ImGui::TextDisabled("%s", openError.c_str());
+
+		const ImVec2 size(0, ImGui::GetWindowHeight()
+				- (ImGui::GetTextLineHeightWithSpacing() * (openError.empty() ? 4 : 5)));
+		editor.Render("TextEditor", size);
+		if (document != nullptr)
+		{
+			if (editor.IsTextChanged() || menuEdited)
+				document->setText(editor.GetText());
+			checker.update(document->getText(), checkBudget);
+			if (!checker.isComplete())
+				FramePacer::requestFrame();
+			renderMisspellings(size);
+		}
 
 		auto cpos = editor.GetCursorPosition();
-		ImGui::Text("%c%c | %6d:%-6d | %s | %s | UTF-8",
+		ImGui::Text("%c%c | %6d:%-6d | %s | %s | UTF-8 | %zu misspelled | %s%s",
 				editor.CanUndo() ? '<' : ' ',
 				editor.CanRedo() ? '>' : ' ',
 				cpos.mLine + 1, cpos.mColumn + 1,
 				editor.IsOverwrite() ? "Ovr" : "Ins",
-				editor.GetLanguageDefinition().mName.c_str());
+				editor.GetLanguageDefinition().mName.c_str(),
+				checker.getMisspellingCount(),
+				document != nullptr ? document->getPath().filename().c_str() : "<no document>",
+				document != nullptr && document->isDirty() ? "*" : "");
 	}
 	ImGui::End();
 }
 
+void graphics::EditorWindowTest::renderMisspellings(const ImVec2& size)
+{
+	// The editor has no way to decorate text, so its child window is entered again to draw on top of it
+	const ImVec2 cursor = ImGui::GetCursorPos();
+	if (ImGui::BeginChild("TextEditor", size, false,
+			ImGuiWindowFlags_HorizontalScrollbar | ImGuiWindowFlags_AlwaysHorizontalScrollbar | ImGuiWindowFlags_NoMove))
+	{
+		ImFont* const font = ImGui::GetFont();
+		const float fontSize = ImGui::GetFontSize();
+		const float lineHeight = fontSize;
+		const float tabWidth = editor.GetTabSize() * font->CalcTextSizeA(fontSize, FLT_MAX, -1.0f, " ").x;
+		const float wave = std::max(1.0f, fontSize / 8.0f);
+
+		// Same layout as the editor: a gutter as wide as the largest line number, tabs snap to the tab stops
+		char gutter[16];
+		std::snprintf(gutter, sizeof(gutter), " %d ", editor.GetTotalLines());
+		const ImVec2 origin(ImGui::GetWindowPos().x - ImGui::GetScrollX()
+				+ font->CalcTextSizeA(fontSize, FLT_MAX, -1.0f, gutter).x + 10.0f,
+				ImGui::GetWindowPos().y - ImGui::GetScrollY());
+		const auto measure = [font, fontSize, tabWidth] (const char* begin, const char* end, float x)
+			{
+				while (begin < end)
+				{
+					if (*begin == '\t')
+					{
+						x = (1.0f + std::floor((1.0f + x) / tabWidth)) * tabWidth;
+						++begin;
+						continue;
+					}
+					const char* next = begin + 1;
+					while (next < end && (static_cast<unsigned char>(*next) & 0xc0) == 0x80)
+						++next;
+					x += font->CalcTextSizeA(fontSize, FLT_MAX, -1.0f, begin, next).x;
+					begin = next;
+				}
+				return x;
+			};
+
+		const std::string& text = document->getText();
+		ImDrawList* const drawList = ImGui::GetWindowDrawList();
+		const ImU32 color = IM_COL32(230, 60, 60, 255);
+		const std::size_t first = static_cast<std::size_t>(std::max(0.0f, ImGui::GetScrollY() / lineHeight));
+		const std::size_t last = std::min(checker.getLineCount(),
+				first + static_cast<std::size_t>(ImGui::GetWindowHeight() / lineHeight) + 2);
+
+		// The editor has drawn already, so ideographs seen for the first time are laid out right from the next frame
+		const std::uint64_t visibleStart = first < last ? std::min<std::uint64_t>(checker.getLineStart(first), text.size())
+				: text.size();
+		const std::uint64_t visibleEnd = last < checker.getLineCount()
+				? std::min<std::uint64_t>(checker.getLineStart(last), text.size()) : text.size();
+		if (visibleStart < visibleEnd)
+			GlyphCache::request(std::string_view(text).substr(visibleStart, visibleEnd - visibleStart));
+		for (std::size_t line = first; line < last; ++line)
+		{
+			const char* const start = text.data() + std::min<std::uint64_t>(checker.getLineStart(line), text.size());
+			const float y = origin.y + (line + 1) * lineHeight - wave;
+			float x = 0.0f;
+			const char* measured = start;
+			for (const storage::SpellChecker::Range& range : checker.getMisspellings(line))
+			{
+				if (start + range.end > text.data() + text.size())
+					break;
+
+				x = measure(measured, start + range.begin, x);
+				const float end = measure(start + range.begin, start + range.end, x);
+				measured = start + range.end;
+
+				bool up = false;
+				for (float segment = x; segment < end; segment += wave, up = !up)
+					drawList->AddLine(ImVec2(origin.x + segment, y + (up ? 0.0f : wave)),
+							ImVec2(origin.x + std::min(segment + wave, end), y + (up ? wave : 0.0f)), color);
+				x = end;
+			}
+		}
+	}
+	ImGui::EndChild();
+	ImGui::SetCursorPos(cursor);
+}
+
+void graphics::EditorWindowTest::select(std::uint64_t offset, std::uint64_t length)
+{
+	if (document == nullptr || offset + length > document->getText().size())
+		return;
+
+	const TextEditor::Coordinates end = getCoordinates(offset + length);
+	editor.SetSelection(getCoordinates(offset), end);
+	editor.SetCursorPosition(end);
+}
+
+TextEditor::Coordinates graphics::EditorWindowTest::getCoordinates(std::uint64_t offset) const
+{
+	// The editor counts columns in characters with tabs expanded to the next tab stop
+	const std::string& text = document->getText();
+	const std::size_t lineStart = offset == 0 ? 0 : text.rfind('\n', offset - 1) + 1;
+	const int tabSize = editor.GetTabSize();
+	int column = 0;
+	for (std::size_t i = lineStart; i < offset; ++i)
+	{
+		if (text[i] == '\t')
+			column = (column / tabSize + 1) * tabSize;
+		else if ((static_cast<unsigned char>(text[i]) & 0xc0) != 0x80)
+			++column;
+	}
+	return TextEditor::Coordinates(std::count(text.begin(), text.begin() + lineStart, '\n'), column);
+}
+
+void graphics::EditorWindowTest::open(const std::filesystem::path& path)
+{
+	// A document which can not be read leaves the open one in place
+	std::unique_ptr<storage::Document> opened;
+	try
+	{
+		opened = std::make_unique<storage::Document>(path);
+	}
+	catch (const storage::FileError& error)
+	{
+		openError = error.what();
+		return;
+	}
+	openError.clear();
+
+	close();
+	document = std::move(opened);
+	storage::Document* const current = document.get();
+
+	// Replay the edits which did not reach the file before the last crash
+	bool replayFailed = false;
+	if (journal != nullptr)
+	{
+		try
+		{
+			for (const auto& edit : journal->attach(path))
+				current->apply(storage::Document::Edit::parse(edit));
+		}
+		catch (const storage::FileError& error)
+		{
+			openError = error.what();
+			replayFailed = true;
+		}
+	}
+
+	current->setEditHandler(
+		[this, current] (const storage::Document::Edit& edit)
+		{
+			if (journal != nullptr)
+				journal->append(current->getPath(), edit.serialize());
+			checker.applyEdit(edit);
+			if (documentEditHandler)
+				documentEditHandler(*current, edit);
+		}
+	);
+	editor.SetText(current->getText());
+	checker.reset(current->getText());
+
+	if (autosave != nullptr)
+	{
+		autosave->addSource(current, {
+			.path = current->getPath(),
+			.generation = [current] () { return current->getGeneration(); },
+			.snapshot = [this, current] ()
+				{
+					if (journal != nullptr)
+						journal->checkpoint(current->getPath(), current->getText());
+					return current->getText();
+				},
+			.saved = [this, current] (std::uint64_t generation)
+				{
+					current->markSaved(generation);
+					if (journal != nullptr)
+						journal->compact();
+				},
+			.prepare = journal != nullptr ? [this] () { journal->sync(); } : std::function<void()>()
+		});
+
+		// Saving right away checkpoints the document, so broken edits are not replayed again
+		if (current->isDirty() || replayFailed)
+			autosave->save(current);
+	}
+}
+
+void graphics::EditorWindowTest::close()
+{
+	if (document == nullptr)
+		return;
+
+	if (autosave != nullptr)
+		autosave->removeSource(document.get());
+	document.reset();
+}
+
 void graphics::MarkdownWindowTest::render(bool* open)
 {
 	//ImGui::SetNextWindowPos(getViewportCenter(ImGui::GetWindowViewport()),
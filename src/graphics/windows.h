@@ -1,16 +1,32 @@
 #ifndef WINDOWS_H
 #define WINDOWS_H
 
+#include <functional>
 #include <list>
+#include <memory>
 
 #include "TextEditor.h"
+#include "autosave.h"
+#include "document.h"
+#include "graph_layout.h"
+#include "library_manager.h"
+#include "mention_index.h"
+#include "query.h"
+#include "repetition_analyzer.h"
 #include "storage.h"
 #include "settings.h"
+#include "spell_checker.h"
+#include "text_import.h"
+#include "thread_pool.h"
+#include "write_ahead_log.h"
 
 
 
 namespace graphics
 {
+	// forward declaration
+	class VulkanInstance;
+
 	class StaticWindow
 	{
 		friend class ViewportRenderer;
@@ -37,15 +53,22 @@ namespace graphics
 #ifdef DEBUG
 				active_demo_window(false), active_stack_tool_window(false),
 #endif
-				active_metrics_window(false), active_about_window(false) { }
+				active_metrics_window(false), active_memory_window(false), active_about_window(false),
+				textImportWindow(nullptr), renderer(nullptr) { }
 
 		void registerStaticWindow(StaticWindow* window) { staticWindows.push_back(window); }
 		void registerSettingsWindow(StaticWindow* window) { settingsWindows.push_back(window); }
+		void setTextImportWindow(StaticWindow* window) { textImportWindow = window; }
+		void setRenderer(const VulkanInstance* _renderer) { renderer = _renderer; }
 
 		void renderMainMenuBar();
 		void renderWindows();
 
+		void forEachWindowState(const std::function<void(std::string_view, bool&)>& function);
+
 	private:
+		void renderMemoryWindow(bool* open);
+
 		std::list<StaticWindow*> staticWindows;
 		std::list<StaticWindow*> settingsWindows;
 
@@ -54,28 +77,257 @@ namespace graphics
 		bool active_stack_tool_window;
 #endif
 		bool active_metrics_window;
+		bool active_memory_window;
 		bool active_about_window;
+
+		StaticWindow* textImportWindow;
+		const VulkanInstance* renderer;
 	};
 
 	class LibraryWindow : public StaticWindow
 	{
 	public:
-		LibraryWindow(storage::Library* _library, bool active = false) :
-				StaticWindow(active), library(_library), currentShelf(nullptr),
-				currentBook(nullptr) { }
+		LibraryWindow(storage::LibraryManager* _libraries, storage::AutosaveScheduler* _autosave = nullptr,
+				bool active = false) :
+				StaticWindow(active), libraries(_libraries), autosave(_autosave), library(nullptr),
+				loader(nullptr), currentShelf(nullptr), currentBook(nullptr), currentBookId(0), propertiesBookId(0),
+				propertiesGeneration(0), properties{}, filter{}, filterChanged(false), filterTime(0.0) { }
 
 		std::string_view getName() { return "Library Viewer"; }
 		void render(bool* open);
 
+		void setBookOpenHandler(std::function<void(storage::LibraryBook&)> handler)
+		{
+			bookOpenHandler = std::move(handler);
+		}
+
 	private:
+		void findCurrentBook();
+		bool isEditable() const;
+		void renderLoader();
 		void renderMenuBar();
+		void renderLibraryMenu();
 		void renderLibrary(storage::Library* library);
 		void renderShelf(storage::LibraryShelf& shelf);
 		void renderBook(storage::LibraryBook& book);
+		void renderBookProperties();
+		void renderFilter();
+		void renderResults();
 
-		storage::Library* const library;
+		storage::LibraryManager* const libraries;
+		storage::AutosaveScheduler* const autosave;
+		storage::Library* library;
+		storage::LibraryLoader* loader;
 		storage::LibraryShelf* currentShelf;
+		/// @brief The selected book, looked up by its id whenever books may have moved
 		storage::LibraryBook* currentBook;
+		std::uint32_t currentBookId;
+		std::function<void(storage::LibraryBook&)> bookOpenHandler;
+
+		std::uint32_t propertiesBookId;
+		std::uint64_t propertiesGeneration;
+		char properties[storage::MetadataStore::attributes.size()][256];
+
+		char filter[256];
+		bool filterChanged;
+		std::string filterError;
+		storage::Query query;
+		storage::LibraryIndex index;
+		std::vector<std::uint32_t> results;
+		double filterTime;
+	};
+
+	class RelationshipWindow : public StaticWindow
+	{
+	public:
+		RelationshipWindow(storage::LibraryManager* _libraries, storage::ThreadPool* pool, bool active = false) :
+				StaticWindow(active), libraries(_libraries), library(nullptr), complete(false), layout(pool),
+				offsetX(0.0f), offsetY(0.0f), zoom(1.0f), selected(storage::RelationshipGraph::noEntity),
+				target(storage::RelationshipGraph::noEntity), dragged(storage::GraphLayout::noNode), entityName{},
+				entityType(0), relationType{}, drawnNodes(0), drawnLinks(0) { }
+
+		std::string_view getName() { return "Relationships"; }
+		void render(bool* open);
+
+	private:
+		/// @brief The time the layout may take per frame
+		static constexpr std::chrono::microseconds layoutBudget{4000};
+
+		bool isEditable() const;
+		void renderToolbar();
+		void renderCanvas(float height);
+		void renderSelection();
+		std::uint32_t findNode(float x, float y, float radius) const;
+
+		storage::LibraryManager* const libraries;
+		storage::Library* library;
+		bool complete;
+		storage::GraphLayout layout;
+
+		float offsetX;
+		float offsetY;
+		float zoom;
+		std::uint32_t selected;
+		std::uint32_t target;
+		std::uint32_t dragged;
+
+		char entityName[256];
+		int entityType;
+		char relationType[256];
+		std::size_t drawnNodes;
+		std::size_t drawnLinks;
+	};
+
+	class TimelineWindow : public StaticWindow
+	{
+	public:
+		TimelineWindow(storage::LibraryManager* _libraries, bool active = false) :
+				StaticWindow(active), libraries(_libraries), library(nullptr), complete(false), fitted(false),
+				offset(0.0), scale(1.0), selected(storage::Timeline::noEvent), edited(storage::Timeline::noEvent),
+				dragged(storage::Timeline::noEvent), dragDelta(0), eventName{}, eventStart{}, eventEnd{},
+				editName{}, editStart{}, editEnd{}, drawnEvents(0), aggregatedEvents(0), histogram(false) { }
+
+		std::string_view getName() { return "Timeline"; }
+		void render(bool* open);
+
+	private:
+		/// @brief The number of visible events above which only their density is drawn
+		static constexpr std::size_t histogramLimit = 4000;
+		/// @brief The width of a density bucket in pixels
+		static constexpr float bucketWidth = 4.0f;
+
+		bool isEditable() const;
+		void fit();
+		void renderToolbar();
+		void renderCanvas(float height);
+		void renderAxis(ImDrawList* drawList, ImVec2 origin, ImVec2 size);
+		void renderHistogram(ImDrawList* drawList, ImVec2 origin, ImVec2 size);
+		void renderSelection();
+
+		storage::LibraryManager* const libraries;
+		storage::Library* library;
+		bool complete;
+		bool fitted;
+
+		double offset;
+		double scale;
+		std::uint32_t selected;
+		std::uint32_t edited;
+		std::uint32_t dragged;
+		std::int64_t dragDelta;
+
+		char eventName[256];
+		char eventStart[64];
+		char eventEnd[64];
+		char editName[256];
+		char editStart[64];
+		char editEnd[64];
+
+		std::vector<std::uint32_t> visible;
+		std::vector<float> laneEnds;
+		std::vector<int> density;
+		std::size_t drawnEvents;
+		std::size_t aggregatedEvents;
+		bool histogram;
+	};
+
+	class MentionWindow : public StaticWindow
+	{
+	public:
+		MentionWindow(storage::LibraryManager* _libraries, storage::ThreadPool* pool, bool active = false) :
+				StaticWindow(active), libraries(_libraries), library(nullptr), complete(false), mentions(pool),
+				selected(storage::RelationshipGraph::noEntity), filter{}, resultsVersion(0),
+				resultsEntity(storage::RelationshipGraph::noEntity) { }
+
+		std::string_view getName() { return "Mentions"; }
+		void render(bool* open);
+
+		void setBookOpenHandler(std::function<void(storage::LibraryBook&)> handler)
+		{
+			bookOpenHandler = std::move(handler);
+		}
+		void applyEdit(const storage::Document& document, const storage::Document::Edit& edit);
+
+	private:
+		/// @brief The time the scan of the books may take per frame
+		static constexpr std::chrono::microseconds scanBudget{4000};
+
+		void renderEntities();
+		void renderBooks();
+
+		storage::LibraryManager* const libraries;
+		storage::Library* library;
+		bool complete;
+		storage::LibraryIndex books;
+		storage::MentionIndex mentions;
+		std::function<void(storage::LibraryBook&)> bookOpenHandler;
+
+		std::uint32_t selected;
+		char filter[256];
+		std::vector<storage::MentionIndex::BookCount> results;
+		std::uint64_t resultsVersion;
+		std::uint32_t resultsEntity;
+	};
+
+	class RepetitionWindow : public StaticWindow
+	{
+	public:
+		RepetitionWindow(storage::ThreadPool* pool, bool active = false) :
+				StaticWindow(active), analyzer(pool), document(nullptr), words(1), phrasesVersion(0), phrasesWords(0),
+				selected(0), occurrencesVersion(0), occurrencesPhrase(0) { }
+
+		std::string_view getName() { return "Repetitions"; }
+		void render(bool* open);
+
+		void setLocateHandler(std::function<void(std::uint64_t, std::uint64_t)> handler)
+		{
+			locateHandler = std::move(handler);
+		}
+		void setDocument(const storage::Document* _document);
+		void applyEdit(const storage::Document& _document, const storage::Document::Edit& edit);
+
+	private:
+		/// @brief The number of phrases listed at most
+		static constexpr std::size_t phraseLimit = 200;
+
+		void renderPhrases();
+		void renderOccurrences();
+
+		storage::RepetitionAnalyzer analyzer;
+		const storage::Document* document;
+		std::function<void(std::uint64_t, std::uint64_t)> locateHandler;
+
+		int words;
+		std::vector<storage::RepetitionAnalyzer::Phrase> phrases;
+		std::uint64_t phrasesVersion;
+		int phrasesWords;
+		std::uint64_t selected;
+		std::vector<storage::RepetitionAnalyzer::Occurrence> occurrences;
+		std::vector<std::size_t> occurrenceLines;
+		std::uint64_t occurrencesVersion;
+		std::uint64_t occurrencesPhrase;
+	};
+
+	class TextImportWindow : public StaticWindow
+	{
+	public:
+		TextImportWindow(storage::LibraryManager* _libraries, std::filesystem::path _destination) :
+				libraries(_libraries), destination(_destination), library(nullptr), sourcePath{}, shelfIndex(-1) { }
+
+		std::string_view getName() { return "Text Import"; }
+		void render(bool* open);
+
+	private:
+		void collectShelfs(storage::LibraryShelf& shelf, int depth);
+
+		storage::LibraryManager* const libraries;
+		const std::filesystem::path destination;
+		storage::Library* library;
+		std::unique_ptr<storage::TextImport> import;
+
+		char sourcePath[1024];
+		int shelfIndex;
+		std::vector<std::pair<std::string, storage::LibraryShelf*>> shelfs;
 	};
 
 	class StyleEditorWindow : public StaticWindow
@@ -106,11 +358,38 @@ namespace graphics
 	class EditorWindowTest : public StaticWindow
 	{
 	public:
+		EditorWindowTest(storage::AutosaveScheduler* _autosave = nullptr, storage::WriteAheadLog* _journal = nullptr) :
+				autosave(_autosave), journal(_journal) { }
+		~EditorWindowTest() { close(); }
+
 		std::string_view getName() { return "Editor Test"; }
 		void render(bool* open);
 
+		void open(const std::filesystem::path& path);
+		void close();
+
+		void setDocumentEditHandler(std::function<void(const storage::Document&, const storage::Document::Edit&)> handler)
+		{
+			documentEditHandler = std::move(handler);
+		}
+		void setDictionary(const storage::Dictionary* dictionary) { checker.setDictionary(dictionary); }
+		const storage::Document* getDocument() const { return document.get(); }
+		void select(std::uint64_t offset, std::uint64_t length);
+
 	private:
+		/// @brief The time the spell checker may take per frame
+		static constexpr std::chrono::microseconds checkBudget{2000};
+
+		void renderMisspellings(const ImVec2& size);
+		TextEditor::Coordinates getCoordinates(std::uint64_t offset) const;
+
 		TextEditor editor;
+		storage::AutosaveScheduler* const autosave;
+		storage::WriteAheadLog* const journal;
+		std::unique_ptr<storage::Document> document;
+		std::string openError;
+		std::function<void(const storage::Document&, const storage::Document::Edit&)> documentEditHandler;
+		storage::SpellChecker checker;
 	};
 
 	/**
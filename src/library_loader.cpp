@@ -0,0 +1,208 @@
+#include <fstream>
+
+#include "library_loader.h"
+#include "tinyxml2.h"
+#include "binary.h"
+#include "exceptions.h"
+#include "wakeup.h"
+
+namespace
+{
+	/// @brief The number of bytes read from the library file per step
+	constexpr std::size_t readChunkSize = 1 << 20;
+	/// @brief The share of the progress spent reading the file
+	constexpr float readShare = 0.5f;
+	/// @brief The share of the progress spent parsing the xml
+	constexpr float parseShare = 0.1f;
+} // namespace
+
+storage::LibraryLoader::LibraryLoader(std::filesystem::path _path) :
+		path(std::move(_path)), delivered(false), state(State::Running), progress(0.0f)
+{
+	library.shelfs.clear();
+	library.library_path = path;
+
+	worker = std::jthread([this] (std::stop_token token) { run(token); });
+}
+
+storage::LibraryLoader::State storage::LibraryLoader::getState() const
+{
+	const State current = state.load(std::memory_order_acquire);
+	return current == State::Finished && !delivered ? State::Running : current;
+}
+
+std::string storage::LibraryLoader::getError() const
+{
+	std::scoped_lock lockGuard(resultMutex);
+	return error;
+}
+
+bool storage::LibraryLoader::update()
+{
+	if (delivered)
+		return false;
+
+	// Read the state first, every shelf is queued before the state changes
+	const State current = state.load(std::memory_order_acquire);
+
+	std::vector<LibraryShelf> shelfs;
+	{
+		std::scoped_lock lockGuard(resultMutex);
+		shelfs.swap(ready);
+		if (!owner.empty())
+			library.owner = std::move(owner);
+		owner.clear();
+	}
+
+	for (auto& shelf : shelfs)
+		library.shelfs.push_back(std::move(shelf));
+
+	if (current != State::Finished)
+		return false;
+
+	{
+		std::scoped_lock lockGuard(resultMutex);
+		library.metadata = std::move(metadata);
+		library.graph = std::move(graph);
+		library.timeline = std::move(timeline);
+	}
+	library.assignBookIds();
+
+	delivered = true;
+	return true;
+}
+
+void storage::LibraryLoader::run(std::stop_token token)
+{
+	try
+	{
+		// Create a new library like the synchronous constructor does
+		if (!std::filesystem::exists(path) || std::filesystem::file_size(path) == 0)
+		{
+			Library newLibrary;
+			newLibrary.save(path);
+		}
+
+		// Read the file in chunks to stay responsive to cancellation
+		const std::size_t size = std::filesystem::file_size(path);
+		std::ifstream input(path, std::ifstream::binary);
+		if (!input)
+			throw OpenError("Unable to open library <", path.string(), ">.");
+
+		std::string content(size, '\0');
+		for (std::size_t offset = 0; offset < size;)
+		{
+			if (token.stop_requested())
+			{
+				state.store(State::Cancelled, std::memory_order_release);
+				return;
+			}
+
+			const std::size_t chunk = std::min(readChunkSize, size - offset);
+			if (!input.read(content.data() + offset, chunk))
+				throw ReadError("Unable to read library <", path.string(), ">.");
+
+			offset += chunk;
+			progress.store(readShare * offset / size, std::memory_order_relaxed);
+		}
+
+		// The document keeps its own copy of the text
+		tinyxml2::XMLDocument document;
+		if (document.Parse(content.data(), content.size()) != tinyxml2::XML_SUCCESS)
+			throw ParsingError("Unable to parse library <", path.string(), ">: ", document.ErrorStr());
+		std::string().swap(content);
+		progress.store(readShare + parseShare, std::memory_order_relaxed);
+
+		tinyxml2::XMLElement* xmlElement = document.FirstChildElement("library");
+		if (xmlElement == nullptr)
+			throw ParsingError("No valid library in library file: ", path.string());
+
+		if (const char* attrib = xmlElement->Attribute("owner"))
+		{
+			std::scoped_lock lockGuard(resultMutex);
+			owner = attrib;
+		}
+
+		// Build and hand over one top-level shelf after the other
+		std::size_t count = 0;
+		for (tinyxml2::XMLElement* shelf = xmlElement->FirstChildElement("shelf");
+				shelf != nullptr; shelf = shelf->NextSiblingElement("shelf"))
+			++count;
+
+		std::size_t built = 0;
+		for (tinyxml2::XMLElement* shelf = xmlElement->FirstChildElement("shelf");
+				shelf != nullptr; shelf = shelf->NextSiblingElement("shelf"))
+		{
+			if (token.stop_requested())
+			{
+				state.store(State::Cancelled, std::memory_order_release);
+				return;
+			}
+
+			LibraryShelf parsed(shelf);
+			{
+				std::scoped_lock lockGuard(resultMutex);
+				ready.push_back(std::move(parsed));
+			}
+			wakeMainLoop();
+
+			++built;
+			progress.store(readShare + parseShare + (1.0f - readShare - parseShare) * built / count,
+					std::memory_order_relaxed);
+		}
+
+		if (tinyxml2::XMLElement* metadataElement = xmlElement->FirstChildElement("metadata"))
+		{
+			if (const char* text = metadataElement->GetText())
+			{
+				MetadataStore parsed;
+				parsed.parse(decodeBase64(text));
+
+				std::scoped_lock lockGuard(resultMutex);
+				metadata = std::move(parsed);
+			}
+		}
+
+		if (tinyxml2::XMLElement* graphElement = xmlElement->FirstChildElement("graph"))
+		{
+			if (const char* text = graphElement->GetText())
+			{
+				RelationshipGraph parsed;
+				parsed.parse(decodeBase64(text));
+
+				std::scoped_lock lockGuard(resultMutex);
+				graph = std::move(parsed);
+			}
+		}
+
+		if (tinyxml2::XMLElement* timelineElement = xmlElement->FirstChildElement("timeline"))
+		{
+			if (const char* text = timelineElement->GetText())
+			{
+				Timeline parsed;
+				parsed.parse(decodeBase64(text));
+
+				std::scoped_lock lockGuard(resultMutex);
+				timeline = std::move(parsed);
+			}
+		}
+
+		progress.store(1.0f, std::memory_order_relaxed);
+		state.store(State::Finished, std::memory_order_release);
+		wakeMainLoop();
+	}
+	catch (const std::exception& exception)
+	{
+		fail(exception.what());
+	}
+}
+
+void storage::LibraryLoader::fail(std::string message)
+{
+	{
+		std::scoped_lock lockGuard(resultMutex);
+		error = std::move(message);
+	}
+	state.store(State::Failed, std::memory_order_release);
+	wakeMainLoop();
+}
@@ -0,0 +1,153 @@
+#ifndef LIBRARY_LOADER_H
+#define LIBRARY_LOADER_H
+
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "storage.h"
+
+
+
+namespace storage
+{
+	/**
+	 * @brief Background loader filling a library from its file.
+	 *
+	 * The loader owns a library which starts out empty and is usable right
+	 * away. The file is read in chunks and parsed on a worker thread which
+	 * builds one top-level shelf after the other. Finished shelf's are moved
+	 * into the library by update() on the thread owning the library, so a
+	 * window can show the library while it fills up.
+	 *
+	 * Until the loader finished the library is incomplete and must neither be
+	 * edited nor saved. Destroying the loader cancels a running load.
+	 */
+	class LibraryLoader
+	{
+	public:
+		/**
+		 * @brief The states a loader can be in
+		 */
+		enum class State
+		{
+			/// @brief The library file is still being read
+			Running,
+			/// @brief The complete library was delivered
+			Finished,
+			/// @brief Loading was aborted, see getError()
+			Failed,
+			/// @brief Loading was cancelled by the user
+			Cancelled
+		};
+
+	public:
+		/**
+		 * @brief Start loading a library in the background
+		 *
+		 * A missing or empty library file is replaced by a new default
+		 * library like the synchronous Library constructor does.
+		 *
+		 * @param path The path to the library file
+		 */
+		LibraryLoader(std::filesystem::path path);
+		LibraryLoader(LibraryLoader&&) = delete;
+		LibraryLoader(const LibraryLoader&) = delete;
+
+		LibraryLoader& operator=(LibraryLoader&&) = delete;
+		LibraryLoader& operator=(const LibraryLoader&) = delete;
+
+		/**
+		 * @brief Get the library which is filled by the loader
+		 *
+		 * @return Library& The library, incomplete until the loader finished
+		 */
+		Library& getLibrary() { return library; }
+
+		/**
+		 * @brief Get the current state of the loader
+		 *
+		 * The state only becomes Finished once update() delivered the last shelf.
+		 *
+		 * @return State The current state
+		 */
+		State getState() const;
+		/**
+		 * @brief Get the progress of the loader
+		 *
+		 * @return float The progress in the range from 0 to 1
+		 */
+		float getProgress() const { return progress.load(std::memory_order_relaxed); }
+		/**
+		 * @brief Get the reason for a failed load
+		 *
+		 * @return std::string The error message, empty unless loading failed
+		 */
+		std::string getError() const;
+
+		/**
+		 * @brief Request the cancellation of a running load
+		 */
+		void cancel() { worker.request_stop(); }
+
+		/**
+		 * @brief Move the shelf's parsed so far into the library
+		 *
+		 * This has to be called regularly (usually once per frame) from the
+		 * thread which owns the library.
+		 *
+		 * @return true Exactly once, when the library was completed by this call
+		 * @return false Otherwise
+		 */
+		bool update();
+
+	private:
+		/**
+		 * @brief The body of the loader thread
+		 *
+		 * @param token The stop token signalling a cancellation
+		 */
+		void run(std::stop_token token);
+		/**
+		 * @brief Mark the load as failed
+		 *
+		 * @param message The reason for the failure
+		 */
+		void fail(std::string message);
+
+		/// @brief The library file to load
+		const std::filesystem::path path;
+		/// @brief The library which is filled by the loader
+		Library library;
+		/// @brief Set once update() delivered everything of a finished load
+		bool delivered;
+
+		/// @brief The state of the loader thread
+		std::atomic<State> state;
+		/// @brief The progress of the loader thread
+		std::atomic<float> progress;
+
+		/// @brief Guards everything parsed and the error message
+		mutable std::mutex resultMutex;
+		/// @brief Shelf's parsed but not moved into the library yet
+		std::vector<LibraryShelf> ready;
+		/// @brief The owner read from the library header
+		std::string owner;
+		/// @brief The book metadata, handed over once the load finished
+		MetadataStore metadata;
+		/// @brief The relationship graph, handed over once the load finished
+		RelationshipGraph graph;
+		/// @brief The timeline, handed over once the load finished
+		Timeline timeline;
+		/// @brief The reason for a failed load
+		std::string error;
+
+		/// @brief The loader thread, declared last so it is joined first
+		std::jthread worker;
+	};
+} // namespace storage
+
+#endif // LIBRARY_LOADER_H
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <fstream>
+
+#include "library_manager.h"
+#include "exceptions.h"
+
+namespace
+{
+	/// @brief The number of bytes read from the start of a library file by a scan
+	constexpr std::size_t headerSize = 4096;
+
+	/**
+	 * @brief Replace the predefined xml entities inside an attribute value
+	 *
+	 * @param value The raw attribute value
+	 * @return std::string The unescaped value
+	 */
+	std::string unescape(std::string_view value)
+	{
+		constexpr std::pair<std::string_view, char> entities[] = {
+			{ "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' }, { "&quot;", '"' }, { "&apos;", '\'' }
+		};
+
+		std::string result;
+		result.reserve(value.size());
+		while (!value.empty())
+		{
+			const auto entity = std::find_if(std::begin(entities), std::end(entities),
+					[value] (const auto& entity) { return value.starts_with(entity.first); });
+			if (entity != std::end(entities))
+			{
+				result.push_back(entity->second);
+				value.remove_prefix(entity->first.size());
+			}
+			else
+			{
+				result.push_back(value.front());
+				value.remove_prefix(1);
+			}
+		}
+		return result;
+	}
+} // namespace
+
+storage::LibraryManager::LibraryManager(std::filesystem::path _folder, std::size_t _memoryBudget) :
+		folder(std::move(_folder)), memoryBudget(_memoryBudget), residentMemory(0)
+{
+	std::filesystem::create_directories(folder);
+	scan();
+}
+
+void storage::LibraryManager::scan()
+{
+	libraries.clear();
+
+	// Files vanishing or becoming unreadable while scanning are skipped instead of throwing filesystem errors
+	std::error_code error;
+	for (std::filesystem::directory_iterator it(folder, error), end; !error && it != end; it.increment(error))
+	{
+		std::error_code typeError;
+		if (!it->is_regular_file(typeError) || it->path().extension() != ".library")
+			continue;
+
+		try
+		{
+			libraries.push_back(readHeader(it->path()));
+		}
+		catch (const FileError&)
+		{
+			// Unreadable files are simply not listed
+		}
+	}
+
+	std::sort(libraries.begin(), libraries.end(),
+			[] (const LibraryInfo& a, const LibraryInfo& b) { return a.name < b.name; });
+}
+
+void storage::LibraryManager::select(const std::filesystem::path& path)
+{
+	auto it = std::find_if(resident.begin(), resident.end(),
+			[&path] (const Entry& entry) { return entry.path == path; });
+	if (it != resident.end())
+	{
+		// Selecting a library which failed or was cancelled loads it again
+		const LibraryLoader::State state = it->loader->getState();
+		if (state != LibraryLoader::State::Failed && state != LibraryLoader::State::Cancelled)
+		{
+			resident.splice(resident.begin(), resident, it);
+			return;
+		}
+		resident.erase(it);
+	}
+
+	// Estimate the memory by the file size until the library is loaded
+	std::error_code error;
+	const std::uintmax_t fileSize = std::filesystem::file_size(path, error);
+	resident.push_front({ path, std::make_unique<LibraryLoader>(path), false,
+			error ? 0 : static_cast<std::size_t>(fileSize), 0 });
+}
+
+void storage::LibraryManager::create(std::string_view name)
+{
+	const std::filesystem::path path = folder / (std::string(name) + ".library");
+
+	if (std::none_of(libraries.begin(), libraries.end(),
+			[&path] (const LibraryInfo& info) { return info.path == path; }))
+	{
+		libraries.push_back({ path, std::string(name), "", 0, std::filesystem::file_time_type::clock::now() });
+		std::sort(libraries.begin(), libraries.end(),
+				[] (const LibraryInfo& a, const LibraryInfo& b) { return a.name < b.name; });
+	}
+
+	select(path);
+}
+
+storage::Library* storage::LibraryManager::getActiveLibrary()
+{
+	return resident.empty() ? nullptr : &resident.front().loader->getLibrary();
+}
+
+storage::LibraryLoader* storage::LibraryManager::getActiveLoader()
+{
+	return resident.empty() ? nullptr : resident.front().loader.get();
+}
+
+bool storage::LibraryManager::isActiveComplete()
+{
+	return !resident.empty() && resident.front().opened;
+}
+
+bool storage::LibraryManager::isResident(const std::filesystem::path& path) const
+{
+	return std::any_of(resident.begin(), resident.end(),
+			[&path] (const Entry& entry) { return entry.path == path; });
+}
+
+void storage::LibraryManager::update()
+{
+	residentMemory = 0;
+
+	for (Entry& entry : resident)
+	{
+		Library& library = entry.loader->getLibrary();
+
+		if (entry.loader->update())
+		{
+			entry.opened = true;
+			if (openHandler)
+				openHandler(library);
+
+			entry.memory = library.getMemoryUsage();
+			entry.measuredGeneration = library.getGeneration();
+		}
+		else if (entry.opened && entry.measuredGeneration != library.getGeneration())
+		{
+			// Only edited libraries need to be measured again
+			entry.memory = library.getMemoryUsage();
+			entry.measuredGeneration = library.getGeneration();
+		}
+
+		residentMemory += entry.memory;
+	}
+
+	evict();
+}
+
+storage::LibraryManager::LibraryInfo storage::LibraryManager::readHeader(const std::filesystem::path& path)
+{
+	std::error_code error;
+	LibraryInfo info{ path, path.stem().string(), "", std::filesystem::file_size(path, error), {} };
+	if (!error)
+		info.lastWrite = std::filesystem::last_write_time(path, error);
+	if (error)
+		throw OpenError("Unable to query library <", path.string(), ">: ", error.message());
+
+	std::ifstream input(path, std::ifstream::binary);
+	if (!input)
+		throw OpenError("Unable to open library <", path.string(), ">.");
+
+	char buffer[headerSize];
+	input.read(buffer, sizeof(buffer));
+	const std::string_view header(buffer, input.gcount());
+
+	// Only the attributes of the root element are of interest
+	const std::size_t begin = header.find("<library");
+	if (begin == std::string_view::npos)
+		return info;
+	const std::string_view element = header.substr(begin, header.find('>', begin) - begin);
+
+	const std::size_t owner = element.find("owner=");
+	if (owner != std::string_view::npos && owner + 6 < element.size())
+	{
+		const char quote = element[owner + 6];
+		const std::size_t end = element.find(quote, owner + 7);
+		if (end != std::string_view::npos)
+			info.owner = unescape(element.substr(owner + 7, end - owner - 7));
+	}
+
+	return info;
+}
+
+void storage::LibraryManager::evict()
+{
+	if (resident.size() < 2 || residentMemory <= memoryBudget)
+		return;
+
+	// Walk from the least recently used library up to, but never including, the active one
+	for (auto it = std::prev(resident.end()); it != resident.begin() && residentMemory > memoryBudget;)
+	{
+		const auto current = it--;
+		Library& library = current->loader->getLibrary();
+
+		if (current->loader->getState() == LibraryLoader::State::Running || library.isDirty())
+			continue;
+
+		if (current->opened && evictHandler)
+			evictHandler(library);
+
+		residentMemory -= current->memory;
+		resident.erase(current);
+	}
+}
@@ -0,0 +1,189 @@
+#ifndef LIBRARY_MANAGER_H
+#define LIBRARY_MANAGER_H
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "library_loader.h"
+#include "storage.h"
+
+
+
+namespace storage
+{
+	/**
+	 * @brief Keeps track of all libraries inside a folder.
+	 *
+	 * Known libraries are listed by reading only the header of every library
+	 * file. A library is opened in the background when it is selected for the
+	 * first time and stays resident afterwards, so switching back to it is
+	 * instant. Resident libraries are ordered by their last use; once their
+	 * estimated memory exceeds the budget, the least recently used libraries
+	 * which are idle and saved are evicted.
+	 */
+	class LibraryManager
+	{
+	public:
+		/**
+		 * @brief The information gathered about a library without opening it
+		 */
+		struct LibraryInfo
+		{
+			/// @brief The path to the library file
+			std::filesystem::path path;
+			/// @brief The name of the library derived from its file name
+			std::string name;
+			/// @brief The owner read from the library header
+			std::string owner;
+			/// @brief The size of the library file in bytes
+			std::uintmax_t fileSize;
+			/// @brief The time the library file was last written
+			std::filesystem::file_time_type lastWrite;
+		};
+
+	public:
+		/**
+		 * @brief Construct a new library manager and scan the library folder
+		 *
+		 * @param folder The folder containing the library files
+		 * @param memoryBudget The estimated memory the resident libraries may use
+		 */
+		LibraryManager(std::filesystem::path folder, std::size_t memoryBudget = 64 << 20);
+
+		/**
+		 * @brief Rescan the library folder for library files
+		 */
+		void scan();
+		/**
+		 * @brief Get all known libraries
+		 *
+		 * @return const std::vector<LibraryInfo>& The libraries sorted by name
+		 */
+		const std::vector<LibraryInfo>& getLibraries() const { return libraries; }
+
+		/**
+		 * @brief Make a library the active one, opening it if it is not resident
+		 *
+		 * @param path The path to the library file
+		 */
+		void select(const std::filesystem::path& path);
+		/**
+		 * @brief Create a new library file inside the library folder and select it
+		 *
+		 * @param name The name of the new library
+		 */
+		void create(std::string_view name);
+
+		/**
+		 * @brief Get the active library
+		 *
+		 * @return Library* The active library, possibly still loading, or nullptr
+		 */
+		Library* getActiveLibrary();
+		/**
+		 * @brief Get the loader of the active library
+		 *
+		 * @return LibraryLoader* The loader of the active library or nullptr
+		 */
+		LibraryLoader* getActiveLoader();
+		/**
+		 * @brief Check if the active library is completely loaded
+		 *
+		 * @return true If the active library can be edited
+		 * @return false If there is no active library or it is incomplete
+		 */
+		bool isActiveComplete();
+		/**
+		 * @brief Check if a library is resident in memory
+		 *
+		 * @param path The path to the library file
+		 * @return true If the library is open
+		 * @return false If it has to be loaded on selection
+		 */
+		bool isResident(const std::filesystem::path& path) const;
+		/**
+		 * @brief Get the estimated memory used by all resident libraries
+		 *
+		 * @return std::size_t The memory in bytes as of the last update
+		 */
+		std::size_t getResidentMemory() const { return residentMemory; }
+
+		/**
+		 * @brief Set a function which is called once a library is completely loaded
+		 *
+		 * @param handler The function receiving the loaded library
+		 */
+		void setOpenHandler(std::function<void(Library&)> handler) { openHandler = std::move(handler); }
+		/**
+		 * @brief Set a function which is called right before an opened library is evicted
+		 *
+		 * @param handler The function receiving the evicted library
+		 */
+		void setEvictHandler(std::function<void(Library&)> handler) { evictHandler = std::move(handler); }
+
+		/**
+		 * @brief Deliver loaded shelf's and evict idle libraries over the budget
+		 *
+		 * This has to be called regularly (usually once per frame) from the
+		 * thread which owns the libraries.
+		 */
+		void update();
+
+	private:
+		/**
+		 * @brief A library which is resident in memory
+		 */
+		struct Entry
+		{
+			/// @brief The path to the library file
+			std::filesystem::path path;
+			/// @brief The loader owning the library
+			std::unique_ptr<LibraryLoader> loader;
+			/// @brief Set once the open handler was called for the library
+			bool opened;
+			/// @brief The estimated memory used by the library
+			std::size_t memory;
+			/// @brief The library generation the memory was estimated at
+			std::uint64_t measuredGeneration;
+		};
+
+		/**
+		 * @brief Read the information about a library from its file header
+		 *
+		 * A file which can not be queried or opened throws an OpenError.
+		 *
+		 * @param path The path to the library file
+		 * @return LibraryInfo The gathered information
+		 */
+		static LibraryInfo readHeader(const std::filesystem::path& path);
+		/**
+		 * @brief Evict least recently used libraries until the budget is met
+		 */
+		void evict();
+
+		/// @brief The folder containing the library files
+		const std::filesystem::path folder;
+		/// @brief The estimated memory the resident libraries may use
+		const std::size_t memoryBudget;
+
+		/// @brief All known libraries
+		std::vector<LibraryInfo> libraries;
+		/// @brief The resident libraries, the active one first and least recently used last
+		std::list<Entry> resident;
+		/// @brief The estimated memory used by all resident libraries
+		std::size_t residentMemory;
+
+		/// @brief The function notified about completely loaded libraries
+		std::function<void(Library&)> openHandler;
+		/// @brief The function notified about evicted libraries
+		std::function<void(Library&)> evictHandler;
+	};
+} // namespace storage
+
+#endif // LIBRARY_MANAGER_H
@@ -9,14 +9,28 @@
 //   the backend itself (imgui_impl_vulkan.cpp), but should PROBABLY NOT be used by your own engine/app code.
 // Read comments in imgui_impl_vulkan.h.
 
+#include <algorithm>
+#include <filesystem>
 #include <iostream>
+#include <optional>
+#include <span>
 #include <stdexcept>
+#include <string_view>
+#include <vector>
 
 #include "graphics/backend.h"
+#include "graphics/font_cache.h"
+#include "graphics/frame_pacer.h"
+#include "graphics/glyph_cache.h"
 #include "graphics/imgui_tools.h"
+#include "graphics/session_state.h"
 #include "graphics/windows.h"
+#include "dictionary.h"
+#include "exceptions.h"
 #include "settings.h"
+#include "startup.h"
 #include "storage.h"
+#include "wakeup.h"
 
 
 
@@ -34,24 +48,159 @@ inline ImVecN<2> getViewportCenter(ImGuiViewport* viewport)
 /**
  * @brief Main entry point of the programm.
  *
+ * The option --startup-trace prints the time to the first frame and the
+ * time every step of the startup took.
+ *
+ * @param argc The number of arguments
+ * @param argv The arguments
  * @return int The error code of the program. A zero indicates normal termination.
  */
-int main(int, char**)
+int main(int argc, char** argv)
 {
+	storage::StartupSequence startup;
+	const bool traceStartup = std::any_of(argv + 1, argv + argc,
+			[] (const char* argument) { return std::string_view(argument) == "--startup-trace"; });
+
 	// Setup backend classes
+	startup.step("backend");
 	FileLocationService rootFLS;
 	graphics::ViewportRenderer viewportRender;
-	storage::Library library("/tmp/test.library");
+	storage::WriteAheadLog journal(rootFLS.getDataLocation("journal.wal"));
+	storage::LibraryManager libraries(rootFLS.getDataLocation("libraries"));
+	storage::AutosaveScheduler autosave;
+	storage::ThreadPool workers;
+
+	// The compiled dictionary is cached next to the word list and only rebuilt if the list changed
+	storage::Dictionary dictionary;
+	bool spellChecking = true;
+	const storage::StartupSequence::JoinGuard dictionaryGuard(startup);
+	startup.launch("dictionary",
+		[&rootFLS, &dictionary, &spellChecking] ()
+		{
+			try
+			{
+				dictionary = storage::Dictionary::load(rootFLS.getDataLocation("dictionary.txt"),
+						rootFLS.getDataLocation("dictionary.dawg"));
+			}
+			catch (const storage::FileError& error)
+			{
+				spellChecking = false;
+				std::cerr << "Spell checking disabled: " << error.what() << std::endl;
+			}
+		}
+	);
 
 	// Setup windows
-	graphics::LibraryWindow libraryWindow(&library, true);
+	startup.step("windows");
+	graphics::LibraryWindow libraryWindow(&libraries, &autosave, true);
 	viewportRender.registerStaticWindow(&libraryWindow);
-	graphics::EditorWindowTest editorWindow;
+	graphics::MentionWindow mentionWindow(&libraries, &workers);
+	viewportRender.registerStaticWindow(&mentionWindow);
+	graphics::RelationshipWindow relationshipWindow(&libraries, &workers);
+	viewportRender.registerStaticWindow(&relationshipWindow);
+	graphics::TimelineWindow timelineWindow(&libraries);
+	viewportRender.registerStaticWindow(&timelineWindow);
+	graphics::EditorWindowTest editorWindow(&autosave, &journal);
 	viewportRender.registerStaticWindow(&editorWindow);
+	graphics::RepetitionWindow repetitionWindow(&workers);
+	viewportRender.registerStaticWindow(&repetitionWindow);
+	repetitionWindow.setLocateHandler(
+		[&editorWindow] (std::uint64_t offset, std::uint64_t length)
+		{
+			editorWindow.select(offset, length);
+			editorWindow.isActive() = true;
+		}
+	);
+	const auto openBook =
+		[&editorWindow, &repetitionWindow] (storage::LibraryBook& book)
+		{
+			if (!book.getLocation().empty())
+			{
+				editorWindow.open(book.getLocation());
+				editorWindow.isActive() = true;
+				repetitionWindow.setDocument(editorWindow.getDocument());
+			}
+		};
+	libraryWindow.setBookOpenHandler(openBook);
+	mentionWindow.setBookOpenHandler(openBook);
+	editorWindow.setDocumentEditHandler(
+		[&mentionWindow, &repetitionWindow] (const storage::Document& document, const storage::Document::Edit& edit)
+		{
+			mentionWindow.applyEdit(document, edit);
+			repetitionWindow.applyEdit(document, edit);
+		}
+	);
 	graphics::MarkdownWindowTest markdownWindow;
 	viewportRender.registerStaticWindow(&markdownWindow);
+	graphics::TextImportWindow textImportWindow(&libraries, rootFLS.getDataLocation("books"));
+	viewportRender.setTextImportWindow(&textImportWindow);
+
+	// Hook libraries up to the journal and autosave once they are completely loaded
+	startup.step("libraries");
+	libraries.setOpenHandler(
+		[&journal, &autosave] (storage::Library& library)
+		{
+			// Replay the library edits which did not reach the file before the last crash
+			bool replayFailed = false;
+			try
+			{
+				for (const auto& edit : journal.attach(library.getPath()))
+					library.apply(storage::LibraryEdit::parse(edit));
+			}
+			catch (const storage::FileError& error)
+			{
+				// Saving right away checkpoints the library, so the broken edits are not replayed again
+				replayFailed = true;
+				std::cerr << "Journal: dropped the unsaved edits of <" << library.getPath().string() << ">: "
+						<< error.what() << std::endl;
+			}
+
+			library.setEditHandler(
+				[&journal, &library] (const storage::LibraryEdit& edit)
+				{
+					journal.append(library.getPath(), edit.serialize());
+				}
+			);
+			autosave.addSource(&library, {
+				.path = library.getPath(),
+				.generation = [&library] () { return library.getGeneration(); },
+				.snapshot = [&journal, &library] ()
+					{
+						std::string content = library.serializeToString();
+						journal.checkpoint(library.getPath(), content);
+						return content;
+					},
+				.saved = [&journal, &library] (std::uint64_t generation)
+					{
+						library.markSaved(generation);
+						journal.compact();
+					},
+				.prepare = [&journal] () { journal.sync(); }
+			});
+			if (library.isDirty() || replayFailed)
+				autosave.save(&library);
+		}
+	);
+	libraries.setEvictHandler(
+		[&autosave] (storage::Library& library)
+		{
+			autosave.removeSource(&library);
+		}
+	);
+
+	if (const auto metrics = journal.getMetrics(); metrics.recoveredEdits + metrics.discardedEdits > 0)
+		std::cerr << "Journal: recovered " << metrics.recoveredEdits << " unsaved edits, discarded "
+				<< metrics.discardedEdits << " outdated edits" << std::endl;
+
+	// Open the most recently written library, or create a first one
+	if (libraries.getLibraries().empty())
+		libraries.create("default");
+	else
+		libraries.select(std::max_element(libraries.getLibraries().begin(), libraries.getLibraries().end(),
+				[] (const auto& a, const auto& b) { return a.lastWrite < b.lastWrite; })->path);
 
 	// Setup the main system window
+	startup.step("system window");
 	graphics::SystemWindow::setErrorCallback(
 		[] (int error, const char* description)
 		{
@@ -72,8 +221,16 @@ int main(int, char**)
 			}
 		}
 	);
-	graphics::VulkanInstance vulkan(window);
+	// Creating the instance and the device loads the drivers, which overlaps with the ImGui setup
+	std::optional<graphics::VulkanInstance> vulkan;
+	const storage::StartupSequence::JoinGuard vulkanGuard(startup);
+	startup.launch("vulkan instance",
+			[&vulkan, &window, pipelineCachePath = rootFLS.getDataLocation("pipelines.cache")] ()
+			{
+				vulkan.emplace(window, pipelineCachePath);
+			});
 
+	startup.step("imgui context");
 	{ // Setup Dear ImGui context
 		IMGUI_CHECKVERSION();
 		ImGui::CreateContext();
@@ -94,15 +251,72 @@ int main(int, char**)
 	}
 
 	// Setup the styling context
+	startup.step("styles");
 	StyleContext styleContext(rootFLS.getConfigLocation("styles"));
 	graphics::StyleEditorWindow styleEditorWindow(&styleContext);
 	viewportRender.registerSettingsWindow(&styleEditorWindow);
 
+	// All fonts of the font folder are merged into one, so a Latin font can be completed by a Japanese one
+	startup.step("fonts");
+	graphics::GlyphCache glyphCache;
+	{
+		std::vector<graphics::FontSource> fonts;
+		std::error_code listError;
+		for (const auto& entry : std::filesystem::directory_iterator(rootFLS.getDataLocation("fonts"), listError))
+			if (entry.path().extension() == ".ttf" || entry.path().extension() == ".otf")
+				fonts.push_back({ entry.path(), 18.0f, graphics::GlyphCache::staticRanges, true });
+		std::sort(fonts.begin(), fonts.end(),
+				[] (const auto& a, const auto& b) { return a.path.filename() < b.path.filename(); });
+
+		// Without fonts ImGui falls back to its built in font
+		if (!fonts.empty())
+		{
+			fonts.front().merge = false;
+			graphics::FontAtlasCache fontCache(rootFLS.getDataLocation("fonts.cache"));
+			try
+			{
+				const float scale = window.getContentScale();
+				fontCache.build(ImGui::GetIO().Fonts, fonts, scale);
+
+				// The ideographs are only rasterized once they are drawn
+				std::vector<std::filesystem::path> paths;
+				for (const graphics::FontSource& font : fonts)
+					paths.push_back(font.path);
+				glyphCache.attach(ImGui::GetIO().Fonts, paths, fonts.front().size * scale);
+			}
+			catch (const storage::FileError& error)
+			{
+				std::cerr << "Fonts not loaded: " << error.what() << std::endl;
+			}
+		}
+	}
+
+	// Restore the dock layout and the open windows of the last run before the first frame
+	startup.step("session");
+	graphics::SessionState session(rootFLS.getConfigLocation("session.bin"), &viewportRender, &autosave);
+	try
+	{
+		session.load();
+	}
+	catch (const storage::FileError& error)
+	{
+		std::cerr << "Session not restored: " << error.what() << std::endl;
+	}
+
+	startup.wait("dictionary");
+	editorWindow.setDictionary(spellChecking ? &dictionary : nullptr);
+
 	// Initialize the vulkan rendering
-	vulkan.init(window);
+	startup.wait("vulkan instance");
+	startup.step(vulkan->hasCachedPipelines() ? "vulkan setup, cached pipelines" : "vulkan setup, compiling pipelines");
+	vulkan->init(window);
+	viewportRender.setRenderer(&*vulkan);
+	startup.step("first frame");
 
-	// Main loop
-	while (window.isActive())
+	// Main loop, which sleeps until an event arrives or a window asks for a frame
+	graphics::FramePacer pacer;
+	storage::setWakeupHandler([] () { graphics::FramePacer::requestFrame(); });
+	while (pacer.waitForFrame(window))
 	{
 		// Poll and handle events (inputs, window resize, etc.)
 		// You can read the io.WantCaptureMouse, io.WantCaptureKeyboard flags
@@ -113,7 +327,10 @@ int main(int, char**)
 		//     data to your main application.
 		// Generally you may always pass all inputs to dear imgui, and hide them
 		// from your application based on those two flags.
-		vulkan.rebuildSwapchain(window);
+		vulkan->rebuildSwapchain(window);
+
+		// Move freshly loaded shelfs into the libraries and evict idle ones
+		libraries.update();
 
 		// Start a new Dear ImGui frame
 		graphics::NewFrame();
@@ -125,7 +342,13 @@ int main(int, char**)
 
 		// Rendering
 		ImGui::Render();
-		vulkan.render();
+		// Ideographs rasterized now show up in the next frame
+		const std::span<const graphics::GlyphCache::Region> regions = glyphCache.update();
+		for (const graphics::GlyphCache::Region& region : regions)
+			vulkan->updateFontTexture(region.x, region.y, region.width, region.height);
+		if (!regions.empty())
+			graphics::FramePacer::requestFrame();
+		vulkan->render();
 
 		// Update and Render additional Platform Windows
 		if (ImGui::GetIO().ConfigFlags & ImGuiConfigFlags_ViewportsEnable)
@@ -134,7 +357,18 @@ int main(int, char**)
 			ImGui::RenderPlatformWindowsDefault();
 		}
 
-		vulkan.presentFrame();
+		vulkan->presentFrame();
+		pacer.setFrameSkipped(vulkan->isFrameSkipped());
+		if (!startup.isFinished())
+		{
+			startup.finish();
+			if (traceStartup)
+				startup.print(std::cerr);
+		}
+
+		// Write modified sources in the background
+		session.update();
+		autosave.update();
 	}
 	return 0;
 }
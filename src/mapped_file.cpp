@@ -0,0 +1,68 @@
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_file.h"
+#include "exceptions.h"
+
+storage::MappedFile::MappedFile(const std::filesystem::path& path, bool sequential) :
+		_data(nullptr), _size(0)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		throw OpenError("Unable to open file <", path.string(), "> for mapping.");
+
+	struct stat status;
+	if (::fstat(fd, &status) != 0)
+	{
+		::close(fd);
+		throw ReadError("Unable to query the size of <", path.string(), ">.");
+	}
+
+	_size = static_cast<std::size_t>(status.st_size);
+	if (_size != 0)
+	{
+		void* mapping = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping == MAP_FAILED)
+		{
+			::close(fd);
+			throw ReadError("Unable to map <", path.string(), "> into memory.");
+		}
+
+		if (sequential)
+			::madvise(mapping, _size, MADV_SEQUENTIAL);
+
+		_data = static_cast<const char*>(mapping);
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	::close(fd);
+}
+
+storage::MappedFile::MappedFile(MappedFile&& other) noexcept :
+		_data(std::exchange(other._data, nullptr)), _size(std::exchange(other._size, 0))
+{
+}
+
+storage::MappedFile::~MappedFile()
+{
+	if (_data != nullptr)
+		::munmap(const_cast<char*>(_data), _size);
+}
+
+storage::MappedFile& storage::MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		if (_data != nullptr)
+			::munmap(const_cast<char*>(_data), _size);
+
+		_data = std::exchange(other._data, nullptr);
+		_size = std::exchange(other._size, 0);
+	}
+
+	return *this;
+}
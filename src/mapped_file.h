@@ -0,0 +1,62 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+
+
+
+namespace storage
+{
+	/**
+	 * @brief A read only memory mapping of a whole file.
+	 *
+	 * The mapping is created on construction and released on destruction.
+	 * Empty files are represented by an empty view without any mapping.
+	 */
+	class MappedFile
+	{
+	public:
+		/**
+		 * @brief Map the given file into memory
+		 *
+		 * @param path The path to the file which should be mapped
+		 * @param sequential Hint the kernel that the file is read front to back
+		 */
+		MappedFile(const std::filesystem::path& path, bool sequential = false);
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile(const MappedFile&) = delete;
+		~MappedFile();
+
+		MappedFile& operator=(MappedFile&& other) noexcept;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		/**
+		 * @brief Get a pointer to the first byte of the mapping
+		 *
+		 * @return const char* The start of the mapped file
+		 */
+		const char* data() const { return _data; }
+		/**
+		 * @brief Get the size of the mapping
+		 *
+		 * @return std::size_t The size of the mapped file in bytes
+		 */
+		std::size_t size() const { return _size; }
+		/**
+		 * @brief Get the whole mapping as a string view
+		 *
+		 * @return std::string_view A view over all mapped bytes
+		 */
+		std::string_view view() const { return std::string_view(_data, _size); }
+
+	private:
+		/// @brief The start of the mapping
+		const char* _data;
+		/// @brief The size of the mapping in bytes
+		std::size_t _size;
+	};
+} // namespace storage
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <deque>
+#include <limits>
+
+#include "mention_index.h"
+#include "exceptions.h"
+#include "mapped_file.h"
+
+namespace
+{
+	/**
+	 * @brief Fold ASCII letters to lower case
+	 *
+	 * @param byte The byte to fold
+	 * @return std::uint8_t The lower case letter or the unchanged byte
+	 */
+	std::uint8_t fold(std::uint8_t byte)
+	{
+		return byte >= 'A' && byte <= 'Z' ? byte + ('a' - 'A') : byte;
+	}
+} // namespace
+
+storage::MentionScanner::MentionScanner() : classes{}, classCount(1), outputStart(1), transitions(1, 0),
+		matchOffsets(1, 0), maxLength(0)
+{
+}
+
+void storage::MentionScanner::build(const std::vector<std::string>& names)
+{
+	// Only bytes used by a name get their own column, upper case letters share the column of their lower case one
+	classes.fill(0);
+	classCount = 1;
+	maxLength = 0;
+	lengths.assign(names.size(), 0);
+	for (std::size_t i = 0; i < names.size(); ++i)
+	{
+		lengths[i] = names[i].size();
+		maxLength = std::max(maxLength, names[i].size());
+		for (const char byte : names[i])
+		{
+			const std::uint8_t folded = fold(byte);
+			if (classes[folded] == 0)
+			{
+				if (classCount > std::numeric_limits<std::uint8_t>::max())
+					throw ParsingError("Too many different characters inside the names.");
+				classes[folded] = classCount++;
+			}
+		}
+	}
+	for (std::uint8_t letter = 'A'; letter <= 'Z'; ++letter)
+		classes[letter] = classes[fold(letter)];
+
+	// Build the trie, zero marks a missing child since the root is nobodies child
+	std::vector<std::uint32_t> table(classCount, 0);
+	std::vector<std::vector<std::uint32_t>> outputs(1);
+	for (std::size_t i = 0; i < names.size(); ++i)
+	{
+		if (names[i].empty())
+			continue;
+
+		std::uint32_t state = 0;
+		for (const char byte : names[i])
+		{
+			std::uint32_t& child = table[state * classCount + classes[static_cast<std::uint8_t>(byte)]];
+			if (child == 0)
+			{
+				child = outputs.size();
+				outputs.emplace_back();
+				table.resize(table.size() + classCount, 0);
+			}
+			state = table[state * classCount + classes[static_cast<std::uint8_t>(byte)]];
+		}
+		outputs[state].push_back(i);
+	}
+	const std::size_t stateCount = outputs.size();
+	if (stateCount * classCount > std::numeric_limits<std::uint32_t>::max())
+		throw ParsingError("The names are too long to be searched for.");
+
+	// Resolve the failure links breadth first, so every missing transition already knows its target
+	std::vector<std::uint32_t> failure(stateCount, 0);
+	std::deque<std::uint32_t> pending;
+	for (std::uint32_t column = 0; column < classCount; ++column)
+		if (table[column] != 0)
+			pending.push_back(table[column]);
+	while (!pending.empty())
+	{
+		const std::uint32_t state = pending.front();
+		pending.pop_front();
+
+		const std::vector<std::uint32_t>& inherited = outputs[failure[state]];
+		outputs[state].insert(outputs[state].end(), inherited.begin(), inherited.end());
+		for (std::uint32_t column = 0; column < classCount; ++column)
+		{
+			std::uint32_t& next = table[state * classCount + column];
+			const std::uint32_t fallback = table[failure[state] * classCount + column];
+			if (next == 0)
+				next = fallback;
+			else
+			{
+				failure[next] = fallback;
+				pending.push_back(next);
+			}
+		}
+	}
+
+	// Number the states completing a name last and store every state as the offset of its row
+	std::vector<std::uint32_t> order;
+	order.reserve(stateCount);
+	for (std::uint32_t state = 0; state < stateCount; ++state)
+		if (outputs[state].empty())
+			order.push_back(state);
+	const std::uint32_t plainCount = order.size();
+	for (std::uint32_t state = 0; state < stateCount; ++state)
+		if (!outputs[state].empty())
+			order.push_back(state);
+
+	std::vector<std::uint32_t> renamed(stateCount);
+	for (std::uint32_t i = 0; i < stateCount; ++i)
+		renamed[order[i]] = i * classCount;
+
+	transitions.resize(stateCount * classCount);
+	for (std::uint32_t i = 0; i < stateCount; ++i)
+		for (std::uint32_t column = 0; column < classCount; ++column)
+			transitions[i * classCount + column] = renamed[table[order[i] * classCount + column]];
+	outputStart = plainCount * classCount;
+
+	matchOffsets.assign(1, 0);
+	matches.clear();
+	for (std::uint32_t i = plainCount; i < stateCount; ++i)
+	{
+		matches.insert(matches.end(), outputs[order[i]].begin(), outputs[order[i]].end());
+		matchOffsets.push_back(matches.size());
+	}
+}
+
+std::size_t storage::MentionScanner::getMemoryUsage() const
+{
+	return sizeof(MentionScanner) + (transitions.capacity() + matchOffsets.capacity() + matches.capacity()
+			+ lengths.capacity()) * sizeof(std::uint32_t);
+}
+
+storage::MentionIndex::MentionIndex(ThreadPool* _pool) :
+		pool(_pool), generation(std::numeric_limits<std::uint64_t>::max()), updates(0), version(0), scannedBytes(0),
+		scanTime(0)
+{
+}
+
+bool storage::MentionIndex::update(const RelationshipGraph& graph, const LibraryIndex& libraryBooks,
+		std::uint64_t _generation)
+{
+	if (generation == _generation)
+		return false;
+	generation = _generation;
+	++updates;
+	++version;
+
+	// Search all books anew once a name changed
+	const std::vector<RelationshipGraph::Entity>& entities = graph.getEntities();
+	bool renamed = entities.size() != names.size();
+	for (std::size_t i = 0; i < entities.size() && !renamed; ++i)
+		renamed = names[i] != (entities[i].removed ? "" : entities[i].name);
+	if (renamed)
+	{
+		names.resize(entities.size());
+		for (std::size_t i = 0; i < entities.size(); ++i)
+			names[i] = entities[i].removed ? "" : entities[i].name;
+		scanner.build(names);
+
+		for (Book& book : books)
+			if (!book.location.empty() || book.pending)
+			{
+				book.mentions.clear();
+				book.pending = true;
+			}
+		totals.assign(names.size(), 0);
+		scannedBytes = 0;
+		scanTime = std::chrono::nanoseconds(0);
+	}
+
+	for (std::size_t position = 0; position < libraryBooks.size(); ++position)
+	{
+		LibraryBook* const libraryBook = libraryBooks.getBook(position);
+		if (libraryBook->getId() >= books.size())
+			books.resize(libraryBook->getId() + 1, Book{ "", {}, 0, 0, false, false });
+
+		Book& book = books[libraryBook->getId()];
+		book.position = position;
+		book.seen = updates;
+		if (book.location != libraryBook->getLocation())
+		{
+			count(book, -1);
+			book.location = libraryBook->getLocation();
+			book.mentions.clear();
+			book.pending = true;
+		}
+	}
+
+	// Forget the books which left the library
+	queue.clear();
+	for (std::uint32_t id = 0; id < books.size(); ++id)
+	{
+		Book& book = books[id];
+		if (book.seen != updates && (!book.location.empty() || book.pending))
+		{
+			count(book, -1);
+			book = Book{ "", {}, 0, 0, false, false };
+		}
+		if (book.pending)
+			queue.push_back(id);
+	}
+	return true;
+}
+
+void storage::MentionIndex::clear()
+{
+	generation = std::numeric_limits<std::uint64_t>::max();
+	++version;
+	names.clear();
+	scanner.build(names);
+	books.clear();
+	queue.clear();
+	totals.clear();
+	scannedBytes = 0;
+	scanTime = std::chrono::nanoseconds(0);
+}
+
+void storage::MentionIndex::step(std::chrono::microseconds budget)
+{
+	using Clock = std::chrono::steady_clock;
+
+	if (queue.empty())
+		return;
+
+	// A batch holds a few books per thread, so uneven books even out
+	const std::size_t batchSize = pool->getConcurrency() * 4;
+	const Clock::time_point start = Clock::now();
+	std::vector<std::uint64_t> sizes;
+	do
+	{
+		const std::size_t taken = std::min(batchSize, queue.size());
+		const std::uint32_t* const batch = queue.data() + queue.size() - taken;
+		sizes.assign(taken, 0);
+
+		pool->parallelFor(taken, 1,
+			[this, batch, &sizes] (std::size_t begin, std::size_t end)
+			{
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					Book& book = books[batch[i]];
+					book.failed = false;
+					try
+					{
+						const MappedFile file(book.location, true);
+						scanText(file.view(), book.mentions);
+						sizes[i] = file.size();
+					}
+					catch (const FileError&)
+					{
+						book.failed = true;
+					}
+				}
+			}
+		);
+
+		for (std::size_t i = 0; i < taken; ++i)
+		{
+			Book& book = books[batch[i]];
+			book.pending = false;
+			count(book, 1);
+			scannedBytes += sizes[i];
+		}
+		queue.resize(queue.size() - taken);
+	}
+	while (!queue.empty() && Clock::now() - start < budget);
+
+	scanTime += Clock::now() - start;
+	++version;
+}
+
+void storage::MentionIndex::applyEdit(const std::filesystem::path& location, const Document::Edit& edit,
+		std::string_view text)
+{
+	const auto found = std::find_if(books.begin(), books.end(),
+			[&location] (const Book& book) { return !book.location.empty() && location == book.location; });
+	if (found == books.end())
+		return;
+	Book& book = *found;
+
+	// The scan of the file would miss the edit, so the whole text is scanned now
+	if (book.pending || book.failed || edit.offset + edit.insert.size() > text.size())
+	{
+		count(book, -1);
+		scanText(text, book.mentions);
+		count(book, 1);
+		if (book.pending)
+			std::erase(queue, static_cast<std::uint32_t>(found - books.begin()));
+		book.pending = false;
+		book.failed = false;
+		++version;
+		return;
+	}
+
+	// Names starting further away than their length plus the boundary byte are not affected by the edit
+	const std::uint64_t margin = scanner.getMaxLength() + 1;
+	const std::uint64_t low = edit.offset > margin ? edit.offset - margin : 0;
+	const std::uint64_t oldHigh = edit.offset + edit.erase + margin;
+	const std::uint64_t newHigh = edit.offset + edit.insert.size() + margin;
+	const auto first = std::lower_bound(book.mentions.begin(), book.mentions.end(), low,
+			[] (const Mention& mention, std::uint64_t offset) { return mention.offset < offset; });
+	const auto last = std::lower_bound(first, book.mentions.end(), oldHigh,
+			[] (const Mention& mention, std::uint64_t offset) { return mention.offset < offset; });
+
+	for (auto mention = first; mention != last; ++mention)
+		--totals[mention->entity];
+	for (auto mention = last; mention != book.mentions.end(); ++mention)
+		mention->offset = mention->offset + edit.insert.size() - edit.erase;
+
+	std::vector<Mention> rescanned;
+	scanner.scan(text, low, std::min<std::uint64_t>(newHigh + scanner.getMaxLength(), text.size()),
+		[this, &rescanned, newHigh] (std::uint32_t entity, std::size_t offset)
+		{
+			if (offset < newHigh)
+			{
+				rescanned.push_back({ offset, entity });
+				++totals[entity];
+			}
+		}
+	);
+	std::sort(rescanned.begin(), rescanned.end(),
+			[] (const Mention& a, const Mention& b) { return a.offset < b.offset; });
+	const auto position = book.mentions.erase(first, last);
+	book.mentions.insert(position, rescanned.begin(), rescanned.end());
+	++version;
+}
+
+void storage::MentionIndex::findBooks(std::uint32_t entity, std::vector<BookCount>& result) const
+{
+	result.clear();
+	for (const Book& book : books)
+	{
+		std::uint32_t mentions = 0;
+		for (const Mention& mention : book.mentions)
+			mentions += mention.entity == entity;
+		if (mentions != 0)
+			result.push_back({ book.position, mentions });
+	}
+
+	std::sort(result.begin(), result.end(),
+			[] (const BookCount& a, const BookCount& b) { return a.position < b.position; });
+}
+
+storage::MentionIndex::Statistics storage::MentionIndex::getStatistics() const
+{
+	Statistics statistics{ queue.size(), 0, scannedBytes, std::chrono::duration<double, std::milli>(scanTime).count() };
+	for (const Book& book : books)
+		statistics.failedBooks += book.failed;
+	return statistics;
+}
+
+void storage::MentionIndex::scanText(std::string_view text, std::vector<Mention>& mentions) const
+{
+	mentions.clear();
+	scanner.scan(text, 0, text.size(),
+		[&mentions] (std::uint32_t entity, std::size_t offset) { mentions.push_back({ offset, entity }); });
+
+	// Matches are reported by their end, a long name may start before a short one found earlier
+	std::sort(mentions.begin(), mentions.end(),
+			[] (const Mention& a, const Mention& b) { return a.offset < b.offset; });
+}
+
+void storage::MentionIndex::count(const Book& book, int sign)
+{
+	for (const Mention& mention : book.mentions)
+		totals[mention.entity] += sign;
+}
@@ -0,0 +1,340 @@
+#ifndef MENTION_INDEX_H
+#define MENTION_INDEX_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "graph.h"
+#include "query.h"
+#include "thread_pool.h"
+
+
+
+namespace storage
+{
+	/**
+	 * @brief Finds many names in a text within a single pass
+	 *
+	 * The names are compiled into an Aho-Corasick automaton whose failure
+	 * links are resolved ahead of time, so every byte of the text costs one
+	 * lookup in a flat transition table. Bytes not used by any name share a
+	 * single column of the table, which keeps it small enough for the cache.
+	 * States completing a name are numbered last, so the scan loop only needs
+	 * a single comparison to notice a match.
+	 *
+	 * Matching ignores the case of ASCII letters and only reports names
+	 * standing on their own, not as part of a longer word.
+	 */
+	class MentionScanner
+	{
+	public:
+		/**
+		 * @brief Construct a new scanner which matches nothing
+		 */
+		MentionScanner();
+
+		/**
+		 * @brief Compile the automaton for a list of names
+		 *
+		 * Empty names never match.
+		 *
+		 * @param names The names to search for, a match reports the index inside this list
+		 */
+		void build(const std::vector<std::string>& names);
+
+		/**
+		 * @brief Call a function for every name found inside a range of a text
+		 *
+		 * Only names lying completely inside the range are found, the bytes
+		 * around the range are still considered for the word boundaries.
+		 *
+		 * @tparam Function The type of the function
+		 * @param text The whole text
+		 * @param begin The offset the scan starts at
+		 * @param end The offset the scan ends at
+		 * @param function The function receiving the index of the name and the offset of the match
+		 */
+		template<typename Function>
+		void scan(std::string_view text, std::size_t begin, std::size_t end, Function function) const
+		{
+			const std::uint32_t* const table = transitions.data();
+			std::uint32_t state = 0;
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				state = table[state + classes[static_cast<std::uint8_t>(text[i])]];
+				if (state >= outputStart) [[unlikely]]
+					report(text, i + 1, state, function);
+			}
+		}
+
+		/**
+		 * @brief Get the length of the longest name
+		 *
+		 * @return std::size_t The length in bytes
+		 */
+		std::size_t getMaxLength() const { return maxLength; }
+		/**
+		 * @brief Get the number of states of the automaton
+		 *
+		 * @return std::size_t The number of states
+		 */
+		std::size_t getStateCount() const { return transitions.size() / classCount; }
+		/**
+		 * @brief Estimate the memory used by the automaton
+		 *
+		 * @return std::size_t The estimated memory in bytes
+		 */
+		std::size_t getMemoryUsage() const;
+
+	private:
+		/**
+		 * @brief Report the names ending at a position
+		 *
+		 * @tparam Function The type of the function
+		 * @param text The whole text
+		 * @param end The offset past the last byte of the names
+		 * @param state The state reached at the offset
+		 * @param function The function receiving the matches
+		 */
+		template<typename Function>
+		void report(std::string_view text, std::size_t end, std::uint32_t state, Function& function) const
+		{
+			const std::uint32_t index = state / classCount - outputStart / classCount;
+			for (std::uint32_t i = matchOffsets[index]; i < matchOffsets[index + 1]; ++i)
+			{
+				const std::uint32_t name = matches[i];
+				const std::size_t start = end - lengths[name];
+				if ((start == 0 || !isWordByte(text[start - 1])) && (end == text.size() || !isWordByte(text[end])))
+					function(name, start);
+			}
+		}
+		/**
+		 * @brief Check if a byte can be part of a word
+		 *
+		 * @param byte The byte to check
+		 * @return true For letters, digits and all bytes of multi byte characters
+		 * @return false Otherwise
+		 */
+		static bool isWordByte(char byte)
+		{
+			const std::uint8_t value = static_cast<std::uint8_t>(byte);
+			return value >= 0x80 || (value >= '0' && value <= '9') || ((value | 0x20) >= 'a' && (value | 0x20) <= 'z')
+					|| value == '_';
+		}
+
+		/// @brief The column of every byte inside the transition table
+		std::array<std::uint8_t, 256> classes;
+		/// @brief The number of columns of the transition table
+		std::uint32_t classCount;
+		/// @brief The first entry of the first state completing a name
+		std::uint32_t outputStart;
+		/// @brief The entry of the next state for every state and column, states are stored as their first entry
+		std::vector<std::uint32_t> transitions;
+		/// @brief The start of the names completed by every output state inside matches
+		std::vector<std::uint32_t> matchOffsets;
+		/// @brief The names completed by all output states
+		std::vector<std::uint32_t> matches;
+		/// @brief The length of every name
+		std::vector<std::uint32_t> lengths;
+		/// @brief The length of the longest name
+		std::size_t maxLength;
+	};
+
+	/**
+	 * @brief Knows which books of a library mention which entities
+	 *
+	 * The names of the entities of the relationship graph are searched inside
+	 * the files of all books. Books are scanned in parallel batches spread
+	 * over several frames, every thread fills the mentions of its own books,
+	 * so no merging is needed. Edits of an open book only rescan the
+	 * surroundings of the change.
+	 */
+	class MentionIndex
+	{
+	public:
+		/**
+		 * @brief A name found inside a book
+		 */
+		struct Mention
+		{
+			/// @brief The byte offset of the name
+			std::uint64_t offset;
+			/// @brief The id of the entity
+			std::uint32_t entity;
+		};
+
+		/**
+		 * @brief The number of mentions of an entity inside a book
+		 */
+		struct BookCount
+		{
+			/// @brief The position of the book inside the library index
+			std::uint32_t position;
+			/// @brief The number of mentions
+			std::uint32_t count;
+		};
+
+		/**
+		 * @brief Measurements of the scan
+		 */
+		struct Statistics
+		{
+			/// @brief The number of books waiting to be scanned
+			std::size_t pendingBooks;
+			/// @brief The number of books whose file could not be read
+			std::size_t failedBooks;
+			/// @brief The number of bytes scanned since the last complete rescan
+			std::uint64_t scannedBytes;
+			/// @brief The time spent scanning since the last complete rescan in milliseconds
+			double scanTime;
+		};
+
+	public:
+		/**
+		 * @brief Construct a new empty index
+		 *
+		 * @param _pool The threads scanning the books
+		 */
+		MentionIndex(ThreadPool* _pool);
+
+		/**
+		 * @brief Take over the entities and books of a library
+		 *
+		 * Nothing is done if the generation did not change since the last
+		 * update. Changed names cause all books to be scanned again, otherwise
+		 * only new books and books with a new location are scanned.
+		 *
+		 * @param graph The graph holding the entities
+		 * @param books The books of the library
+		 * @param generation A number which changes whenever the library changed
+		 * @return true If the index changed
+		 * @return false If the index was up to date
+		 */
+		bool update(const RelationshipGraph& graph, const LibraryIndex& books, std::uint64_t generation);
+		/**
+		 * @brief Forget all books and entities
+		 */
+		void clear();
+		/**
+		 * @brief Scan waiting books until a time budget is used up
+		 *
+		 * @param budget The time the scan may take
+		 */
+		void step(std::chrono::microseconds budget);
+		/**
+		 * @brief Update the mentions of a book after its text changed
+		 *
+		 * @param location The location of the book
+		 * @param edit The change of the text
+		 * @param text The text after the change
+		 */
+		void applyEdit(const std::filesystem::path& location, const Document::Edit& edit, std::string_view text);
+
+		/**
+		 * @brief Get the number of mentions of every entity
+		 *
+		 * @return const std::vector<std::uint32_t>& The numbers indexed by entity id
+		 */
+		const std::vector<std::uint32_t>& getTotals() const { return totals; }
+		/**
+		 * @brief Find all books mentioning an entity
+		 *
+		 * @param entity The id of the entity
+		 * @param result Receives the books ordered by their position
+		 */
+		void findBooks(std::uint32_t entity, std::vector<BookCount>& result) const;
+		/**
+		 * @brief Get a number which changes whenever the mentions changed
+		 *
+		 * @return std::uint64_t The version of the mentions
+		 */
+		std::uint64_t getVersion() const { return version; }
+		/**
+		 * @brief Check if all books were scanned
+		 *
+		 * @return true If no book waits for its scan
+		 * @return false Otherwise
+		 */
+		bool isComplete() const { return queue.empty(); }
+		/**
+		 * @brief Get the automaton searching the names
+		 *
+		 * @return const MentionScanner& The scanner
+		 */
+		const MentionScanner& getScanner() const { return scanner; }
+		/**
+		 * @brief Get the measurements of the scan
+		 *
+		 * @return Statistics The statistics
+		 */
+		Statistics getStatistics() const;
+
+	private:
+		/**
+		 * @brief The mentions of a book
+		 */
+		struct Book
+		{
+			/// @brief The location of the book file
+			std::string location;
+			/// @brief The mentions ordered by offset
+			std::vector<Mention> mentions;
+			/// @brief The position of the book inside the library index
+			std::uint32_t position;
+			/// @brief The update the book was last seen by, books not seen by the last update were removed
+			std::uint64_t seen;
+			/// @brief Set while the book waits for its scan
+			bool pending;
+			/// @brief Set if the book file could not be read
+			bool failed;
+		};
+
+		/**
+		 * @brief Scan a whole text
+		 *
+		 * @param text The text to scan
+		 * @param mentions Receives the mentions ordered by offset
+		 */
+		void scanText(std::string_view text, std::vector<Mention>& mentions) const;
+		/**
+		 * @brief Add or remove the mentions of a book from the totals
+		 *
+		 * @param book The book
+		 * @param sign 1 to add the mentions, -1 to remove them
+		 */
+		void count(const Book& book, int sign);
+
+		/// @brief The threads scanning the books
+		ThreadPool* const pool;
+		/// @brief The generation of the library at the last update
+		std::uint64_t generation;
+		/// @brief The number of updates so far
+		std::uint64_t updates;
+		/// @brief Bumped whenever the mentions changed
+		std::uint64_t version;
+
+		/// @brief The names of the entities, empty for removed ones
+		std::vector<std::string> names;
+		/// @brief The automaton searching the names
+		MentionScanner scanner;
+		/// @brief The mentions of all books indexed by book id
+		std::vector<Book> books;
+		/// @brief The ids of the books waiting for their scan
+		std::vector<std::uint32_t> queue;
+		/// @brief The number of mentions of every entity
+		std::vector<std::uint32_t> totals;
+
+		/// @brief The number of bytes scanned since the last complete rescan
+		std::uint64_t scannedBytes;
+		/// @brief The time spent scanning since the last complete rescan
+		std::chrono::nanoseconds scanTime;
+	};
+} // namespace storage
+
+#endif // MENTION_INDEX_H
@@ -0,0 +1,616 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+
+#include "metadata.h"
+#include "binary.h"
+#include "exceptions.h"
+
+namespace
+{
+	/// @brief The version of the binary form written by serialize
+	constexpr std::uint8_t formatVersion = 1;
+
+	/**
+	 * @brief Build a bitmap by evaluating a predicate for every row
+	 *
+	 * The predicate results of 64 rows are packed into one word without
+	 * branches, so the inner loop can be vectorized.
+	 *
+	 * @tparam Value The type of the column values
+	 * @tparam Predicate The type of the predicate
+	 * @param values The column values
+	 * @param result Receives the rows for which the predicate is true
+	 * @param predicate The predicate
+	 */
+	template<typename Value, typename Predicate>
+	void scanColumn(const std::vector<Value>& values, storage::Bitmap& result, Predicate predicate)
+	{
+		result.resize(0);
+		result.resize(values.size());
+
+		std::vector<std::uint64_t>& words = result.getWords();
+		const std::size_t full = values.size() / 64;
+		for (std::size_t i = 0; i < full; ++i)
+		{
+			const Value* block = values.data() + i * 64;
+			std::uint64_t word = 0;
+			for (std::size_t bit = 0; bit < 64; ++bit)
+				word |= static_cast<std::uint64_t>(predicate(block[bit])) << bit;
+			words[i] = word;
+		}
+
+		std::uint64_t word = 0;
+		for (std::size_t row = full * 64; row < values.size(); ++row)
+			word |= static_cast<std::uint64_t>(predicate(values[row])) << (row & 63);
+		if (full < words.size())
+			words[full] = word;
+	}
+
+	/**
+	 * @brief Remove leading and trailing spaces
+	 *
+	 * @param text The text to trim
+	 * @return std::string_view The trimmed text
+	 */
+	std::string_view trim(std::string_view text)
+	{
+		const std::size_t begin = text.find_first_not_of(" \t");
+		if (begin == std::string_view::npos)
+			return { };
+		return text.substr(begin, text.find_last_not_of(" \t") - begin + 1);
+	}
+
+	/**
+	 * @brief Split a comma separated list of tags
+	 *
+	 * @param text The list of tags
+	 * @return std::vector<std::string_view> The trimmed, non empty tags
+	 */
+	std::vector<std::string_view> splitTags(std::string_view text)
+	{
+		std::vector<std::string_view> tags;
+		while (!text.empty())
+		{
+			const std::size_t comma = text.find(',');
+			const std::string_view tag = trim(text.substr(0, comma));
+			if (!tag.empty() && std::find(tags.begin(), tags.end(), tag) == tags.end())
+				tags.push_back(tag);
+			text.remove_prefix(comma == std::string_view::npos ? text.size() : comma + 1);
+		}
+		return tags;
+	}
+
+	/**
+	 * @brief Parse a signed integer which has to span the whole text
+	 *
+	 * @param text The text to parse
+	 * @param value Receives the parsed value
+	 * @return true If the text is an integer
+	 * @return false If the text is no integer
+	 */
+	bool parseInteger(std::string_view text, std::int64_t& value)
+	{
+		text = trim(text);
+		const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+		return error == std::errc() && end == text.data() + text.size() && !text.empty();
+	}
+
+	/**
+	 * @brief Read a row index and make sure it lies inside the store
+	 *
+	 * @param reader The reader to read the delta encoded row from
+	 * @param previous The previous row, updated to the read row
+	 * @param rows The number of rows of the store
+	 * @return std::size_t The read row
+	 */
+	std::size_t readRow(storage::BinaryReader& reader, std::size_t& previous, std::size_t rows)
+	{
+		previous += reader.readVarint();
+		if (previous >= rows)
+			throw storage::ParsingError("Metadata row is out of range.");
+		return previous++;
+	}
+} // namespace
+
+void storage::Bitmap::resize(std::size_t size, bool value)
+{
+	if (value && bits < size && !words.empty() && (bits & 63) != 0)
+		words.back() |= ~std::uint64_t(0) << (bits & 63);
+
+	words.resize((size + 63) / 64, value ? ~std::uint64_t(0) : 0);
+	bits = size;
+	trim();
+}
+
+void storage::Bitmap::setRange(std::size_t begin, std::size_t end)
+{
+	for (; begin < end && (begin & 63) != 0; ++begin)
+		set(begin);
+	for (; begin + 64 <= end; begin += 64)
+		words[begin >> 6] = ~std::uint64_t(0);
+	for (; begin < end; ++begin)
+		set(begin);
+}
+
+storage::Bitmap& storage::Bitmap::operator&=(const Bitmap& other)
+{
+	const std::size_t common = std::min(words.size(), other.words.size());
+	for (std::size_t i = 0; i < common; ++i)
+		words[i] &= other.words[i];
+	std::fill(words.begin() + common, words.end(), 0);
+	return *this;
+}
+
+storage::Bitmap& storage::Bitmap::operator|=(const Bitmap& other)
+{
+	const std::size_t common = std::min(words.size(), other.words.size());
+	for (std::size_t i = 0; i < common; ++i)
+		words[i] |= other.words[i];
+	trim();
+	return *this;
+}
+
+void storage::Bitmap::flip()
+{
+	for (std::uint64_t& word : words)
+		word = ~word;
+	trim();
+}
+
+std::size_t storage::Bitmap::count() const
+{
+	std::size_t count = 0;
+	for (const std::uint64_t word : words)
+		count += __builtin_popcountll(word);
+	return count;
+}
+
+void storage::Bitmap::trim()
+{
+	if ((bits & 63) != 0)
+		words.back() &= (std::uint64_t(1) << (bits & 63)) - 1;
+}
+
+void storage::MetadataStore::IntegerColumn::scan(Comparison comparison, std::int64_t value, Bitmap& result) const
+{
+	// Dispatch once per scan so every loop only contains a single comparison
+	switch (comparison)
+	{
+	case Comparison::Equal:
+		scanColumn(values, result, [value] (std::int64_t v) { return v == value; });
+		break;
+	case Comparison::NotEqual:
+		scanColumn(values, result, [value] (std::int64_t v) { return v != value; });
+		break;
+	case Comparison::Less:
+		scanColumn(values, result, [value] (std::int64_t v) { return v < value; });
+		break;
+	case Comparison::LessEqual:
+		scanColumn(values, result, [value] (std::int64_t v) { return v <= value; });
+		break;
+	case Comparison::Greater:
+		scanColumn(values, result, [value] (std::int64_t v) { return v > value; });
+		break;
+	case Comparison::GreaterEqual:
+		scanColumn(values, result, [value] (std::int64_t v) { return v >= value; });
+		break;
+	}
+	result &= valid;
+}
+
+void storage::MetadataStore::StringColumn::scan(std::string_view value, Bitmap& result) const
+{
+	const auto code = codes.find(value);
+	if (code == codes.end())
+	{
+		result = Bitmap(values.size());
+		return;
+	}
+
+	scanColumn(values, result, [code = code->second] (std::uint32_t v) { return v == code; });
+	result &= valid;
+}
+
+std::uint32_t storage::MetadataStore::StringColumn::encode(std::string_view value)
+{
+	const auto code = codes.find(value);
+	if (code != codes.end())
+		return code->second;
+
+	dictionary.emplace_back(value);
+	codes.emplace(value, static_cast<std::uint32_t>(dictionary.size() - 1));
+	return static_cast<std::uint32_t>(dictionary.size() - 1);
+}
+
+void storage::MetadataStore::TagColumn::scan(std::string_view tag, Bitmap& result) const
+{
+	const auto code = codes.find(tag);
+	const std::size_t size = rows.empty() ? 0 : rows.front().size();
+	result = code == codes.end() ? Bitmap(size) : rows[code->second];
+}
+
+bool storage::MetadataStore::parseDate(std::string_view text, std::int64_t& days)
+{
+	text = trim(text);
+	if (text.size() != 10 || text[4] != '-' || text[7] != '-')
+		return false;
+
+	std::int64_t year, month, day;
+	if (!parseInteger(text.substr(0, 4), year) || !parseInteger(text.substr(5, 2), month)
+			|| !parseInteger(text.substr(8, 2), day))
+		return false;
+
+	const std::chrono::year_month_day date{ std::chrono::year(static_cast<int>(year)),
+			std::chrono::month(static_cast<unsigned>(month)), std::chrono::day(static_cast<unsigned>(day)) };
+	if (!date.ok())
+		return false;
+
+	days = std::chrono::sys_days(date).time_since_epoch().count();
+	return true;
+}
+
+std::string storage::MetadataStore::formatDate(std::int64_t days)
+{
+	const std::chrono::year_month_day date{ std::chrono::sys_days(std::chrono::days(days)) };
+
+	char buffer[16];
+	std::snprintf(buffer, sizeof(buffer), "%04d-%02u-%02u", static_cast<int>(date.year()),
+			static_cast<unsigned>(date.month()), static_cast<unsigned>(date.day()));
+	return buffer;
+}
+
+storage::MetadataStore::MetadataStore() :
+		rows(0)
+{
+	for (const Attribute& attribute : attributes)
+	{
+		switch (attribute.type)
+		{
+		case Type::Integer:
+		case Type::Date:
+			columns.emplace_back(IntegerColumn());
+			break;
+		case Type::String:
+			columns.emplace_back(StringColumn());
+			break;
+		case Type::Tags:
+			columns.emplace_back(TagColumn());
+			break;
+		}
+	}
+}
+
+const storage::MetadataStore::Column* storage::MetadataStore::getColumn(std::string_view name) const
+{
+	const std::size_t index = findAttribute(name);
+	return index < columns.size() ? &columns[index] : nullptr;
+}
+
+bool storage::MetadataStore::isValid(std::string_view attribute, std::string_view value) const
+{
+	const std::size_t index = findAttribute(attribute);
+	if (index == attributes.size())
+		return false;
+	if (trim(value).empty())
+		return true;
+
+	std::int64_t number;
+	switch (attributes[index].type)
+	{
+	case Type::Integer:
+		return parseInteger(value, number);
+	case Type::Date:
+		return parseDate(value, number);
+	case Type::String:
+	case Type::Tags:
+		return true;
+	}
+	return false;
+}
+
+bool storage::MetadataStore::set(std::uint32_t row, std::string_view attribute, std::string_view value)
+{
+	if (!isValid(attribute, value))
+		return false;
+
+	reserveRow(row);
+
+	const std::size_t index = findAttribute(attribute);
+	const bool remove = trim(value).empty();
+	Column& column = columns[index];
+
+	if (IntegerColumn* integers = std::get_if<IntegerColumn>(&column))
+	{
+		std::int64_t number = 0;
+		if (!remove && attributes[index].type == Type::Date)
+			parseDate(value, number);
+		else if (!remove)
+			parseInteger(value, number);
+
+		integers->values[row] = number;
+		remove ? integers->valid.reset(row) : integers->valid.set(row);
+	}
+	else if (StringColumn* strings = std::get_if<StringColumn>(&column))
+	{
+		strings->values[row] = remove ? 0 : strings->encode(trim(value));
+		remove ? strings->valid.reset(row) : strings->valid.set(row);
+	}
+	else if (TagColumn* tags = std::get_if<TagColumn>(&column))
+	{
+		for (Bitmap& tagged : tags->rows)
+			tagged.reset(row);
+
+		for (const std::string_view tag : splitTags(value))
+		{
+			auto code = tags->codes.find(tag);
+			if (code == tags->codes.end())
+			{
+				tags->dictionary.emplace_back(tag);
+				tags->rows.emplace_back(rows);
+				code = tags->codes.emplace(tag, static_cast<std::uint32_t>(tags->dictionary.size() - 1)).first;
+			}
+			tags->rows[code->second].set(row);
+		}
+	}
+
+	return true;
+}
+
+std::string storage::MetadataStore::get(std::uint32_t row, std::string_view attribute) const
+{
+	const std::size_t index = findAttribute(attribute);
+	if (index == attributes.size() || row >= rows)
+		return { };
+
+	const Column& column = columns[index];
+	if (const IntegerColumn* integers = std::get_if<IntegerColumn>(&column))
+	{
+		if (!integers->valid.test(row))
+			return { };
+		return attributes[index].type == Type::Date ? formatDate(integers->values[row])
+				: std::to_string(integers->values[row]);
+	}
+	else if (const StringColumn* strings = std::get_if<StringColumn>(&column))
+	{
+		return strings->valid.test(row) ? strings->dictionary[strings->values[row]] : std::string();
+	}
+	else
+	{
+		const TagColumn& tags = std::get<TagColumn>(column);
+
+		std::string text;
+		for (std::size_t i = 0; i < tags.rows.size(); ++i)
+		{
+			if (!tags.rows[i].test(row))
+				continue;
+			if (!text.empty())
+				text += ", ";
+			text += tags.dictionary[i];
+		}
+		return text;
+	}
+}
+
+void storage::MetadataStore::clear(std::uint32_t row)
+{
+	if (row >= rows)
+		return;
+
+	for (Column& column : columns)
+	{
+		if (IntegerColumn* integers = std::get_if<IntegerColumn>(&column))
+		{
+			integers->values[row] = 0;
+			integers->valid.reset(row);
+		}
+		else if (StringColumn* strings = std::get_if<StringColumn>(&column))
+		{
+			strings->values[row] = 0;
+			strings->valid.reset(row);
+		}
+		else
+		{
+			for (Bitmap& tagged : std::get<TagColumn>(column).rows)
+				tagged.reset(row);
+		}
+	}
+}
+
+std::size_t storage::MetadataStore::getMemoryUsage() const
+{
+	const auto bitmapSize = [] (const Bitmap& bitmap) { return bitmap.getWords().capacity() * sizeof(std::uint64_t); };
+	const auto dictionarySize = [] (const std::vector<std::string>& dictionary)
+	{
+		// Every dictionary entry is also a key of the code map
+		std::size_t size = 0;
+		for (const std::string& value : dictionary)
+			size += 2 * (sizeof(std::string) + value.capacity()) + 32;
+		return size;
+	};
+
+	std::size_t size = sizeof(MetadataStore) + columns.capacity() * sizeof(Column);
+	for (const Column& column : columns)
+	{
+		if (const IntegerColumn* integers = std::get_if<IntegerColumn>(&column))
+			size += integers->values.capacity() * sizeof(std::int64_t) + bitmapSize(integers->valid);
+		else if (const StringColumn* strings = std::get_if<StringColumn>(&column))
+			size += strings->values.capacity() * sizeof(std::uint32_t) + bitmapSize(strings->valid)
+					+ dictionarySize(strings->dictionary);
+		else
+		{
+			const TagColumn& tags = std::get<TagColumn>(column);
+			size += dictionarySize(tags.dictionary);
+			for (const Bitmap& tagged : tags.rows)
+				size += sizeof(Bitmap) + bitmapSize(tagged);
+		}
+	}
+	return size;
+}
+
+std::string storage::MetadataStore::serialize() const
+{
+	std::string data;
+	BinaryWriter writer(data);
+	writer.writeU8(formatVersion);
+	writer.writeVarint(rows);
+	writer.writeVarint(columns.size());
+
+	// Every column is length prefixed so that readers can skip unknown attributes
+	std::string payload;
+	for (std::size_t i = 0; i < columns.size(); ++i)
+	{
+		payload.clear();
+		BinaryWriter column(payload);
+
+		if (const IntegerColumn* integers = std::get_if<IntegerColumn>(&columns[i]))
+		{
+			column.writeVarint(integers->valid.count());
+			std::size_t previous = 0;
+			integers->valid.forEach([&] (std::size_t row) {
+				column.writeVarint(row - previous);
+				column.writeSignedVarint(integers->values[row]);
+				previous = row + 1;
+			});
+		}
+		else if (const StringColumn* strings = std::get_if<StringColumn>(&columns[i]))
+		{
+			column.writeVarint(strings->dictionary.size());
+			for (const std::string& value : strings->dictionary)
+				column.writeString(value);
+
+			column.writeVarint(strings->valid.count());
+			std::size_t previous = 0;
+			strings->valid.forEach([&] (std::size_t row) {
+				column.writeVarint(row - previous);
+				column.writeVarint(strings->values[row]);
+				previous = row + 1;
+			});
+		}
+		else
+		{
+			const TagColumn& tags = std::get<TagColumn>(columns[i]);
+			column.writeVarint(tags.dictionary.size());
+			for (std::size_t tag = 0; tag < tags.dictionary.size(); ++tag)
+			{
+				column.writeString(tags.dictionary[tag]);
+				column.writeVarint(tags.rows[tag].count());
+				std::size_t previous = 0;
+				tags.rows[tag].forEach([&] (std::size_t row) {
+					column.writeVarint(row - previous);
+					previous = row + 1;
+				});
+			}
+		}
+
+		writer.writeString(attributes[i].name);
+		writer.writeU8(static_cast<std::uint8_t>(attributes[i].type));
+		writer.writeString(payload);
+	}
+
+	return data;
+}
+
+void storage::MetadataStore::parse(std::string_view data)
+{
+	BinaryReader reader(data);
+	if (reader.readU8() != formatVersion)
+		throw ParsingError("Unsupported metadata version.");
+
+	MetadataStore store;
+	const std::size_t rowCount = reader.readVarint();
+	if (rowCount > data.size() * 8 + 64 * 1024)
+		throw ParsingError("Metadata row count is implausible.");
+	if (rowCount > 0)
+		store.reserveRow(static_cast<std::uint32_t>(rowCount - 1));
+
+	for (std::uint64_t count = reader.readVarint(); count > 0; --count)
+	{
+		const std::string_view name = reader.readString();
+		const Type type = static_cast<Type>(reader.readU8());
+		BinaryReader column(reader.readString());
+
+		const std::size_t index = findAttribute(name);
+		if (index == attributes.size() || attributes[index].type != type)
+			continue;
+
+		if (IntegerColumn* integers = std::get_if<IntegerColumn>(&store.columns[index]))
+		{
+			std::size_t previous = 0;
+			for (std::uint64_t values = column.readVarint(); values > 0; --values)
+			{
+				const std::size_t row = readRow(column, previous, rowCount);
+				integers->values[row] = column.readSignedVarint();
+				integers->valid.set(row);
+			}
+		}
+		else if (StringColumn* strings = std::get_if<StringColumn>(&store.columns[index]))
+		{
+			for (std::uint64_t values = column.readVarint(); values > 0; --values)
+				strings->encode(column.readString());
+
+			std::size_t previous = 0;
+			for (std::uint64_t values = column.readVarint(); values > 0; --values)
+			{
+				const std::size_t row = readRow(column, previous, rowCount);
+				const std::uint64_t code = column.readVarint();
+				if (code >= strings->dictionary.size())
+					throw ParsingError("Metadata string code is out of range.");
+				strings->values[row] = static_cast<std::uint32_t>(code);
+				strings->valid.set(row);
+			}
+		}
+		else
+		{
+			TagColumn& tags = std::get<TagColumn>(store.columns[index]);
+			for (std::uint64_t values = column.readVarint(); values > 0; --values)
+			{
+				const std::string_view tag = column.readString();
+				tags.dictionary.emplace_back(tag);
+				tags.codes.emplace(tag, static_cast<std::uint32_t>(tags.dictionary.size() - 1));
+				Bitmap& tagged = tags.rows.emplace_back(rowCount);
+
+				std::size_t previous = 0;
+				for (std::uint64_t tagCount = column.readVarint(); tagCount > 0; --tagCount)
+					tagged.set(readRow(column, previous, rowCount));
+			}
+		}
+	}
+
+	*this = std::move(store);
+}
+
+void storage::MetadataStore::reserveRow(std::uint32_t row)
+{
+	if (row < rows)
+		return;
+
+	// Grow geometrically so that adding books one by one stays cheap
+	const std::size_t size = std::max<std::size_t>(row + 1, rows + rows / 2);
+	for (Column& column : columns)
+	{
+		if (IntegerColumn* integers = std::get_if<IntegerColumn>(&column))
+		{
+			integers->values.resize(size);
+			integers->valid.resize(size);
+		}
+		else if (StringColumn* strings = std::get_if<StringColumn>(&column))
+		{
+			strings->values.resize(size);
+			strings->valid.resize(size);
+		}
+		else
+		{
+			for (Bitmap& tagged : std::get<TagColumn>(column).rows)
+				tagged.resize(size);
+		}
+	}
+	rows = size;
+}
+
+std::size_t storage::MetadataStore::findAttribute(std::string_view name)
+{
+	return std::find_if(attributes.begin(), attributes.end(),
+			[name] (const Attribute& attribute) { return attribute.name == name; }) - attributes.begin();
+}
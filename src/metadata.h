@@ -0,0 +1,360 @@
+#ifndef METADATA_H
+#define METADATA_H
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+
+
+namespace storage
+{
+	/**
+	 * @brief A fixed size set of bits stored in 64 bit words
+	 *
+	 * Bits past the size inside the last word are always zero.
+	 */
+	class Bitmap
+	{
+	public:
+		/**
+		 * @brief Construct a new bitmap
+		 *
+		 * @param size The number of bits
+		 * @param value The initial value of all bits
+		 */
+		Bitmap(std::size_t size = 0, bool value = false) : bits(0) { resize(size, value); }
+
+		/**
+		 * @brief Get the number of bits
+		 *
+		 * @return std::size_t The number of bits
+		 */
+		std::size_t size() const { return bits; }
+		/**
+		 * @brief Change the number of bits
+		 *
+		 * @param size The new number of bits
+		 * @param value The value of added bits
+		 */
+		void resize(std::size_t size, bool value = false);
+
+		bool test(std::size_t index) const { return words[index >> 6] >> (index & 63) & 1; }
+		void set(std::size_t index) { words[index >> 6] |= std::uint64_t(1) << (index & 63); }
+		void reset(std::size_t index) { words[index >> 6] &= ~(std::uint64_t(1) << (index & 63)); }
+
+		/**
+		 * @brief Set all bits inside a range
+		 *
+		 * @param begin The first bit to set
+		 * @param end One past the last bit to set
+		 */
+		void setRange(std::size_t begin, std::size_t end);
+
+		Bitmap& operator&=(const Bitmap& other);
+		Bitmap& operator|=(const Bitmap& other);
+		/**
+		 * @brief Invert all bits
+		 */
+		void flip();
+		/**
+		 * @brief Count the set bits
+		 *
+		 * @return std::size_t The number of set bits
+		 */
+		std::size_t count() const;
+
+		/**
+		 * @brief Call a function with the index of every set bit in ascending order
+		 *
+		 * @tparam Function The type of the function
+		 * @param function The function to call
+		 */
+		template<typename Function>
+		void forEach(Function function) const
+		{
+			for (std::size_t i = 0; i < words.size(); ++i)
+				for (std::uint64_t word = words[i]; word != 0; word &= word - 1)
+					function((i << 6) + __builtin_ctzll(word));
+		}
+
+		/**
+		 * @brief Access the underlying words
+		 *
+		 * @return std::vector<std::uint64_t>& The words holding the bits
+		 */
+		std::vector<std::uint64_t>& getWords() { return words; }
+		const std::vector<std::uint64_t>& getWords() const { return words; }
+
+	private:
+		/**
+		 * @brief Clear the unused bits of the last word
+		 */
+		void trim();
+
+		/// @brief The words holding the bits
+		std::vector<std::uint64_t> words;
+		/// @brief The number of bits
+		std::size_t bits;
+	};
+
+	/**
+	 * @brief Column oriented store of typed book attributes
+	 *
+	 * Every attribute is one dense column indexed by the book id. Missing
+	 * values are tracked by a validity bitmap per column. Strings are
+	 * dictionary encoded so that comparisons only touch integer codes, tags
+	 * are stored as one bitmap of books per distinct tag.
+	 *
+	 * All scans produce bitmaps of matching rows and process 64 rows per
+	 * output word without branches, which lets the compiler vectorize them.
+	 */
+	class MetadataStore
+	{
+	public:
+		/**
+		 * @brief The value types of attributes
+		 */
+		enum class Type : std::uint8_t
+		{
+			/// @brief A signed integer
+			Integer,
+			/// @brief A calendar date stored as days since 1970-01-01
+			Date,
+			/// @brief A string out of a usually small set of values
+			String,
+			/// @brief Any number of strings out of a usually small set of values
+			Tags
+		};
+
+		/**
+		 * @brief The description of an attribute
+		 */
+		struct Attribute
+		{
+			/// @brief The name of the attribute
+			std::string_view name;
+			/// @brief The value type of the attribute
+			Type type;
+		};
+
+		/**
+		 * @brief The comparisons supported by integer scans
+		 */
+		enum class Comparison : std::uint8_t
+		{
+			Equal,
+			NotEqual,
+			Less,
+			LessEqual,
+			Greater,
+			GreaterEqual
+		};
+
+		/**
+		 * @brief A column of integers or dates
+		 */
+		struct IntegerColumn
+		{
+			/// @brief The value of every row, zero for missing values
+			std::vector<std::int64_t> values;
+			/// @brief The rows which have a value
+			Bitmap valid;
+
+			/**
+			 * @brief Find all rows with a value matching a comparison
+			 *
+			 * @param comparison The comparison to apply
+			 * @param value The value to compare with
+			 * @param result Receives the matching rows
+			 */
+			void scan(Comparison comparison, std::int64_t value, Bitmap& result) const;
+		};
+
+		/**
+		 * @brief A dictionary encoded string column
+		 */
+		struct StringColumn
+		{
+			/// @brief The distinct values, indexed by their code
+			std::vector<std::string> dictionary;
+			/// @brief The code of every distinct value
+			std::map<std::string, std::uint32_t, std::less<>> codes;
+			/// @brief The code of every row, zero for missing values
+			std::vector<std::uint32_t> values;
+			/// @brief The rows which have a value
+			Bitmap valid;
+
+			/**
+			 * @brief Find all rows with a value equal to a string
+			 *
+			 * @param value The string to search for
+			 * @param result Receives the matching rows
+			 */
+			void scan(std::string_view value, Bitmap& result) const;
+			/**
+			 * @brief Get the code of a value, adding it to the dictionary if needed
+			 *
+			 * @param value The value
+			 * @return std::uint32_t The code of the value
+			 */
+			std::uint32_t encode(std::string_view value);
+		};
+
+		/**
+		 * @brief A dictionary encoded multi value column
+		 */
+		struct TagColumn
+		{
+			/// @brief The distinct tags, indexed by their code
+			std::vector<std::string> dictionary;
+			/// @brief The code of every distinct tag
+			std::map<std::string, std::uint32_t, std::less<>> codes;
+			/// @brief The rows carrying a tag, indexed by the tag code
+			std::vector<Bitmap> rows;
+
+			/**
+			 * @brief Find all rows carrying a tag
+			 *
+			 * @param tag The tag to search for
+			 * @param result Receives the matching rows
+			 */
+			void scan(std::string_view tag, Bitmap& result) const;
+		};
+
+		/// @brief The storage of any attribute
+		using Column = std::variant<IntegerColumn, StringColumn, TagColumn>;
+
+		/// @brief All attributes known to the store
+		static constexpr std::array<Attribute, 7> attributes = { {
+			{ "tags", Type::Tags },
+			{ "status", Type::String },
+			{ "pov", Type::String },
+			{ "words", Type::Integer },
+			{ "target", Type::Integer },
+			{ "created", Type::Date },
+			{ "due", Type::Date }
+		} };
+
+		/**
+		 * @brief Parse a date in the form YYYY-MM-DD
+		 *
+		 * @param text The text to parse
+		 * @param days Receives the days since 1970-01-01
+		 * @return true If the text is a valid date
+		 * @return false If the text is no date
+		 */
+		static bool parseDate(std::string_view text, std::int64_t& days);
+		/**
+		 * @brief Format a date in the form YYYY-MM-DD
+		 *
+		 * @param days The days since 1970-01-01
+		 * @return std::string The formatted date
+		 */
+		static std::string formatDate(std::int64_t days);
+
+	public:
+		/**
+		 * @brief Construct a new store without any rows
+		 */
+		MetadataStore();
+
+		/**
+		 * @brief Get the number of rows of every column
+		 *
+		 * @return std::size_t The number of rows
+		 */
+		std::size_t getRowCount() const { return rows; }
+		/**
+		 * @brief Find the column of an attribute
+		 *
+		 * @param name The name of the attribute
+		 * @return const Column* The column or nullptr for an unknown attribute
+		 */
+		const Column* getColumn(std::string_view name) const;
+
+		/**
+		 * @brief Check if a textual value is valid for an attribute
+		 *
+		 * @param attribute The name of the attribute
+		 * @param value The textual value, empty to remove the value
+		 * @return true If set() would accept the value
+		 * @return false If the attribute is unknown or the value malformed
+		 */
+		bool isValid(std::string_view attribute, std::string_view value) const;
+		/**
+		 * @brief Set the value of an attribute from its textual form
+		 *
+		 * Tags are given as a comma separated list.
+		 *
+		 * @param row The row, usually the id of a book
+		 * @param attribute The name of the attribute
+		 * @param value The textual value, empty to remove the value
+		 * @return true If the value was stored
+		 * @return false If the attribute is unknown or the value malformed
+		 */
+		bool set(std::uint32_t row, std::string_view attribute, std::string_view value);
+		/**
+		 * @brief Get the textual form of an attribute value
+		 *
+		 * @param row The row, usually the id of a book
+		 * @param attribute The name of the attribute
+		 * @return std::string The textual value, empty if there is none
+		 */
+		std::string get(std::uint32_t row, std::string_view attribute) const;
+		/**
+		 * @brief Remove all values of a row
+		 *
+		 * @param row The row to clear
+		 */
+		void clear(std::uint32_t row);
+
+		/**
+		 * @brief Estimate the memory used by the store
+		 *
+		 * @return std::size_t The estimated memory in bytes
+		 */
+		std::size_t getMemoryUsage() const;
+
+		/**
+		 * @brief Encode all columns into a compact binary form
+		 *
+		 * @return std::string The encoded store
+		 */
+		std::string serialize() const;
+		/**
+		 * @brief Replace the content of the store by decoding its binary form
+		 *
+		 * Columns of unknown attributes are skipped.
+		 *
+		 * @param data The encoded store
+		 */
+		void parse(std::string_view data);
+
+	private:
+		/**
+		 * @brief Grow all columns so that a row exists
+		 *
+		 * @param row The row which has to exist
+		 */
+		void reserveRow(std::uint32_t row);
+		/**
+		 * @brief Find the index of an attribute
+		 *
+		 * @param name The name of the attribute
+		 * @return std::size_t The index or the number of attributes if unknown
+		 */
+		static std::size_t findAttribute(std::string_view name);
+
+		/// @brief The number of rows of every column
+		std::size_t rows;
+		/// @brief The columns in the order of the attributes
+		std::vector<Column> columns;
+	};
+} // namespace storage
+
+#endif // METADATA_H
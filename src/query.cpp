@@ -0,0 +1,545 @@
+#include <algorithm>
+#include <charconv>
+
+#include "query.h"
+#include "exceptions.h"
+
+namespace
+{
+	/// @brief The number of name searches cached by an index
+	constexpr std::size_t nameCacheSize = 32;
+
+	/**
+	 * @brief Read up to 64 bits starting at any bit offset
+	 *
+	 * @param words The words to read from, bits past the end read as zero
+	 * @param offset The offset of the first bit
+	 * @return std::uint64_t The bits, the first one in the lowest bit
+	 */
+	std::uint64_t readBits(const std::vector<std::uint64_t>& words, std::size_t offset)
+	{
+		const std::size_t index = offset >> 6;
+		const unsigned shift = offset & 63;
+		if (index >= words.size())
+			return 0;
+
+		std::uint64_t bits = words[index] >> shift;
+		if (shift != 0 && index + 1 < words.size())
+			bits |= words[index + 1] << (64 - shift);
+		return bits;
+	}
+
+	/**
+	 * @brief Set up to 64 bits starting at any bit offset
+	 *
+	 * @param words The words to write to, they have to cover all written bits
+	 * @param offset The offset of the first bit
+	 * @param bits The bits to set, the first one in the lowest bit
+	 * @param count The number of bits to write
+	 */
+	void writeBits(std::vector<std::uint64_t>& words, std::size_t offset, std::uint64_t bits, std::size_t count)
+	{
+		if (count < 64)
+			bits &= (std::uint64_t(1) << count) - 1;
+
+		const std::size_t index = offset >> 6;
+		const unsigned shift = offset & 63;
+		words[index] |= bits << shift;
+		if (shift != 0 && shift + count > 64)
+			words[index + 1] |= bits >> (64 - shift);
+	}
+
+	/**
+	 * @brief Convert ASCII letters to lower case, new lines become spaces
+	 *
+	 * @param text The text to convert
+	 * @return std::string The converted text
+	 */
+	std::string toLower(std::string_view text)
+	{
+		std::string result(text);
+		for (char& c : result)
+		{
+			if (c >= 'A' && c <= 'Z')
+				c = c - 'A' + 'a';
+			else if (c == '\n')
+				c = ' ';
+		}
+		return result;
+	}
+
+	/**
+	 * @brief Find a metadata attribute by its name
+	 *
+	 * @param name The name of the attribute
+	 * @return const storage::MetadataStore::Attribute* The attribute or nullptr if unknown
+	 */
+	const storage::MetadataStore::Attribute* findAttribute(std::string_view name)
+	{
+		for (const auto& attribute : storage::MetadataStore::attributes)
+			if (attribute.name == name)
+				return &attribute;
+		return nullptr;
+	}
+} // namespace
+
+/**
+ * @brief Recursive descent parser emitting the postfix plan of a query
+ */
+class storage::Query::Parser
+{
+public:
+	Parser(std::string_view _text, std::vector<Instruction>& _plan) : text(_text), offset(0), plan(_plan)
+	{
+		next();
+	}
+
+	void parse()
+	{
+		if (token.type == Token::Type::End)
+			return;
+
+		parseOr();
+		if (token.type != Token::Type::End)
+			fail("Unexpected <", std::string(token.text), ">");
+	}
+
+private:
+	struct Token
+	{
+		enum class Type
+		{
+			Word,
+			String,
+			Operator,
+			Open,
+			Close,
+			End
+		};
+
+		Type type;
+		std::string_view text;
+		std::size_t position;
+	};
+
+	/**
+	 * @brief Read the next token into token
+	 */
+	void next()
+	{
+		while (offset < text.size() && (text[offset] == ' ' || text[offset] == '\t'))
+			++offset;
+
+		token.position = offset;
+		if (offset == text.size())
+		{
+			token = { Token::Type::End, { }, offset };
+			return;
+		}
+
+		const char c = text[offset];
+		if (c == '(' || c == ')')
+		{
+			token = { c == '(' ? Token::Type::Open : Token::Type::Close, text.substr(offset, 1), offset };
+			++offset;
+		}
+		else if (c == '"')
+		{
+			const std::size_t end = text.find('"', offset + 1);
+			if (end == std::string_view::npos)
+				fail("Unterminated string");
+			token = { Token::Type::String, text.substr(offset + 1, end - offset - 1), offset };
+			offset = end + 1;
+		}
+		else if (c == ':' || c == '=' || c == '<' || c == '>' || c == '!')
+		{
+			const std::size_t length = offset + 1 < text.size() && text[offset + 1] == '=' && c != ':' && c != '=' ? 2 : 1;
+			token = { Token::Type::Operator, text.substr(offset, length), offset };
+			offset += length;
+		}
+		else
+		{
+			const std::size_t end = text.find_first_of(" \t()\":=<>!", offset);
+			token = { Token::Type::Word, text.substr(offset, end - offset), offset };
+			offset = end == std::string_view::npos ? text.size() : end;
+		}
+	}
+
+	bool isKeyword(std::string_view keyword) const
+	{
+		return token.type == Token::Type::Word && toLower(token.text) == keyword;
+	}
+
+	void parseOr()
+	{
+		parseAnd();
+		while (isKeyword("or"))
+		{
+			next();
+			parseAnd();
+			emit(Instruction::Type::Or);
+		}
+	}
+
+	void parseAnd()
+	{
+		parseUnary();
+		while (true)
+		{
+			if (isKeyword("and"))
+				next();
+			else if (token.type == Token::Type::End || token.type == Token::Type::Close || isKeyword("or"))
+				break;
+
+			// Adjacent terms are combined like an explicit and
+			parseUnary();
+			emit(Instruction::Type::And);
+		}
+	}
+
+	void parseUnary()
+	{
+		if (isKeyword("not") || (token.type == Token::Type::Operator && token.text == "!"))
+		{
+			next();
+			parseUnary();
+			emit(Instruction::Type::Not);
+		}
+		else if (token.type == Token::Type::Open)
+		{
+			next();
+			parseOr();
+			if (token.type != Token::Type::Close)
+				fail("Missing <)>");
+			next();
+		}
+		else
+			parseTerm();
+	}
+
+	void parseTerm()
+	{
+		if (token.type == Token::Type::String)
+		{
+			emit(Instruction::Type::Name, { }, toLower(token.text));
+			next();
+			return;
+		}
+		if (token.type != Token::Type::Word)
+			fail("Expected a term instead of <", std::string(token.text), ">");
+
+		const Token field = token;
+		next();
+		if (token.type != Token::Type::Operator || token.text == "!")
+		{
+			emit(Instruction::Type::Name, { }, toLower(field.text));
+			return;
+		}
+
+		const Token op = token;
+		next();
+		if (token.type != Token::Type::Word && token.type != Token::Type::String)
+			fail("Expected a value after <", std::string(field.text), std::string(op.text), ">");
+		const Token value = token;
+		next();
+
+		parseField(field, op, value);
+	}
+
+	void parseField(const Token& field, const Token& op, const Token& value)
+	{
+		const bool equality = op.text == ":" || op.text == "=";
+		const bool inequality = op.text == "!=";
+
+		std::string name = toLower(field.text);
+		if (name == "tag")
+			name = "tags";
+
+		if (name == "name" || name == "under")
+		{
+			if (!equality && !inequality)
+				fail("<", name, "> only supports <:> and <!=>");
+			emit(name == "name" ? Instruction::Type::Name : Instruction::Type::Under, { }, toLower(value.text));
+		}
+		else if (name == "has")
+		{
+			std::string attribute = toLower(value.text);
+			if (attribute == "tag")
+				attribute = "tags";
+
+			const auto known = findAttribute(attribute);
+			if (known == nullptr)
+				fail("Unknown attribute <", std::string(value.text), ">");
+			if (!equality)
+				fail("<has> only supports <:>");
+			emit(Instruction::Type::Has, known->name);
+		}
+		else
+		{
+			const auto attribute = findAttribute(name);
+			if (attribute == nullptr)
+				fail("Unknown field <", std::string(field.text), ">");
+
+			switch (attribute->type)
+			{
+			case MetadataStore::Type::Integer:
+			case MetadataStore::Type::Date:
+				{
+					std::int64_t number;
+					if (attribute->type == MetadataStore::Type::Date)
+					{
+						if (!MetadataStore::parseDate(value.text, number))
+							fail("Expected a date like 2024-12-31 instead of <", std::string(value.text), ">");
+					}
+					else
+					{
+						const auto [end, error] = std::from_chars(value.text.data(),
+								value.text.data() + value.text.size(), number);
+						if (error != std::errc() || end != value.text.data() + value.text.size())
+							fail("Expected a number instead of <", std::string(value.text), ">");
+					}
+
+					Instruction instruction{ Instruction::Type::Compare, attribute->name, comparison(op), number, { } };
+					plan.push_back(std::move(instruction));
+				}
+				return;
+
+			case MetadataStore::Type::String:
+			case MetadataStore::Type::Tags:
+				if (!equality && !inequality)
+					fail("<", name, "> only supports <:> and <!=>");
+				emit(attribute->type == MetadataStore::Type::Tags ? Instruction::Type::Tag
+						: Instruction::Type::Equal, attribute->name, std::string(value.text));
+				break;
+			}
+		}
+
+		if (inequality)
+			emit(Instruction::Type::Not);
+	}
+
+	MetadataStore::Comparison comparison(const Token& op) const
+	{
+		if (op.text == "!=")
+			return MetadataStore::Comparison::NotEqual;
+		if (op.text == "<")
+			return MetadataStore::Comparison::Less;
+		if (op.text == "<=")
+			return MetadataStore::Comparison::LessEqual;
+		if (op.text == ">")
+			return MetadataStore::Comparison::Greater;
+		if (op.text == ">=")
+			return MetadataStore::Comparison::GreaterEqual;
+		return MetadataStore::Comparison::Equal;
+	}
+
+	void emit(Instruction::Type type, std::string_view attribute = { }, std::string text = { })
+	{
+		plan.push_back({ type, attribute, MetadataStore::Comparison::Equal, 0, std::move(text) });
+	}
+
+	template<typename... T>
+	[[noreturn]] void fail(T... what) const
+	{
+		throw ParsingError(what..., " at position ", std::to_string(token.position + 1), ".");
+	}
+
+	/// @brief The text of the query
+	const std::string_view text;
+	/// @brief The offset of the next token
+	std::size_t offset;
+	/// @brief The current token
+	Token token;
+	/// @brief The plan receiving the instructions
+	std::vector<Instruction>& plan;
+};
+
+bool storage::LibraryIndex::update(Library& _library)
+{
+	if (library == &_library && generation == _library.getGeneration())
+		return false;
+
+	library = &_library;
+	generation = _library.getGeneration();
+
+	books.clear();
+	shelfs.clear();
+	shelfPaths.clear();
+	bookShelfs.clear();
+	names.clear();
+	nameOffsets.clear();
+
+	for (auto& shelf : _library)
+		add(shelf, "");
+
+	// Books added one after the other get consecutive ids, so most books fall into long runs
+	runs.clear();
+	for (std::size_t i = 0; i < books.size(); ++i)
+	{
+		const std::uint32_t id = books[i]->getId();
+		if (!runs.empty() && runs.back().id + runs.back().length == id)
+			++runs.back().length;
+		else
+			runs.push_back({ id, static_cast<std::uint32_t>(i), 1 });
+	}
+
+	nameCache.clear();
+	return true;
+}
+
+storage::LibraryBook* storage::LibraryIndex::findBook(std::uint32_t id) const
+{
+	for (const Run& run : runs)
+		if (id >= run.id && id - run.id < run.length)
+			return books[run.position + (id - run.id)];
+
+	return nullptr;
+}
+
+void storage::LibraryIndex::mapIds(const Bitmap& ids, Bitmap& result) const
+{
+	result = Bitmap(books.size());
+
+	// Copy every run as a whole, 64 bits at a time
+	std::vector<std::uint64_t>& target = result.getWords();
+	for (const Run& run : runs)
+		for (std::size_t done = 0; done < run.length; done += 64)
+			writeBits(target, run.position + done, readBits(ids.getWords(), run.id + done),
+					std::min<std::size_t>(64, run.length - done));
+}
+
+const storage::Bitmap& storage::LibraryIndex::findNames(const std::string& text) const
+{
+	if (const auto cached = nameCache.find(text); cached != nameCache.end())
+		return cached->second;
+	if (nameCache.size() >= nameCacheSize)
+		nameCache.clear();
+
+	Bitmap& matches = nameCache.emplace(text, Bitmap(books.size())).first->second;
+
+	// Search the joined names once and skip to the next name after every hit
+	std::size_t book = 0;
+	for (std::size_t from = names.find(text); from != std::string::npos; from = names.find(text, from))
+	{
+		// Hits are ascending, so the book holding a hit is found by walking forward
+		while (book + 1 < nameOffsets.size() && nameOffsets[book + 1] <= from)
+			++book;
+		matches.set(book);
+		if (++book == nameOffsets.size())
+			break;
+		from = nameOffsets[book];
+	}
+
+	return matches;
+}
+
+void storage::LibraryIndex::add(LibraryShelf& shelf, const std::string& path)
+{
+	const std::size_t index = shelfs.size();
+	std::string shelfPath = path.empty() ? shelf.getName() : path + "/" + shelf.getName();
+
+	shelfs.push_back({ toLower(shelf.getName()), toLower(shelfPath), static_cast<std::uint32_t>(books.size()), 0 });
+	shelfPaths.push_back(shelfPath);
+
+	for (auto& subShelf : shelf.subshelfs)
+		add(subShelf, shelfPath);
+
+	for (auto& book : shelf)
+	{
+		books.push_back(&book);
+		bookShelfs.push_back(static_cast<std::uint32_t>(index));
+		nameOffsets.push_back(static_cast<std::uint32_t>(names.size()));
+		names += toLower(book.getName());
+		names.push_back('\n');
+	}
+
+	shelfs[index].end = static_cast<std::uint32_t>(books.size());
+}
+
+storage::Query::Query(std::string_view text)
+{
+	Parser(text, plan).parse();
+}
+
+void storage::Query::evaluate(const Library& library, const LibraryIndex& index, Bitmap& result) const
+{
+	if (plan.empty())
+	{
+		result = Bitmap(index.size(), true);
+		return;
+	}
+
+	const MetadataStore& metadata = library.getMetadata();
+	std::vector<Bitmap> stack;
+	Bitmap ids;
+
+	for (const Instruction& instruction : plan)
+	{
+		switch (instruction.type)
+		{
+		case Instruction::Type::Compare:
+			std::get<MetadataStore::IntegerColumn>(*metadata.getColumn(instruction.attribute))
+					.scan(instruction.comparison, instruction.value, ids);
+			index.mapIds(ids, stack.emplace_back());
+			break;
+
+		case Instruction::Type::Equal:
+			std::get<MetadataStore::StringColumn>(*metadata.getColumn(instruction.attribute))
+					.scan(instruction.text, ids);
+			index.mapIds(ids, stack.emplace_back());
+			break;
+
+		case Instruction::Type::Tag:
+			std::get<MetadataStore::TagColumn>(*metadata.getColumn(instruction.attribute))
+					.scan(instruction.text, ids);
+			index.mapIds(ids, stack.emplace_back());
+			break;
+
+		case Instruction::Type::Has:
+			{
+				const MetadataStore::Column& column = *metadata.getColumn(instruction.attribute);
+				if (const auto* integers = std::get_if<MetadataStore::IntegerColumn>(&column))
+					ids = integers->valid;
+				else if (const auto* strings = std::get_if<MetadataStore::StringColumn>(&column))
+					ids = strings->valid;
+				else
+				{
+					ids = Bitmap(metadata.getRowCount());
+					for (const Bitmap& tagged : std::get<MetadataStore::TagColumn>(column).rows)
+						ids |= tagged;
+				}
+				index.mapIds(ids, stack.emplace_back());
+			}
+			break;
+
+		case Instruction::Type::Name:
+			stack.push_back(index.findNames(instruction.text));
+			break;
+
+		case Instruction::Type::Under:
+			{
+				Bitmap& matches = stack.emplace_back(index.size());
+				for (const auto& shelf : index.getShelfs())
+					if (shelf.name == instruction.text || shelf.path == instruction.text)
+						matches.setRange(shelf.begin, shelf.end);
+			}
+			break;
+
+		case Instruction::Type::And:
+			stack[stack.size() - 2] &= stack.back();
+			stack.pop_back();
+			break;
+
+		case Instruction::Type::Or:
+			stack[stack.size() - 2] |= stack.back();
+			stack.pop_back();
+			break;
+
+		case Instruction::Type::Not:
+			stack.back().flip();
+			break;
+		}
+	}
+
+	result = std::move(stack.back());
+}
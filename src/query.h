@@ -0,0 +1,265 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "metadata.h"
+#include "storage.h"
+
+
+
+namespace storage
+{
+	/**
+	 * @brief A flat pre-order view of all books inside a library
+	 *
+	 * Books are numbered by a depth first walk in which every shelf lists its
+	 * subshelf's before its own books. The books of a shelf subtree therefore
+	 * form one contiguous range of positions, which turns a subtree
+	 * restriction into setting a range of bits.
+	 *
+	 * The index holds pointers into the library and has to be updated before
+	 * every use, it is only rebuilt when the library changed. It is not safe
+	 * to use from multiple threads.
+	 */
+	class LibraryIndex
+	{
+	public:
+		/**
+		 * @brief A shelf and the range of book positions of its subtree
+		 */
+		struct ShelfRange
+		{
+			/// @brief The lower case name of the shelf
+			std::string name;
+			/// @brief The lower case names of the shelf and its parents joined by '/'
+			std::string path;
+			/// @brief The position of the first book inside the subtree
+			std::uint32_t begin;
+			/// @brief The position past the last book inside the subtree
+			std::uint32_t end;
+		};
+
+	public:
+		/**
+		 * @brief Construct a new empty index
+		 */
+		LibraryIndex() : library(nullptr), generation(0) { }
+
+		/**
+		 * @brief Rebuild the index if the library changed since the last update
+		 *
+		 * @param library The library to index
+		 * @return true If the index was rebuilt
+		 * @return false If the index was up to date
+		 */
+		bool update(Library& library);
+		/**
+		 * @brief Force the index to be rebuilt on the next update
+		 */
+		void invalidate() { library = nullptr; }
+
+		/**
+		 * @brief Get the number of indexed books
+		 *
+		 * @return std::size_t The number of books
+		 */
+		std::size_t size() const { return books.size(); }
+		/**
+		 * @brief Get the book at a position
+		 *
+		 * @param position The pre-order position of the book
+		 * @return LibraryBook* The book
+		 */
+		LibraryBook* getBook(std::size_t position) const { return books[position]; }
+		/**
+		 * @brief Get the path of the shelf holding the book at a position
+		 *
+		 * @param position The pre-order position of the book
+		 * @return const std::string& The shelf names joined by '/'
+		 */
+		const std::string& getShelfPath(std::size_t position) const { return shelfPaths[bookShelfs[position]]; }
+		/**
+		 * @brief Find a book by its id
+		 *
+		 * @param id The id of the book
+		 * @return LibraryBook* The book, nullptr if no indexed book has the id
+		 */
+		LibraryBook* findBook(std::uint32_t id) const;
+
+		/**
+		 * @brief Get all shelf's with the book ranges of their subtrees
+		 *
+		 * @return const std::vector<ShelfRange>& The shelf's in pre-order
+		 */
+		const std::vector<ShelfRange>& getShelfs() const { return shelfs; }
+		/**
+		 * @brief Convert a set of book ids into a set of book positions
+		 *
+		 * @param ids The set of book ids, as produced by the metadata scans
+		 * @param result Receives the positions of the books
+		 */
+		void mapIds(const Bitmap& ids, Bitmap& result) const;
+		/**
+		 * @brief Find all books whose name contains a text
+		 *
+		 * Results are cached until the index is rebuilt, so a query which is
+		 * extended while typing only searches the names for its new terms.
+		 *
+		 * @param text The lower case text to search for
+		 * @return const Bitmap& The positions of the matching books
+		 */
+		const Bitmap& findNames(const std::string& text) const;
+
+	private:
+		/**
+		 * @brief A sequence of books with consecutive ids at consecutive positions
+		 */
+		struct Run
+		{
+			/// @brief The id of the first book
+			std::uint32_t id;
+			/// @brief The position of the first book
+			std::uint32_t position;
+			/// @brief The number of books
+			std::uint32_t length;
+		};
+
+		/**
+		 * @brief Add a shelf subtree to the index
+		 *
+		 * @param shelf The shelf to add
+		 * @param path The path of the parent shelf
+		 */
+		void add(LibraryShelf& shelf, const std::string& path);
+
+		/// @brief The indexed library
+		const Library* library;
+		/// @brief The library generation the index was built for
+		std::uint64_t generation;
+
+		/// @brief The books in pre-order
+		std::vector<LibraryBook*> books;
+		/// @brief The mapping from book ids to positions, usually far fewer runs than books
+		std::vector<Run> runs;
+		/// @brief The shelf's in pre-order
+		std::vector<ShelfRange> shelfs;
+		/// @brief The original case paths of all shelf's
+		std::vector<std::string> shelfPaths;
+		/// @brief The index of the shelf holding every book
+		std::vector<std::uint32_t> bookShelfs;
+		/// @brief The lower case names of all books, each terminated by a new line
+		std::string names;
+		/// @brief The start of every book name inside names
+		std::vector<std::uint32_t> nameOffsets;
+		/// @brief The results of recent name searches
+		mutable std::map<std::string, Bitmap, std::less<>> nameCache;
+	};
+
+	/**
+	 * @brief A compiled filter over the books of a library
+	 *
+	 * A query consists of terms combined by `and`, `or`, `not` and
+	 * parentheses, adjacent terms are implicitly combined by `and`. A term is
+	 * either a bare word matching a part of the book name or a field, an
+	 * operator and a value, for example:
+	 *
+	 *     tag:villain and words>2000 under:"Book 2"
+	 *
+	 * The fields are the metadata attributes, `tag` as an alias of `tags`,
+	 * `name` for a part of the name, `under` for the name or path of a shelf
+	 * and `has` to test if an attribute is set at all. The operators are `:`
+	 * and `=` for equality, `!=` and the ordering comparisons.
+	 *
+	 * The text is compiled once into a postfix plan of bitmap operations. Each
+	 * leaf scans a whole column at once, so the evaluation does not touch the
+	 * books one by one.
+	 */
+	class Query
+	{
+	public:
+		/**
+		 * @brief Construct a query matching every book
+		 */
+		Query() = default;
+		/**
+		 * @brief Compile a query
+		 *
+		 * A ParsingError describing the problem is thrown for malformed queries.
+		 *
+		 * @param text The text of the query
+		 */
+		Query(std::string_view text);
+
+		/**
+		 * @brief Check if the query matches every book
+		 *
+		 * @return true If the query is empty
+		 * @return false If the query filters the books
+		 */
+		bool empty() const { return plan.empty(); }
+
+		/**
+		 * @brief Evaluate the query
+		 *
+		 * @param library The library to filter, the index has to be up to date with it
+		 * @param index The index of the library
+		 * @param result Receives the positions of all matching books
+		 */
+		void evaluate(const Library& library, const LibraryIndex& index, Bitmap& result) const;
+
+	private:
+		/**
+		 * @brief A single step of the postfix plan
+		 */
+		struct Instruction
+		{
+			/**
+			 * @brief The kind of step
+			 */
+			enum class Type : std::uint8_t
+			{
+				/// @brief Push the books with an integer or date attribute matching a comparison
+				Compare,
+				/// @brief Push the books with a string attribute equal to text
+				Equal,
+				/// @brief Push the books carrying the tag text
+				Tag,
+				/// @brief Push the books with a value for an attribute
+				Has,
+				/// @brief Push the books whose name contains text
+				Name,
+				/// @brief Push the books inside the shelf's named text
+				Under,
+				/// @brief Replace the two topmost sets by their intersection
+				And,
+				/// @brief Replace the two topmost sets by their union
+				Or,
+				/// @brief Replace the topmost set by its complement
+				Not
+			};
+
+			/// @brief The kind of step
+			Type type;
+			/// @brief The attribute the step scans
+			std::string_view attribute;
+			/// @brief The comparison of a Compare step
+			MetadataStore::Comparison comparison;
+			/// @brief The value of a Compare step
+			std::int64_t value;
+			/// @brief The text of a Equal, Tag, Name or Under step
+			std::string text;
+		};
+
+		/// @brief The compiled steps in postfix order
+		std::vector<Instruction> plan;
+
+		class Parser;
+	};
+} // namespace storage
+
+#endif // QUERY_H
@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <array>
+
+#include "repetition_analyzer.h"
+#include "text_scan.h"
+
+namespace
+{
+	/// @brief The base of the rolling hashes
+	constexpr std::uint64_t rollingBase = 0x100000001b3;
+	/// @brief The number of paragraphs per thread below which a complete analysis stays on fewer threads
+	constexpr std::size_t paragraphsPerTask = 64;
+
+	/**
+	 * @brief Get the number of bytes of the separator at an offset
+	 *
+	 * @param text The text
+	 * @param offset The offset of the first byte of a character
+	 * @return std::size_t The length of the separator, zero if the character is part of a word
+	 */
+	std::size_t getSeparatorLength(std::string_view text, std::size_t offset)
+	{
+		const std::uint8_t byte = static_cast<std::uint8_t>(text[offset]);
+		if (byte < 0x80)
+			return (byte >= '0' && byte <= '9') || ((byte | 0x20) >= 'a' && (byte | 0x20) <= 'z') ? 0 : 1;
+		// Latin-1 punctuation like guillemets and general punctuation like dashes and quotes
+		if (byte == 0xc2 || (byte == 0xe2 && offset + 1 < text.size() && static_cast<std::uint8_t>(text[offset + 1]) == 0x80))
+			return std::min<std::size_t>(byte == 0xc2 ? 2 : 3, text.size() - offset);
+		return 0;
+	}
+
+	/**
+	 * @brief Check if a separator is an apostrophe, which is part of a word when letters follow
+	 *
+	 * @param text The text
+	 * @param offset The offset of the separator
+	 * @param length The length of the separator
+	 * @return true For the ASCII apostrophe and the right single quote
+	 * @return false Otherwise
+	 */
+	bool isApostrophe(std::string_view text, std::size_t offset, std::size_t length)
+	{
+		return (length == 1 && text[offset] == '\'')
+				|| (length == 3 && text[offset] == '\xe2' && static_cast<std::uint8_t>(text[offset + 2]) == 0x99);
+	}
+
+	/**
+	 * @brief Mix the bits of a hash, so similar rolling hashes end up far apart
+	 *
+	 * @param value The value to mix
+	 * @return std::uint64_t The mixed value
+	 */
+	std::uint64_t mix(std::uint64_t value)
+	{
+		value ^= value >> 33;
+		value *= 0xff51afd7ed558ccd;
+		value ^= value >> 33;
+		value *= 0xc4ceb9fe1a85ec53;
+		return value ^ (value >> 33);
+	}
+} // namespace
+
+storage::RepetitionAnalyzer::RepetitionAnalyzer(ThreadPool* _pool) :
+		pool(_pool), version(0), analysisTime(0)
+{
+}
+
+void storage::RepetitionAnalyzer::analyze(std::string_view text)
+{
+	const auto start = std::chrono::steady_clock::now();
+	paragraphs.clear();
+	split(text, 0, text.size(), paragraphs);
+
+	// Every task counts a consecutive run of paragraphs into its own table
+	const std::size_t tasks = std::clamp<std::size_t>(paragraphs.size() / paragraphsPerTask, 1,
+			pool->getConcurrency());
+	partials.resize(std::max(partials.size(), tasks));
+	pool->parallelFor(tasks, 1,
+		[this, text, tasks] (std::size_t begin, std::size_t end)
+		{
+			for (std::size_t task = begin; task < end; ++task)
+			{
+				Table& partial = partials[task];
+				partial.clear();
+				for (std::size_t i = paragraphs.size() * task / tasks; i < paragraphs.size() * (task + 1) / tasks; ++i)
+					count(text, paragraphs[i], partial);
+			}
+		}
+	);
+
+	table.clear();
+	table.swap(partials[0]);
+	for (std::size_t task = 1; task < tasks; ++task)
+		for (const auto& [hash, entry] : partials[task])
+		{
+			Entry& merged = table.try_emplace(hash, Entry{ 0, entry.words }).first->second;
+			merged.count += entry.count;
+		}
+
+	++version;
+	analysisTime = std::chrono::steady_clock::now() - start;
+}
+
+void storage::RepetitionAnalyzer::clear()
+{
+	paragraphs.clear();
+	table.clear();
+	++version;
+}
+
+void storage::RepetitionAnalyzer::applyEdit(const Document::Edit& edit, std::string_view text)
+{
+	// Paragraphs touching the edit are counted again, together with their neighbours as the edit may join them
+	auto first = std::lower_bound(paragraphs.begin(), paragraphs.end(), edit.offset,
+			[] (const Paragraph& paragraph, std::uint64_t offset) { return paragraph.end < offset; });
+	auto last = std::upper_bound(first, paragraphs.end(), edit.offset + edit.erase,
+			[] (std::uint64_t offset, const Paragraph& paragraph) { return offset < paragraph.start; });
+	if (first != paragraphs.begin())
+		--first;
+	if (last != paragraphs.end())
+		++last;
+
+	const std::uint64_t shift = edit.insert.size() - edit.erase;
+	const std::uint64_t begin = first == paragraphs.begin() ? 0 : std::prev(first)->end;
+	const std::uint64_t end = last == paragraphs.end() ? text.size() : last->start + shift;
+
+	for (auto paragraph = first; paragraph != last; ++paragraph)
+		uncount(*paragraph);
+	std::vector<Paragraph> replaced;
+	split(text, begin, end, replaced);
+	for (Paragraph& paragraph : replaced)
+		count(text, paragraph, table);
+
+	// Move the new paragraphs in and shift the paragraphs behind them
+	const std::size_t position = first - paragraphs.begin();
+	const std::size_t oldCount = last - first;
+	if (replaced.size() < oldCount)
+		paragraphs.erase(first + replaced.size(), last);
+	else
+		paragraphs.insert(last, replaced.size() - oldCount, Paragraph());
+	std::move(replaced.begin(), replaced.end(), paragraphs.begin() + position);
+	for (std::size_t i = position + replaced.size(); i < paragraphs.size(); ++i)
+	{
+		paragraphs[i].start += shift;
+		paragraphs[i].end += shift;
+	}
+
+	++version;
+}
+
+void storage::RepetitionAnalyzer::findHotPhrases(std::size_t words, std::size_t limit,
+		std::vector<Phrase>& result) const
+{
+	result.clear();
+	for (const auto& [hash, entry] : table)
+		if (entry.words == words && entry.count > 1)
+			result.push_back({ hash, 0, 0, entry.count });
+
+	const auto compare = [] (const Phrase& a, const Phrase& b)
+		{
+			return a.count != b.count ? a.count > b.count : a.hash < b.hash;
+		};
+	if (result.size() > limit)
+	{
+		std::nth_element(result.begin(), result.begin() + limit, result.end(), compare);
+		result.resize(limit);
+	}
+
+	// Look up one occurrence of every phrase, a single pass over all paragraphs finds them
+	std::sort(result.begin(), result.end(), [] (const Phrase& a, const Phrase& b) { return a.hash < b.hash; });
+	std::size_t missing = result.size();
+	for (const Paragraph& paragraph : paragraphs)
+	{
+		for (const Gram& gram : paragraph.grams)
+		{
+			const auto found = std::lower_bound(result.begin(), result.end(), gram.hash,
+					[] (const Phrase& phrase, std::uint64_t hash) { return phrase.hash < hash; });
+			if (found != result.end() && found->hash == gram.hash && found->length == 0)
+			{
+				found->offset = paragraph.start + gram.offset;
+				found->length = gram.length;
+				--missing;
+			}
+		}
+		if (missing == 0)
+			break;
+	}
+	std::sort(result.begin(), result.end(), compare);
+}
+
+void storage::RepetitionAnalyzer::findOccurrences(std::uint64_t hash, std::vector<Occurrence>& result) const
+{
+	result.clear();
+	for (const Paragraph& paragraph : paragraphs)
+		for (const Gram& gram : paragraph.grams)
+			if (gram.hash == hash)
+				result.push_back({ paragraph.start + gram.offset, gram.length });
+}
+
+storage::RepetitionAnalyzer::Statistics storage::RepetitionAnalyzer::getStatistics() const
+{
+	std::size_t words = 0;
+	for (const Paragraph& paragraph : paragraphs)
+		words += paragraph.words;
+
+	return {
+		.paragraphs = paragraphs.size(),
+		.words = words,
+		.phrases = table.size(),
+		.analysisTime = std::chrono::duration<double, std::milli>(analysisTime).count()
+	};
+}
+
+void storage::RepetitionAnalyzer::split(std::string_view text, std::uint64_t begin, std::uint64_t end,
+		std::vector<Paragraph>& result)
+{
+	bool open = false;
+	for (std::uint64_t line = begin; line < end; )
+	{
+		const std::uint64_t lineEnd = std::min<std::uint64_t>(text.find('\n', line), end);
+		if (textscan::isBlank(text.substr(line, lineEnd - line)))
+			open = false;
+		else if (open)
+			result.back().end = lineEnd;
+		else
+		{
+			result.push_back({ line, lineEnd, 0, {} });
+			open = true;
+		}
+		line = lineEnd + 1;
+	}
+}
+
+void storage::RepetitionAnalyzer::count(std::string_view text, Paragraph& paragraph, Table& table)
+{
+	// The hashes and starts of the last words, one more than the longest phrase to roll the oldest one out
+	std::array<std::uint64_t, maximumWords + 1> hashes;
+	std::array<std::uint64_t, maximumWords + 1> starts;
+	std::array<std::uint64_t, maximumWords> rolling{};
+	std::array<std::uint64_t, maximumWords> powers;
+	powers[0] = rollingBase;
+	for (std::size_t i = 1; i < maximumWords; ++i)
+		powers[i] = powers[i - 1] * rollingBase;
+
+	paragraph.words = 0;
+	paragraph.grams.clear();
+	std::uint64_t offset = paragraph.start;
+	while (offset < paragraph.end)
+	{
+		std::size_t length = getSeparatorLength(text, offset);
+		if (length != 0)
+		{
+			offset += length;
+			continue;
+		}
+
+		// Hash the word, apostrophes followed by more of the word belong to it
+		const std::uint64_t start = offset;
+		std::uint64_t hash = 0xcbf29ce484222325;
+		while (offset < paragraph.end)
+		{
+			length = getSeparatorLength(text, offset);
+			if (length != 0 && (!isApostrophe(text, offset, length) || offset + length >= paragraph.end
+					|| getSeparatorLength(text, offset + length) != 0))
+				break;
+
+			for (const std::uint64_t next = offset + std::max<std::size_t>(length, 1); offset < next; ++offset)
+			{
+				std::uint8_t byte = text[offset];
+				if (byte >= 'A' && byte <= 'Z')
+					byte += 'a' - 'A';
+				hash = (hash ^ byte) * rollingBase;
+			}
+		}
+
+		const std::size_t slot = paragraph.words % hashes.size();
+		hashes[slot] = hash;
+		starts[slot] = start;
+		++paragraph.words;
+
+		for (std::size_t words = 1; words <= maximumWords; ++words)
+		{
+			// Roll the newest word in and, once the phrase is full, the word before the phrase out
+			std::uint64_t& value = rolling[words - 1];
+			value = value * rollingBase + hash;
+			if (paragraph.words > words)
+				value -= hashes[(paragraph.words - 1 - words) % hashes.size()] * powers[words - 1];
+			if (paragraph.words < words || (words == 1 && offset - start < minimumWordLength))
+				continue;
+
+			const std::uint64_t phraseStart = starts[(paragraph.words - words) % hashes.size()];
+			const std::uint64_t key = mix(value + words);
+			paragraph.grams.push_back({ key, static_cast<std::uint32_t>(phraseStart - paragraph.start),
+					static_cast<std::uint32_t>(offset - phraseStart) });
+			Entry& entry = table.try_emplace(key, Entry{ 0, static_cast<std::uint32_t>(words) }).first->second;
+			++entry.count;
+		}
+	}
+}
+
+void storage::RepetitionAnalyzer::uncount(const Paragraph& paragraph)
+{
+	for (const Gram& gram : paragraph.grams)
+	{
+		const auto entry = table.find(gram.hash);
+		if (entry != table.end() && --entry->second.count == 0)
+			table.erase(entry);
+	}
+}
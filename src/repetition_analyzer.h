@@ -0,0 +1,222 @@
+#ifndef REPETITION_ANALYZER_H
+#define REPETITION_ANALYZER_H
+
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+#include "thread_pool.h"
+
+
+
+namespace storage
+{
+	/**
+	 * @brief Counts repeated words and phrases of a text
+	 *
+	 * The text is split into paragraphs at blank lines and every paragraph
+	 * into words. All sequences of up to maximumWords words are hashed with a
+	 * rolling hash per length, so every word costs a constant amount of work
+	 * no matter how long the phrases are. Phrases never cross paragraphs.
+	 *
+	 * A complete analysis spreads the paragraphs over the threads of a pool,
+	 * every thread counts into its own table and the tables are merged at the
+	 * end. Edits only count the paragraphs they touch again.
+	 *
+	 * Single words shorter than minimumWordLength bytes are not counted, as
+	 * they are mostly articles and prepositions. Matching ignores the case of
+	 * ASCII letters.
+	 */
+	class RepetitionAnalyzer
+	{
+	public:
+		/// @brief The number of words of the longest phrases
+		static constexpr std::size_t maximumWords = 5;
+		/// @brief The length in bytes below which single words are not counted
+		static constexpr std::size_t minimumWordLength = 4;
+
+		/**
+		 * @brief A repeated word or phrase
+		 */
+		struct Phrase
+		{
+			/// @brief The hash identifying the phrase
+			std::uint64_t hash;
+			/// @brief The byte offset of one of its occurrences
+			std::uint64_t offset;
+			/// @brief The length in bytes of that occurrence
+			std::uint32_t length;
+			/// @brief The number of occurrences
+			std::uint32_t count;
+		};
+
+		/**
+		 * @brief An occurrence of a phrase
+		 */
+		struct Occurrence
+		{
+			/// @brief The byte offset
+			std::uint64_t offset;
+			/// @brief The length in bytes
+			std::uint32_t length;
+		};
+
+		/**
+		 * @brief Measurements of the analysis
+		 */
+		struct Statistics
+		{
+			/// @brief The number of paragraphs
+			std::size_t paragraphs;
+			/// @brief The number of words
+			std::size_t words;
+			/// @brief The number of distinct words and phrases
+			std::size_t phrases;
+			/// @brief The time the last complete analysis took in milliseconds
+			double analysisTime;
+		};
+
+	public:
+		/**
+		 * @brief Construct a new analyzer without a text
+		 *
+		 * @param _pool The threads analyzing the paragraphs
+		 */
+		RepetitionAnalyzer(ThreadPool* _pool);
+
+		/**
+		 * @brief Analyze a whole text
+		 *
+		 * @param text The text
+		 */
+		void analyze(std::string_view text);
+		/**
+		 * @brief Forget the text
+		 */
+		void clear();
+		/**
+		 * @brief Count the paragraphs touched by an edit again
+		 *
+		 * @param edit The change of the text
+		 * @param text The text after the change
+		 */
+		void applyEdit(const Document::Edit& edit, std::string_view text);
+
+		/**
+		 * @brief Find the most frequent phrases of a length
+		 *
+		 * Only phrases occurring at least twice are reported.
+		 *
+		 * @param words The number of words of the phrases
+		 * @param limit The maximum number of phrases
+		 * @param result Receives the phrases ordered by descending count
+		 */
+		void findHotPhrases(std::size_t words, std::size_t limit, std::vector<Phrase>& result) const;
+		/**
+		 * @brief Find all occurrences of a phrase
+		 *
+		 * @param hash The hash of the phrase
+		 * @param result Receives the occurrences ordered by offset
+		 */
+		void findOccurrences(std::uint64_t hash, std::vector<Occurrence>& result) const;
+
+		/**
+		 * @brief Get a number which changes whenever the counts changed
+		 *
+		 * @return std::uint64_t The version of the counts
+		 */
+		std::uint64_t getVersion() const { return version; }
+		/**
+		 * @brief Get the measurements of the analysis
+		 *
+		 * @return Statistics The statistics
+		 */
+		Statistics getStatistics() const;
+
+	private:
+		/**
+		 * @brief A word or phrase inside a paragraph
+		 */
+		struct Gram
+		{
+			/// @brief The hash identifying the phrase
+			std::uint64_t hash;
+			/// @brief The byte offset relative to the start of the paragraph
+			std::uint32_t offset;
+			/// @brief The length in bytes
+			std::uint32_t length;
+		};
+
+		/**
+		 * @brief A run of lines which are not blank
+		 */
+		struct Paragraph
+		{
+			/// @brief The byte offset of the first byte
+			std::uint64_t start;
+			/// @brief The byte offset past the last byte
+			std::uint64_t end;
+			/// @brief The number of words
+			std::size_t words;
+			/// @brief The words and phrases in the order of their end
+			std::vector<Gram> grams;
+		};
+
+		/**
+		 * @brief The number of occurrences of a phrase
+		 */
+		struct Entry
+		{
+			/// @brief The number of occurrences
+			std::uint32_t count;
+			/// @brief The number of words
+			std::uint32_t words;
+		};
+
+		using Table = std::unordered_map<std::uint64_t, Entry>;
+
+		/**
+		 * @brief Split a range of a text into paragraphs
+		 *
+		 * @param text The whole text
+		 * @param begin The start of the range, either the start of the text or the end of a paragraph
+		 * @param end The end of the range, either the end of the text or the start of a paragraph
+		 * @param result Receives the paragraphs
+		 */
+		static void split(std::string_view text, std::uint64_t begin, std::uint64_t end,
+				std::vector<Paragraph>& result);
+		/**
+		 * @brief Find the words and phrases of a paragraph and count them
+		 *
+		 * @param text The whole text
+		 * @param paragraph The paragraph
+		 * @param table The table counting the phrases
+		 */
+		static void count(std::string_view text, Paragraph& paragraph, Table& table);
+		/**
+		 * @brief Remove the words and phrases of a paragraph from the counts
+		 *
+		 * @param paragraph The paragraph
+		 */
+		void uncount(const Paragraph& paragraph);
+
+		/// @brief The threads analyzing the paragraphs
+		ThreadPool* const pool;
+		/// @brief Bumped whenever the counts changed
+		std::uint64_t version;
+
+		/// @brief The paragraphs ordered by offset
+		std::vector<Paragraph> paragraphs;
+		/// @brief The number of occurrences of every phrase
+		Table table;
+		/// @brief The tables of the threads during a complete analysis, kept to reuse their memory
+		std::vector<Table> partials;
+		/// @brief The time the last complete analysis took
+		std::chrono::nanoseconds analysisTime;
+	};
+} // namespace storage
+
+#endif // REPETITION_ANALYZER_H
@@ -1,8 +1,169 @@
-#include <fstream>
-#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "settings.h"
+#include "autosave.h"
+#include "binary.h"
 #include "exceptions.h"
+#include "wakeup.h"
+
+namespace
+{
+	/// @brief The header of the current style format
+	constexpr std::string_view styleHeader = "honmonostyle 2.0";
+	/// @brief The header of the first style format, which wrote all fields in a fixed order without ids
+	constexpr std::string_view legacyStyleHeader = "honmonostyle 1.0";
+	/// @brief The record id of a color, colors are identified by their name
+	constexpr std::uint64_t colorField = 0x100;
+
+	/**
+	 * @brief The type of a style field
+	 */
+	enum class FieldType : std::uint8_t
+	{
+		Float,
+		Vec2,
+		Dir,
+		Bool
+	};
+
+	/**
+	 * @brief A field of ImGuiStyle which is saved to style files
+	 */
+	struct StyleField
+	{
+		/// @brief The record id, ids are never reused for another field
+		std::uint32_t id;
+		/// @brief The type of the field
+		FieldType type;
+		/// @brief The offset of the field inside ImGuiStyle
+		std::size_t offset;
+	};
+
+	/**
+	 * @brief Get the size of a field inside ImGuiStyle
+	 *
+	 * @param type The type of the field
+	 * @return constexpr std::size_t The size in bytes
+	 */
+	constexpr std::size_t getFieldSize(FieldType type)
+	{
+		switch (type)
+		{
+		case FieldType::Float:
+			return sizeof(float);
+		case FieldType::Vec2:
+			return sizeof(ImVec2);
+		case FieldType::Dir:
+			return sizeof(ImGuiDir);
+		case FieldType::Bool:
+			return sizeof(bool);
+		}
+		return 0;
+	}
+
+	/// @brief All fields except the colors in the order of the first style format, the id is the position plus one
+	constexpr StyleField styleFields[] = {
+		{ 1, FieldType::Float, offsetof(ImGuiStyle, Alpha) },
+		{ 2, FieldType::Float, offsetof(ImGuiStyle, DisabledAlpha) },
+		{ 3, FieldType::Vec2, offsetof(ImGuiStyle, WindowPadding) },
+		{ 4, FieldType::Float, offsetof(ImGuiStyle, WindowRounding) },
+		{ 5, FieldType::Float, offsetof(ImGuiStyle, WindowBorderSize) },
+		{ 6, FieldType::Vec2, offsetof(ImGuiStyle, WindowMinSize) },
+		{ 7, FieldType::Vec2, offsetof(ImGuiStyle, WindowTitleAlign) },
+		{ 8, FieldType::Dir, offsetof(ImGuiStyle, WindowMenuButtonPosition) },
+		{ 9, FieldType::Float, offsetof(ImGuiStyle, ChildRounding) },
+		{ 10, FieldType::Float, offsetof(ImGuiStyle, ChildBorderSize) },
+		{ 11, FieldType::Float, offsetof(ImGuiStyle, PopupRounding) },
+		{ 12, FieldType::Float, offsetof(ImGuiStyle, PopupBorderSize) },
+		{ 13, FieldType::Vec2, offsetof(ImGuiStyle, FramePadding) },
+		{ 14, FieldType::Float, offsetof(ImGuiStyle, FrameRounding) },
+		{ 15, FieldType::Float, offsetof(ImGuiStyle, FrameBorderSize) },
+		{ 16, FieldType::Vec2, offsetof(ImGuiStyle, ItemSpacing) },
+		{ 17, FieldType::Vec2, offsetof(ImGuiStyle, ItemInnerSpacing) },
+		{ 18, FieldType::Vec2, offsetof(ImGuiStyle, CellPadding) },
+		{ 19, FieldType::Vec2, offsetof(ImGuiStyle, TouchExtraPadding) },
+		{ 20, FieldType::Float, offsetof(ImGuiStyle, IndentSpacing) },
+		{ 21, FieldType::Float, offsetof(ImGuiStyle, ColumnsMinSpacing) },
+		{ 22, FieldType::Float, offsetof(ImGuiStyle, ScrollbarSize) },
+		{ 23, FieldType::Float, offsetof(ImGuiStyle, ScrollbarRounding) },
+		{ 24, FieldType::Float, offsetof(ImGuiStyle, GrabMinSize) },
+		{ 25, FieldType::Float, offsetof(ImGuiStyle, GrabRounding) },
+		{ 26, FieldType::Float, offsetof(ImGuiStyle, LogSliderDeadzone) },
+		{ 27, FieldType::Float, offsetof(ImGuiStyle, TabRounding) },
+		{ 28, FieldType::Float, offsetof(ImGuiStyle, TabBorderSize) },
+		{ 29, FieldType::Float, offsetof(ImGuiStyle, TabMinWidthForCloseButton) },
+		{ 30, FieldType::Dir, offsetof(ImGuiStyle, ColorButtonPosition) },
+		{ 31, FieldType::Vec2, offsetof(ImGuiStyle, ButtonTextAlign) },
+		{ 32, FieldType::Vec2, offsetof(ImGuiStyle, SelectableTextAlign) },
+		{ 33, FieldType::Vec2, offsetof(ImGuiStyle, DisplayWindowPadding) },
+		{ 34, FieldType::Vec2, offsetof(ImGuiStyle, DisplaySafeAreaPadding) },
+		{ 35, FieldType::Float, offsetof(ImGuiStyle, MouseCursorScale) },
+		{ 36, FieldType::Bool, offsetof(ImGuiStyle, AntiAliasedLines) },
+		{ 37, FieldType::Bool, offsetof(ImGuiStyle, AntiAliasedLinesUseTex) },
+		{ 38, FieldType::Bool, offsetof(ImGuiStyle, AntiAliasedFill) },
+		{ 39, FieldType::Float, offsetof(ImGuiStyle, CurveTessellationTol) },
+		{ 40, FieldType::Float, offsetof(ImGuiStyle, CircleTessellationMaxError) }
+	};
+
+	static_assert([] ()
+		{
+			for (std::size_t i = 0; i < std::size(styleFields); ++i)
+				if (styleFields[i].id != i + 1 || styleFields[i].id >= colorField)
+					return false;
+			return true;
+		}(), "Style field ids have to match their position");
+
+	/**
+	 * @brief Read a whole style file with a single read
+	 *
+	 * @param path The path of the style file
+	 * @return std::string The content of the file
+	 */
+	std::string readStyleFile(const std::filesystem::path& path)
+	{
+		const int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (descriptor == -1)
+			throw storage::OpenError("Style file <", path.string(), "> does not exist.");
+
+		struct stat status;
+		std::string content;
+		ssize_t length = -1;
+		if (::fstat(descriptor, &status) == 0)
+		{
+			content.resize(status.st_size);
+			length = ::read(descriptor, content.data(), content.size());
+		}
+		::close(descriptor);
+		if (length != static_cast<ssize_t>(content.size()))
+			throw storage::ReadError("Unable to read style file <", path.string(), ">.");
+		return content;
+	}
+
+	/**
+	 * @brief Find a style color by its name
+	 *
+	 * @param name The name of the color
+	 * @return int The index of the color or -1 if this version of ImGui does not know it
+	 */
+	int findStyleColor(std::string_view name)
+	{
+		for (int i = 0; i < ImGuiCol_COUNT; ++i)
+			if (name == ImGui::GetStyleColorName(i))
+				return i;
+		return -1;
+	}
+} // namespace
 
 FileLocationService::FileLocationService()
 {
@@ -21,11 +182,13 @@ FileLocationService::FileLocationService()
 		dataFolder = "./honmonogatari";
 }
 
-StyleContext::StyleContext(std::filesystem::path path) : styleFolder(path)
+StyleContext::StyleContext(std::filesystem::path path) : styleFolder(path), stylesChanged(true),
+		inotifyDescriptor(-1), stopDescriptor(-1)
 {
 	current_style = &ImGui::GetStyle();
 
 	std::filesystem::create_directories(path);
+
 	if (std::filesystem::is_regular_file(path / "default.style"))
 		loadStyleFile("default");
 	else
@@ -34,29 +197,44 @@ StyleContext::StyleContext(std::filesystem::path path) : styleFolder(path)
 		current_style->Colors[ImGuiCol_WindowBg].w = 1.0f;
 		current_style->Colors[ImGuiCol_DockingEmptyBg] = ImVec4(0.188f, 0.25f, 0.25f, 1.0f);
 	}
+
+	// The watcher starts last, a constructor throwing after it would never stop it
+	// Without inotify the styles are only listed again after saving one
+	inotifyDescriptor = inotify_init1(IN_CLOEXEC);
+	stopDescriptor = eventfd(0, EFD_CLOEXEC);
+	if (inotifyDescriptor != -1 && stopDescriptor != -1
+			&& inotify_add_watch(inotifyDescriptor, styleFolder.c_str(),
+				IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR) != -1)
+		watcher = std::jthread([this] (std::stop_token token) { watch(token); });
 }
 
-std::vector<std::string> StyleContext::getStyleFiles()
+StyleContext::~StyleContext()
 {
-	std::vector<std::string> styles;
-
-	for (auto& entry : std::filesystem::directory_iterator(styleFolder))
-		styles.emplace_back(entry.path().stem());
+	// The watch may already be gone with the style folder, so the watcher is woken up separately
+	watcher.request_stop();
+	if (stopDescriptor != -1)
+	{
+		const std::uint64_t value = 1;
+		[[maybe_unused]] const ssize_t written = write(stopDescriptor, &value, sizeof(value));
+	}
+	if (watcher.joinable())
+		watcher.join();
+	if (stopDescriptor != -1)
+		close(stopDescriptor);
+	if (inotifyDescriptor != -1)
+		close(inotifyDescriptor);
+}
 
+const std::vector<std::string>& StyleContext::getStyleFiles()
+{
+	refreshStyles();
 	return styles;
 }
 
 const char* StyleContext::getStyleFilesImGui()
 {
-	std::stringstream outStream;
-
-	for (auto& entry : std::filesystem::directory_iterator(styleFolder))
-		outStream << entry.path().stem() << '\0';
-
-	// Ensure that even with zero elements there are always two zero bytes
-	outStream << '\0' << '\0';
-
-	return outStream.str().c_str();
+	refreshStyles();
+	return stylesImGui.c_str();
 }
 
 bool StyleContext::isStyleFile(const std::string& name)
@@ -66,136 +244,167 @@ bool StyleContext::isStyleFile(const std::string& name)
 
 void StyleContext::loadStyleFile(const std::string& name)
 {
-	std::filesystem::path path = styleFolder / (name + ".style");
-
-	if (!std::filesystem::is_regular_file(path))
-		throw storage::FileError("Style file <", path, "> does not exist.");
-
-	std::ifstream input(path, std::ifstream::binary | std::ifstream::ate);
-
-	if (input.tellg() != 0x450)
-		throw storage::FileError("Style file <", path, "> has length of ",
-				std::to_string(input.tellg()), " instead of 1104.");
-	input.seekg(0);
-
-	char header[0x10 + 1] = {};
-	input.read(header, 0x10);
-	if (std::string("honmonostyle 1.0").compare(header))
-		throw storage::FileError("Style file <", path, "> has a incorrect header.");
-
-	unsigned int value;
-
-	input.read(reinterpret_cast<char*>(&current_style->Alpha), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->DisabledAlpha), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->WindowPadding), sizeof(ImVec2));
-	input.read(reinterpret_cast<char*>(&current_style->WindowRounding), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->WindowBorderSize), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->WindowMinSize), sizeof(ImVec2));
-	input.read(reinterpret_cast<char*>(&current_style->WindowTitleAlign), sizeof(ImVec2));
-	input.read(reinterpret_cast<char*>(&current_style->WindowMenuButtonPosition), sizeof(ImGuiDir));
-	input.read(reinterpret_cast<char*>(&current_style->ChildRounding), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->ChildBorderSize), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->PopupRounding), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->PopupBorderSize), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->FramePadding), sizeof(ImVec2));
-	input.read(reinterpret_cast<char*>(&current_style->FrameRounding), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->FrameBorderSize), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->ItemSpacing), sizeof(ImVec2));
-	input.read(reinterpret_cast<char*>(&current_style->ItemInnerSpacing), sizeof(ImVec2));
-	input.read(reinterpret_cast<char*>(&current_style->CellPadding), sizeof(ImVec2));
-	input.read(reinterpret_cast<char*>(&current_style->TouchExtraPadding), sizeof(ImVec2));
-	input.read(reinterpret_cast<char*>(&current_style->IndentSpacing), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->ColumnsMinSpacing), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->ScrollbarSize), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->ScrollbarRounding), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->GrabMinSize), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->GrabRounding), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->LogSliderDeadzone), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->TabRounding), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->TabBorderSize), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->TabMinWidthForCloseButton), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->ColorButtonPosition), sizeof(ImGuiDir));
-	input.read(reinterpret_cast<char*>(&current_style->ButtonTextAlign), sizeof(ImVec2));
-	input.read(reinterpret_cast<char*>(&current_style->SelectableTextAlign), sizeof(ImVec2));
-	input.read(reinterpret_cast<char*>(&current_style->DisplayWindowPadding), sizeof(ImVec2));
-	input.read(reinterpret_cast<char*>(&current_style->DisplaySafeAreaPadding), sizeof(ImVec2));
-	input.read(reinterpret_cast<char*>(&current_style->MouseCursorScale), sizeof(float));
-
-	input.read(reinterpret_cast<char*>(&value), sizeof(unsigned int));
-	current_style->AntiAliasedLines = value != 0;
-	input.read(reinterpret_cast<char*>(&value), sizeof(unsigned int));
-	current_style->AntiAliasedLinesUseTex = value != 0;
-	input.read(reinterpret_cast<char*>(&value), sizeof(unsigned int));
-	current_style->AntiAliasedFill = value != 0;
-
-	input.read(reinterpret_cast<char*>(&current_style->CurveTessellationTol), sizeof(float));
-	input.read(reinterpret_cast<char*>(&current_style->CircleTessellationMaxError), sizeof(float));
-
-	for (std::size_t i = 0; i < ImGuiCol_COUNT; ++i)
-		input.read(reinterpret_cast<char*>(&current_style->Colors[i]), sizeof(ImVec4));
+	const std::filesystem::path path = styleFolder / (name + ".style");
+	const std::string content = readStyleFile(path);
+
+	// Decode into a copy, so a damaged file leaves the current style untouched
+	ImGuiStyle style = *current_style;
+	char* const target = reinterpret_cast<char*>(&style);
+	if (content.starts_with(legacyStyleHeader))
+	{
+		// The first format wrote all fields in a fixed order, booleans as 32 bit values and the colors last
+		std::size_t expected = legacyStyleHeader.size() + ImGuiCol_COUNT * sizeof(ImVec4);
+		for (const StyleField& field : styleFields)
+			expected += field.type == FieldType::Bool ? sizeof(std::uint32_t) : getFieldSize(field.type);
+		if (content.size() != expected)
+			throw storage::ParsingError("Style file <", path.string(), "> has length of ",
+					std::to_string(content.size()), " instead of ", std::to_string(expected), ".");
+
+		const char* data = content.data() + legacyStyleHeader.size();
+		for (const StyleField& field : styleFields)
+			if (field.type == FieldType::Bool)
+			{
+				std::uint32_t value;
+				std::memcpy(&value, data, sizeof(value));
+				*reinterpret_cast<bool*>(target + field.offset) = value != 0;
+				data += sizeof(value);
+			}
+			else
+			{
+				std::memcpy(target + field.offset, data, getFieldSize(field.type));
+				data += getFieldSize(field.type);
+			}
+		std::memcpy(style.Colors, data, ImGuiCol_COUNT * sizeof(ImVec4));
+		*current_style = style;
+		return;
+	}
+
+	storage::BinaryReader reader(content);
+	if (!content.starts_with(styleHeader))
+		throw storage::ParsingError("Style file <", path.string(), "> has a incorrect header.");
+	reader.readBytes(styleHeader.size());
+	const std::uint32_t size = reader.readU32();
+	const std::uint32_t checksum = reader.readU32();
+	const std::string_view payload = reader.remaining();
+	if (payload.size() != size || static_cast<std::uint32_t>(storage::fnv1a(payload)) != checksum)
+		throw storage::ParsingError("Style file <", path.string(), "> is damaged.");
+
+	// Every record carries its size, so records of fields this version does not know are skipped
+	try
+	{
+		while (!reader.empty())
+		{
+			const std::uint64_t id = reader.readVarint();
+			const std::string_view value = reader.readString();
+			if (id - 1 < std::size(styleFields))
+			{
+				const StyleField& field = styleFields[id - 1];
+				if (value.size() != getFieldSize(field.type))
+					continue;
+				if (field.type == FieldType::Bool)
+					*reinterpret_cast<bool*>(target + field.offset) = value[0] != 0;
+				else
+					std::memcpy(target + field.offset, value.data(), value.size());
+			}
+			else if (id == colorField)
+			{
+				storage::BinaryReader color(value);
+				const int index = findStyleColor(color.readString());
+				const std::string_view rgba = color.readBytes(sizeof(ImVec4));
+				if (index != -1)
+					std::memcpy(&style.Colors[index], rgba.data(), rgba.size());
+			}
+		}
+	}
+	catch (const storage::ParsingError&)
+	{
+		throw storage::ParsingError("Style file <", path.string(), "> is damaged.");
+	}
+	*current_style = style;
 }
 
 void StyleContext::saveStyleFile(const std::string& name)
 {
-	unsigned int value;
-	std::ofstream output(styleFolder / (name + ".style"), std::ifstream::binary | std::ofstream::trunc);
-
-	output << "honmonostyle 1.0" << std::flush;
-	output.write(reinterpret_cast<const char*>(&current_style->Alpha), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->DisabledAlpha), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->WindowPadding), sizeof(ImVec2));
-	output.write(reinterpret_cast<const char*>(&current_style->WindowRounding), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->WindowBorderSize), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->WindowMinSize), sizeof(ImVec2));
-	output.write(reinterpret_cast<const char*>(&current_style->WindowTitleAlign), sizeof(ImVec2));
-	output.write(reinterpret_cast<const char*>(&current_style->WindowMenuButtonPosition), sizeof(ImGuiDir));
-	output.write(reinterpret_cast<const char*>(&current_style->ChildRounding), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->ChildBorderSize), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->PopupRounding), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->PopupBorderSize), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->FramePadding), sizeof(ImVec2));
-	output.write(reinterpret_cast<const char*>(&current_style->FrameRounding), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->FrameBorderSize), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->ItemSpacing), sizeof(ImVec2));
-	output.write(reinterpret_cast<const char*>(&current_style->ItemInnerSpacing), sizeof(ImVec2));
-	output.write(reinterpret_cast<const char*>(&current_style->CellPadding), sizeof(ImVec2));
-	output.write(reinterpret_cast<const char*>(&current_style->TouchExtraPadding), sizeof(ImVec2));
-	output.write(reinterpret_cast<const char*>(&current_style->IndentSpacing), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->ColumnsMinSpacing), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->ScrollbarSize), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->ScrollbarRounding), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->GrabMinSize), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->GrabRounding), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->LogSliderDeadzone), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->TabRounding), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->TabBorderSize), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->TabMinWidthForCloseButton), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->ColorButtonPosition), sizeof(ImGuiDir));
-	output.write(reinterpret_cast<const char*>(&current_style->ButtonTextAlign), sizeof(ImVec2));
-	output.write(reinterpret_cast<const char*>(&current_style->SelectableTextAlign), sizeof(ImVec2));
-	output.write(reinterpret_cast<const char*>(&current_style->DisplayWindowPadding), sizeof(ImVec2));
-	output.write(reinterpret_cast<const char*>(&current_style->DisplaySafeAreaPadding), sizeof(ImVec2));
-	output.write(reinterpret_cast<const char*>(&current_style->MouseCursorScale), sizeof(float));
-
-	if (current_style->AntiAliasedLines)
-		value = 0 - 1;
-	else
-		value = 0;
-	output.write(reinterpret_cast<const char*>(&value), sizeof(unsigned int));
-	if (current_style->AntiAliasedLinesUseTex)
-		value = 0 - 1;
-	else
-		value = 0;
-	output.write(reinterpret_cast<const char*>(&value), sizeof(unsigned int));
-	if (current_style->AntiAliasedFill)
-		value = 0 - 1;
-	else
-		value = 0;
-	output.write(reinterpret_cast<const char*>(&value), sizeof(unsigned int));
+	std::string payload;
+	storage::BinaryWriter writer(payload);
+	const char* const source = reinterpret_cast<const char*>(current_style);
+	for (const StyleField& field : styleFields)
+	{
+		writer.writeVarint(field.id);
+		if (field.type == FieldType::Bool)
+			writer.writeString(*reinterpret_cast<const bool*>(source + field.offset) ? "\x01" : std::string_view("\0", 1));
+		else
+			writer.writeString(std::string_view(source + field.offset, getFieldSize(field.type)));
+	}
 
-	output.write(reinterpret_cast<const char*>(&current_style->CurveTessellationTol), sizeof(float));
-	output.write(reinterpret_cast<const char*>(&current_style->CircleTessellationMaxError), sizeof(float));
+	// Colors are stored by name, as new versions of ImGui may insert colors anywhere
+	std::string color;
+	for (int i = 0; i < ImGuiCol_COUNT; ++i)
+	{
+		color.clear();
+		storage::BinaryWriter colorWriter(color);
+		colorWriter.writeString(ImGui::GetStyleColorName(i));
+		colorWriter.writeBytes(std::string_view(reinterpret_cast<const char*>(&current_style->Colors[i]), sizeof(ImVec4)));
+		writer.writeVarint(colorField);
+		writer.writeString(color);
+	}
+
+	std::string content(styleHeader);
+	storage::BinaryWriter header(content);
+	header.writeU32(static_cast<std::uint32_t>(payload.size()));
+	header.writeU32(static_cast<std::uint32_t>(storage::fnv1a(payload)));
+	content += payload;
+
+	storage::writeFileAtomically(styleFolder / (name + ".style"), content);
+	stylesChanged = true;
+}
+
+void StyleContext::refreshStyles()
+{
+	if (!stylesChanged.exchange(false))
+		return;
+
+	styles.clear();
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(styleFolder, error))
+		if (entry.path().extension() == ".style" && entry.is_regular_file(error))
+			styles.emplace_back(entry.path().stem());
+	std::sort(styles.begin(), styles.end());
 
-	for (std::size_t i = 0; i < ImGuiCol_COUNT; ++i)
-		output.write(reinterpret_cast<const char*>(&current_style->Colors[i]), sizeof(ImVec4));
+	// Ensure that even with zero elements there are always two zero bytes
+	stylesImGui.clear();
+	for (const std::string& style : styles)
+		stylesImGui.append(style) += '\0';
+	stylesImGui += '\0';
+}
+
+void StyleContext::watch(std::stop_token token)
+{
+	alignas(inotify_event) char buffer[4096];
+	pollfd descriptors[] = {
+		{ inotifyDescriptor, POLLIN, 0 },
+		{ stopDescriptor, POLLIN, 0 }
+	};
+	while (!token.stop_requested())
+	{
+		if (poll(descriptors, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		if (descriptors[1].revents != 0)
+			return;
+		if (descriptors[0].revents == 0)
+			continue;
+
+		const ssize_t length = read(inotifyDescriptor, buffer, sizeof(buffer));
+		if (length < 0 && errno != EINTR)
+			return;
+		if (length > 0)
+		{
+			stylesChanged = true;
+			storage::wakeMainLoop();
+		}
+	}
 }
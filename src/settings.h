@@ -1,7 +1,11 @@
 #ifndef SETTINGS_H
 #define SETTINGS_H
 
+#include <atomic>
 #include <filesystem>
+#include <stop_token>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "graphics/imgui_tools.h"
@@ -56,6 +60,10 @@ namespace graphics
 
 /**
  * @brief The style context handles all styling of the application
+ *
+ * The names of the available styles are cached. A background thread waits
+ * for inotify to report changes of the style folder and only then the
+ * folder is listed again, so asking for the styles every frame is free.
  */
 class StyleContext
 {
@@ -68,19 +76,24 @@ public:
 	 * @param path The location of the style configuration
 	 */
 	StyleContext(std::filesystem::path path);
+	/**
+	 * @brief Stop watching the style folder
+	 */
+	~StyleContext();
 
 	/**
 	 * @brief Get a vector of all available style files
 	 *
-	 * @return std::vector<std::string> with the names of the styles
+	 * @return const std::vector<std::string>& with the names of the styles in alphabetical order
 	 */
-	std::vector<std::string> getStyleFiles();
+	const std::vector<std::string>& getStyleFiles();
 
 	/**
 	 * @brief Get the style files as a c string for use with ImGui
 	 *
 	 * This function returns the style names as a '\0' c string which is
-	 * terminated by dual '\0'.
+	 * terminated by dual '\0'. The string stays valid until the styles
+	 * change.
 	 *
 	 * @return const char* The c string for ImGui
 	 */
@@ -108,11 +121,35 @@ public:
 	void saveStyleFile(const std::string& name);
 
 private:
+	/**
+	 * @brief List the style folder again if it changed since the last listing
+	 */
+	void refreshStyles();
+	/**
+	 * @brief The main function of the thread waiting for changes of the style folder
+	 *
+	 * @param token The token signaling the thread to stop
+	 */
+	void watch(std::stop_token token);
+
 	/// @brief The root folder where the styles are saved to
 	std::filesystem::path styleFolder;
 
 	/// @brief A pointer to the current styling of ImGui
 	ImGuiStyle* current_style;
+
+	/// @brief The names of the styles in alphabetical order
+	std::vector<std::string> styles;
+	/// @brief The names of the styles as a list of c strings for ImGui
+	std::string stylesImGui;
+	/// @brief Set whenever the style folder changed since the last listing
+	std::atomic<bool> stylesChanged;
+	/// @brief The inotify instance, -1 if the folder can not be watched
+	int inotifyDescriptor;
+	/// @brief The event which wakes the watcher up to stop, -1 if there is none
+	int stopDescriptor;
+	/// @brief The thread waiting for changes of the style folder
+	std::jthread watcher;
 };
 
 #endif // SETTINGS_H
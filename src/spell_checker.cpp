@@ -0,0 +1,214 @@
+#include <algorithm>
+
+#include "spell_checker.h"
+
+namespace
+{
+	/**
+	 * @brief The role of a character when splitting a line into words
+	 */
+	enum class CharacterKind
+	{
+		/// @brief Ends a word
+		Separator,
+		/// @brief Part of a word
+		Letter,
+		/// @brief Part of a word if letters follow, like in contractions
+		Apostrophe,
+		/// @brief Part of a word which is not checked, like digits or characters of scripts without word lists
+		Mark
+	};
+
+	/**
+	 * @brief Find out the role of the character at an offset
+	 *
+	 * @param text The text of the line
+	 * @param offset The offset of the first byte of the character
+	 * @param length Receives the number of bytes of the character
+	 * @return CharacterKind The role of the character
+	 */
+	CharacterKind classify(std::string_view text, std::size_t offset, std::size_t& length)
+	{
+		const std::uint8_t byte = static_cast<std::uint8_t>(text[offset]);
+		length = 1;
+		if (byte < 0x80)
+		{
+			if ((byte | 0x20) >= 'a' && (byte | 0x20) <= 'z')
+				return CharacterKind::Letter;
+			if ((byte >= '0' && byte <= '9') || byte == '_')
+				return CharacterKind::Mark;
+			return byte == '\'' ? CharacterKind::Apostrophe : CharacterKind::Separator;
+		}
+		if (byte < 0xc0)
+			return CharacterKind::Letter;
+
+		length = std::min<std::size_t>(byte < 0xe0 ? 2 : byte < 0xf0 ? 3 : 4, text.size() - offset);
+		const std::uint8_t next = length > 1 ? static_cast<std::uint8_t>(text[offset + 1]) : 0;
+		// Latin-1 punctuation like guillemets or the no-break space
+		if (byte == 0xc2)
+			return CharacterKind::Separator;
+		// General punctuation like dashes and quotes, the right single quote is used as apostrophe
+		if (byte == 0xe2 && next == 0x80)
+			return length == 3 && static_cast<std::uint8_t>(text[offset + 2]) == 0x99 ? CharacterKind::Apostrophe
+					: CharacterKind::Separator;
+		// CJK punctuation
+		if (byte == 0xe3 && next == 0x80)
+			return CharacterKind::Separator;
+		// CJK, Hangul and everything beyond does not separate its words by spaces
+		return byte >= 0xe3 ? CharacterKind::Mark : CharacterKind::Letter;
+	}
+} // namespace
+
+storage::SpellChecker::SpellChecker(const Dictionary* _dictionary) :
+		dictionary(_dictionary), firstDirty(0), dirtyCount(0), misspellingCount(0)
+{
+	lines.push_back({ 0, {}, false });
+}
+
+void storage::SpellChecker::setDictionary(const Dictionary* _dictionary)
+{
+	dictionary = _dictionary;
+	for (Line& line : lines)
+		markDirty(line);
+	firstDirty = 0;
+}
+
+void storage::SpellChecker::reset(std::string_view text)
+{
+	lines.clear();
+	lines.push_back({ 0, {}, true });
+	for (std::size_t i = text.find('\n'); i != std::string_view::npos; i = text.find('\n', i + 1))
+		lines.push_back({ i + 1, {}, true });
+
+	firstDirty = 0;
+	dirtyCount = lines.size();
+	misspellingCount = 0;
+}
+
+void storage::SpellChecker::applyEdit(const Document::Edit& edit)
+{
+	const auto findLine = [this] (std::uint64_t offset)
+		{
+			return static_cast<std::size_t>(std::upper_bound(lines.begin(), lines.end(), offset,
+					[] (std::uint64_t value, const Line& line) { return value < line.start; }) - lines.begin() - 1);
+		};
+	const std::size_t firstLine = findLine(edit.offset);
+	const std::size_t lastLine = findLine(edit.offset + edit.erase);
+	const std::size_t oldCount = lastLine - firstLine + 1;
+	const std::size_t newCount = 1 + std::count(edit.insert.begin(), edit.insert.end(), '\n');
+
+	// Forget the lines which disappear, the remaining ones are reused for the new lines
+	for (std::size_t i = firstLine + std::min(oldCount, newCount); i <= lastLine; ++i)
+	{
+		dirtyCount -= lines[i].dirty;
+		misspellingCount -= lines[i].misspellings.size();
+	}
+	if (newCount < oldCount)
+		lines.erase(lines.begin() + firstLine + newCount, lines.begin() + lastLine + 1);
+	else if (newCount > oldCount)
+		lines.insert(lines.begin() + lastLine + 1, newCount - oldCount, Line{ 0, {}, false });
+
+	std::size_t line = firstLine;
+	markDirty(lines[line]);
+	for (std::size_t i = edit.insert.find('\n'); i != std::string::npos; i = edit.insert.find('\n', i + 1))
+	{
+		lines[++line].start = edit.offset + i + 1;
+		markDirty(lines[line]);
+	}
+
+	const std::uint64_t shift = edit.insert.size() - edit.erase;
+	for (std::size_t i = firstLine + newCount; i < lines.size(); ++i)
+		lines[i].start += shift;
+
+	if (firstDirty > lastLine)
+		firstDirty = firstDirty + newCount - oldCount;
+	firstDirty = std::min(firstDirty, firstLine);
+}
+
+bool storage::SpellChecker::update(std::string_view text, std::chrono::microseconds budget)
+{
+	if (dirtyCount == 0)
+		return false;
+
+	const auto start = std::chrono::steady_clock::now();
+	std::size_t checked = 0;
+	for (; firstDirty < lines.size() && dirtyCount != 0; ++firstDirty)
+	{
+		Line& line = lines[firstDirty];
+		if (!line.dirty)
+			continue;
+
+		const std::size_t begin = std::min<std::uint64_t>(line.start, text.size());
+		std::size_t end = firstDirty + 1 < lines.size() ? lines[firstDirty + 1].start - 1 : text.size();
+		end = std::clamp(end, begin, text.size());
+		if (end > begin && text[end - 1] == '\r')
+			--end;
+
+		check(line, text.substr(begin, end - begin));
+		line.dirty = false;
+		--dirtyCount;
+
+		if (++checked % 64 == 0 && std::chrono::steady_clock::now() - start >= budget)
+		{
+			++firstDirty;
+			break;
+		}
+	}
+	return checked != 0;
+}
+
+void storage::SpellChecker::check(Line& line, std::string_view text)
+{
+	misspellingCount -= line.misspellings.size();
+	line.misspellings.clear();
+	if (dictionary == nullptr)
+		return;
+
+	std::size_t length;
+	std::size_t offset = 0;
+	while (offset < text.size())
+	{
+		const CharacterKind kind = classify(text, offset, length);
+		if (kind != CharacterKind::Letter && kind != CharacterKind::Mark)
+		{
+			offset += length;
+			continue;
+		}
+
+		// Words end at separators and at apostrophes not followed by a letter
+		const std::size_t begin = offset;
+		bool checked = true;
+		std::size_t end = offset;
+		while (offset < text.size())
+		{
+			const CharacterKind next = classify(text, offset, length);
+			if (next == CharacterKind::Separator)
+				break;
+			if (next == CharacterKind::Apostrophe)
+			{
+				std::size_t letterLength;
+				if (offset + length >= text.size()
+						|| classify(text, offset + length, letterLength) != CharacterKind::Letter)
+					break;
+			}
+			checked &= next != CharacterKind::Mark;
+			offset += length;
+			end = offset;
+		}
+
+		if (checked && !dictionary->check(text.substr(begin, end - begin)))
+			line.misspellings.push_back({ static_cast<std::uint32_t>(begin), static_cast<std::uint32_t>(end) });
+	}
+	misspellingCount += line.misspellings.size();
+}
+
+void storage::SpellChecker::markDirty(Line& line)
+{
+	if (!line.dirty)
+	{
+		line.dirty = true;
+		++dirtyCount;
+	}
+	misspellingCount -= line.misspellings.size();
+	line.misspellings.clear();
+}
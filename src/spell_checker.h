@@ -0,0 +1,152 @@
+#ifndef SPELL_CHECKER_H
+#define SPELL_CHECKER_H
+
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "dictionary.h"
+#include "document.h"
+
+
+
+namespace storage
+{
+	/**
+	 * @brief Keeps the misspelled words of a text up to date
+	 *
+	 * The text is split into lines which are checked independently. An edit
+	 * only marks the lines it touches as dirty and shifts the lines behind it,
+	 * so typing costs a single line check no matter how long the text is. The
+	 * dirty lines are checked within a time budget, which spreads the first
+	 * check of a long text over several frames. The misspellings of a line
+	 * keep their storage when the line is checked again.
+	 */
+	class SpellChecker
+	{
+	public:
+		/**
+		 * @brief A misspelled word inside a line
+		 */
+		struct Range
+		{
+			/// @brief The byte offset of the word relative to the start of the line
+			std::uint32_t begin;
+			/// @brief The byte offset past the word relative to the start of the line
+			std::uint32_t end;
+		};
+
+	public:
+		/**
+		 * @brief Construct a new spell checker
+		 *
+		 * @param _dictionary The dictionary to check against, nullptr disables the checks
+		 */
+		SpellChecker(const Dictionary* _dictionary = nullptr);
+
+		/**
+		 * @brief Change the dictionary, all lines are checked again
+		 *
+		 * @param _dictionary The dictionary to check against, nullptr disables the checks
+		 */
+		void setDictionary(const Dictionary* _dictionary);
+		/**
+		 * @brief Start over with a new text, all lines are checked again
+		 *
+		 * @param text The new text
+		 */
+		void reset(std::string_view text);
+		/**
+		 * @brief Mark the lines touched by an edit as dirty
+		 *
+		 * @param edit The change of the text
+		 */
+		void applyEdit(const Document::Edit& edit);
+		/**
+		 * @brief Check dirty lines until a time budget is used up
+		 *
+		 * @param text The current text
+		 * @param budget The time the checks may take
+		 * @return true If misspellings changed
+		 * @return false Otherwise
+		 */
+		bool update(std::string_view text, std::chrono::microseconds budget);
+
+		/**
+		 * @brief Get the number of lines
+		 *
+		 * @return std::size_t The number of lines
+		 */
+		std::size_t getLineCount() const { return lines.size(); }
+		/**
+		 * @brief Get the byte offset of a line
+		 *
+		 * @param line The index of the line
+		 * @return std::uint64_t The offset of the first byte of the line
+		 */
+		std::uint64_t getLineStart(std::size_t line) const { return lines[line].start; }
+		/**
+		 * @brief Get the misspelled words of a line
+		 *
+		 * @param line The index of the line
+		 * @return std::span<const Range> The words ordered by offset
+		 */
+		std::span<const Range> getMisspellings(std::size_t line) const { return lines[line].misspellings; }
+		/**
+		 * @brief Get the number of misspelled words of the whole text
+		 *
+		 * @return std::size_t The number of words
+		 */
+		std::size_t getMisspellingCount() const { return misspellingCount; }
+		/**
+		 * @brief Check if all lines were checked
+		 *
+		 * @return true If no line is dirty
+		 * @return false Otherwise
+		 */
+		bool isComplete() const { return dirtyCount == 0; }
+
+	private:
+		/**
+		 * @brief A line of the text
+		 */
+		struct Line
+		{
+			/// @brief The byte offset of the first byte
+			std::uint64_t start;
+			/// @brief The misspelled words ordered by offset
+			std::vector<Range> misspellings;
+			/// @brief Set while the line waits for its check
+			bool dirty;
+		};
+
+		/**
+		 * @brief Check a single line
+		 *
+		 * @param line The line to check
+		 * @param text The text of the line without the line break
+		 */
+		void check(Line& line, std::string_view text);
+		/**
+		 * @brief Mark a line as dirty
+		 *
+		 * @param line The line
+		 */
+		void markDirty(Line& line);
+
+		/// @brief The dictionary to check against
+		const Dictionary* dictionary;
+		/// @brief The lines of the text
+		std::vector<Line> lines;
+		/// @brief The index of the first line which may be dirty
+		std::size_t firstDirty;
+		/// @brief The number of dirty lines
+		std::size_t dirtyCount;
+		/// @brief The number of misspelled words of all lines
+		std::size_t misspellingCount;
+	};
+} // namespace storage
+
+#endif // SPELL_CHECKER_H
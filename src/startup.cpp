@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "startup.h"
+
+namespace
+{
+	/**
+	 * @brief Convert a duration to milliseconds
+	 *
+	 * @param duration The duration
+	 * @return double The number of milliseconds
+	 */
+	double toMilliseconds(storage::StartupSequence::Clock::duration duration)
+	{
+		return std::chrono::duration<double, std::milli>(duration).count();
+	}
+} // namespace
+
+storage::StartupSequence::StartupSequence() :
+		origin(Clock::now()), finished(false), firstFrame(0), currentBegin(0)
+{
+}
+
+void storage::StartupSequence::step(std::string_view name)
+{
+	endStep();
+	currentName = name;
+	currentBegin = Clock::now() - origin;
+}
+
+void storage::StartupSequence::launch(std::string_view name, std::function<void()> function)
+{
+	Task& task = tasks.emplace_back(std::string(name), nullptr, std::jthread());
+	task.thread = std::jthread(
+		[this, &task, function = std::move(function)] ()
+		{
+			const Clock::duration begin = Clock::now() - origin;
+			try
+			{
+				function();
+			}
+			catch (...)
+			{
+				task.error = std::current_exception();
+			}
+			record({ task.name, true, begin, Clock::now() - origin });
+		}
+	);
+}
+
+void storage::StartupSequence::wait(std::string_view name)
+{
+	const auto task = std::find_if(tasks.begin(), tasks.end(), [name] (const Task& entry) { return entry.name == name; });
+	if (task == tasks.end())
+		return;
+
+	endStep();
+	const Clock::duration begin = Clock::now() - origin;
+	task->thread.join();
+	record({ "waiting for " + task->name, false, begin, Clock::now() - origin });
+
+	const std::exception_ptr error = task->error;
+	tasks.erase(task);
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void storage::StartupSequence::finish()
+{
+	endStep();
+	join();
+
+	firstFrame = Clock::now() - origin;
+	finished = true;
+}
+
+void storage::StartupSequence::join()
+{
+	for (Task& task : tasks)
+		if (task.thread.joinable())
+			task.thread.join();
+	tasks.clear();
+}
+
+void storage::StartupSequence::print(std::ostream& stream) const
+{
+	std::vector<Phase> sorted;
+	{
+		std::scoped_lock lock(mutex);
+		sorted = phases;
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [] (const Phase& a, const Phase& b) { return a.begin < b.begin; });
+
+	char line[160];
+	std::snprintf(line, sizeof(line), "Startup: %.1f ms to the first frame\n", toMilliseconds(firstFrame));
+	stream << line;
+	std::snprintf(line, sizeof(line), "%10s %10s %10s  %-10s  %s\n", "begin", "end", "duration", "thread", "step");
+	stream << line;
+	for (const Phase& phase : sorted)
+	{
+		std::snprintf(line, sizeof(line), "%7.1f ms %7.1f ms %7.1f ms  %-10s  %s\n", toMilliseconds(phase.begin),
+				toMilliseconds(phase.end), toMilliseconds(phase.end - phase.begin),
+				phase.background ? "background" : "main", phase.name.c_str());
+		stream << line;
+	}
+	stream.flush();
+}
+
+void storage::StartupSequence::endStep()
+{
+	if (currentName.empty())
+		return;
+
+	record({ std::move(currentName), false, currentBegin, Clock::now() - origin });
+	currentName.clear();
+}
+
+void storage::StartupSequence::record(Phase phase)
+{
+	std::scoped_lock lock(mutex);
+	phases.push_back(std::move(phase));
+}
@@ -0,0 +1,184 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+
+namespace storage
+{
+	/**
+	 * @brief Runs the steps of the program start and records how long they take
+	 *
+	 * The calling thread works through its steps one after another, every
+	 * call of step() ends the current step and begins the next one. Steps
+	 * which do not depend on the others are launched on a thread of their own
+	 * and overlap with the following steps, until the caller waits for them.
+	 * Waiting rethrows the exception a background step ended with.
+	 *
+	 * All times are measured from the construction of the sequence, the end
+	 * of the sequence is the first presented frame.
+	 */
+	class StartupSequence
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		/**
+		 * @brief Start measuring
+		 */
+		StartupSequence();
+
+		StartupSequence(const StartupSequence&) = delete;
+		StartupSequence& operator=(const StartupSequence&) = delete;
+
+		/**
+		 * @brief End the current step of the calling thread and begin the next one
+		 *
+		 * @param name The name of the next step
+		 */
+		void step(std::string_view name);
+		/**
+		 * @brief Run a step on a thread of its own
+		 *
+		 * @param name The name of the step, used to wait for it
+		 * @param function The work of the step
+		 */
+		void launch(std::string_view name, std::function<void()> function);
+		/**
+		 * @brief Wait until a launched step is done
+		 *
+		 * This ends the current step of the calling thread, the time spent
+		 * waiting is recorded as a step of its own.
+		 *
+		 * @param name The name of the launched step
+		 */
+		void wait(std::string_view name);
+		/**
+		 * @brief End the sequence once the first frame was presented
+		 *
+		 * Launched steps which were never waited for are joined here.
+		 */
+		void finish();
+		/**
+		 * @brief Join all launched steps which were not waited for yet
+		 *
+		 * Their exceptions are dropped. Used while unwinding, so no step
+		 * outlives the objects it writes to.
+		 */
+		void join();
+
+		/**
+		 * @brief Check if the first frame was presented
+		 *
+		 * @return true If finish() was called
+		 * @return false Otherwise
+		 */
+		bool isFinished() const { return finished; }
+
+		/**
+		 * @brief Write the time to the first frame and the times of all steps
+		 *
+		 * @param stream The stream to write to
+		 */
+		void print(std::ostream& stream) const;
+
+		/**
+		 * @brief Joins the launched steps of a sequence when it goes out of scope
+		 *
+		 * Declared after the objects the launched steps capture, so an
+		 * exception thrown before the steps are waited for does not leave
+		 * them running on destroyed objects.
+		 */
+		class JoinGuard
+		{
+		public:
+			/**
+			 * @brief Construct a new guard
+			 *
+			 * @param _sequence The sequence to join
+			 */
+			explicit JoinGuard(StartupSequence& _sequence) : sequence(_sequence) {}
+			JoinGuard(const JoinGuard&) = delete;
+			JoinGuard& operator=(const JoinGuard&) = delete;
+			/**
+			 * @brief Join the launched steps
+			 */
+			~JoinGuard() { sequence.join(); }
+
+		private:
+			/// @brief The sequence to join
+			StartupSequence& sequence;
+		};
+
+	private:
+		/**
+		 * @brief A measured step
+		 */
+		struct Phase
+		{
+			/// @brief The name of the step
+			std::string name;
+			/// @brief Whether the step ran on a thread of its own
+			bool background;
+			/// @brief The begin of the step
+			Clock::duration begin;
+			/// @brief The end of the step
+			Clock::duration end;
+		};
+
+		/**
+		 * @brief A step running on a thread of its own
+		 */
+		struct Task
+		{
+			/// @brief The name of the step
+			std::string name;
+			/// @brief The exception the step ended with, if any
+			std::exception_ptr error;
+			/// @brief The thread running the step
+			std::jthread thread;
+		};
+
+		/**
+		 * @brief End the current step of the calling thread
+		 */
+		void endStep();
+		/**
+		 * @brief Record a finished step
+		 *
+		 * @param phase The step
+		 */
+		void record(Phase phase);
+
+		/// @brief The time the sequence was constructed
+		const Clock::time_point origin;
+		/// @brief Set once the first frame was presented
+		bool finished;
+		/// @brief The time from the construction to the first frame
+		Clock::duration firstFrame;
+
+		/// @brief The name of the current step of the calling thread, empty if there is none
+		std::string currentName;
+		/// @brief The begin of the current step of the calling thread
+		Clock::duration currentBegin;
+
+		/// @brief Guards the finished steps, which background steps add to
+		mutable std::mutex mutex;
+		/// @brief The finished steps in the order they ended
+		std::vector<Phase> phases;
+		/// @brief The launched steps which were not waited for yet
+		std::list<Task> tasks;
+	};
+} // namespace storage
+
+#endif // STARTUP_H
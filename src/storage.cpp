@@ -1,10 +1,102 @@
+#include <charconv>
 #include <functional>
+#include <limits>
 
 #include "storage.h"
 #include "tinyxml2.h"
+#include "binary.h"
 #include "exceptions.h"
 
-storage::LibraryBook::LibraryBook(tinyxml2::XMLElement* xmlElement) : name("<untitled>"), location("")
+namespace
+{
+	/**
+	 * @brief Find the path of a shelf inside a list of shelf's
+	 *
+	 * @param shelfs The shelf's to search recursively
+	 * @param shelf The shelf to search for
+	 * @param path Receives the indices leading to the shelf
+	 * @return true If the shelf was found
+	 * @return false If the shelf is not part of the list
+	 */
+	bool locateShelf(std::vector<storage::LibraryShelf>& shelfs, const storage::LibraryShelf* shelf,
+			std::vector<std::uint32_t>& path)
+	{
+		for (std::size_t i = 0; i < shelfs.size(); ++i)
+		{
+			path.push_back(i);
+			if (&shelfs[i] == shelf || locateShelf(shelfs[i].subshelfs, shelf, path))
+				return true;
+			path.pop_back();
+		}
+		return false;
+	}
+
+	/**
+	 * @brief Find the path of a book inside a list of shelf's
+	 *
+	 * @param shelfs The shelf's to search recursively
+	 * @param book The book to search for
+	 * @param path Receives the shelf indices followed by the book index
+	 * @return true If the book was found
+	 * @return false If the book is not part of the list
+	 */
+	bool locateBook(std::vector<storage::LibraryShelf>& shelfs, const storage::LibraryBook* book,
+			std::vector<std::uint32_t>& path)
+	{
+		for (std::size_t i = 0; i < shelfs.size(); ++i)
+		{
+			path.push_back(i);
+			for (std::size_t j = 0; j < shelfs[i].books.size(); ++j)
+			{
+				if (&shelfs[i].books[j] == book)
+				{
+					path.push_back(j);
+					return true;
+				}
+			}
+			if (locateBook(shelfs[i].subshelfs, book, path))
+				return true;
+			path.pop_back();
+		}
+		return false;
+	}
+
+	/**
+	 * @brief Encode the span of an event for a library edit
+	 *
+	 * @param start The start time
+	 * @param end The end time
+	 * @return std::string The times separated by a space
+	 */
+	std::string formatSpan(std::int64_t start, std::int64_t end)
+	{
+		return std::to_string(start) + ' ' + std::to_string(end);
+	}
+
+	/**
+	 * @brief Decode the span of an event from a library edit
+	 *
+	 * @param text The times separated by a space
+	 * @param start Receives the start time
+	 * @param end Receives the end time
+	 * @return true If the text holds two times
+	 * @return false Otherwise
+	 */
+	bool parseSpan(std::string_view text, std::int64_t& start, std::int64_t& end)
+	{
+		const std::size_t space = text.find(' ');
+		if (space == std::string_view::npos)
+			return false;
+
+		const char* const middle = text.data() + space;
+		const char* const last = text.data() + text.size();
+		const auto [startEnd, startError] = std::from_chars(text.data(), middle, start);
+		const auto [endEnd, endError] = std::from_chars(middle + 1, last, end);
+		return startError == std::errc() && startEnd == middle && endError == std::errc() && endEnd == last;
+	}
+} // namespace
+
+storage::LibraryBook::LibraryBook(tinyxml2::XMLElement* xmlElement) : name("<untitled>"), location(""), id(0)
 {
 	{ // Try to load the book name
 		const char* attrib = xmlElement->Attribute("name");
@@ -15,6 +107,9 @@ storage::LibraryBook::LibraryBook(tinyxml2::XMLElement* xmlElement) : name("<unt
 		const char* attrib = xmlElement->Attribute("location");
 		if (attrib != nullptr) location = attrib;
 	}
+
+	// Books without an id get one once the library is complete
+	xmlElement->QueryUnsignedAttribute("id", &id);
 }
 
 tinyxml2::XMLElement* storage::LibraryBook::serialize(tinyxml2::XMLDocument* document)
@@ -23,6 +118,8 @@ tinyxml2::XMLElement* storage::LibraryBook::serialize(tinyxml2::XMLDocument* doc
 
 	xmlElement->SetAttribute("name", name.c_str());
 	xmlElement->SetAttribute("location", location.c_str());
+	if (id != 0)
+		xmlElement->SetAttribute("id", id);
 
 	return xmlElement;
 }
@@ -80,6 +177,20 @@ bool storage::LibraryShelf::deleteBook(LibraryBook* const book)
 	return false;
 }
 
+std::size_t storage::LibraryShelf::getMemoryUsage() const
+{
+	std::size_t usage = name.capacity()
+			+ subshelfs.capacity() * sizeof(LibraryShelf)
+			+ books.capacity() * sizeof(LibraryBook);
+
+	for (const auto& book : books)
+		usage += book.name.capacity() + book.location.capacity();
+	for (const auto& subShelf : subshelfs)
+		usage += subShelf.getMemoryUsage();
+
+	return usage;
+}
+
 tinyxml2::XMLElement* storage::LibraryShelf::serialize(tinyxml2::XMLDocument* document)
 {
 	tinyxml2::XMLElement* xmlElement = document->NewElement("shelf");
@@ -94,13 +205,15 @@ tinyxml2::XMLElement* storage::LibraryShelf::serialize(tinyxml2::XMLDocument* do
 	return xmlElement;
 }
 
-storage::Library::Library() : library_path(""), owner("unknown")
+storage::Library::Library() : library_path(""), generation(0), savedGeneration(0), nextBookId(1), owner("unknown")
 {
 	shelfs.emplace_back("default");
 	shelfs.back().books.emplace_back("New Book");
+	assignBookIds();
 }
 
-storage::Library::Library(std::filesystem::path path) : library_path(path), owner("unknown")
+storage::Library::Library(std::filesystem::path path) :
+		library_path(path), generation(0), savedGeneration(0), nextBookId(1), owner("unknown")
 {
 	tinyxml2::XMLDocument document;
 	tinyxml2::XMLError load_error = document.LoadFile(path.c_str());
@@ -151,22 +264,261 @@ storage::Library::Library(std::filesystem::path path) : library_path(path), owne
 	for (tinyxml2::XMLElement* shelf = xmlElement->FirstChildElement("shelf");
 			shelf != nullptr; shelf = shelf->NextSiblingElement("shelf"))
 		shelfs.emplace_back(shelf);
+
+	// Load the book metadata
+	if (tinyxml2::XMLElement* metadataElement = xmlElement->FirstChildElement("metadata"))
+		if (const char* text = metadataElement->GetText())
+			metadata.parse(decodeBase64(text));
+
+	// Load the relationship graph
+	if (tinyxml2::XMLElement* graphElement = xmlElement->FirstChildElement("graph"))
+		if (const char* text = graphElement->GetText())
+			graph.parse(decodeBase64(text));
+
+	// Load the timeline
+	if (tinyxml2::XMLElement* timelineElement = xmlElement->FirstChildElement("timeline"))
+		if (const char* text = timelineElement->GetText())
+			timeline.parse(decodeBase64(text));
+
+	assignBookIds();
+}
+
+storage::LibraryShelf* storage::Library::addShelf(LibraryShelf* const parent, std::string name)
+{
+	LibraryEdit edit{ LibraryEdit::Type::AddShelf, {}, std::move(name), "", "" };
+	if (parent != nullptr && !locateShelf(shelfs, parent, edit.path))
+		return nullptr;
+
+	commit(edit);
+	return parent != nullptr ? &parent->subshelfs.back() : &shelfs.back();
+}
+
+storage::LibraryBook* storage::Library::addBook(LibraryShelf* const shelf, LibraryBook book)
+{
+	LibraryEdit edit{ LibraryEdit::Type::AddBook, {}, std::move(book.getName()), std::move(book.getLocation()), "" };
+	if (!locateShelf(shelfs, shelf, edit.path))
+		return nullptr;
+
+	commit(edit);
+	return &shelf->books.back();
 }
 
 bool storage::Library::deleteShelf(LibraryShelf* const shelf)
 {
-	for (auto& _shelf : shelfs)
-		if (_shelf.deleteShelf(shelf))
-			return true;
-	return false;
+	LibraryEdit edit{ LibraryEdit::Type::DeleteShelf, {}, "", "", "" };
+	if (!locateShelf(shelfs, shelf, edit.path))
+		return false;
+
+	commit(edit);
+	return true;
 }
 
 bool storage::Library::deleteBook(LibraryBook* const book)
 {
-	for (auto& shelf : shelfs)
-		if (shelf.deleteBook(book))
-			return true;
-	return false;
+	LibraryEdit edit{ LibraryEdit::Type::DeleteBook, {}, "", "", "" };
+	if (!locateBook(shelfs, book, edit.path))
+		return false;
+
+	commit(edit);
+	return true;
+}
+
+bool storage::Library::setMetadata(LibraryBook* const book, std::string_view attribute, std::string_view value)
+{
+	LibraryEdit edit{ LibraryEdit::Type::SetMetadata, {}, std::string(attribute), "", std::string(value) };
+	if (!metadata.isValid(attribute, value) || !locateBook(shelfs, book, edit.path))
+		return false;
+
+	commit(edit);
+	return true;
+}
+
+std::uint32_t storage::Library::addEntity(std::string name, RelationshipGraph::EntityType type)
+{
+	commit({ LibraryEdit::Type::AddEntity, { static_cast<std::uint32_t>(type) }, std::move(name), "", "" });
+	return static_cast<std::uint32_t>(graph.getEntities().size() - 1);
+}
+
+bool storage::Library::removeEntity(std::uint32_t entity)
+{
+	if (!graph.isEntity(entity))
+		return false;
+
+	commit({ LibraryEdit::Type::RemoveEntity, { entity }, "", "", "" });
+	return true;
+}
+
+bool storage::Library::addRelation(std::uint32_t source, std::uint32_t target, std::string_view type)
+{
+	if (!graph.isEntity(source) || !graph.isEntity(target) || source == target
+			|| graph.hasRelation(source, target, type))
+		return false;
+
+	commit({ LibraryEdit::Type::AddRelation, { source, target }, std::string(type), "", "" });
+	return true;
+}
+
+bool storage::Library::removeRelation(std::uint32_t source, std::uint32_t target, std::string_view type)
+{
+	if (!graph.hasRelation(source, target, type))
+		return false;
+
+	commit({ LibraryEdit::Type::RemoveRelation, { source, target }, std::string(type), "", "" });
+	return true;
+}
+
+std::uint32_t storage::Library::addEvent(std::string name, std::int64_t start, std::int64_t end)
+{
+	if (end < start)
+		return Timeline::noEvent;
+
+	commit({ LibraryEdit::Type::AddEvent, {}, std::move(name), "", formatSpan(start, end) });
+	return static_cast<std::uint32_t>(timeline.getEvents().size() - 1);
+}
+
+bool storage::Library::removeEvent(std::uint32_t event)
+{
+	if (!timeline.isEvent(event))
+		return false;
+
+	commit({ LibraryEdit::Type::RemoveEvent, { event }, "", "", "" });
+	return true;
+}
+
+bool storage::Library::moveEvent(std::uint32_t event, std::int64_t start, std::int64_t end)
+{
+	if (!timeline.isEvent(event) || end < start)
+		return false;
+
+	commit({ LibraryEdit::Type::MoveEvent, { event }, "", "", formatSpan(start, end) });
+	return true;
+}
+
+bool storage::Library::renameEvent(std::uint32_t event, std::string name)
+{
+	if (!timeline.isEvent(event))
+		return false;
+
+	commit({ LibraryEdit::Type::RenameEvent, { event }, std::move(name), "", "" });
+	return true;
+}
+
+std::size_t storage::Library::getMemoryUsage() const
+{
+	std::size_t usage = sizeof(Library) + owner.capacity() + shelfs.capacity() * sizeof(LibraryShelf)
+			+ metadata.getMemoryUsage() + graph.getMemoryUsage() + timeline.getMemoryUsage();
+
+	for (const auto& shelf : shelfs)
+		usage += shelf.getMemoryUsage();
+
+	return usage;
+}
+
+void storage::Library::apply(const LibraryEdit& edit)
+{
+	const std::span<const std::uint32_t> path(edit.path);
+
+	switch (edit.type)
+	{
+	case LibraryEdit::Type::AddShelf:
+		(path.empty() ? shelfs : resolveShelf(path).subshelfs).emplace_back(edit.name);
+		break;
+
+	case LibraryEdit::Type::AddBook:
+		resolveShelf(path).books.emplace_back(edit.name, edit.location).id = nextBookId++;
+		break;
+
+	case LibraryEdit::Type::DeleteShelf:
+		{
+			if (path.empty())
+				throw ParsingError("Library edit does not address a shelf.");
+
+			auto& list = path.size() == 1 ? shelfs : resolveShelf(path.first(path.size() - 1)).subshelfs;
+			if (path.back() >= list.size())
+				throw ParsingError("Library edit refers to a missing shelf.");
+			clearMetadata(list[path.back()]);
+			list.erase(list.begin() + path.back());
+		}
+		break;
+
+	case LibraryEdit::Type::DeleteBook:
+		{
+			if (path.empty())
+				throw ParsingError("Library edit does not address a book.");
+
+			auto& list = resolveShelf(path.first(path.size() - 1)).books;
+			if (path.back() >= list.size())
+				throw ParsingError("Library edit refers to a missing book.");
+			metadata.clear(list[path.back()].id);
+			list.erase(list.begin() + path.back());
+		}
+		break;
+
+	case LibraryEdit::Type::SetMetadata:
+		{
+			if (path.empty())
+				throw ParsingError("Library edit does not address a book.");
+
+			auto& list = resolveShelf(path.first(path.size() - 1)).books;
+			if (path.back() >= list.size())
+				throw ParsingError("Library edit refers to a missing book.");
+			if (!metadata.set(list[path.back()].id, edit.name, edit.value))
+				throw ParsingError("Invalid value for the metadata attribute <", edit.name, ">.");
+		}
+		break;
+
+	case LibraryEdit::Type::AddEntity:
+		if (path.size() != 1 || path[0] > static_cast<std::uint32_t>(RelationshipGraph::EntityType::Term))
+			throw ParsingError("Library edit has an invalid entity type.");
+		graph.addEntity(edit.name, static_cast<RelationshipGraph::EntityType>(path[0]));
+		break;
+
+	case LibraryEdit::Type::RemoveEntity:
+		if (path.size() != 1 || !graph.removeEntity(path[0]))
+			throw ParsingError("Library edit refers to a missing entity.");
+		break;
+
+	case LibraryEdit::Type::AddRelation:
+		if (path.size() != 2 || !graph.addRelation(path[0], path[1], edit.name))
+			throw ParsingError("Library edit adds an invalid relationship.");
+		break;
+
+	case LibraryEdit::Type::RemoveRelation:
+		if (path.size() != 2 || !graph.removeRelation(path[0], path[1], edit.name))
+			throw ParsingError("Library edit refers to a missing relationship.");
+		break;
+
+	case LibraryEdit::Type::AddEvent:
+		{
+			std::int64_t start, end;
+			if (!parseSpan(edit.value, start, end) || timeline.addEvent(edit.name, start, end) == Timeline::noEvent)
+				throw ParsingError("Library edit has an invalid event span.");
+		}
+		break;
+
+	case LibraryEdit::Type::RemoveEvent:
+		if (path.size() != 1 || !timeline.removeEvent(path[0]))
+			throw ParsingError("Library edit refers to a missing event.");
+		break;
+
+	case LibraryEdit::Type::MoveEvent:
+		{
+			std::int64_t start, end;
+			if (path.size() != 1 || !parseSpan(edit.value, start, end) || !timeline.moveEvent(path[0], start, end))
+				throw ParsingError("Library edit moves a missing event or has an invalid event span.");
+		}
+		break;
+
+	case LibraryEdit::Type::RenameEvent:
+		if (path.size() != 1 || !timeline.renameEvent(path[0], edit.name))
+			throw ParsingError("Library edit refers to a missing event.");
+		break;
+
+	default:
+		throw ParsingError("Unknown library edit type.");
+	}
+
+	markDirty();
 }
 
 void storage::Library::save(const std::filesystem::path& path)
@@ -177,6 +529,20 @@ void storage::Library::save(const std::filesystem::path& path)
 	document.InsertEndChild(serialize(&document));
 
 	document.SaveFile(path.c_str());
+	markSaved(generation);
+}
+
+std::string storage::Library::serializeToString()
+{
+	tinyxml2::XMLDocument document;
+
+	document.InsertFirstChild(document.NewDeclaration());
+	document.InsertEndChild(serialize(&document));
+
+	tinyxml2::XMLPrinter printer;
+	document.Print(&printer);
+
+	return std::string(printer.CStr(), printer.CStrSize() - 1);
 }
 
 tinyxml2::XMLElement* storage::Library::serialize(tinyxml2::XMLDocument* document)
@@ -188,5 +554,129 @@ tinyxml2::XMLElement* storage::Library::serialize(tinyxml2::XMLDocument* documen
 	for (auto& shelf : shelfs)
 		xmlElement->InsertEndChild(shelf.serialize(document));
 
+	// The columns are stored as one binary block, which is far smaller than one attribute per value
+	if (metadata.getRowCount() != 0)
+	{
+		tinyxml2::XMLElement* metadataElement = document->NewElement("metadata");
+		metadataElement->SetText(encodeBase64(metadata.serialize()).c_str());
+		xmlElement->InsertEndChild(metadataElement);
+	}
+	if (!graph.getEntities().empty())
+	{
+		tinyxml2::XMLElement* graphElement = document->NewElement("graph");
+		graphElement->SetText(encodeBase64(graph.serialize()).c_str());
+		xmlElement->InsertEndChild(graphElement);
+	}
+	if (!timeline.getEvents().empty())
+	{
+		tinyxml2::XMLElement* timelineElement = document->NewElement("timeline");
+		timelineElement->SetText(encodeBase64(timeline.serialize()).c_str());
+		xmlElement->InsertEndChild(timelineElement);
+	}
+
 	return xmlElement;
 }
+
+storage::LibraryShelf& storage::Library::resolveShelf(std::span<const std::uint32_t> path)
+{
+	std::vector<LibraryShelf>* list = &shelfs;
+	LibraryShelf* shelf = nullptr;
+
+	for (const std::uint32_t index : path)
+	{
+		if (index >= list->size())
+			throw ParsingError("Library edit refers to a missing shelf.");
+
+		shelf = &(*list)[index];
+		list = &shelf->subshelfs;
+	}
+
+	if (shelf == nullptr)
+		throw ParsingError("Library edit does not address a shelf.");
+	return *shelf;
+}
+
+void storage::Library::commit(const LibraryEdit& edit)
+{
+	apply(edit);
+
+	if (editHandler)
+		editHandler(edit);
+}
+
+void storage::Library::assignBookIds()
+{
+	std::vector<LibraryBook*> books;
+	const std::function<void(LibraryShelf&)> collect = [&books, &collect] (LibraryShelf& shelf) {
+		for (auto& subShelf : shelf.subshelfs)
+			collect(subShelf);
+		for (auto& book : shelf.books)
+			books.push_back(&book);
+	};
+	for (auto& shelf : shelfs)
+		collect(shelf);
+
+	// Ids size the metadata rows and the mention index, so ids beyond every book and every metadata row
+	// can only come from a damaged file and are treated as missing
+	const std::uint32_t idLimit = static_cast<std::uint32_t>(std::min<std::size_t>(
+			std::max(books.size(), metadata.getRowCount()) + 1, std::numeric_limits<std::uint32_t>::max()));
+	for (const LibraryBook* book : books)
+		if (book->id < idLimit)
+			nextBookId = std::max(nextBookId, book->id + 1);
+
+	// Ids are handed out in tree order, so replaying a journal yields the same ids
+	std::vector<bool> used(nextBookId, false);
+	for (LibraryBook* book : books)
+	{
+		if (book->id == 0 || book->id >= idLimit || used[book->id])
+		{
+			book->id = nextBookId++;
+			metadata.clear(book->id);
+		}
+		else
+			used[book->id] = true;
+	}
+}
+
+void storage::Library::clearMetadata(const LibraryShelf& shelf)
+{
+	for (const auto& book : shelf.books)
+		metadata.clear(book.id);
+	for (const auto& subShelf : shelf.subshelfs)
+		clearMetadata(subShelf);
+}
+
+std::string storage::LibraryEdit::serialize() const
+{
+	std::string data;
+	BinaryWriter writer(data);
+
+	writer.writeU8(static_cast<std::uint8_t>(type));
+	writer.writeVarint(path.size());
+	for (const std::uint32_t index : path)
+		writer.writeVarint(index);
+	writer.writeString(name);
+	writer.writeString(location);
+	writer.writeString(value);
+
+	return data;
+}
+
+storage::LibraryEdit storage::LibraryEdit::parse(std::string_view data)
+{
+	BinaryReader reader(data);
+	LibraryEdit edit;
+
+	edit.type = static_cast<Type>(reader.readU8());
+	const std::uint64_t depth = reader.readVarint();
+	if (depth > reader.remaining().size())
+		throw ParsingError("Library edit path is too long.");
+	edit.path.resize(depth);
+	for (std::uint32_t& index : edit.path)
+		index = reader.readVarint();
+	edit.name = reader.readString();
+	edit.location = reader.readString();
+	edit.value = reader.readString();
+
+	return edit;
+}
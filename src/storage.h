@@ -1,9 +1,18 @@
 #ifndef STORAGE_H
 #define STORAGE_H
 
+#include <algorithm>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <span>
 #include <vector>
 #include <string>
+#include <string_view>
+
+#include "graph.h"
+#include "metadata.h"
+#include "timeline.h"
 
 
 
@@ -25,12 +34,13 @@ namespace storage
 	class LibraryBook
 	{
 		friend class LibraryShelf;
+		friend class Library;
 
 	public:
 		/**
 		 * @brief Construct a new empty library book
 		 */
-		LibraryBook() : name("<untitled>"), location("") { }
+		LibraryBook() : name("<untitled>"), location(""), id(0) { }
 		/**
 		 * @brief Parses a new library book from an XMLElement
 		 *
@@ -43,7 +53,7 @@ namespace storage
 		 * @param _name The name of the new library book
 		 * @param _location The location of the new library book
 		 */
-		LibraryBook(std::string _name, std::string _location = "") : name(_name), location(_location) { }
+		LibraryBook(std::string _name, std::string _location = "") : name(_name), location(_location), id(0) { }
 
 		/**
 		 * @brief Get the name of a library book
@@ -57,6 +67,15 @@ namespace storage
 		 * @return std::string& Provides a reference to the library book location
 		 */
 		std::string& getLocation() { return location; }
+		/**
+		 * @brief Get the id of a library book
+		 *
+		 * The id is unique inside the library and stays the same for the
+		 * lifetime of the book. It addresses the metadata of the book.
+		 *
+		 * @return std::uint32_t The id of the book, 0 if none was assigned yet
+		 */
+		std::uint32_t getId() const { return id; }
 
 	private:
 		/**
@@ -72,6 +91,8 @@ namespace storage
 		std::string name;
 		/// @brief The location of the library book
 		std::string location;
+		/// @brief The id of the library book inside its library
+		std::uint32_t id;
 	};
 
 	/**
@@ -128,6 +149,13 @@ namespace storage
 		 */
 		bool deleteBook(LibraryBook* const book);
 
+		/**
+		 * @brief Estimate the memory used by the shelf and its content
+		 *
+		 * @return std::size_t The estimated memory in bytes
+		 */
+		std::size_t getMemoryUsage() const;
+
 		/**
 		 * @brief Returns an iterator to the beginning of the books inside the shelf
 		 *
@@ -168,11 +196,83 @@ namespace storage
 		std::string name;
 	};
 
+	/**
+	 * @brief A single change of the library tree
+	 *
+	 * Shelf's are addressed by the indices leading to them from the library
+	 * root. Books are addressed by the path of their shelf followed by their
+	 * index inside that shelf. Edits of the relationship graph use the path
+	 * for entity ids and edits of the timeline for event ids. Event times are
+	 * stored in value as start and end minutes separated by a space.
+	 */
+	struct LibraryEdit
+	{
+		/**
+		 * @brief The kind of change
+		 */
+		enum class Type : std::uint8_t
+		{
+			/// @brief Append a shelf to the shelf at path, or the library root if empty
+			AddShelf,
+			/// @brief Append a book to the shelf at path
+			AddBook,
+			/// @brief Remove the shelf at path
+			DeleteShelf,
+			/// @brief Remove the book at path
+			DeleteBook,
+			/// @brief Set the metadata attribute name of the book at path to value
+			SetMetadata,
+			/// @brief Add an entity called name whose type is the only element of path
+			AddEntity,
+			/// @brief Remove the entity whose id is the only element of path
+			RemoveEntity,
+			/// @brief Add a relationship of type name between the two entities in path
+			AddRelation,
+			/// @brief Remove the relationship of type name between the two entities in path
+			RemoveRelation,
+			/// @brief Add an event called name spanning the times in value
+			AddEvent,
+			/// @brief Remove the event whose id is the only element of path
+			RemoveEvent,
+			/// @brief Move the event whose id is the only element of path to the times in value
+			MoveEvent,
+			/// @brief Rename the event whose id is the only element of path to name
+			RenameEvent
+		};
+
+		/// @brief The kind of change
+		Type type;
+		/// @brief The indices addressing the changed shelf or book
+		std::vector<std::uint32_t> path;
+		/// @brief The name of an added shelf or book, or the name of a metadata attribute
+		std::string name;
+		/// @brief The location of an added book
+		std::string location;
+		/// @brief The new value of a metadata attribute or the times of an event
+		std::string value;
+
+		/**
+		 * @brief Encode the edit into a compact binary form
+		 *
+		 * @return std::string The encoded edit
+		 */
+		std::string serialize() const;
+		/**
+		 * @brief Decode an edit from its binary form
+		 *
+		 * @param data The encoded edit
+		 * @return LibraryEdit The decoded edit
+		 */
+		static LibraryEdit parse(std::string_view data);
+	};
+
 	/**
 	 * @brief This class represents a collection of shelf's
 	 */
 	class Library
 	{
+		friend class LibraryLoader;
+
 	public:
 		/**
 		 * @brief Construct a new default library object
@@ -191,7 +291,56 @@ namespace storage
 		 * @return Provides a reference to the library owner
 		 */
 		std::string& getOwner() { return owner; }
+		/**
+		 * @brief Get the path the library was loaded from
+		 *
+		 * @return const std::filesystem::path& The library file path
+		 */
+		const std::filesystem::path& getPath() const { return library_path; }
 
+		/**
+		 * @brief Mark the library as modified
+		 *
+		 * This has to be called after every change to the library content so
+		 * that the autosave can pick up the change.
+		 */
+		void markDirty() { ++generation; }
+		/**
+		 * @brief Mark the library content up to a generation as saved
+		 *
+		 * @param _generation The generation which has been written to disk
+		 */
+		void markSaved(std::uint64_t _generation) { savedGeneration = std::max(savedGeneration, _generation); }
+		/**
+		 * @brief Get the edit generation of the library
+		 *
+		 * @return std::uint64_t The number of modifications since loading
+		 */
+		std::uint64_t getGeneration() const { return generation; }
+		/**
+		 * @brief Check if the library contains unsaved modifications
+		 *
+		 * @return true If the library was modified since the last save
+		 * @return false If the library is saved
+		 */
+		bool isDirty() const { return generation != savedGeneration; }
+
+		/**
+		 * @brief Add a new library shelf to the library
+		 *
+		 * @param parent The shelf to add the new shelf to, nullptr for the library root
+		 * @param name The name of the new shelf
+		 * @return LibraryShelf* The new shelf or nullptr if the parent is not part of the library
+		 */
+		LibraryShelf* addShelf(LibraryShelf* const parent, std::string name = "<unnamed>");
+		/**
+		 * @brief Add a new library book to a shelf of the library
+		 *
+		 * @param shelf The shelf to add the book to
+		 * @param book The book to add
+		 * @return LibraryBook* The new book or nullptr if the shelf is not part of the library
+		 */
+		LibraryBook* addBook(LibraryShelf* const shelf, LibraryBook book);
 		/**
 		 * @brief Delete a library shelf from the library
 		 *
@@ -210,6 +359,131 @@ namespace storage
 		 * @return false If no matching item was found
 		 */
 		bool deleteBook(LibraryBook* const book);
+		/**
+		 * @brief Set a metadata attribute of a library book
+		 *
+		 * @param book A pointer to the library book to change
+		 * @param attribute The name of the attribute
+		 * @param value The textual value, empty to remove the value
+		 * @return true If the value was stored
+		 * @return false If the book is unknown or the value invalid for the attribute
+		 */
+		bool setMetadata(LibraryBook* const book, std::string_view attribute, std::string_view value);
+		/**
+		 * @brief Get the metadata of all books, addressed by the book ids
+		 *
+		 * @return const MetadataStore& The metadata store
+		 */
+		const MetadataStore& getMetadata() const { return metadata; }
+
+		/**
+		 * @brief Add an entity to the relationship graph
+		 *
+		 * @param name The name of the entity
+		 * @param type The kind of the entity
+		 * @return std::uint32_t The id of the new entity
+		 */
+		std::uint32_t addEntity(std::string name, RelationshipGraph::EntityType type);
+		/**
+		 * @brief Remove an entity and all its relationships from the relationship graph
+		 *
+		 * @param entity The id of the entity
+		 * @return true If the entity was removed
+		 * @return false If there is no such entity
+		 */
+		bool removeEntity(std::uint32_t entity);
+		/**
+		 * @brief Add a relationship between two entities
+		 *
+		 * @param source The entity the relationship starts at
+		 * @param target The entity the relationship points to
+		 * @param type The type of the relationship
+		 * @return true If the relationship was added
+		 * @return false If an entity is missing or the relationship already exists
+		 */
+		bool addRelation(std::uint32_t source, std::uint32_t target, std::string_view type);
+		/**
+		 * @brief Remove a relationship between two entities
+		 *
+		 * @param source The entity the relationship starts at
+		 * @param target The entity the relationship points to
+		 * @param type The type of the relationship
+		 * @return true If the relationship was removed
+		 * @return false If there is no such relationship
+		 */
+		bool removeRelation(std::uint32_t source, std::uint32_t target, std::string_view type);
+		/**
+		 * @brief Get the relationship graph of the library
+		 *
+		 * @return const RelationshipGraph& The relationship graph
+		 */
+		const RelationshipGraph& getGraph() const { return graph; }
+
+		/**
+		 * @brief Add an event to the timeline
+		 *
+		 * @param name The name of the event
+		 * @param start The in-story time the event starts at
+		 * @param end The in-story time the event ends at
+		 * @return std::uint32_t The id of the new event or Timeline::noEvent if it ends before it starts
+		 */
+		std::uint32_t addEvent(std::string name, std::int64_t start, std::int64_t end);
+		/**
+		 * @brief Remove an event from the timeline
+		 *
+		 * @param event The id of the event
+		 * @return true If the event was removed
+		 * @return false If there is no such event
+		 */
+		bool removeEvent(std::uint32_t event);
+		/**
+		 * @brief Change the span of an event
+		 *
+		 * @param event The id of the event
+		 * @param start The new start time
+		 * @param end The new end time
+		 * @return true If the event was moved
+		 * @return false If there is no such event or it would end before it starts
+		 */
+		bool moveEvent(std::uint32_t event, std::int64_t start, std::int64_t end);
+		/**
+		 * @brief Change the name of an event
+		 *
+		 * @param event The id of the event
+		 * @param name The new name
+		 * @return true If the event was renamed
+		 * @return false If there is no such event
+		 */
+		bool renameEvent(std::uint32_t event, std::string name);
+		/**
+		 * @brief Get the timeline of the library
+		 *
+		 * @return const Timeline& The timeline
+		 */
+		const Timeline& getTimeline() const { return timeline; }
+
+		/**
+		 * @brief Apply a single edit to the library
+		 *
+		 * This is used to replay logged edits and does not notify the edit
+		 * handler.
+		 *
+		 * @param edit The edit to apply
+		 */
+		void apply(const LibraryEdit& edit);
+		/**
+		 * @brief Set a function which is called with every change of the library tree
+		 *
+		 * @param handler The function receiving the edits
+		 */
+		void setEditHandler(std::function<void(const LibraryEdit&)> handler) { editHandler = std::move(handler); }
+
+		/**
+		 * @brief Estimate the memory used by the library and its content
+		 *
+		 * @return std::size_t The estimated memory in bytes
+		 */
+		std::size_t getMemoryUsage() const;
 
 		/**
 		 * @brief Returns an iterator to the beginning of the shelfs inside the library
@@ -244,6 +518,12 @@ namespace storage
 		 * @param path The path to save the library to
 		 */
 		void save(const std::filesystem::path& path);
+		/**
+		 * @brief Serialize the library into the content of a library file
+		 *
+		 * @return std::string The xml text of the library
+		 */
+		std::string serializeToString();
 
 	private:
 		/**
@@ -253,9 +533,48 @@ namespace storage
 		 * @return tinyxml2::XMLElement* Returns a pointer to the new XMLElement
 		 */
 		tinyxml2::XMLElement* serialize(tinyxml2::XMLDocument* document);
+		/**
+		 * @brief Find the shelf addressed by a path
+		 *
+		 * @param path The indices leading to the shelf
+		 * @return LibraryShelf& The addressed shelf
+		 */
+		LibraryShelf& resolveShelf(std::span<const std::uint32_t> path);
+		/**
+		 * @brief Apply an edit and notify the edit handler about it
+		 *
+		 * @param edit The edit to commit
+		 */
+		void commit(const LibraryEdit& edit);
+		/**
+		 * @brief Give every book without a unique id a new one
+		 *
+		 * This has to be called once the library is completely loaded.
+		 */
+		void assignBookIds();
+		/**
+		 * @brief Remove the metadata of all books inside a shelf
+		 *
+		 * @param shelf The shelf whose books are removed
+		 */
+		void clearMetadata(const LibraryShelf& shelf);
 
 		/// @brief The path where the library was loaded from
 		std::filesystem::path library_path;
+		/// @brief The number of modifications since loading
+		std::uint64_t generation;
+		/// @brief The generation which was last written to disk
+		std::uint64_t savedGeneration;
+		/// @brief The function which is notified about every change
+		std::function<void(const LibraryEdit&)> editHandler;
+		/// @brief The metadata of all books, addressed by the book ids
+		MetadataStore metadata;
+		/// @brief The id given to the next new book
+		std::uint32_t nextBookId;
+		/// @brief The characters, places and factions of the library
+		RelationshipGraph graph;
+		/// @brief The scenes and events of the story
+		Timeline timeline;
 
 	public:
 		/// @brief A list of shells contained in this library
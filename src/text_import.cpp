@@ -0,0 +1,256 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+#include "text_import.h"
+#include "text_scan.h"
+#include "mapped_file.h"
+#include "exceptions.h"
+#include "wakeup.h"
+
+namespace
+{
+	/// @brief The number of bytes validated and split per step
+	constexpr std::size_t scanChunkSize = 4 << 20;
+	/// @brief Lines longer than this are never considered a heading
+	constexpr std::size_t maxHeadingLength = 200;
+
+	/**
+	 * @brief Remove surrounding white space from a line
+	 *
+	 * @param line The line to trim
+	 * @return std::string_view The trimmed line
+	 */
+	std::string_view trim(std::string_view line)
+	{
+		const std::size_t begin = line.find_first_not_of(" \t\r\f\v");
+		if (begin == std::string_view::npos)
+			return std::string_view();
+
+		return line.substr(begin, line.find_last_not_of(" \t\r\f\v") - begin + 1);
+	}
+
+	/**
+	 * @brief Turn a heading line into a book name
+	 *
+	 * @param line The heading line
+	 * @return std::string The heading without white space and markdown markers
+	 */
+	std::string headingName(std::string_view line)
+	{
+		line = trim(line);
+		if (line.starts_with('#'))
+			line = trim(line.substr(std::min(line.find_first_not_of('#'), line.size())));
+
+		return std::string(line);
+	}
+} // namespace
+
+std::vector<std::string> storage::TextImport::getDefaultHeadingPatterns()
+{
+	// A keyword alone would also match prose like "Part of me wanted", so a number has to follow it
+	return {
+		"(chapter|part)\\s+([0-9]+|[ivxlcdm]+|one|two|three|four|five|six|seven|eight|nine|ten|eleven|twelve"
+				"|thirteen|fourteen|fifteen|sixteen|seventeen|eighteen|nineteen|twenty|thirty|forty|fifty|sixty"
+				"|seventy|eighty|ninety|hundred)\\b(\\s*(\\.|:|-|–|—).*)?",
+		"(prologue|epilogue|interlude)",
+		"#{1,3}\\s+\\S.*",
+		"第([0-9]|０|１|２|３|４|５|６|７|８|９|〇|一|二|三|四|五|六|七|八|九|十|百|千)+(章|話|部).*",
+		"(序章|終章|プロローグ|エピローグ).*"
+	};
+}
+
+storage::TextImport::TextImport(std::filesystem::path _source, std::filesystem::path _destination,
+		const std::vector<std::string>& headingPatterns) :
+		source(std::move(_source)), destination(std::move(_destination)), taken(false),
+		state(State::Running), processed(0), sourceSize(0), throughput(0.0)
+{
+	for (const auto& pattern : headingPatterns)
+		headings.emplace_back(pattern, std::regex::ECMAScript | std::regex::icase | std::regex::optimize);
+
+	worker = std::jthread([this] (std::stop_token token) { run(token); });
+}
+
+storage::TextImport::~TextImport()
+{
+	worker.request_stop();
+	if (worker.joinable())
+		worker.join();
+
+	// The folder is only known to the import, nothing else would ever remove it
+	if (!folder.empty() && (!taken || state.load(std::memory_order_acquire) != State::Finished))
+	{
+		std::error_code removeError;
+		std::filesystem::remove_all(folder, removeError);
+	}
+}
+
+float storage::TextImport::getProgress() const
+{
+	const std::uint64_t total = sourceSize.load(std::memory_order_relaxed);
+	if (total == 0)
+		return 0.0f;
+
+	// Scanning and writing each account for half of the work
+	return static_cast<float>(processed.load(std::memory_order_relaxed))
+			/ static_cast<float>(2 * total);
+}
+
+std::string storage::TextImport::getError() const
+{
+	std::scoped_lock lockGuard(resultMutex);
+	return error;
+}
+
+std::vector<storage::LibraryBook> storage::TextImport::takeBooks()
+{
+	std::scoped_lock lockGuard(resultMutex);
+	taken = true;
+	return std::move(books);
+}
+
+void storage::TextImport::run(std::stop_token token)
+{
+	try
+	{
+		MappedFile file(source, true);
+		const char* const data = file.data();
+		const std::size_t size = file.size();
+		sourceSize.store(size, std::memory_order_relaxed);
+
+		// Skip a leading byte order mark
+		std::size_t start = 0;
+		if (file.view().starts_with("\xEF\xBB\xBF"))
+			start = 3;
+
+		// Validate the text and gather all line feeds chunk by chunk
+		std::vector<std::uint64_t> newlines;
+		newlines.reserve(size / 64);
+
+		const auto scanStart = std::chrono::steady_clock::now();
+		for (std::size_t begin = start; begin < size;)
+		{
+			if (token.stop_requested())
+			{
+				state.store(State::Cancelled, std::memory_order_release);
+				return;
+			}
+
+			std::size_t end = textscan::alignToCharacter(data, size, begin + scanChunkSize);
+			if (end <= begin)
+				end = std::min(size, begin + scanChunkSize);
+
+			if (!textscan::validateUtf8(data + begin, end - begin))
+			{
+				fail("Invalid UTF-8 sequence at byte "
+						+ std::to_string(begin + textscan::findInvalidUtf8(data + begin, end - begin))
+						+ " of " + source.string());
+				return;
+			}
+
+			textscan::findNewlines(data + begin, end - begin, begin, newlines);
+			processed.fetch_add(end - begin, std::memory_order_relaxed);
+			begin = end;
+		}
+		const std::chrono::duration<double> scanTime = std::chrono::steady_clock::now() - scanStart;
+		if (scanTime.count() > 0.0)
+			throughput.store((size - start) / scanTime.count() / 1e9, std::memory_order_relaxed);
+
+		// Split the text into chapters at every heading starting a paragraph
+		std::vector<Chapter> chapters;
+		chapters.push_back({ source.stem().string(), start, start });
+
+		bool paragraphStart = true;
+		std::uint64_t lineBegin = start;
+		for (std::size_t i = 0; i <= newlines.size(); ++i)
+		{
+			const std::uint64_t lineEnd = i < newlines.size() ? newlines[i] : size;
+			const std::string_view line(data + lineBegin, lineEnd - lineBegin);
+			const std::uint64_t nextLine = std::min<std::uint64_t>(lineEnd + 1, size);
+
+			if (textscan::isBlank(line))
+				paragraphStart = true;
+			else
+			{
+				if (paragraphStart && line.size() <= maxHeadingLength && isHeading(trim(line)))
+				{
+					chapters.back().end = lineBegin;
+					chapters.push_back({ headingName(line), nextLine, nextLine });
+				}
+				paragraphStart = false;
+			}
+
+			lineBegin = nextLine;
+		}
+		chapters.back().end = size;
+
+		// Drop a front matter chapter without any content
+		if (chapters.size() > 1 && textscan::isBlank(std::string_view(data + chapters.front().begin,
+				chapters.front().end - chapters.front().begin)))
+			chapters.erase(chapters.begin());
+
+		// Write every chapter into its own file, inside a new folder so the chapters of earlier imports stay untouched
+		if (destination.has_parent_path())
+			std::filesystem::create_directories(destination.parent_path());
+		std::filesystem::path created = destination;
+		for (unsigned int suffix = 2; !std::filesystem::create_directory(created); ++suffix)
+			created = destination.string() + "_" + std::to_string(suffix);
+		folder = std::move(created);
+
+		std::vector<LibraryBook> result;
+		result.reserve(chapters.size());
+		processed.store(size, std::memory_order_relaxed);
+
+		for (std::size_t i = 0; i < chapters.size(); ++i)
+		{
+			if (token.stop_requested())
+			{
+				state.store(State::Cancelled, std::memory_order_release);
+				return;
+			}
+
+			char filename[32];
+			std::snprintf(filename, sizeof(filename), "_%04zu.txt", i + 1);
+			const std::filesystem::path path = folder / (source.stem().string() + filename);
+
+			std::ofstream output(path, std::ofstream::binary | std::ofstream::trunc);
+			output.write(data + chapters[i].begin, chapters[i].end - chapters[i].begin);
+			if (!output)
+				throw FileError("Unable to write chapter file <", path.string(), ">.");
+
+			result.emplace_back(chapters[i].name, path.string());
+			processed.fetch_add(chapters[i].end - chapters[i].begin, std::memory_order_relaxed);
+		}
+
+		{
+			std::scoped_lock lockGuard(resultMutex);
+			books = std::move(result);
+		}
+		processed.store(2 * size, std::memory_order_relaxed);
+		state.store(State::Finished, std::memory_order_release);
+		wakeMainLoop();
+	}
+	catch (const std::exception& exception)
+	{
+		fail(exception.what());
+	}
+}
+
+bool storage::TextImport::isHeading(std::string_view line) const
+{
+	for (const auto& heading : headings)
+		if (std::regex_match(line.begin(), line.end(), heading))
+			return true;
+
+	return false;
+}
+
+void storage::TextImport::fail(std::string message)
+{
+	{
+		std::scoped_lock lockGuard(resultMutex);
+		error = std::move(message);
+	}
+	state.store(State::Failed, std::memory_order_release);
+	wakeMainLoop();
+}
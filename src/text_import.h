@@ -0,0 +1,189 @@
+#ifndef TEXT_IMPORT_H
+#define TEXT_IMPORT_H
+
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "storage.h"
+
+
+
+namespace storage
+{
+	/**
+	 * @brief Background import of a plain text file into library books.
+	 *
+	 * The source file is memory mapped, validated as UTF-8 and split into
+	 * lines by the vectorized kernels of the textscan namespace. Every line
+	 * starting a paragraph which matches one of the heading patterns begins a
+	 * new chapter. Each chapter is written into its own file inside the
+	 * destination folder and described by a new library book. If the folder
+	 * already exists, a numbered one next to it is used instead, so existing
+	 * books are never overwritten.
+	 *
+	 * The import runs on its own thread as soon as the object is constructed.
+	 * Destroying the object cancels a running import and waits for it. Unless
+	 * the books were taken, the folder created for the chapters is removed
+	 * again, so cancelled, failed and discarded imports leave nothing behind.
+	 */
+	class TextImport
+	{
+	public:
+		/**
+		 * @brief The states an import can be in
+		 */
+		enum class State
+		{
+			/// @brief The import is still running
+			Running,
+			/// @brief All chapters were written and the books can be taken
+			Finished,
+			/// @brief The import was aborted, see getError()
+			Failed,
+			/// @brief The import was cancelled by the user
+			Cancelled
+		};
+
+		/**
+		 * @brief Get the heading patterns used if none are given explicitly
+		 *
+		 * @return std::vector<std::string> The default heading regular expressions
+		 */
+		static std::vector<std::string> getDefaultHeadingPatterns();
+
+	public:
+		/**
+		 * @brief Start a new import in the background
+		 *
+		 * @param source The text file to import
+		 * @param destination The folder the chapter files are written to, created by the import
+		 * @param headingPatterns Regular expressions matching a whole heading line
+		 */
+		TextImport(std::filesystem::path source, std::filesystem::path destination,
+				const std::vector<std::string>& headingPatterns = getDefaultHeadingPatterns());
+		TextImport(TextImport&&) = delete;
+		TextImport(const TextImport&) = delete;
+		/**
+		 * @brief Cancel the import and remove its chapter files unless the books were taken
+		 */
+		~TextImport();
+
+		TextImport& operator=(TextImport&&) = delete;
+		TextImport& operator=(const TextImport&) = delete;
+
+		/**
+		 * @brief Get the current state of the import
+		 *
+		 * @return State The current state
+		 */
+		State getState() const { return state.load(std::memory_order_acquire); }
+		/**
+		 * @brief Get the progress of the import
+		 *
+		 * @return float The progress in the range from 0 to 1
+		 */
+		float getProgress() const;
+		/**
+		 * @brief Get the throughput of the validation and line splitting
+		 *
+		 * @return double The scanning throughput in GB/s or zero if unknown
+		 */
+		double getThroughput() const { return throughput.load(std::memory_order_relaxed); }
+		/**
+		 * @brief Get the size of the source file
+		 *
+		 * @return std::uint64_t The source size in bytes
+		 */
+		std::uint64_t getSourceSize() const { return sourceSize.load(std::memory_order_relaxed); }
+		/**
+		 * @brief Get the reason for a failed import
+		 *
+		 * @return std::string The error message, empty unless the import failed
+		 */
+		std::string getError() const;
+
+		/**
+		 * @brief Request the cancellation of a running import
+		 */
+		void cancel() { worker.request_stop(); }
+
+		/**
+		 * @brief Take the books created by a finished import, which keeps their chapter files
+		 *
+		 * @return std::vector<LibraryBook> The books in chapter order
+		 */
+		std::vector<LibraryBook> takeBooks();
+
+	private:
+		/**
+		 * @brief A chapter found inside the source text
+		 */
+		struct Chapter
+		{
+			/// @brief The heading of the chapter
+			std::string name;
+			/// @brief The offset of the first byte after the heading line
+			std::uint64_t begin;
+			/// @brief The offset one past the last byte of the chapter
+			std::uint64_t end;
+		};
+
+		/**
+		 * @brief The body of the import thread
+		 *
+		 * @param token The stop token signalling a cancellation
+		 */
+		void run(std::stop_token token);
+		/**
+		 * @brief Check if a line is a chapter heading
+		 *
+		 * @param line The line without its line feed
+		 * @return true If any of the heading patterns matches
+		 * @return false If no heading pattern matches
+		 */
+		bool isHeading(std::string_view line) const;
+		/**
+		 * @brief Mark the import as failed
+		 *
+		 * @param message The reason for the failure
+		 */
+		void fail(std::string message);
+
+		/// @brief The text file to import
+		const std::filesystem::path source;
+		/// @brief The folder the chapter files are written to, unless it exists already
+		const std::filesystem::path destination;
+		/// @brief The compiled heading patterns
+		std::vector<std::regex> headings;
+		/// @brief The folder created for the chapter files, empty until it exists
+		std::filesystem::path folder;
+		/// @brief Set once the books were taken
+		bool taken;
+
+		/// @brief The current state of the import
+		std::atomic<State> state;
+		/// @brief The number of bytes scanned and written so far
+		std::atomic<std::uint64_t> processed;
+		/// @brief The size of the source file
+		std::atomic<std::uint64_t> sourceSize;
+		/// @brief The measured scanning throughput in GB/s
+		std::atomic<double> throughput;
+
+		/// @brief Guards the error message and the resulting books
+		mutable std::mutex resultMutex;
+		/// @brief The reason for a failed import
+		std::string error;
+		/// @brief The books created by the import
+		std::vector<LibraryBook> books;
+
+		/// @brief The import thread, declared last so it is joined first
+		std::jthread worker;
+	};
+} // namespace storage
+
+#endif // TEXT_IMPORT_H
@@ -0,0 +1,480 @@
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+	#define TEXTSCAN_X86
+#endif
+
+#include "text_scan.h"
+
+namespace
+{
+	using ValidateFunction = bool (*)(const char*, std::size_t);
+	using NewlineFunction = void (*)(const char*, std::size_t, std::uint64_t,
+			std::vector<std::uint64_t>&);
+
+	/// @brief Set of kernel implementations for a specific instruction set
+	struct Kernels
+	{
+		ValidateFunction validate;
+		NewlineFunction newlines;
+		const char* name;
+	};
+
+	// ---------------------------------------------------------------------------
+	// Scalar kernels
+
+	bool validateScalar(const char* data, std::size_t size)
+	{
+		return storage::textscan::findInvalidUtf8(data, size) == size;
+	}
+
+	void newlinesScalar(const char* data, std::size_t size, std::uint64_t base,
+			std::vector<std::uint64_t>& newlines)
+	{
+		const char* position = data;
+		const char* const end = data + size;
+
+		while ((position = static_cast<const char*>(std::memchr(position, '\n', end - position))) != nullptr)
+		{
+			newlines.push_back(base + (position - data));
+			++position;
+		}
+	}
+
+#ifdef TEXTSCAN_X86
+	// ---------------------------------------------------------------------------
+	// Lookup tables of the vectorized UTF-8 validation
+	//
+	// Every pair of adjacent bytes is classified by the high nibble of the first
+	// byte, the low nibble of the first byte and the high nibble of the second
+	// byte. Each lookup yields a set of error bits which are only kept if all
+	// three lookups agree on them. Sequences of three and four bytes are checked
+	// by ensuring that the continuation bytes are exactly where a lead byte two
+	// or three positions earlier demands them.
+
+	constexpr std::uint8_t TOO_SHORT      = 1 << 0;
+	constexpr std::uint8_t TOO_LONG       = 1 << 1;
+	constexpr std::uint8_t OVERLONG_3     = 1 << 2;
+	constexpr std::uint8_t TOO_LARGE      = 1 << 3;
+	constexpr std::uint8_t SURROGATE      = 1 << 4;
+	constexpr std::uint8_t OVERLONG_2     = 1 << 5;
+	constexpr std::uint8_t TOO_LARGE_1000 = 1 << 6;
+	constexpr std::uint8_t OVERLONG_4     = 1 << 6;
+	constexpr std::uint8_t TWO_CONTS      = 1 << 7;
+	constexpr std::uint8_t CARRY          = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+	alignas(16) constexpr std::uint8_t byte1HighTable[16] = {
+		// 0_______ ________ <ASCII in byte 1>
+		TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+		TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+		// 10______ ________ <continuation in byte 1>
+		TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+		// 1100____ ________ <two byte lead in byte 1>
+		TOO_SHORT | OVERLONG_2,
+		// 1101____ ________ <two byte lead in byte 1>
+		TOO_SHORT,
+		// 1110____ ________ <three byte lead in byte 1>
+		TOO_SHORT | OVERLONG_3 | SURROGATE,
+		// 1111____ ________ <four byte lead in byte 1>
+		TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+	};
+
+	alignas(16) constexpr std::uint8_t byte1LowTable[16] = {
+		// ____0000 ________
+		CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+		// ____0001 ________
+		CARRY | OVERLONG_2,
+		// ____001_ ________
+		CARRY,
+		CARRY,
+		// ____0100 ________
+		CARRY | TOO_LARGE,
+		// ____0101 ________
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		// ____011_ ________
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		// ____1___ ________
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		// ____1101 ________
+		CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000
+	};
+
+	alignas(16) constexpr std::uint8_t byte2HighTable[16] = {
+		// ________ 0_______ <ASCII in byte 2>
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+		// ________ 1000____
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+		// ________ 1001____
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+		// ________ 101_____
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE  | TOO_LARGE,
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE  | TOO_LARGE,
+		// ________ 11______ <lead byte in byte 2>
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+	};
+
+	// ---------------------------------------------------------------------------
+	// SSSE3 kernels
+
+	/// @brief Validation state carried from one 16 byte block to the next
+	struct StateSSE
+	{
+		__m128i error;
+		__m128i previousInput;
+		__m128i previousIncomplete;
+	};
+
+	__attribute__((target("ssse3")))
+	inline __m128i nibbleHighSSE(__m128i value)
+	{
+		return _mm_and_si128(_mm_srli_epi16(value, 4), _mm_set1_epi8(0x0F));
+	}
+
+	__attribute__((target("ssse3")))
+	inline void checkBlockSSE(StateSSE& state, __m128i input)
+	{
+		// ASCII blocks can only be invalid if the previous block was cut short
+		if (_mm_movemask_epi8(input) == 0)
+		{
+			state.error = _mm_or_si128(state.error, state.previousIncomplete);
+			state.previousIncomplete = _mm_setzero_si128();
+			state.previousInput = input;
+			return;
+		}
+
+		const __m128i table1High = _mm_load_si128(reinterpret_cast<const __m128i*>(byte1HighTable));
+		const __m128i table1Low = _mm_load_si128(reinterpret_cast<const __m128i*>(byte1LowTable));
+		const __m128i table2High = _mm_load_si128(reinterpret_cast<const __m128i*>(byte2HighTable));
+
+		const __m128i previous1 = _mm_alignr_epi8(input, state.previousInput, 16 - 1);
+		const __m128i previous2 = _mm_alignr_epi8(input, state.previousInput, 16 - 2);
+		const __m128i previous3 = _mm_alignr_epi8(input, state.previousInput, 16 - 3);
+
+		// Two byte special cases
+		const __m128i byte1High = _mm_shuffle_epi8(table1High, nibbleHighSSE(previous1));
+		const __m128i byte1Low = _mm_shuffle_epi8(table1Low,
+				_mm_and_si128(previous1, _mm_set1_epi8(0x0F)));
+		const __m128i byte2High = _mm_shuffle_epi8(table2High, nibbleHighSSE(input));
+		const __m128i special = _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);
+
+		// Continuations demanded by three and four byte lead bytes
+		const __m128i isThird = _mm_subs_epu8(previous2, _mm_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+		const __m128i isFourth = _mm_subs_epu8(previous3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+		const __m128i mustContinue = _mm_and_si128(_mm_or_si128(isThird, isFourth),
+				_mm_set1_epi8(static_cast<char>(0x80)));
+
+		state.error = _mm_or_si128(state.error, _mm_xor_si128(mustContinue, special));
+
+		// Remember if the block ends inside of a multi byte sequence
+		const __m128i maxValue = _mm_setr_epi8(
+				-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+				static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+		state.previousIncomplete = _mm_subs_epu8(input, maxValue);
+		state.previousInput = input;
+	}
+
+	__attribute__((target("ssse3")))
+	bool validateSSE(const char* data, std::size_t size)
+	{
+		StateSSE state{ _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+
+		std::size_t i = 0;
+		for (; i + 16 <= size; i += 16)
+			checkBlockSSE(state, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+
+		// The zero padding of the last block catches truncated sequences
+		alignas(16) char tail[16] = {};
+		std::memcpy(tail, data + i, size - i);
+		checkBlockSSE(state, _mm_load_si128(reinterpret_cast<const __m128i*>(tail)));
+
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(state.error, _mm_setzero_si128())) == 0xFFFF;
+	}
+
+	__attribute__((target("sse2")))
+	void newlinesSSE(const char* data, std::size_t size, std::uint64_t base,
+			std::vector<std::uint64_t>& newlines)
+	{
+		const __m128i newline = _mm_set1_epi8('\n');
+
+		std::size_t i = 0;
+		for (; i + 16 <= size; i += 16)
+		{
+			const __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(input, newline));
+
+			while (mask != 0)
+			{
+				newlines.push_back(base + i + __builtin_ctz(mask));
+				mask &= mask - 1;
+			}
+		}
+
+		newlinesScalar(data + i, size - i, base + i, newlines);
+	}
+
+	// ---------------------------------------------------------------------------
+	// AVX2 kernels
+
+	/// @brief Validation state carried from one 32 byte block to the next
+	struct StateAVX2
+	{
+		__m256i error;
+		__m256i previousInput;
+		__m256i previousIncomplete;
+	};
+
+	template<int N>
+	__attribute__((target("avx2")))
+	inline __m256i previousAVX2(__m256i input, __m256i previousInput)
+	{
+		// Build the 32 bytes preceding input shifted by N positions across both lanes
+		return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previousInput, input, 0x21), 16 - N);
+	}
+
+	__attribute__((target("avx2")))
+	inline __m256i nibbleHighAVX2(__m256i value)
+	{
+		return _mm256_and_si256(_mm256_srli_epi16(value, 4), _mm256_set1_epi8(0x0F));
+	}
+
+	__attribute__((target("avx2")))
+	inline void checkBlockAVX2(StateAVX2& state, __m256i input)
+	{
+		// ASCII blocks can only be invalid if the previous block was cut short
+		if (_mm256_movemask_epi8(input) == 0)
+		{
+			state.error = _mm256_or_si256(state.error, state.previousIncomplete);
+			state.previousIncomplete = _mm256_setzero_si256();
+			state.previousInput = input;
+			return;
+		}
+
+		const __m256i table1High = _mm256_broadcastsi128_si256(
+				_mm_load_si128(reinterpret_cast<const __m128i*>(byte1HighTable)));
+		const __m256i table1Low = _mm256_broadcastsi128_si256(
+				_mm_load_si128(reinterpret_cast<const __m128i*>(byte1LowTable)));
+		const __m256i table2High = _mm256_broadcastsi128_si256(
+				_mm_load_si128(reinterpret_cast<const __m128i*>(byte2HighTable)));
+
+		const __m256i previous1 = previousAVX2<1>(input, state.previousInput);
+		const __m256i previous2 = previousAVX2<2>(input, state.previousInput);
+		const __m256i previous3 = previousAVX2<3>(input, state.previousInput);
+
+		// Two byte special cases
+		const __m256i byte1High = _mm256_shuffle_epi8(table1High, nibbleHighAVX2(previous1));
+		const __m256i byte1Low = _mm256_shuffle_epi8(table1Low,
+				_mm256_and_si256(previous1, _mm256_set1_epi8(0x0F)));
+		const __m256i byte2High = _mm256_shuffle_epi8(table2High, nibbleHighAVX2(input));
+		const __m256i special = _mm256_and_si256(_mm256_and_si256(byte1High, byte1Low), byte2High);
+
+		// Continuations demanded by three and four byte lead bytes
+		const __m256i isThird = _mm256_subs_epu8(previous2, _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+		const __m256i isFourth = _mm256_subs_epu8(previous3, _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+		const __m256i mustContinue = _mm256_and_si256(_mm256_or_si256(isThird, isFourth),
+				_mm256_set1_epi8(static_cast<char>(0x80)));
+
+		state.error = _mm256_or_si256(state.error, _mm256_xor_si256(mustContinue, special));
+
+		// Remember if the block ends inside of a multi byte sequence
+		const __m256i maxValue = _mm256_setr_epi8(
+				-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+				-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+				static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+		state.previousIncomplete = _mm256_subs_epu8(input, maxValue);
+		state.previousInput = input;
+	}
+
+	__attribute__((target("avx2")))
+	bool validateAVX2(const char* data, std::size_t size)
+	{
+		StateAVX2 state{ _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256() };
+
+		std::size_t i = 0;
+		for (; i + 32 <= size; i += 32)
+			checkBlockAVX2(state, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+
+		// The zero padding of the last block catches truncated sequences
+		alignas(32) char tail[32] = {};
+		std::memcpy(tail, data + i, size - i);
+		checkBlockAVX2(state, _mm256_load_si256(reinterpret_cast<const __m256i*>(tail)));
+
+		return _mm256_testz_si256(state.error, state.error) != 0;
+	}
+
+	__attribute__((target("avx2")))
+	void newlinesAVX2(const char* data, std::size_t size, std::uint64_t base,
+			std::vector<std::uint64_t>& newlines)
+	{
+		const __m256i newline = _mm256_set1_epi8('\n');
+
+		std::size_t i = 0;
+		for (; i + 32 <= size; i += 32)
+		{
+			const __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+			unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(input, newline));
+
+			while (mask != 0)
+			{
+				newlines.push_back(base + i + __builtin_ctz(mask));
+				mask &= mask - 1;
+			}
+		}
+
+		newlinesScalar(data + i, size - i, base + i, newlines);
+	}
+#endif // TEXTSCAN_X86
+
+	/**
+	 * @brief Select the fastest kernels supported by the executing cpu
+	 *
+	 * @return const Kernels& The selected kernels
+	 */
+	const Kernels& getKernels()
+	{
+		static const Kernels kernels = [] () -> Kernels
+		{
+#ifdef TEXTSCAN_X86
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2"))
+				return { validateAVX2, newlinesAVX2, "avx2" };
+			if (__builtin_cpu_supports("ssse3"))
+				return { validateSSE, newlinesSSE, "ssse3" };
+#endif
+			return { validateScalar, newlinesScalar, "scalar" };
+		}();
+
+		return kernels;
+	}
+} // namespace
+
+bool storage::textscan::validateUtf8(const char* data, std::size_t size)
+{
+	return getKernels().validate(data, size);
+}
+
+std::size_t storage::textscan::findInvalidUtf8(const char* data, std::size_t size)
+{
+	const auto* bytes = reinterpret_cast<const unsigned char*>(data);
+	std::size_t i = 0;
+
+	while (i < size)
+	{
+		// Skip eight ASCII characters at once
+		if (i + 8 <= size)
+		{
+			std::uint64_t word;
+			std::memcpy(&word, bytes + i, sizeof(word));
+			if ((word & 0x8080808080808080ull) == 0)
+			{
+				i += 8;
+				continue;
+			}
+		}
+
+		const unsigned char lead = bytes[i];
+		if (lead < 0x80)
+		{
+			++i;
+			continue;
+		}
+
+		std::size_t length;
+		std::uint32_t codepoint;
+		if (lead >= 0xC2 && lead <= 0xDF)
+		{
+			length = 2;
+			codepoint = lead & 0x1F;
+		}
+		else if ((lead & 0xF0) == 0xE0)
+		{
+			length = 3;
+			codepoint = lead & 0x0F;
+		}
+		else if (lead >= 0xF0 && lead <= 0xF4)
+		{
+			length = 4;
+			codepoint = lead & 0x07;
+		}
+		else
+			return i;
+
+		if (i + length > size)
+			return i;
+
+		for (std::size_t k = 1; k < length; ++k)
+		{
+			if ((bytes[i + k] & 0xC0) != 0x80)
+				return i;
+			codepoint = (codepoint << 6) | (bytes[i + k] & 0x3F);
+		}
+
+		// Reject overlong encodings, surrogates and values beyond unicode
+		if ((length == 3 && (codepoint < 0x800 || (codepoint >= 0xD800 && codepoint <= 0xDFFF)))
+				|| (length == 4 && (codepoint < 0x10000 || codepoint > 0x10FFFF)))
+			return i;
+
+		i += length;
+	}
+
+	return size;
+}
+
+void storage::textscan::findNewlines(const char* data, std::size_t size, std::uint64_t base,
+		std::vector<std::uint64_t>& newlines)
+{
+	getKernels().newlines(data, size, base, newlines);
+}
+
+std::size_t storage::textscan::alignToCharacter(const char* data, std::size_t size, std::size_t offset)
+{
+	if (offset >= size)
+		return size;
+
+	// A sequence has at most three continuation bytes
+	for (int i = 0; i < 3 && offset > 0
+			&& (static_cast<unsigned char>(data[offset]) & 0xC0) == 0x80; ++i)
+		--offset;
+
+	return offset;
+}
+
+bool storage::textscan::isBlank(std::string_view line)
+{
+	for (std::size_t i = 0; i < line.size(); ++i)
+	{
+		switch (line[i])
+		{
+		case ' ':
+		case '\t':
+		case '\r':
+		case '\f':
+		case '\v':
+			continue;
+		}
+
+		// The ideographic space U+3000 is common in japanese manuscripts
+		if (line.substr(i, 3) == "\xE3\x80\x80")
+		{
+			i += 2;
+			continue;
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+const char* storage::textscan::getKernelName()
+{
+	return getKernels().name;
+}
@@ -0,0 +1,88 @@
+#ifndef TEXT_SCAN_H
+#define TEXT_SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+
+
+namespace storage
+{
+	/**
+	 * @brief Vectorized scanning kernels for large UTF-8 text buffers.
+	 *
+	 * Every kernel comes in an AVX2, an SSSE3 and a scalar flavour. The best
+	 * flavour supported by the executing cpu is selected once on first use.
+	 */
+	namespace textscan
+	{
+		/**
+		 * @brief Check if a buffer contains only well formed UTF-8
+		 *
+		 * Overlong encodings, surrogates, code points above U+10FFFF and
+		 * truncated sequences are all rejected.
+		 *
+		 * @param data The start of the buffer
+		 * @param size The size of the buffer in bytes
+		 * @return true If the whole buffer is valid UTF-8
+		 * @return false If at least one invalid sequence was found
+		 */
+		bool validateUtf8(const char* data, std::size_t size);
+
+		/**
+		 * @brief Find the offset of the first invalid UTF-8 sequence
+		 *
+		 * This is the slow scalar companion of validateUtf8 and is meant to
+		 * produce error messages once a buffer is known to be invalid.
+		 *
+		 * @param data The start of the buffer
+		 * @param size The size of the buffer in bytes
+		 * @return std::size_t The offset of the first invalid byte or size if valid
+		 */
+		std::size_t findInvalidUtf8(const char* data, std::size_t size);
+
+		/**
+		 * @brief Append the offset of every line feed inside a buffer
+		 *
+		 * @param data The start of the buffer
+		 * @param size The size of the buffer in bytes
+		 * @param base The value added to every offset before it is stored
+		 * @param newlines The list the offsets are appended to
+		 */
+		void findNewlines(const char* data, std::size_t size, std::uint64_t base,
+				std::vector<std::uint64_t>& newlines);
+
+		/**
+		 * @brief Move a chunk boundary back onto the start of a UTF-8 sequence
+		 *
+		 * Splitting a buffer at the returned offset never cuts a multi byte
+		 * sequence in half, which allows validating chunks independently.
+		 *
+		 * @param data The start of the buffer
+		 * @param size The size of the buffer in bytes
+		 * @param offset The desired split offset
+		 * @return std::size_t The adjusted split offset
+		 */
+		std::size_t alignToCharacter(const char* data, std::size_t size, std::size_t offset);
+
+		/**
+		 * @brief Check if a line consists of white space only
+		 *
+		 * @param line The line without its line feed
+		 * @return true If the line is blank
+		 * @return false If the line contains printable characters
+		 */
+		bool isBlank(std::string_view line);
+
+		/**
+		 * @brief Get the name of the kernel flavour in use
+		 *
+		 * @return const char* Either "avx2", "ssse3" or "scalar"
+		 */
+		const char* getKernelName();
+	} // namespace textscan
+} // namespace storage
+
+#endif // TEXT_SCAN_H
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <utility>
+
+#include "thread_pool.h"
+
+storage::ThreadPool::ThreadPool(std::size_t threads) :
+		function(nullptr), count(0), chunkSize(0), chunkCount(0), nextChunk(0), generation(0), busy(0)
+{
+	if (threads == 0)
+		threads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+	workers.reserve(threads);
+	for (std::size_t i = 0; i < threads; ++i)
+		workers.emplace_back([this] (std::stop_token token) { run(token); });
+}
+
+void storage::ThreadPool::parallelFor(std::size_t count, std::size_t grain,
+		const std::function<void(std::size_t, std::size_t)>& function)
+{
+	if (count == 0)
+		return;
+
+	// Small loops are not worth waking the workers
+	grain = std::max<std::size_t>(grain, 1);
+	if (workers.empty() || count <= grain)
+	{
+		function(0, count);
+		return;
+	}
+
+	std::scoped_lock submitLock(submitMutex);
+	{
+		// Use a few chunks per thread so uneven chunks even out
+		std::scoped_lock lock(mutex);
+		this->function = &function;
+		this->count = count;
+		chunkSize = std::max(grain, (count + getConcurrency() * 4 - 1) / (getConcurrency() * 4));
+		chunkCount = (count + chunkSize - 1) / chunkSize;
+		nextChunk = 0;
+		error = nullptr;
+		++generation;
+	}
+	wakeup.notify_all();
+
+	work();
+
+	std::unique_lock lock(mutex);
+	finished.wait(lock, [this] () { return busy == 0; });
+	// Workers waking up late must not join the finished loop
+	this->function = nullptr;
+
+	if (error)
+		std::rethrow_exception(std::exchange(error, nullptr));
+}
+
+void storage::ThreadPool::work()
+{
+	for (std::size_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++)
+	{
+		try
+		{
+			(*function)(chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+		}
+		catch (...)
+		{
+			std::scoped_lock lock(mutex);
+			if (!error)
+				error = std::current_exception();
+			// Skip the remaining chunks
+			nextChunk = chunkCount;
+		}
+	}
+}
+
+void storage::ThreadPool::run(std::stop_token token)
+{
+	std::uint64_t seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock lock(mutex);
+			if (!wakeup.wait(lock, token, [this, &seen] () { return function != nullptr && generation != seen; }))
+				return;
+
+			seen = generation;
+			++busy;
+		}
+
+		work();
+
+		{
+			std::scoped_lock lock(mutex);
+			--busy;
+		}
+		finished.notify_all();
+	}
+}
@@ -0,0 +1,101 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+
+
+namespace storage
+{
+	/**
+	 * @brief A fixed set of worker threads splitting loops into chunks
+	 *
+	 * The pool runs one loop at a time. The calling thread works on the loop
+	 * as well and only returns once every chunk is done, so the loop body may
+	 * safely reference local state of the caller. Loops submitted from
+	 * several threads are run one after another. The first exception thrown
+	 * by the loop body is rethrown to the caller once the loop finished.
+	 */
+	class ThreadPool
+	{
+	public:
+		/**
+		 * @brief Construct a new pool
+		 *
+		 * @param threads The number of worker threads, zero to use one less than the hardware threads
+		 */
+		ThreadPool(std::size_t threads = 0);
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		/**
+		 * @brief Get the number of threads working on a loop, including the caller
+		 *
+		 * @return std::size_t The number of threads
+		 */
+		std::size_t getConcurrency() const { return workers.size() + 1; }
+
+		/**
+		 * @brief Run a loop on all threads of the pool
+		 *
+		 * @param count The number of iterations
+		 * @param grain The minimal number of iterations per chunk
+		 * @param function The function receiving the begin and end of every chunk
+		 */
+		void parallelFor(std::size_t count, std::size_t grain,
+				const std::function<void(std::size_t, std::size_t)>& function);
+
+	private:
+		/**
+		 * @brief Work on the chunks of the current loop until none are left
+		 */
+		void work();
+		/**
+		 * @brief The main function of every worker thread
+		 *
+		 * @param token The token signaling the worker to stop
+		 */
+		void run(std::stop_token token);
+
+		/// @brief Serializes loops submitted from several threads
+		std::mutex submitMutex;
+		/// @brief Guards the description of the current loop
+		std::mutex mutex;
+		/// @brief Wakes the workers when a loop was submitted
+		std::condition_variable_any wakeup;
+		/// @brief Wakes the caller when a worker finished its part of the loop
+		std::condition_variable_any finished;
+
+		/// @brief The body of the current loop, nullptr if there is none
+		const std::function<void(std::size_t, std::size_t)>* function;
+		/// @brief The number of iterations of the current loop
+		std::size_t count;
+		/// @brief The number of iterations per chunk of the current loop
+		std::size_t chunkSize;
+		/// @brief The number of chunks of the current loop
+		std::size_t chunkCount;
+		/// @brief The next chunk to hand out
+		std::atomic<std::size_t> nextChunk;
+		/// @brief Incremented for every loop so workers join each loop at most once
+		std::uint64_t generation;
+		/// @brief The number of workers currently working on the loop
+		std::size_t busy;
+		/// @brief The first exception thrown by the current loop
+		std::exception_ptr error;
+
+		/// @brief The worker threads, declared last so they are joined first
+		std::vector<std::jthread> workers;
+	};
+} // namespace storage
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+
+#include "timeline.h"
+#include "binary.h"
+#include "exceptions.h"
+
+namespace
+{
+	/// @brief The version of the binary form written by serialize
+	constexpr std::uint8_t formatVersion = 1;
+	/// @brief The number of minutes per day
+	constexpr std::int64_t minutesPerDay = 24 * 60;
+
+	/**
+	 * @brief Derive the heap priority of an event from its id
+	 *
+	 * The priorities only have to look random, deriving them keeps the tree
+	 * shape independent of the order the events were loaded in.
+	 *
+	 * @param event The id of the event
+	 * @return std::uint32_t The priority
+	 */
+	std::uint32_t getPriority(std::uint32_t event)
+	{
+		std::uint64_t x = event + 0x9e3779b97f4a7c15ull;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+		return static_cast<std::uint32_t>(x ^ (x >> 31));
+	}
+
+	/**
+	 * @brief Parse a whole text as integer
+	 *
+	 * @param text The text to parse
+	 * @param value Receives the parsed value
+	 * @return true If the text is an integer
+	 * @return false If the text is no integer
+	 */
+	bool parseInteger(std::string_view text, std::int64_t& value)
+	{
+		const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+		return error == std::errc() && end == text.data() + text.size() && !text.empty();
+	}
+} // namespace
+
+bool storage::Timeline::parseTime(std::string_view text, std::int64_t& time)
+{
+	const std::size_t first = text.find_first_not_of(" \t");
+	if (first == std::string_view::npos)
+		return false;
+	text = text.substr(first, text.find_last_not_of(" \t") - first + 1);
+
+	// The day is followed by an optional time of the day
+	const std::size_t space = text.find(' ');
+	std::int64_t day;
+	std::int64_t hours = 0;
+	std::int64_t minutes = 0;
+	if (!parseInteger(text.substr(0, space), day))
+		return false;
+	if (space != std::string_view::npos)
+	{
+		const std::string_view clock = text.substr(text.find_first_not_of(' ', space));
+		const std::size_t colon = clock.find(':');
+		if (colon == std::string_view::npos || !parseInteger(clock.substr(0, colon), hours)
+				|| !parseInteger(clock.substr(colon + 1), minutes)
+				|| hours < 0 || hours >= 24 || minutes < 0 || minutes >= 60)
+			return false;
+	}
+
+	// Keep far away days from overflowing
+	if (day < -(std::int64_t(1) << 40) || day > (std::int64_t(1) << 40))
+		return false;
+
+	time = day * minutesPerDay + hours * 60 + minutes;
+	return true;
+}
+
+std::string storage::Timeline::formatTime(std::int64_t time)
+{
+	// Round towards negative infinity, so times before the story start count backwards by day
+	std::int64_t day = time / minutesPerDay;
+	std::int64_t minute = time % minutesPerDay;
+	if (minute < 0)
+	{
+		--day;
+		minute += minutesPerDay;
+	}
+
+	char buffer[48];
+	std::snprintf(buffer, sizeof(buffer), "%lld %02d:%02d", static_cast<long long>(day),
+			static_cast<int>(minute / 60), static_cast<int>(minute % 60));
+	return buffer;
+}
+
+std::uint32_t storage::Timeline::addEvent(std::string name, std::int64_t start, std::int64_t end)
+{
+	if (end < start)
+		return noEvent;
+
+	const std::uint32_t event = events.size();
+	events.push_back({ std::move(name), start, end, false });
+	nodes.push_back({ noEvent, noEvent, getPriority(event), end });
+	insert(event);
+	insertTimes(event);
+	++count;
+	return event;
+}
+
+bool storage::Timeline::removeEvent(std::uint32_t event)
+{
+	if (!isEvent(event))
+		return false;
+
+	root = unlink(root, event);
+	eraseTimes(event);
+	events[event].removed = true;
+	events[event].name.clear();
+	events[event].name.shrink_to_fit();
+	--count;
+	return true;
+}
+
+bool storage::Timeline::moveEvent(std::uint32_t event, std::int64_t start, std::int64_t end)
+{
+	if (!isEvent(event) || end < start)
+		return false;
+
+	root = unlink(root, event);
+	eraseTimes(event);
+	events[event].start = start;
+	events[event].end = end;
+	insert(event);
+	insertTimes(event);
+	return true;
+}
+
+bool storage::Timeline::renameEvent(std::uint32_t event, std::string name)
+{
+	if (!isEvent(event))
+		return false;
+
+	events[event].name = std::move(name);
+	return true;
+}
+
+std::vector<std::uint32_t> storage::Timeline::findOverlapping(std::int64_t from, std::int64_t to) const
+{
+	std::vector<std::uint32_t> result;
+	forEachOverlapping(from, to, [&result] (std::uint32_t event) { result.push_back(event); });
+	return result;
+}
+
+std::size_t storage::Timeline::countOverlapping(std::int64_t from, std::int64_t to) const
+{
+	if (to < from)
+		return 0;
+
+	// Every event ending before the span also starts before its end
+	const auto started = std::upper_bound(starts.begin(), starts.end(), to) - starts.begin();
+	const auto ended = std::lower_bound(ends.begin(), ends.end(), from) - ends.begin();
+	return started - ended;
+}
+
+std::size_t storage::Timeline::getMemoryUsage() const
+{
+	std::size_t usage = sizeof(Timeline) + events.capacity() * sizeof(Event) + nodes.capacity() * sizeof(Node)
+			+ (starts.capacity() + ends.capacity()) * sizeof(std::int64_t);
+
+	for (const Event& event : events)
+		usage += event.name.capacity();
+
+	return usage;
+}
+
+std::string storage::Timeline::serialize() const
+{
+	std::string data;
+	BinaryWriter writer(data);
+	writer.writeU8(formatVersion);
+
+	// Removed events are kept as empty entries, so the ids stay stable
+	writer.writeVarint(events.size());
+	for (const Event& event : events)
+	{
+		writer.writeU8(event.removed);
+		if (event.removed)
+			continue;
+		writer.writeString(event.name);
+		writer.writeSignedVarint(event.start);
+		writer.writeVarint(static_cast<std::uint64_t>(event.end - event.start));
+	}
+
+	return data;
+}
+
+void storage::Timeline::parse(std::string_view data)
+{
+	BinaryReader reader(data);
+	if (reader.readU8() != formatVersion)
+		throw ParsingError("Unsupported timeline version.");
+
+	Timeline timeline;
+
+	const std::uint64_t eventCount = reader.readVarint();
+	if (eventCount > reader.remaining().size())
+		throw ParsingError("Timeline event count is implausible.");
+	timeline.events.reserve(eventCount);
+	timeline.nodes.reserve(eventCount);
+	for (std::uint64_t i = 0; i < eventCount; ++i)
+	{
+		if (reader.readU8() != 0)
+		{
+			timeline.events.push_back({ "", 0, 0, true });
+			timeline.nodes.push_back({ noEvent, noEvent, 0, 0 });
+			continue;
+		}
+
+		const std::string_view name = reader.readString();
+		const std::int64_t start = reader.readSignedVarint();
+		const std::uint64_t length = reader.readVarint();
+		if (length > static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max() - std::max<std::int64_t>(start, 0)))
+			throw ParsingError("Timeline event is too long.");
+
+		const std::uint32_t event = timeline.events.size();
+		const std::int64_t end = start + static_cast<std::int64_t>(length);
+		timeline.events.push_back({ std::string(name), start, end, false });
+		timeline.nodes.push_back({ noEvent, noEvent, getPriority(event), end });
+		timeline.insert(event);
+		timeline.starts.push_back(start);
+		timeline.ends.push_back(end);
+		++timeline.count;
+	}
+
+	// Sorting once is far cheaper than inserting every time into place
+	std::sort(timeline.starts.begin(), timeline.starts.end());
+	std::sort(timeline.ends.begin(), timeline.ends.end());
+
+	*this = std::move(timeline);
+}
+
+void storage::Timeline::pull(std::uint32_t node)
+{
+	std::int64_t maxEnd = events[node].end;
+	if (nodes[node].left != noEvent)
+		maxEnd = std::max(maxEnd, nodes[nodes[node].left].maxEnd);
+	if (nodes[node].right != noEvent)
+		maxEnd = std::max(maxEnd, nodes[nodes[node].right].maxEnd);
+	nodes[node].maxEnd = maxEnd;
+}
+
+void storage::Timeline::split(std::uint32_t node, std::uint32_t key, std::uint32_t& left, std::uint32_t& right)
+{
+	if (node == noEvent)
+	{
+		left = noEvent;
+		right = noEvent;
+		return;
+	}
+
+	if (isBefore(node, key))
+	{
+		split(nodes[node].right, key, nodes[node].right, right);
+		left = node;
+	}
+	else
+	{
+		split(nodes[node].left, key, left, nodes[node].left);
+		right = node;
+	}
+	pull(node);
+}
+
+std::uint32_t storage::Timeline::merge(std::uint32_t left, std::uint32_t right)
+{
+	if (left == noEvent)
+		return right;
+	if (right == noEvent)
+		return left;
+
+	if (nodes[left].priority > nodes[right].priority)
+	{
+		nodes[left].right = merge(nodes[left].right, right);
+		pull(left);
+		return left;
+	}
+
+	nodes[right].left = merge(left, nodes[right].left);
+	pull(right);
+	return right;
+}
+
+std::uint32_t storage::Timeline::unlink(std::uint32_t node, std::uint32_t event)
+{
+	if (node == event)
+		return merge(nodes[node].left, nodes[node].right);
+
+	if (isBefore(event, node))
+		nodes[node].left = unlink(nodes[node].left, event);
+	else
+		nodes[node].right = unlink(nodes[node].right, event);
+	pull(node);
+	return node;
+}
+
+void storage::Timeline::insert(std::uint32_t event)
+{
+	nodes[event].left = noEvent;
+	nodes[event].right = noEvent;
+	nodes[event].maxEnd = events[event].end;
+
+	std::uint32_t left, right;
+	split(root, event, left, right);
+	root = merge(merge(left, event), right);
+}
+
+void storage::Timeline::insertTimes(std::uint32_t event)
+{
+	starts.insert(std::upper_bound(starts.begin(), starts.end(), events[event].start), events[event].start);
+	ends.insert(std::upper_bound(ends.begin(), ends.end(), events[event].end), events[event].end);
+}
+
+void storage::Timeline::eraseTimes(std::uint32_t event)
+{
+	starts.erase(std::lower_bound(starts.begin(), starts.end(), events[event].start));
+	ends.erase(std::lower_bound(ends.begin(), ends.end(), events[event].end));
+}
@@ -0,0 +1,312 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+
+namespace storage
+{
+	/**
+	 * @brief Scenes and events placed on the in-story time axis
+	 *
+	 * Times are minutes since the start of the story, an event spans the
+	 * closed interval from its start to its end. The events are kept in an
+	 * augmented interval tree: a treap ordered by start time in which every
+	 * node knows the latest end inside its subtree. Subtrees ending before a
+	 * queried span are skipped entirely, so finding the k events overlapping
+	 * a span takes O(log n + k). Adding, moving and removing an event only
+	 * touches one path of the tree.
+	 *
+	 * For zoomed out views the number of events overlapping a span is
+	 * counted without visiting them, from the sorted start and end times.
+	 *
+	 * Event ids are indices which stay stable, removed events are only
+	 * marked as such.
+	 */
+	class Timeline
+	{
+	public:
+		/**
+		 * @brief A scene or event of the story
+		 */
+		struct Event
+		{
+			/// @brief The name of the event
+			std::string name;
+			/// @brief The time the event starts at
+			std::int64_t start;
+			/// @brief The time the event ends at, never before the start
+			std::int64_t end;
+			/// @brief Set once the event was removed, its id is never reused
+			bool removed;
+		};
+
+		/// @brief The id used for missing events
+		static constexpr std::uint32_t noEvent = std::numeric_limits<std::uint32_t>::max();
+
+		/**
+		 * @brief Parse an in-story time like "12" or "12 08:30" for day 12 at half past eight
+		 *
+		 * @param text The text to parse
+		 * @param time Receives the minutes since the start of the story
+		 * @return true If the text is a valid time
+		 * @return false Otherwise
+		 */
+		static bool parseTime(std::string_view text, std::int64_t& time);
+		/**
+		 * @brief Format an in-story time the way parseTime reads it
+		 *
+		 * @param time The minutes since the start of the story
+		 * @return std::string The formatted time
+		 */
+		static std::string formatTime(std::int64_t time);
+
+	public:
+		/**
+		 * @brief Construct a new empty timeline
+		 */
+		Timeline() : root(noEvent), count(0) { }
+
+		/**
+		 * @brief Add an event
+		 *
+		 * @param name The name of the event
+		 * @param start The time the event starts at
+		 * @param end The time the event ends at
+		 * @return std::uint32_t The id of the new event or noEvent if it ends before it starts
+		 */
+		std::uint32_t addEvent(std::string name, std::int64_t start, std::int64_t end);
+		/**
+		 * @brief Remove an event
+		 *
+		 * @param event The id of the event
+		 * @return true If the event was removed
+		 * @return false If there is no such event
+		 */
+		bool removeEvent(std::uint32_t event);
+		/**
+		 * @brief Change the span of an event
+		 *
+		 * @param event The id of the event
+		 * @param start The new start time
+		 * @param end The new end time
+		 * @return true If the event was moved
+		 * @return false If there is no such event or it would end before it starts
+		 */
+		bool moveEvent(std::uint32_t event, std::int64_t start, std::int64_t end);
+		/**
+		 * @brief Change the name of an event
+		 *
+		 * @param event The id of the event
+		 * @param name The new name
+		 * @return true If the event was renamed
+		 * @return false If there is no such event
+		 */
+		bool renameEvent(std::uint32_t event, std::string name);
+		/**
+		 * @brief Check if an event exists
+		 *
+		 * @param event The id of the event
+		 * @return true If the event exists and was not removed
+		 * @return false Otherwise
+		 */
+		bool isEvent(std::uint32_t event) const { return event < events.size() && !events[event].removed; }
+		/**
+		 * @brief Get all events including removed ones, indexed by their ids
+		 *
+		 * @return const std::vector<Event>& The events
+		 */
+		const std::vector<Event>& getEvents() const { return events; }
+		/**
+		 * @brief Get the number of events which were not removed
+		 *
+		 * @return std::size_t The number of events
+		 */
+		std::size_t size() const { return count; }
+		/**
+		 * @brief Get the earliest start of all events
+		 *
+		 * @return std::int64_t The earliest start or zero if there are no events
+		 */
+		std::int64_t getStart() const { return starts.empty() ? 0 : starts.front(); }
+		/**
+		 * @brief Get the latest end of all events
+		 *
+		 * @return std::int64_t The latest end or zero if there are no events
+		 */
+		std::int64_t getEnd() const { return ends.empty() ? 0 : ends.back(); }
+
+		/**
+		 * @brief Call a function for every event overlapping a span, ordered by start time
+		 *
+		 * @tparam Function The type of the function
+		 * @param from The start of the span
+		 * @param to The end of the span
+		 * @param function The function receiving the id of every overlapping event
+		 */
+		template<typename Function>
+		void forEachOverlapping(std::int64_t from, std::int64_t to, Function function) const
+		{
+			visit(root, from, to, function);
+		}
+		/**
+		 * @brief Find all events overlapping a span
+		 *
+		 * @param from The start of the span
+		 * @param to The end of the span
+		 * @return std::vector<std::uint32_t> The ids of the events ordered by start time
+		 */
+		std::vector<std::uint32_t> findOverlapping(std::int64_t from, std::int64_t to) const;
+		/**
+		 * @brief Count the events overlapping a span without visiting them
+		 *
+		 * @param from The start of the span
+		 * @param to The end of the span
+		 * @return std::size_t The number of overlapping events
+		 */
+		std::size_t countOverlapping(std::int64_t from, std::int64_t to) const;
+
+		/**
+		 * @brief Estimate the memory used by the timeline
+		 *
+		 * @return std::size_t The estimated memory in bytes
+		 */
+		std::size_t getMemoryUsage() const;
+
+		/**
+		 * @brief Encode the timeline into a compact binary form
+		 *
+		 * @return std::string The encoded timeline
+		 */
+		std::string serialize() const;
+		/**
+		 * @brief Replace the timeline by decoding its binary form
+		 *
+		 * @param data The encoded timeline
+		 */
+		void parse(std::string_view data);
+
+	private:
+		/**
+		 * @brief The tree links of an event
+		 */
+		struct Node
+		{
+			/// @brief The event with the next smaller start or noEvent
+			std::uint32_t left;
+			/// @brief The event with the next larger start or noEvent
+			std::uint32_t right;
+			/// @brief The heap priority, parents always have a larger one
+			std::uint32_t priority;
+			/// @brief The latest end inside the subtree
+			std::int64_t maxEnd;
+		};
+
+		/**
+		 * @brief Visit the events of a subtree overlapping a span in order
+		 *
+		 * @tparam Function The type of the function
+		 * @param node The root of the subtree
+		 * @param from The start of the span
+		 * @param to The end of the span
+		 * @param function The function receiving the id of every overlapping event
+		 */
+		template<typename Function>
+		void visit(std::uint32_t node, std::int64_t from, std::int64_t to, Function& function) const
+		{
+			// Walk down the right spine iteratively, only the left subtrees recurse
+			while (node != noEvent && nodes[node].maxEnd >= from)
+			{
+				visit(nodes[node].left, from, to, function);
+
+				// Everything further right starts later
+				if (events[node].start > to)
+					return;
+				if (events[node].end >= from)
+					function(node);
+				node = nodes[node].right;
+			}
+		}
+		/**
+		 * @brief Check if an event sorts before another one
+		 *
+		 * @param a The id of the first event
+		 * @param b The id of the second event
+		 * @return true If a starts earlier, or at the same time with a smaller id
+		 * @return false Otherwise
+		 */
+		bool isBefore(std::uint32_t a, std::uint32_t b) const
+		{
+			return events[a].start < events[b].start || (events[a].start == events[b].start && a < b);
+		}
+		/**
+		 * @brief Recompute the latest end of a node from its children
+		 *
+		 * @param node The node to update
+		 */
+		void pull(std::uint32_t node);
+		/**
+		 * @brief Split a subtree into the events sorting before an event and all others
+		 *
+		 * @param node The root of the subtree
+		 * @param key The event to split at
+		 * @param left Receives the root of the events sorting before key
+		 * @param right Receives the root of the remaining events
+		 */
+		void split(std::uint32_t node, std::uint32_t key, std::uint32_t& left, std::uint32_t& right);
+		/**
+		 * @brief Join two subtrees, all events of the left one sort before the right one
+		 *
+		 * @param left The root of the left subtree
+		 * @param right The root of the right subtree
+		 * @return std::uint32_t The root of the joined tree
+		 */
+		std::uint32_t merge(std::uint32_t left, std::uint32_t right);
+		/**
+		 * @brief Unlink an event from a subtree
+		 *
+		 * @param node The root of the subtree
+		 * @param event The id of the event
+		 * @return std::uint32_t The new root of the subtree
+		 */
+		std::uint32_t unlink(std::uint32_t node, std::uint32_t event);
+		/**
+		 * @brief Insert an event into the tree
+		 *
+		 * @param event The id of the event
+		 */
+		void insert(std::uint32_t event);
+		/**
+		 * @brief Insert the times of an event into the sorted times
+		 *
+		 * @param event The id of the event
+		 */
+		void insertTimes(std::uint32_t event);
+		/**
+		 * @brief Remove the times of an event from the sorted times
+		 *
+		 * @param event The id of the event
+		 */
+		void eraseTimes(std::uint32_t event);
+
+		/// @brief All events indexed by their ids
+		std::vector<Event> events;
+		/// @brief The tree links of all events indexed by their ids
+		std::vector<Node> nodes;
+		/// @brief The root of the tree or noEvent
+		std::uint32_t root;
+		/// @brief The number of events which were not removed
+		std::size_t count;
+		/// @brief The start times of all events, sorted
+		std::vector<std::int64_t> starts;
+		/// @brief The end times of all events, sorted
+		std::vector<std::int64_t> ends;
+	};
+} // namespace storage
+
+#endif // TIMELINE_H
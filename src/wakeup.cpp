@@ -0,0 +1,20 @@
+#include <atomic>
+
+#include "wakeup.h"
+
+namespace
+{
+	/// @brief The function waking the main loop, nullptr if there is none
+	std::atomic<storage::WakeupHandler> wakeupHandler(nullptr);
+} // namespace
+
+void storage::setWakeupHandler(WakeupHandler handler)
+{
+	wakeupHandler.store(handler, std::memory_order_release);
+}
+
+void storage::wakeMainLoop()
+{
+	if (const WakeupHandler handler = wakeupHandler.load(std::memory_order_acquire))
+		handler();
+}
@@ -0,0 +1,27 @@
+#ifndef WAKEUP_H
+#define WAKEUP_H
+
+
+
+namespace storage
+{
+	/// @brief A function waking the main loop, it has to be callable from any thread
+	using WakeupHandler = void (*)();
+
+	/**
+	 * @brief Set the function waking the main loop
+	 *
+	 * The main loop sleeps while nothing happens. Background threads call
+	 * wakeMainLoop() once they produced something the main loop has to pick
+	 * up, like a finished load.
+	 *
+	 * @param handler The function, nullptr to disable waking
+	 */
+	void setWakeupHandler(WakeupHandler handler);
+	/**
+	 * @brief Wake the main loop, callable from any thread
+	 */
+	void wakeMainLoop();
+} // namespace storage
+
+#endif // WAKEUP_H
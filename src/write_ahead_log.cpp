@@ -0,0 +1,533 @@
+#include <algorithm>
+#include <fstream>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "write_ahead_log.h"
+#include "autosave.h"
+#include "binary.h"
+#include "exceptions.h"
+
+namespace
+{
+	/// @brief The first bytes of every journal file
+	constexpr std::string_view journalMagic = "HMNWAL01";
+
+	/**
+	 * @brief Append a record with its size and checksum to a buffer
+	 *
+	 * @param buffer The buffer to append to
+	 * @param body The content of the record
+	 */
+	void frameRecord(std::string& buffer, std::string_view body)
+	{
+		storage::BinaryWriter writer(buffer);
+		writer.writeU32(body.size());
+		writer.writeU32(static_cast<std::uint32_t>(storage::fnv1a(body)));
+		writer.writeBytes(body);
+	}
+
+	/**
+	 * @brief Hash the content of a file
+	 *
+	 * A missing file hashes like an empty one.
+	 *
+	 * @param path The file to hash
+	 * @return std::uint64_t The FNV-1a hash of the file content
+	 */
+	std::uint64_t hashFile(const std::filesystem::path& path)
+	{
+		std::uint64_t hash = storage::fnv1a({});
+
+		std::ifstream input(path, std::ifstream::binary);
+		char chunk[1 << 16];
+		while (input.read(chunk, sizeof(chunk)) || input.gcount() > 0)
+			hash = storage::fnv1a(std::string_view(chunk, input.gcount()), hash);
+
+		return hash;
+	}
+
+	/**
+	 * @brief Read a whole journal file
+	 *
+	 * @param path The journal file
+	 * @return std::string The content of the journal, empty if it does not exist
+	 */
+	std::string readJournal(const std::filesystem::path& path)
+	{
+		std::string content;
+		if (std::filesystem::exists(path))
+		{
+			std::ifstream input(path, std::ifstream::binary);
+			if (!input)
+				throw storage::OpenError("Unable to open journal <", path.string(), ">.");
+
+			content.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+			if (input.bad())
+				throw storage::ReadError("Unable to read journal <", path.string(), ">.");
+		}
+		return content;
+	}
+} // namespace
+
+storage::WriteAheadLog::WriteAheadLog(std::filesystem::path _path, std::chrono::milliseconds _commitInterval) :
+		path(std::move(_path)), commitInterval(_commitInterval), fd(-1), nextStreamId(0),
+		appended(0), durable(0), urgent(false), compactPending(false), lastSync(Clock::now())
+{
+	if (path.has_parent_path())
+		std::filesystem::create_directories(path.parent_path());
+
+	writeFileAtomically(path, recover());
+
+	fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+	if (fd < 0)
+		throw OpenError("Unable to open journal <", path.string(), "> for appending.");
+
+	worker = std::jthread([this] (std::stop_token token) { run(token); });
+}
+
+storage::WriteAheadLog::~WriteAheadLog()
+{
+	worker.request_stop();
+	if (worker.joinable())
+		worker.join();
+
+	writeAndSync(buffer);
+	::close(fd);
+}
+
+std::vector<std::string> storage::WriteAheadLog::attach(const std::filesystem::path& file)
+{
+	Stream& stream = getStream(file);
+
+	// Recovered edits are already covered by the checkpoint of the compacted journal
+	if (!stream.recovered.empty())
+	{
+		std::vector<std::string> recovered;
+		recovered.swap(stream.recovered);
+		return recovered;
+	}
+
+	BinaryWriter writer(scratch);
+	scratch.clear();
+	writer.writeU8(static_cast<std::uint8_t>(RecordType::Checkpoint));
+	writer.writeVarint(stream.id);
+	writer.writeVarint(stream.generation);
+	writer.writeU64(hashFile(file));
+	appendRecord(scratch);
+
+	return {};
+}
+
+void storage::WriteAheadLog::append(const std::filesystem::path& file, std::string_view edit)
+{
+	Stream& stream = getStream(file);
+
+	BinaryWriter writer(scratch);
+	scratch.clear();
+	writer.writeU8(static_cast<std::uint8_t>(RecordType::Edit));
+	writer.writeVarint(stream.id);
+	writer.writeVarint(++stream.generation);
+	writer.writeBytes(edit);
+	appendRecord(scratch);
+}
+
+void storage::WriteAheadLog::checkpoint(const std::filesystem::path& file, std::string_view content)
+{
+	Stream& stream = getStream(file);
+
+	BinaryWriter writer(scratch);
+	scratch.clear();
+	writer.writeU8(static_cast<std::uint8_t>(RecordType::Checkpoint));
+	writer.writeVarint(stream.id);
+	writer.writeVarint(stream.generation);
+	writer.writeU64(fnv1a(content));
+	appendRecord(scratch);
+}
+
+void storage::WriteAheadLog::compact()
+{
+	{
+		std::scoped_lock lockGuard(mutex);
+		compactPending = true;
+	}
+	condition.notify_all();
+}
+
+void storage::WriteAheadLog::sync()
+{
+	std::unique_lock lock(mutex);
+
+	const std::uint64_t target = appended;
+	const std::uint64_t failures = metrics.failedSyncs;
+	if (durable >= target)
+		return;
+
+	urgent = true;
+	condition.notify_all();
+	condition.wait(lock, [this, target, failures]
+		{
+			return durable >= target || metrics.failedSyncs != failures
+					|| worker.get_stop_token().stop_requested();
+		}
+	);
+}
+
+storage::WriteAheadLog::Metrics storage::WriteAheadLog::getMetrics() const
+{
+	std::scoped_lock lockGuard(mutex);
+	return metrics;
+}
+
+std::string storage::WriteAheadLog::recover()
+{
+	std::string compacted(journalMagic);
+
+	const std::string previous = readJournal(path);
+	if (previous.empty())
+		return compacted;
+	if (!std::string_view(previous).starts_with(journalMagic))
+		throw ParsingError("File <", path.string(), "> is not a journal.");
+
+	// Gather the logged streams in the order of their records
+	struct Logged
+	{
+		std::string file;
+		std::vector<std::pair<std::uint64_t, std::uint64_t>> checkpoints;
+		std::vector<std::pair<std::uint64_t, std::string_view>> edits;
+	};
+	std::map<std::uint32_t, Logged> logged;
+
+	BinaryReader reader(std::string_view(previous).substr(journalMagic.size()));
+	try
+	{
+		while (!reader.empty())
+		{
+			const std::uint32_t size = reader.readU32();
+			const std::uint32_t checksum = reader.readU32();
+			const std::string_view body = reader.readBytes(size);
+			if (static_cast<std::uint32_t>(fnv1a(body)) != checksum)
+				break;
+
+			BinaryReader record(body);
+			const RecordType type = static_cast<RecordType>(record.readU8());
+			Logged& stream = logged[record.readVarint()];
+
+			switch (type)
+			{
+			case RecordType::Stream:
+				stream.file = record.readString();
+				break;
+
+			case RecordType::Checkpoint:
+				{
+					const std::uint64_t generation = record.readVarint();
+					stream.checkpoints.emplace_back(generation, record.readU64());
+				}
+				break;
+
+			case RecordType::Edit:
+				{
+					const std::uint64_t generation = record.readVarint();
+					stream.edits.emplace_back(generation, record.remaining());
+				}
+				break;
+
+			default:
+				throw ParsingError("Unknown journal record type.");
+			}
+		}
+	}
+	catch (const ParsingError&)
+	{
+		// A torn record at the end of the journal is expected after a crash
+	}
+
+	// Keep the edits newer than the checkpoint matching the current file content
+	for (auto& [id, stream] : logged)
+	{
+		if (stream.file.empty() || stream.edits.empty())
+			continue;
+
+		const std::uint64_t hash = hashFile(stream.file);
+		const auto match = std::find_if(stream.checkpoints.rbegin(), stream.checkpoints.rend(),
+				[hash] (const auto& checkpoint) { return checkpoint.second == hash; });
+		if (match == stream.checkpoints.rend())
+		{
+			metrics.discardedEdits += stream.edits.size();
+			continue;
+		}
+
+		std::vector<std::string> recovered;
+		std::uint64_t last = match->first;
+		for (const auto& [generation, edit] : stream.edits)
+		{
+			if (generation > last)
+			{
+				recovered.emplace_back(edit);
+				last = generation;
+			}
+		}
+		if (recovered.empty())
+			continue;
+
+		// Renumber the recovered edits on top of the current file content
+		Stream& current = streams[stream.file];
+		current.id = nextStreamId++;
+		current.generation = recovered.size();
+
+		std::string body;
+		BinaryWriter writer(body);
+		writer.writeU8(static_cast<std::uint8_t>(RecordType::Stream));
+		writer.writeVarint(current.id);
+		writer.writeString(stream.file);
+		frameRecord(compacted, body);
+
+		body.clear();
+		writer.writeU8(static_cast<std::uint8_t>(RecordType::Checkpoint));
+		writer.writeVarint(current.id);
+		writer.writeVarint(0);
+		writer.writeU64(hash);
+		frameRecord(compacted, body);
+
+		for (std::size_t i = 0; i < recovered.size(); ++i)
+		{
+			body.clear();
+			writer.writeU8(static_cast<std::uint8_t>(RecordType::Edit));
+			writer.writeVarint(current.id);
+			writer.writeVarint(i + 1);
+			writer.writeBytes(recovered[i]);
+			frameRecord(compacted, body);
+		}
+
+		metrics.recoveredEdits += recovered.size();
+		current.recovered = std::move(recovered);
+	}
+
+	return compacted;
+}
+
+std::string storage::WriteAheadLog::compactRecords(std::string_view previous)
+{
+	std::string compacted(journalMagic);
+	if (!previous.starts_with(journalMagic))
+		return compacted;
+
+	// The records are kept as they are, so the ids and generations handed out in this session stay valid
+	struct Logged
+	{
+		std::string file;
+		std::string_view stream;
+		std::vector<std::string_view> records;
+		std::vector<std::pair<std::size_t, std::uint64_t>> checkpoints;
+		bool edited = false;
+	};
+	std::map<std::uint32_t, Logged> logged;
+
+	BinaryReader reader(previous.substr(journalMagic.size()));
+	try
+	{
+		while (!reader.empty())
+		{
+			const std::uint32_t size = reader.readU32();
+			const std::uint32_t checksum = reader.readU32();
+			const std::string_view body = reader.readBytes(size);
+			if (static_cast<std::uint32_t>(fnv1a(body)) != checksum)
+				break;
+
+			BinaryReader record(body);
+			const RecordType type = static_cast<RecordType>(record.readU8());
+			Logged& stream = logged[record.readVarint()];
+
+			switch (type)
+			{
+			case RecordType::Stream:
+				stream.file = record.readString();
+				stream.stream = body;
+				break;
+
+			case RecordType::Checkpoint:
+				record.readVarint();
+				stream.checkpoints.emplace_back(stream.records.size(), record.readU64());
+				stream.records.push_back(body);
+				break;
+
+			case RecordType::Edit:
+				stream.edited = true;
+				stream.records.push_back(body);
+				break;
+
+			default:
+				throw ParsingError("Unknown journal record type.");
+			}
+		}
+	}
+	catch (const ParsingError&)
+	{
+		// Everything up to the damaged record is kept
+	}
+
+	// Drop everything before the checkpoint matching the file content, which the file contains already
+	for (const auto& [id, stream] : logged)
+	{
+		if (stream.stream.empty())
+			continue;
+
+		std::size_t first = 0;
+		if (stream.edited || stream.checkpoints.size() > 1)
+		{
+			const std::uint64_t hash = hashFile(stream.file);
+			const auto match = std::find_if(stream.checkpoints.rbegin(), stream.checkpoints.rend(),
+					[hash] (const auto& checkpoint) { return checkpoint.second == hash; });
+			if (match != stream.checkpoints.rend())
+				first = match->first;
+		}
+
+		frameRecord(compacted, stream.stream);
+		for (std::size_t i = first; i < stream.records.size(); ++i)
+			frameRecord(compacted, stream.records[i]);
+	}
+
+	return compacted;
+}
+
+bool storage::WriteAheadLog::replaceJournal()
+{
+	std::filesystem::path temporary = path;
+	temporary += ".compact";
+	try
+	{
+		writeFileAtomically(temporary, compactRecords(readJournal(path)));
+	}
+	catch (const std::exception&)
+	{
+		return false;
+	}
+
+	// The compacted journal is opened before it replaces the old one, which stays in use on any failure
+	const int compactedFd = ::open(temporary.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+	if (compactedFd < 0)
+		return false;
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+	if (error)
+	{
+		::close(compactedFd);
+		return false;
+	}
+	::close(fd);
+	fd = compactedFd;
+
+	// Records appended from now on only survive a crash once the rename is on disk
+	const std::filesystem::path folder = path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+	const int folderFd = ::open(folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (folderFd < 0)
+		return false;
+	const bool folderSynced = ::fsync(folderFd) == 0;
+	::close(folderFd);
+	return folderSynced;
+}
+
+storage::WriteAheadLog::Stream& storage::WriteAheadLog::getStream(const std::filesystem::path& file)
+{
+	const std::string key = std::filesystem::absolute(file).lexically_normal().string();
+
+	auto [it, inserted] = streams.try_emplace(key);
+	if (inserted)
+	{
+		it->second.id = nextStreamId++;
+		it->second.generation = 0;
+
+		BinaryWriter writer(scratch);
+		scratch.clear();
+		writer.writeU8(static_cast<std::uint8_t>(RecordType::Stream));
+		writer.writeVarint(it->second.id);
+		writer.writeString(key);
+		appendRecord(scratch);
+	}
+	return it->second;
+}
+
+void storage::WriteAheadLog::appendRecord(std::string_view body)
+{
+	{
+		std::scoped_lock lockGuard(mutex);
+
+		const std::size_t before = buffer.size();
+		frameRecord(buffer, body);
+		appended += buffer.size() - before;
+
+		++metrics.records;
+		metrics.bytesLogged += buffer.size() - before;
+	}
+	condition.notify_all();
+}
+
+bool storage::WriteAheadLog::writeAndSync(std::string& data)
+{
+	std::size_t offset = 0;
+	while (offset < data.size())
+	{
+		const ssize_t written = ::write(fd, data.data() + offset, data.size() - offset);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			data.erase(0, offset);
+			return false;
+		}
+		offset += written;
+	}
+	data.clear();
+
+	return ::fdatasync(fd) == 0;
+}
+
+void storage::WriteAheadLog::run(std::stop_token token)
+{
+	std::unique_lock lock(mutex);
+
+	while (condition.wait(lock, token, [this] { return !buffer.empty() || compactPending; }))
+	{
+		// Group commit: records arriving until the interval passed share this sync
+		condition.wait_until(lock, token, lastSync + commitInterval, [this] { return urgent; });
+
+		std::string data;
+		data.swap(buffer);
+		const std::uint64_t end = appended;
+		const bool compacting = compactPending;
+		urgent = false;
+		compactPending = false;
+		lock.unlock();
+
+		const Clock::time_point start = Clock::now();
+		const bool success = writeAndSync(data);
+		const Clock::time_point finish = Clock::now();
+
+		// Only records which are on disk can be compacted
+		const bool compacted = success && compacting && replaceJournal();
+
+		lock.lock();
+		if (compacted)
+			++metrics.compactions;
+		if (success)
+		{
+			durable = end;
+			++metrics.syncs;
+		}
+		else
+		{
+			// Keep the unwritten rest in front of newer records for the next attempt
+			buffer.insert(0, data);
+			compactPending = compactPending || compacting;
+			++metrics.failedSyncs;
+		}
+		metrics.lastSyncTime = finish - start;
+		lastSync = finish;
+
+		condition.notify_all();
+	}
+}
@@ -0,0 +1,248 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+
+namespace storage
+{
+	/**
+	 * @brief Append only journal of edits which are not written to their files yet
+	 *
+	 * Every file taking part in the journal is a stream of opaque edit records.
+	 * Edits are appended from the UI thread into a memory buffer which a
+	 * committer thread writes and syncs to disk. Syncs are grouped so that at
+	 * most one happens per commit interval, no matter how many edits arrive.
+	 *
+	 * Whenever a snapshot of a stream is taken for saving, a checkpoint with
+	 * the hash of the snapshot is logged. On startup the checkpoint matching
+	 * the current file content tells which logged edits never reached the
+	 * file. Those are handed out by attach() to be replayed and the journal is
+	 * compacted down to them. During a session compact() drops the records
+	 * which are older than the checkpoint matching the file content, so the
+	 * journal does not grow with every snapshot written.
+	 */
+	class WriteAheadLog
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		/**
+		 * @brief Statistics about the journal
+		 */
+		struct Metrics
+		{
+			/// @brief The number of records appended during this session
+			std::uint64_t records = 0;
+			/// @brief The number of bytes appended during this session
+			std::uint64_t bytesLogged = 0;
+			/// @brief The number of syncs to disk
+			std::uint64_t syncs = 0;
+			/// @brief The number of failed writes or syncs
+			std::uint64_t failedSyncs = 0;
+			/// @brief The number of edits recovered from the previous session
+			std::uint64_t recoveredEdits = 0;
+			/// @brief The number of edits which did not match the file content anymore
+			std::uint64_t discardedEdits = 0;
+			/// @brief The number of times the journal was compacted during this session
+			std::uint64_t compactions = 0;
+			/// @brief The time the last write and sync took
+			std::chrono::duration<double> lastSyncTime{};
+		};
+
+	public:
+		/**
+		 * @brief Open the journal, recover it and start the committer thread
+		 *
+		 * @param path The path of the journal file
+		 * @param commitInterval The shortest time between two syncs
+		 */
+		WriteAheadLog(std::filesystem::path path,
+				std::chrono::milliseconds commitInterval = std::chrono::milliseconds(100));
+		WriteAheadLog(WriteAheadLog&&) = delete;
+		WriteAheadLog(const WriteAheadLog&) = delete;
+		/**
+		 * @brief Sync all remaining records and close the journal
+		 */
+		~WriteAheadLog();
+
+		WriteAheadLog& operator=(WriteAheadLog&&) = delete;
+		WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+		/**
+		 * @brief Start journaling the edits of a file
+		 *
+		 * This has to be called after the file was loaded and before any edit
+		 * of it is appended. The first attach of a file after a crash returns
+		 * the edits which were lost; they have to be applied to the loaded
+		 * content in the given order without appending them again.
+		 *
+		 * @param file The file the edits belong to
+		 * @return std::vector<std::string> The recovered edits
+		 */
+		std::vector<std::string> attach(const std::filesystem::path& file);
+		/**
+		 * @brief Append an edit of a file to the journal
+		 *
+		 * @param file The file the edit belongs to
+		 * @param edit The encoded edit
+		 */
+		void append(const std::filesystem::path& file, std::string_view edit);
+		/**
+		 * @brief Log that a snapshot of a file containing all edits so far is about to be written
+		 *
+		 * @param file The file the snapshot belongs to
+		 * @param content The complete content of the snapshot
+		 */
+		void checkpoint(const std::filesystem::path& file, std::string_view content);
+		/**
+		 * @brief Drop the records of the edits which reached their files
+		 *
+		 * This is meant to be called whenever a snapshot was written. The
+		 * committer thread compacts the journal after its next sync, keeping
+		 * every record newer than the checkpoint matching the file content.
+		 */
+		void compact();
+		/**
+		 * @brief Wait until everything appended so far is on disk
+		 *
+		 * This skips the commit interval and must not be called from the UI
+		 * thread, it is meant to run right before a snapshot is written.
+		 */
+		void sync();
+
+		/**
+		 * @brief Get statistics about the journal
+		 *
+		 * @return Metrics A copy of the current statistics
+		 */
+		Metrics getMetrics() const;
+
+	private:
+		/**
+		 * @brief The kind of a journal record
+		 */
+		enum class RecordType : std::uint8_t
+		{
+			/// @brief Assigns a stream id to a file path
+			Stream,
+			/// @brief The hash of the file content at an edit generation
+			Checkpoint,
+			/// @brief A single edit of a stream
+			Edit
+		};
+
+		/**
+		 * @brief The state of a file taking part in the journal
+		 */
+		struct Stream
+		{
+			/// @brief The id used for the file inside the journal
+			std::uint32_t id;
+			/// @brief The number of the last edit appended
+			std::uint64_t generation;
+			/// @brief Edits recovered from the previous session, not handed out yet
+			std::vector<std::string> recovered;
+		};
+
+		/**
+		 * @brief Read the previous journal and keep the edits that never reached their files
+		 *
+		 * @return std::string The content of the compacted journal
+		 */
+		std::string recover();
+		/**
+		 * @brief Drop the records of a journal which are older than the checkpoint matching their file
+		 *
+		 * Unlike recover() the ids and generations are kept, so this session can go on appending.
+		 *
+		 * @param previous The content of the journal
+		 * @return std::string The content of the compacted journal
+		 */
+		std::string compactRecords(std::string_view previous);
+		/**
+		 * @brief Replace the journal file by its compacted content and append to that from now on
+		 *
+		 * Has to run on the committer thread once the buffer is on disk.
+		 *
+		 * @return true If the journal was compacted
+		 * @return false If it could not be replaced, the old journal stays in use
+		 */
+		bool replaceJournal();
+		/**
+		 * @brief Get the stream of a file, registering it in the journal if needed
+		 *
+		 * @param file The file of the stream
+		 * @return Stream& The stream of the file
+		 */
+		Stream& getStream(const std::filesystem::path& file);
+		/**
+		 * @brief Frame a record and queue it for the committer thread
+		 *
+		 * @param body The content of the record
+		 */
+		void appendRecord(std::string_view body);
+		/**
+		 * @brief Write data to the journal file and sync it
+		 *
+		 * @param data The data to write, on failure it keeps the unwritten rest
+		 * @return true If everything was written and synced
+		 * @return false If writing or syncing failed
+		 */
+		bool writeAndSync(std::string& data);
+		/**
+		 * @brief The body of the committer thread
+		 *
+		 * @param token The stop token of the committer thread
+		 */
+		void run(std::stop_token token);
+
+		/// @brief The path of the journal file
+		const std::filesystem::path path;
+		/// @brief The shortest time between two syncs
+		const std::chrono::milliseconds commitInterval;
+		/// @brief The file descriptor of the journal opened for appending
+		int fd;
+
+		/// @brief The streams of all files known to this session, keyed by path
+		std::map<std::string, Stream> streams;
+		/// @brief The id given to the next new stream
+		std::uint32_t nextStreamId;
+		/// @brief Reused buffer for encoding record bodies on the UI thread
+		std::string scratch;
+
+		/// @brief Guards the buffer, the counters and the metrics
+		mutable std::mutex mutex;
+		/// @brief Signals new records to the committer and finished syncs to waiters
+		std::condition_variable_any condition;
+		/// @brief Records waiting to be written
+		std::string buffer;
+		/// @brief The number of bytes appended in total
+		std::uint64_t appended;
+		/// @brief The number of bytes known to be on disk
+		std::uint64_t durable;
+		/// @brief Set when a waiter needs the buffer synced immediately
+		bool urgent;
+		/// @brief Set when the journal should be compacted after the next sync
+		bool compactPending;
+		/// @brief The end of the last sync
+		Clock::time_point lastSync;
+		/// @brief The current statistics
+		Metrics metrics;
+
+		/// @brief The committer thread, declared last so it is joined first
+		std::jthread worker;
+	};
+} // namespace storage
+
+#endif // WRITE_AHEAD_LOG_H
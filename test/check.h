@@ -0,0 +1,57 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+
+
+
+/**
+ * @brief Fail the test with the location of a condition which does not hold
+ *
+ * Unlike assert() this also checks in release builds.
+ */
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": Check failed: " #condition << std::endl; \
+			std::exit(EXIT_FAILURE); \
+		} \
+	} while (false)
+
+namespace test
+{
+	/**
+	 * @brief An empty temporary folder which is removed again with the object
+	 */
+	class TemporaryFolder
+	{
+	public:
+		/**
+		 * @brief Create a new empty folder
+		 *
+		 * @param name The name of the folder inside the temporary directory
+		 */
+		TemporaryFolder(const std::string& name) : path(std::filesystem::temp_directory_path() / name)
+		{
+			std::filesystem::remove_all(path);
+			std::filesystem::create_directories(path);
+		}
+		TemporaryFolder(const TemporaryFolder&) = delete;
+		~TemporaryFolder()
+		{
+			std::error_code error;
+			std::filesystem::remove_all(path, error);
+		}
+
+		TemporaryFolder& operator=(const TemporaryFolder&) = delete;
+
+		/// @brief The path of the folder
+		const std::filesystem::path path;
+	};
+} // namespace test
+
+#endif // CHECK_H
@@ -0,0 +1,31 @@
+#include "check.h"
+#include "query.h"
+
+int main()
+{
+	// A selection kept as a pointer dangles once the books of its shelf move, the id finds the book again
+	storage::Library library;
+	storage::LibraryShelf* const shelf = library.addShelf(nullptr, "Novels");
+	const std::uint32_t selected = library.addBook(shelf, storage::LibraryBook("Selected"))->getId();
+	CHECK(selected != 0);
+
+	storage::LibraryIndex index;
+	CHECK(index.update(library));
+	CHECK(index.findBook(selected) != nullptr);
+	CHECK(index.findBook(selected)->getName() == "Selected");
+
+	for (int i = 0; i < 64; ++i)
+		library.addBook(shelf, storage::LibraryBook("Book " + std::to_string(i)));
+	CHECK(index.update(library));
+	CHECK(index.findBook(selected) != nullptr);
+	CHECK(index.findBook(selected)->getName() == "Selected");
+	CHECK(index.findBook(selected)->getId() == selected);
+
+	// Deleting the shelf deletes the selected book with it
+	CHECK(library.deleteShelf(shelf));
+	CHECK(index.update(library));
+	CHECK(index.findBook(selected) == nullptr);
+	CHECK(index.findBook(0) == nullptr);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,55 @@
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+#include "check.h"
+#include "text_import.h"
+
+namespace
+{
+	/**
+	 * @brief Import a text with the default heading patterns and wait for the books
+	 *
+	 * @param folder The folder to import into
+	 * @param text The text to import
+	 * @return std::vector<storage::LibraryBook> The imported books
+	 */
+	std::vector<storage::LibraryBook> import(const std::filesystem::path& folder, std::string_view text)
+	{
+		const std::filesystem::path source = folder / "source.txt";
+		std::ofstream(source, std::ofstream::binary | std::ofstream::trunc) << text;
+
+		storage::TextImport textImport(source, folder / "books");
+		while (textImport.getState() == storage::TextImport::State::Running)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		CHECK(textImport.getState() == storage::TextImport::State::Finished);
+		return textImport.takeBooks();
+	}
+} // namespace
+
+int main()
+{
+	const test::TemporaryFolder folder("honmono_test_text_import");
+
+	// Chapter keywords only start a chapter when a number follows them
+	std::vector<storage::LibraryBook> books = import(folder.path,
+			"Prologue\n\nIt began.\n\n"
+			"Chapter 1\n\nPart of me wanted to leave.\n\n"
+			"Chapter and verse, he said.\n\n"
+			"CHAPTER XII: The End\n\nChapter 1 was fine.\n");
+	CHECK(books.size() == 3);
+	CHECK(books[0].getName() == "Prologue");
+	CHECK(books[1].getName() == "Chapter 1");
+	CHECK(books[2].getName() == "CHAPTER XII: The End");
+
+	// Discarding the books removes their chapter files
+	{
+		const std::filesystem::path source = folder.path / "source.txt";
+		storage::TextImport textImport(source, folder.path / "discarded");
+		while (textImport.getState() == storage::TextImport::State::Running)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	CHECK(!std::filesystem::exists(folder.path / "discarded"));
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+#include <fstream>
+#include <iterator>
+
+#include "check.h"
+#include "exceptions.h"
+#include "storage.h"
+#include "write_ahead_log.h"
+
+int main()
+{
+	const test::TemporaryFolder folder("honmono_test_write_ahead_log");
+	const std::filesystem::path journalPath = folder.path / "journal.wal";
+	const std::filesystem::path libraryPath = folder.path / "test.library";
+	std::ofstream(libraryPath) << "<library/>";
+
+	// A valid edit is followed by one which can not be decoded
+	storage::LibraryEdit edit;
+	edit.type = storage::LibraryEdit::Type::AddShelf;
+	edit.name = "Recovered";
+	{
+		storage::WriteAheadLog journal(journalPath);
+		CHECK(journal.attach(libraryPath).empty());
+		journal.append(libraryPath, edit.serialize());
+		journal.append(libraryPath, std::string("\xff\xff\xff", 3));
+		journal.sync();
+	}
+
+	// The replay has to report the corrupt edit as an error instead of crashing
+	std::vector<std::string> recovered;
+	{
+		storage::WriteAheadLog journal(journalPath);
+		recovered = journal.attach(libraryPath);
+		CHECK(journal.getMetrics().recoveredEdits == 2);
+	}
+	CHECK(recovered.size() == 2);
+	storage::Library library;
+	bool failed = false;
+	try
+	{
+		for (const std::string& data : recovered)
+			library.apply(storage::LibraryEdit::parse(data));
+	}
+	catch (const storage::FileError&)
+	{
+		failed = true;
+	}
+	CHECK(failed);
+	CHECK(std::prev(library.end())->getName() == "Recovered");
+
+	// A torn record at the end of the journal is dropped
+	{
+		std::ofstream journal(journalPath, std::ofstream::binary | std::ofstream::app);
+		journal.write("\x40\x00\x00\x00\x12\x34", 6);
+	}
+	{
+		storage::WriteAheadLog journal(journalPath);
+		CHECK(journal.attach(libraryPath).size() == 2);
+	}
+
+	// A journal which is not one is rejected as a whole
+	std::ofstream(journalPath, std::ofstream::binary | std::ofstream::trunc) << "garbage";
+	failed = false;
+	try
+	{
+		storage::WriteAheadLog journal(journalPath);
+	}
+	catch (const storage::ParsingError&)
+	{
+		failed = true;
+	}
+	CHECK(failed);
+
+	return EXIT_SUCCESS;
+}